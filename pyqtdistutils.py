@@ -83,7 +83,12 @@ class build_ext(distutils.command.build_ext.build_ext):
          'override Qt library directory'),
         ('qt-libinfix=', None,
          'override Qt infix setting'),
+        ('enable-tracing', None,
+         'compile timers and counters into the helper modules'),
         ]
+    boolean_options = (
+        distutils.command.build_ext.build_ext.boolean_options +
+        ['enable-tracing'])
 
     def initialize_options(self):
         distutils.command.build_ext.build_ext.initialize_options(self)
@@ -94,6 +99,7 @@ class build_ext(distutils.command.build_ext.build_ext):
         self.qt_include_dir = None
         self.qt_library_dir = None
         self.qt_libinfix = None
+        self.enable_tracing = bool(os.environ.get('VEUSZ_TRACING'))
 
     def _get_sip_exe(self, build_cmd):
         """Get exe for sip. Sources are:
@@ -205,7 +211,8 @@ class build_ext(distutils.command.build_ext.build_ext):
         if not self.extensions:
             return
 
-        build_cmd = self.get_finalized_command('build_ext')
+        # options of this command (build_ext, or build_bench)
+        build_cmd = self
 
         # executable in order of priority using or
         sip_exe = self._get_sip_exe(build_cmd)
@@ -252,6 +259,9 @@ class build_ext(distutils.command.build_ext.build_ext):
             # may cause problems with compilers which don't allow this
             if self.compiler.compiler_type == 'unix':
                 extension.extra_compile_args.append('-std=c++11')
+                # for std::thread in the helper modules
+                extension.extra_compile_args.append('-pthread')
+                extension.extra_link_args.append('-pthread')
 
         depends = extension.depends
 
@@ -314,4 +324,84 @@ class build_ext(distutils.command.build_ext.build_ext):
             self.compiler.compiler_so.remove("-Wstrict-prototypes")
         except (AttributeError, ValueError):
             pass
+        if self.enable_tracing:
+            # see helpers/src/common/tracing.h
+            self.compiler.define_macro('VEUSZ_TRACING')
         distutils.command.build_ext.build_ext.build_extensions(self)
+
+class build_bench(build_ext):
+    """Build the native benchmark programs, which are not installed.
+
+    The programs are given by benchmarks, a list of Extension objects
+    whose names are the program names. They are compiled with the
+    same Qt and Python settings as the extension modules."""
+
+    description = 'build the native benchmark programs (not installed)'
+
+    user_options = build_ext.user_options + [
+        ('bench-dir=', None,
+         'directory for benchmark programs [default: build/bench]'),
+        ]
+
+    benchmarks = []
+
+    def initialize_options(self):
+        build_ext.initialize_options(self)
+        self.bench_dir = None
+
+    def finalize_options(self):
+        build_ext.finalize_options(self)
+        build_base = self.get_finalized_command('build').build_base
+        if self.bench_dir is None:
+            self.bench_dir = os.path.join(build_base, 'bench')
+        # keep objects apart from those of the extension modules
+        self.build_temp = os.path.join(self.build_temp, 'bench')
+        self.extensions = list(self.benchmarks)
+
+    def _get_python_link(self):
+        """Get libraries, library directories and extra arguments to
+        link a program embedding Python."""
+        if sys.platform == 'win32':
+            return (
+                ['python%i%i' % sys.version_info[:2]],
+                [os.path.join(sys.base_prefix, 'libs')],
+                [])
+
+        ver = (sysconfig.get_config_var('LDVERSION') or
+               sysconfig.get_config_var('VERSION'))
+        libdir = sysconfig.get_config_var('LIBDIR')
+        extra = []
+        for var in ('LIBS', 'SYSLIBS'):
+            extra += (sysconfig.get_config_var(var) or '').split()
+        if ( not sysconfig.get_config_var('Py_ENABLE_SHARED') and
+             sys.platform.startswith('linux') ):
+            # extension modules loaded by the program need the
+            # symbols of a static Python library
+            extra += (sysconfig.get_config_var('LINKFORSHARED') or '').split()
+        return ['python'+ver], [libdir] if libdir else [], extra
+
+    def get_ext_fullpath(self, ext_name):
+        """Programs go in the benchmark directory."""
+        return os.path.join(
+            self.bench_dir, self.compiler.executable_filename(ext_name))
+
+    def build_extension(self, ext):
+        sources = self.swig_sources(list(ext.sources), ext)
+        objects = self.compiler.compile(
+            sources,
+            output_dir=self.build_temp,
+            macros=ext.define_macros,
+            include_dirs=ext.include_dirs,
+            debug=self.debug,
+            extra_postargs=ext.extra_compile_args,
+            depends=ext.depends)
+
+        libs, libdirs, extra = self._get_python_link()
+        self.compiler.link_executable(
+            objects, ext.name,
+            output_dir=self.bench_dir,
+            libraries=ext.libraries + libs,
+            library_dirs=ext.library_dirs + libdirs,
+            extra_postargs=ext.extra_link_args + extra,
+            debug=self.debug,
+            target_lang=ext.language)
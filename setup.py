@@ -99,6 +99,59 @@ def findData(dirname, extns):
     files.sort()
     return (dirname, files)
 
+class build_bench(pyqtdistutils.build_bench):
+    """Build the native benchmark programs (python3 setup.py build_bench)."""
+
+    benchmarks = [
+        # 3D rendering pipeline
+        Extension(
+            'threedbench',
+            [
+                'veusz/helpers/src/threed/benchmark/threedbench.cpp',
+                'veusz/helpers/src/threed/bsp.cpp',
+                'veusz/helpers/src/threed/camera.cpp',
+                'veusz/helpers/src/threed/clipcontainer.cpp',
+                'veusz/helpers/src/threed/fragment.cpp',
+                'veusz/helpers/src/threed/mmaths.cpp',
+                'veusz/helpers/src/threed/objects.cpp',
+                'veusz/helpers/src/threed/pathsprites.cpp',
+                'veusz/helpers/src/threed/scene.cpp',
+                'veusz/helpers/src/threed/twod.cpp',
+                'veusz/helpers/src/threed/zbuffer.cpp',
+            ],
+            language="c++",
+            include_dirs=[
+                'veusz/helpers/src/threed', 'veusz/helpers/src/common'
+            ],
+        ),
+
+        # kernels of the qtloops, recordpaint and contour modules
+        Extension(
+            'kernelbench',
+            [
+                'veusz/helpers/src/benchmark/kernelbench.cpp',
+                'veusz/helpers/src/qtloops/qtloops.cpp',
+                'veusz/helpers/src/qtloops/qtloops_helpers.cpp',
+                'veusz/helpers/src/qtloops/polygonclip.cpp',
+                'veusz/helpers/src/qtloops/polylineclip.cpp',
+                'veusz/helpers/src/qtloops/polylinereduce.cpp',
+                'veusz/helpers/src/qtloops/beziers.cpp',
+                'veusz/helpers/src/qtloops/beziers_qtwrap.cpp',
+                'veusz/helpers/src/qtloops/numpyfuncs.cpp',
+                'veusz/helpers/src/qtloops/imagepyramid.cpp',
+                'veusz/helpers/src/recordpaint/paintbuffer.cpp',
+                'veusz/helpers/src/recordpaint/recordpaintdevice.cpp',
+                'veusz/helpers/src/recordpaint/recordpaintengine.cpp',
+                'veusz/helpers/src/nc_cntr/_nc_cntr.c',
+            ],
+            language="c++",
+            include_dirs=[
+                'veusz/helpers/src/qtloops', 'veusz/helpers/src/recordpaint',
+                'veusz/helpers/src/common', numpy.get_include()
+            ],
+        ),
+    ]
+
 setup(
     name = 'veusz',
     version = version,
@@ -161,12 +214,16 @@ setup(
                 'veusz/helpers/src/threed/numpy_helpers.cpp',
                 'veusz/helpers/src/threed/clipcontainer.cpp',
                 'veusz/helpers/src/threed/bsp.cpp',
+                'veusz/helpers/src/threed/zbuffer.cpp',
                 'veusz/helpers/src/threed/twod.cpp',
+                'veusz/helpers/src/threed/renderjob.cpp',
+                'veusz/helpers/src/threed/pathsprites.cpp',
                 'veusz/helpers/src/threed/threed.sip'
             ],
             language="c++",
             include_dirs=[
-                'veusz/helpers/src/threed', numpy.get_include()
+                'veusz/helpers/src/threed', 'veusz/helpers/src/common',
+                numpy.get_include()
             ],
         ),
 
@@ -185,12 +242,15 @@ setup(
         Extension(
             'veusz.helpers.recordpaint',
             [
+                'veusz/helpers/src/recordpaint/paintbuffer.cpp',
                 'veusz/helpers/src/recordpaint/recordpaintdevice.cpp',
                 'veusz/helpers/src/recordpaint/recordpaintengine.cpp',
                 'veusz/helpers/src/recordpaint/recordpaint.sip'
             ],
             language="c++",
-            include_dirs=['veusz/helpers/src/recordpaint'],
+            include_dirs=[
+                'veusz/helpers/src/recordpaint', 'veusz/helpers/src/common'
+            ],
         ),
 
         # contour plotting library
@@ -210,13 +270,15 @@ setup(
                 'veusz/helpers/src/qtloops/qtloops_helpers.cpp',
                 'veusz/helpers/src/qtloops/polygonclip.cpp',
                 'veusz/helpers/src/qtloops/polylineclip.cpp',
+                'veusz/helpers/src/qtloops/polylinereduce.cpp',
                 'veusz/helpers/src/qtloops/beziers.cpp',
                 'veusz/helpers/src/qtloops/beziers_qtwrap.cpp',
                 'veusz/helpers/src/qtloops/numpyfuncs.cpp',
+                'veusz/helpers/src/qtloops/imagepyramid.cpp',
                 'veusz/helpers/src/qtloops/qtloops.sip'],
             language="c++",
             include_dirs=[
-                'veusz/helpers/src/qtloops',
+                'veusz/helpers/src/qtloops', 'veusz/helpers/src/common',
                 numpy.get_include()
             ],
         ),
@@ -225,6 +287,7 @@ setup(
     # new command options
     cmdclass = {
         'build_ext': pyqtdistutils.build_ext,
+        'build_bench': build_bench,
         'install_data': smart_install_data,
         'install': install
     },
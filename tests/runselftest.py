@@ -201,7 +201,10 @@ class Dirs:
             glob.glob( os.path.join(self.exampledir, '*.vsz') ) +
             glob.glob( os.path.join(self.testdir, '*.vsz') ) +
             glob.glob( os.path.join(self.testdir, '*.vszh5') ) )
-        self.infiles += glob.glob(os.path.join(self.testdir, '*.py'))
+        # python files starting with _ are helpers for the tests
+        self.infiles += [
+            f for f in glob.glob(os.path.join(self.testdir, '*.py'))
+            if not os.path.basename(f).startswith('_') ]
 
 def renderAllTests():
     """Check documents produce same output as in comparison directory."""
@@ -0,0 +1,54 @@
+"""Functions shared by the selftests which compare images.
+
+These tests draw the same thing in two ways, checking that the
+images are the same. Files starting with _ are not run as tests.
+"""
+
+import sys
+
+import numpy as N
+import veusz.qtall as qt
+
+def imageArray(img):
+    """Return the bytes of an image as an array of ints, so that
+    images can be subtracted."""
+    ptr = img.constBits()
+    ptr.setsize(img.bytesPerLine()*img.height())
+    return N.frombuffer(ptr, dtype=N.uint8).astype(N.int32)
+
+def newImage(width, height, color='white'):
+    """Make an image to draw on, filled with color."""
+    img = qt.QImage(width, height, qt.QImage.Format_ARGB32_Premultiplied)
+    img.fill(qt.QColor(color))
+    return img
+
+def newPainter(device, antialias=True):
+    """Start painting on device."""
+    painter = qt.QPainter(device)
+    painter.setRenderHint(qt.QPainter.Antialiasing, antialias)
+    return painter
+
+def renderArray(width, height, draw, antialias=True, color='white'):
+    """Return an array of the image drawn by draw(painter)."""
+    img = newImage(width, height, color=color)
+    painter = newPainter(img, antialias=antialias)
+    draw(painter)
+    painter.end()
+    return imageArray(img)
+
+def sameImages(arr1, arr2, tolerance=0):
+    """Are the image arrays the same, allowing each byte to differ by
+    up to tolerance?"""
+    if arr1.shape != arr2.shape:
+        return False
+    return arr1.size == 0 or N.abs(arr1-arr2).max() <= tolerance
+
+def writeResult(out, name, ok):
+    """Write a line with the result of a check."""
+    out.write('%s %s\n' % (name, bool(ok)))
+
+def runTest(main):
+    """Call main(outfile) with the output filename given to the
+    test, with an application for drawing."""
+    app = qt.QApplication([])
+    main(sys.argv[1])
@@ -0,0 +1,57 @@
+import sys
+
+import numpy as N
+from veusz.helpers._nc_cntr import Cntr
+
+# check that tracing many contour levels at once, in threads, gives
+# the same result as tracing them one by one on the same Cntr
+
+def makeCntr(noise):
+    rng = N.random.RandomState(42)
+    yw, xw = 90, 120
+    x = N.tile(N.arange(xw, dtype=N.float64), (yw, 1))
+    y = N.tile(N.arange(yw, dtype=N.float64)[:, N.newaxis], (1, xw))
+    z = N.sin(x*0.1)*N.cos(y*0.13) + (rng.rand(yw, xw)-0.5)*noise
+    # some values lie on the levels
+    z.flat[::7] = N.floor(z.flat[::7]*4)/4
+    z[(x-40)**2+(y-30)**2 < 100] = N.nan
+    mask = N.logical_not(N.isfinite(z))
+    return Cntr(x, y, z, mask)
+
+def same(res1, res2):
+    if len(res1) != len(res2):
+        return False
+    for (xy1, off1), (xy2, off2) in zip(res1, res2):
+        if not (N.array_equal(xy1, xy2) and N.array_equal(off1, off2)):
+            return False
+    return True
+
+def main(outfile):
+    levels = N.linspace(-1.2, 1.2, 40)
+    sublevels = N.linspace(-0.99, 1.01, 17)
+
+    with open(outfile, 'w') as out:
+        for noise in (0., 0.25, 1.):
+            c1 = makeCntr(noise)
+            c2 = makeCntr(noise)
+
+            lines = [c1.trace(l, flat=True) for l in levels]
+            fills = [
+                c1.trace(l1, l2, flat=True)
+                for l1, l2 in zip(levels[:-1], levels[1:]) ]
+            sublines = [c1.trace(l, flat=True) for l in sublevels]
+            after = c1.trace(0.01, flat=True)
+
+            out.write('noise %g\n' % noise)
+            out.write(' lines %s\n' % same(
+                lines, c2.trace_levels(levels, flat=True, nthreads=4)))
+            out.write(' fills %s\n' % same(
+                fills, c2.trace_levels(
+                    levels, filled=True, flat=True, nthreads=4)))
+            out.write(' sublevels %s\n' % same(
+                sublines, c2.trace_levels(sublevels, flat=True, nthreads=4)))
+            out.write(' after %s\n' % same(
+                [after], [c2.trace(0.01, flat=True)]))
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,76 @@
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers.qtloops import plotImageAsRects
+
+from _testutils import renderArray, sameImages, writeResult, runTest
+
+# check that drawing an image as boxes, merging pixels of the same
+# color, gives the same result as drawing each pixel in turn
+
+def makeImage(rng, palette, width, height):
+    img = qt.QImage(width, height, qt.QImage.Format_ARGB32)
+    idx = rng.randint(len(palette), size=(height, width))
+    # runs of the same color along and down the image
+    idx[:, 1::2] = idx[:, ::2][:, :width//2]
+    idx[1::3, :] = idx[::3, :][:len(idx[1::3, :]), :]
+    for y in range(height):
+        for x in range(width):
+            img.setPixel(x, y, palette[idx[y, x]])
+    return img
+
+background = qt.QColor(200, 220, 240)
+
+def render(bounds, draw):
+    return renderArray(
+        int(bounds.right())+10, int(bounds.bottom())+10, draw,
+        antialias=False, color=background)
+
+def renderRects(img, bounds):
+    return render(
+        bounds, lambda painter: plotImageAsRects(painter, bounds, img))
+
+def drawPixels(painter, img, bounds):
+    dx = bounds.width() / img.width()
+    dy = bounds.height() / img.height()
+    for y in range(img.height()):
+        for x in range(img.width()):
+            col = qt.QColor.fromRgba(img.pixel(x, y))
+            if col.alpha() == 0:
+                continue
+            path = qt.QPainterPath()
+            path.addRect(qt.QRectF(
+                bounds.left()+x*dx, bounds.top()+y*dy, dx, dy))
+            if col.alpha() == 255:
+                painter.setPen(qt.QPen(qt.QBrush(col), 0.))
+                painter.setBrush(qt.QBrush(col))
+                painter.drawPath(path)
+            else:
+                painter.fillPath(path, col)
+
+def renderPixels(img, bounds):
+    return render(
+        bounds, lambda painter: drawPixels(painter, img, bounds))
+
+def main(outfile):
+    rng = N.random.RandomState(7)
+    opaque = [
+        qt.qRgba(255, 0, 0, 255), qt.qRgba(0, 128, 0, 255),
+        qt.qRgba(20, 20, 160, 255)]
+    translucent = [
+        qt.qRgba(255, 128, 0, 128), qt.qRgba(0, 0, 0, 40),
+        qt.qRgba(0, 0, 0, 0)]
+
+    images = (
+        ('mixed', makeImage(rng, opaque+translucent, 37, 29)),
+        ('opaque', makeImage(rng, opaque, 37, 29)),
+        ('translucent', makeImage(rng, translucent, 37, 29)),
+    )
+    bounds = qt.QRectF(5, 5, 37*4, 29*3)
+
+    with open(outfile, 'w') as out:
+        for name, img in images:
+            writeResult(out, name, sameImages(
+                renderRects(img, bounds), renderPixels(img, bounds)))
+
+if __name__ == '__main__':
+    runTest(main)
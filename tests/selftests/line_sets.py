@@ -0,0 +1,154 @@
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers.qtloops import plotLinesToPainter, plotBoxesToPainter, \
+    plotLineSetsToPainter, plotBoxSetsToPainter
+
+from _testutils import newImage, newPainter, renderArray, sameImages, \
+    writeResult, runTest
+
+# check drawing lines and boxes from sets of arrays in one call against
+# drawing them one at a time
+
+width, height = 300, 200
+clip = qt.QRectF(40, 30, 200, 130)
+
+def makeSet(rng, n, xrange, yrange):
+    """Arrays of x1, y1, x2, y2 for n random items."""
+    return [rng.uniform(*xrange, size=n), rng.uniform(*yrange, size=n),
+            rng.uniform(*xrange, size=n), rng.uniform(*yrange, size=n)]
+
+def itemCoords(sets):
+    """Coordinates of each item in several sets of arrays."""
+    items = []
+    for i in range(0, len(sets), 4):
+        x1, y1, x2, y2 = sets[i:i+4]
+        n = min(len(x1), len(y1), len(x2), len(y2))
+        items += [(float(x1[j]), float(y1[j]), float(x2[j]), float(y2[j]))
+                  for j in range(n)]
+    return items
+
+def penClip(pen):
+    lw = pen.widthF()
+    return clip.adjusted(-lw, -lw, lw, lw)
+
+def render(pen, draw, antialias=False):
+    def drawPen(painter):
+        painter.setPen(pen)
+        painter.setBrush(qt.QBrush(qt.QColor(255, 200, 0)))
+        draw(painter)
+    return renderArray(width, height, drawPen, antialias=antialias)
+
+def drawLineItems(painter, items):
+    painter.drawLines([qt.QLineF(*item) for item in items])
+
+def drawBoxItems(painter, items, cliprect):
+    rects = []
+    for x1, y1, x2, y2 in items:
+        rect = qt.QRectF(qt.QPointF(x1, y1), qt.QPointF(x2, y2)).normalized()
+        if cliprect is None:
+            rects.append(rect)
+        elif cliprect.intersects(rect):
+            rects.append(cliprect.intersected(rect))
+    painter.drawRects(rects)
+
+def cropClip(arr):
+    """Part of image array inside the clip rectangle."""
+    arr = arr.reshape((height, width, 4))
+    return arr[int(clip.top()):int(clip.bottom()),
+               int(clip.left()):int(clip.right())]
+
+def isTypeError(draw):
+    painter = newPainter(newImage(width, height))
+    try:
+        draw(painter)
+    except TypeError:
+        return True
+    finally:
+        painter.end()
+    return False
+
+def main(outfile):
+    rng = N.random.RandomState(3)
+    pen = qt.QPen(qt.QColor(20, 40, 200), 2.)
+
+    # strided and integer arrays, and arrays of different lengths
+    inside = makeSet(rng, 150, (60, 220), (50, 140))
+    inside[1] = rng.uniform(50, 140, 300)[::2]
+    inside[2] = N.rint(inside[2]).astype(N.int32)
+    inside += makeSet(rng, 40, (60, 220), (50, 140))
+    inside[-1] = inside[-1][:25]
+    outside = makeSet(rng, 50, (250, 300), (0, 200))
+    crossing = makeSet(rng, 100, (0, 300), (0, 200))
+    insideitems = itemCoords(inside)
+    allsets = inside + outside + crossing
+    allitems = itemCoords(allsets)
+
+    with open(outfile, 'w') as out:
+        # no clipping, so the same as drawing each item
+        writeResult(out, 'lines unclipped', sameImages(
+            render(pen, lambda p: plotLineSetsToPainter(p, None, *allsets)),
+            render(pen, lambda p: drawLineItems(p, allitems))))
+        writeResult(out, 'lines one set', sameImages(
+            render(pen, lambda p: plotLinesToPainter(p, *crossing)),
+            render(pen, lambda p: drawLineItems(
+                p, itemCoords(crossing)))))
+
+        # lines outside the expanded clip are removed
+        writeResult(out, 'lines inside', sameImages(
+            render(pen, lambda p: plotLineSetsToPainter(
+                p, clip, *(inside+outside))),
+            render(pen, lambda p: drawLineItems(p, insideitems))))
+
+        # lines crossing the edges are clipped, so are drawn the same
+        # inside the clip, and are not drawn outside the expanded clip
+        for antialias in (False, True):
+            clipped = render(pen, lambda p: plotLineSetsToPainter(
+                p, clip, *allsets), antialias=antialias)
+            def drawRefClipped(painter):
+                painter.setClipRect(penClip(pen))
+                drawLineItems(painter, allitems)
+            ref = render(pen, drawRefClipped, antialias=antialias)
+            writeResult(
+                out, 'lines clipped antialias=%s' % antialias,
+                N.mean(cropClip(clipped) != cropClip(ref)) < 0.002)
+
+            # allowing for the line caps and antialiasing
+            near = penClip(pen).toAlignedRect().adjusted(-4, -4, 4, 4)
+            far = N.ones((height, width, 4), dtype=bool)
+            far[max(near.top(), 0):near.bottom()+1,
+                max(near.left(), 0):near.right()+1] = False
+            blank = render(pen, lambda p: None)
+            writeResult(
+                out, 'lines outside antialias=%s' % antialias, sameImages(
+                    clipped.reshape((height, width, 4))[far],
+                    blank.reshape((height, width, 4))[far]))
+
+        # without autoexpand, the clip is not used
+        writeResult(out, 'lines noautoexpand', sameImages(
+            render(pen, lambda p: plotLinesToPainter(
+                p, *(crossing+[clip, False]))),
+            render(pen, lambda p: drawLineItems(
+                p, itemCoords(crossing)))))
+
+        # boxes, with corners in either order
+        writeResult(out, 'boxes clipped', sameImages(
+            render(pen, lambda p: plotBoxSetsToPainter(p, clip, *allsets)),
+            render(pen, lambda p: drawBoxItems(
+                p, allitems, penClip(pen)))))
+        writeResult(out, 'boxes unclipped', sameImages(
+            render(pen, lambda p: plotBoxSetsToPainter(p, None, *allsets)),
+            render(pen, lambda p: drawBoxItems(p, allitems, None))))
+        writeResult(out, 'boxes noautoexpand', sameImages(
+            render(pen, lambda p: plotBoxesToPainter(
+                p, *(crossing+[clip, False]))),
+            render(pen, lambda p: drawBoxItems(
+                p, itemCoords(crossing), None))))
+
+        writeResult(out, 'empty', sameImages(
+            render(pen, lambda p: plotLineSetsToPainter(p, clip)),
+            render(pen, lambda p: None)))
+        writeResult(out, 'bad sets', isTypeError(
+            lambda p: plotLineSetsToPainter(p, None, *allsets[:-1])))
+
+if __name__ == '__main__':
+    runTest(main)
@@ -0,0 +1,51 @@
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers.qtloops import plotPathsToPainter
+from veusz.utils.points import getPointPainterPath
+
+from _testutils import renderArray, sameImages, writeResult, runTest
+
+# check that skipping markers hidden by earlier markers does not
+# change what is drawn
+
+def drawMarkers(painter, marker, pen, brush, x, y, scaling, decimate):
+    pen.setJoinStyle(qt.Qt.MiterJoin)
+    painter.setPen(pen)
+    path, fill = getPointPainterPath(marker, 6, pen.widthF())
+    painter.setBrush(brush if fill else qt.QBrush())
+    plotPathsToPainter(
+        painter, path, x, y, scaling, qt.QRectF(0, 0, 320, 240),
+        None, False, decimate)
+
+def render(marker, pen, brush, x, y, scaling, decimate):
+    return renderArray(
+        320, 240, lambda painter: drawMarkers(
+            painter, marker, pen, brush, x, y, scaling, decimate))
+
+def main(outfile):
+    rng = N.random.RandomState(13)
+    # clustered points, so that many markers are hidden
+    x = rng.normal(160, 25, 5000)
+    y = rng.normal(120, 20, 5000)
+    scaling = rng.uniform(0.5, 1.5, 5000)
+
+    blue = qt.QColor(30, 60, 200)
+    red = qt.QColor(220, 20, 20)
+    cases = (
+        ('nopen', 'square', qt.QPen(qt.Qt.NoPen), qt.QBrush(blue)),
+        ('samecolor', 'circle', qt.QPen(blue, 1.5), qt.QBrush(blue)),
+        ('diffcolor', 'circle', qt.QPen(red, 1.5), qt.QBrush(blue)),
+        ('line', 'cross', qt.QPen(red, 1.), qt.QBrush()),
+    )
+
+    with open(outfile, 'w') as out:
+        for name, marker, pen, brush in cases:
+            for sc in (None, scaling):
+                img1 = render(marker, qt.QPen(pen), brush, x, y, sc, False)
+                img2 = render(marker, qt.QPen(pen), brush, x, y, sc, True)
+                kind = 'scaled' if sc is not None else 'fixed'
+                writeResult(out, '%s %s' % (name, kind),
+                            sameImages(img1, img2, tolerance=1))
+
+if __name__ == '__main__':
+    runTest(main)
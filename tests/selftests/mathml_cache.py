@@ -0,0 +1,90 @@
+import veusz.qtall as qt
+from veusz.helpers.qtmml import QtMmlDocument, QtMmlWidget
+
+from _testutils import renderArray, sameImages, writeResult, runTest
+
+# check that sharing laid out MathML documents gives the same
+# output as laying out each document itself
+
+mml = '''<math><mrow>
+<msup><mi>x</mi><mn>2</mn></msup><mo>+</mo>
+<mfrac><mrow><mi>a</mi><mo>-</mo><mi>b</mi></mrow>
+<msqrt><mi>y</mi></msqrt></mfrac>
+</mrow></math>'''
+
+def render(doc):
+    size = doc.size()
+    img = renderArray(
+        size.width()+10, size.height()+10,
+        lambda painter: doc.paint(painter, qt.QPoint(5, 5)),
+        antialias=False)
+    return (size.width(), size.height()), img
+
+def same(doc1, doc2):
+    (size1, img1), (size2, img2) = render(doc1), render(doc2)
+    return size1 == size2 and sameImages(img1, img2)
+
+def makeDoc(text, size=None, font=None):
+    doc = QtMmlDocument()
+    if font is not None:
+        doc.setFontName(QtMmlWidget.NormalFont, font)
+    if size is not None:
+        doc.setBaseFontPointSize(size)
+    doc.setContent(text)
+    return doc
+
+def uncached(text, size=None, font=None):
+    limit = QtMmlDocument.cacheLimit()
+    QtMmlDocument.setCacheLimit(0)
+    try:
+        return makeDoc(text, size=size, font=font)
+    finally:
+        QtMmlDocument.setCacheLimit(limit)
+
+def isError(text):
+    try:
+        makeDoc(text)
+    except ValueError:
+        return True
+    return False
+
+def main(outfile):
+    limit = QtMmlDocument.cacheLimit()
+
+    with open(outfile, 'w') as out:
+        doc1 = makeDoc(mml)
+        doc2 = makeDoc(mml)
+        writeResult(out, 'shared', same(doc1, doc2))
+        writeResult(out, 'uncached', same(doc1, uncached(mml)))
+
+        # changing the size after the content must not change the
+        # other documents sharing the layout
+        before = render(doc2)
+        doc1.setBaseFontPointSize(doc1.baseFontPointSize()*2)
+        writeResult(out, 'size other unchanged', same(doc2, makeDoc(mml)))
+        writeResult(out, 'size other same', sameImages(
+            before[1], render(doc2)[1]))
+        writeResult(out, 'size relaid', same(
+            doc1, uncached(mml, size=doc1.baseFontPointSize())))
+
+        doc3 = makeDoc(mml)
+        doc3.setFontName(QtMmlWidget.NormalFont, 'Serif')
+        writeResult(out, 'font other unchanged', same(doc2, makeDoc(mml)))
+        writeResult(out, 'font relaid', same(
+            doc3, uncached(mml, font='Serif')))
+        writeResult(out, 'font name',
+                    doc3.fontName(QtMmlWidget.NormalFont) == 'Serif')
+
+        # documents stay valid when dropped from the cache
+        QtMmlDocument.setCacheLimit(4096)
+        for i in range(50):
+            makeDoc('<math><mn>%i</mn><mo>+</mo><mi>z</mi></math>' % i)
+        writeResult(out, 'evicted', same(doc2, uncached(mml)))
+        QtMmlDocument.setCacheLimit(limit)
+
+        bad = '<math><mi>x</mo></math>'
+        writeResult(out, 'error', isError(bad))
+        writeResult(out, 'error again', isError(bad))
+
+if __name__ == '__main__':
+    runTest(main)
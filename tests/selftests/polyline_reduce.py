@@ -0,0 +1,101 @@
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers.qtloops import plotClippedPolyline, reducePolyline
+
+from _testutils import renderArray, writeResult, runTest
+
+# check that reducing the points of a polyline to those changing each
+# column of pixels draws the same as drawing every point
+
+width, height = 300, 200
+clip = qt.QRectF(20, 15, 260, 170)
+
+def makePolygon(x, y):
+    return qt.QPolygonF([qt.QPointF(*p) for p in zip(x, y)])
+
+def makeLines(rng):
+    """Dense lines, some with breaks, going backwards or leaving the
+    clip rectangle."""
+    x = N.linspace(-10, 310, 30000)
+    noisy = 100 + 60*N.sin(x*0.05) + rng.normal(0, 15, len(x))
+    broken = noisy.copy()
+    broken[rng.randint(len(x), size=20)] = N.nan
+
+    t = N.linspace(0, 6*N.pi, 20000)
+    loopx = 150 + 120*N.sin(t*1.3) + rng.normal(0, 1, len(t))
+    loopy = 100 + 90*N.cos(t*0.7) + rng.normal(0, 1, len(t))
+
+    # fewer points than pixel columns, so nothing is removed
+    sx = N.linspace(0, 300, 120)
+    sparse = 100 + 80*N.sin(sx*0.1)
+
+    return {
+        'noisy': makePolygon(x, noisy),
+        'broken': makePolygon(x, broken),
+        'loop': makePolygon(loopx, loopy),
+        'sparse': makePolygon(sx, sparse),
+    }
+
+def render(poly, pen, antialias, scale):
+    def draw(painter):
+        painter.scale(scale, scale)
+        painter.setPen(pen)
+        plotClippedPolyline(painter, clip, poly)
+    return renderArray(width, height, draw, antialias=antialias)
+
+def compare(poly, pen, antialias, scale=1.):
+    """Return fraction of bytes different between drawing the reduced
+    and full line, with columns a pixel wide."""
+    full = render(poly, pen, antialias, scale)
+    reduced = render(
+        reducePolyline(poly, 1./scale), pen, antialias, scale)
+    return N.mean(full != reduced)
+
+def main(outfile):
+    rng = N.random.RandomState(23)
+    lines = makeLines(rng)
+
+    black = qt.QColor('black')
+    thick = qt.QPen(qt.QColor(200, 30, 30), 4.)
+    thick.setJoinStyle(qt.Qt.RoundJoin)
+    thick.setCapStyle(qt.Qt.RoundCap)
+    dashed = qt.QPen(qt.QColor(30, 30, 200), 1.5)
+    dashed.setStyle(qt.Qt.DashLine)
+
+    with open(outfile, 'w') as out:
+        for name in ('noisy', 'broken', 'loop'):
+            poly = lines[name]
+
+            # thin lines are drawn the same
+            frac = compare(poly, qt.QPen(black, 0.), False)
+            writeResult(out, '%s cosmetic' % name, frac == 0)
+            frac = compare(poly, qt.QPen(black, 1.), False)
+            writeResult(out, '%s thin' % name, frac == 0)
+            frac = compare(poly, qt.QPen(black, 0.), False, 2.)
+            writeResult(out, '%s cosmetic scaled' % name, frac == 0)
+
+            # antialiasing and thick pens may change the edges of the
+            # line at the removed points by a little
+            frac = compare(poly, qt.QPen(black, 1.), True)
+            writeResult(out, '%s antialiased' % name, frac < 0.01)
+            frac = compare(poly, thick, True)
+            writeResult(out, '%s thick antialiased' % name, frac < 0.01)
+
+            # dashes follow the length of the line, so are changed by
+            # removing points (which is why the xy widget does not
+            # reduce dashed lines)
+            frac = compare(poly, dashed, True)
+            writeResult(out, '%s dashed changed' % name, frac > 0)
+
+        # nothing is removed from a sparse line, so even dashes and
+        # thick pens are the same
+        poly = lines['sparse']
+        writeResult(out, 'sparse unchanged',
+                    reducePolyline(poly, 1.) == poly)
+        for name, pen in (('thin', qt.QPen(black, 1.)), ('thick', thick),
+                          ('dashed', dashed)):
+            frac = compare(poly, pen, True)
+            writeResult(out, 'sparse %s' % name, frac == 0)
+
+if __name__ == '__main__':
+    runTest(main)
@@ -0,0 +1,106 @@
+import os
+import shutil
+import tempfile
+
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers.recordpaint import RecordPaintDevice
+
+from _testutils import renderArray, sameImages, writeResult, runTest
+
+# check that recordings saved to files load back the same, and that
+# damaged files are rejected
+
+width, height = 300, 200
+
+def makeRecording(seed):
+    rng = N.random.RandomState(seed)
+    record = RecordPaintDevice(width, height, 90, 120)
+    painter = qt.QPainter(record)
+    painter.setRenderHint(qt.QPainter.Antialiasing, True)
+
+    painter.setPen(qt.QPen(qt.QColor('black'), 1.5))
+    painter.drawLines([
+        qt.QLineF(*rng.uniform(0, 200, 4)) for i in range(30)])
+    painter.setBrush(qt.QBrush(qt.QColor(int(rng.randint(256)), 100, 50)))
+    path = qt.QPainterPath()
+    path.addEllipse(qt.QRectF(*rng.uniform(20, 100, 4)))
+    painter.drawPath(path)
+
+    img = qt.QImage(8, 6, qt.QImage.Format_ARGB32)
+    for y in range(6):
+        for x in range(8):
+            img.setPixel(x, y, qt.qRgba(x*30, y*40, 100, 200))
+    painter.drawImage(qt.QRectF(150, 20, 80, 60), img)
+
+    painter.setFont(qt.QFont('Sans', 12))
+    painter.drawText(qt.QPointF(20, 180), 'Recording %i' % seed)
+    painter.end()
+    return record
+
+def render(record):
+    return renderArray(width, height, record.play, antialias=False)
+
+def same(rec1, rec2):
+    return (
+        rec1.width() == rec2.width() and rec1.height() == rec2.height() and
+        rec1.logicalDpiX() == rec2.logicalDpiX() and
+        rec1.logicalDpiY() == rec2.logicalDpiY() and
+        rec1.drawItemCount() == rec2.drawItemCount() and
+        sameImages(render(rec1), render(rec2)))
+
+def rejected(filename):
+    try:
+        RecordPaintDevice.loadFile(filename)
+    except ValueError:
+        return True
+    return False
+
+def main(outfile):
+    tempdir = tempfile.mkdtemp()
+    try:
+        runTests(outfile, tempdir)
+    finally:
+        shutil.rmtree(tempdir)
+
+def runTests(outfile, tempdir):
+    filename = os.path.join(tempdir, 'page.rec')
+    rec1 = makeRecording(1)
+    rec2 = makeRecording(2)
+
+    with open(outfile, 'w') as out:
+        rec1.saveFile(filename)
+        loaded1 = RecordPaintDevice.loadFile(filename)
+        writeResult(out, 'roundtrip', same(rec1, loaded1))
+
+        # overwriting does not change a recording loaded from the file
+        rec2.saveFile(filename)
+        loaded2 = RecordPaintDevice.loadFile(filename)
+        writeResult(out, 'overwrite', same(rec2, loaded2))
+        writeResult(out, 'loaded unchanged', same(rec1, loaded1))
+        writeResult(out, 'no temporary files',
+                    os.listdir(tempdir) == ['page.rec'])
+
+        empty = RecordPaintDevice(50, 40, 96, 96)
+        empty.saveFile(filename)
+        writeResult(out, 'empty', same(
+            empty, RecordPaintDevice.loadFile(filename)))
+
+        writeResult(out, 'missing', rejected(
+            os.path.join(tempdir, 'missing.rec')))
+
+        rng = N.random.RandomState(5)
+        with open(filename, 'wb') as f:
+            f.write(rng.bytes(5000))
+        writeResult(out, 'garbage', rejected(filename))
+
+        rec1.saveFile(filename)
+        with open(filename, 'rb') as f:
+            data = f.read()
+        for frac in (0.02, 0.5, 0.99):
+            with open(filename, 'wb') as f:
+                f.write(data[:int(len(data)*frac)])
+            writeResult(out, 'truncated %g' % frac, rejected(filename))
+
+if __name__ == '__main__':
+    runTest(main)
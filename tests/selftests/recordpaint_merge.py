@@ -0,0 +1,76 @@
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers.recordpaint import RecordPaintDevice
+
+from _testutils import newPainter, renderArray, sameImages, writeResult, \
+    runTest
+
+# check that merging primitives and dropping repeated state changes
+# in recordings does not change what is drawn
+
+width, height = 300, 200
+
+def drawRects(painter, pen, brush, rng):
+    # overlapping rectangles drawn one at a time, setting the same
+    # state each time
+    for i in range(200):
+        painter.setPen(pen)
+        painter.setBrush(brush)
+        painter.drawRect(qt.QRectF(
+            rng.uniform(0, 250), rng.uniform(0, 150),
+            rng.uniform(2, 50), rng.uniform(2, 50)))
+
+def drawLines(painter, pen, brush, rng):
+    for i in range(200):
+        painter.setPen(pen)
+        painter.drawLine(qt.QLineF(*rng.uniform(0, 200, 4)))
+
+def drawPoints(painter, pen, brush, rng):
+    for i in range(200):
+        painter.setPen(pen)
+        painter.drawPoint(qt.QPointF(*rng.uniform(0, 200, 2)))
+
+def render(draw, pen, brush, antialias, recorded):
+    def drawItems(painter):
+        draw(painter, pen, brush, N.random.RandomState(17))
+
+    if not recorded:
+        return renderArray(width, height, drawItems, antialias=antialias)
+
+    record = RecordPaintDevice(width, height, 96, 96)
+    painter = newPainter(record, antialias=antialias)
+    drawItems(painter)
+    painter.end()
+    return renderArray(width, height, record.play, antialias=antialias)
+
+def main(outfile):
+    blue = qt.QColor(20, 40, 220)
+    red = qt.QColor(230, 30, 10)
+    transblue = qt.QColor(20, 40, 220, 100)
+    cases = (
+        ('rects samecolor', drawRects, qt.QPen(blue, 2.), qt.QBrush(blue)),
+        ('rects diffcolor', drawRects, qt.QPen(red, 2.), qt.QBrush(blue)),
+        ('rects nopen', drawRects, qt.QPen(qt.Qt.NoPen), qt.QBrush(blue)),
+        ('rects nobrush', drawRects, qt.QPen(red, 1.5), qt.QBrush()),
+        ('rects translucent', drawRects, qt.QPen(qt.Qt.NoPen),
+         qt.QBrush(transblue)),
+        ('rects translucentpen', drawRects, qt.QPen(transblue, 3.),
+         qt.QBrush(blue)),
+        ('lines opaque', drawLines, qt.QPen(red, 2.5), None),
+        ('lines translucent', drawLines, qt.QPen(transblue, 2.5), None),
+        ('points opaque', drawPoints, qt.QPen(red, 4.), None),
+        ('points translucent', drawPoints, qt.QPen(transblue, 4.), None),
+    )
+
+    with open(outfile, 'w') as out:
+        for name, draw, pen, brush in cases:
+            for antialias in (False, True):
+                direct = render(draw, pen, brush, antialias, False)
+                played = render(draw, pen, brush, antialias, True)
+                # antialiased overlaps may be drawn in a different
+                # order, which can change the rounding of a pixel
+                writeResult(out, '%s antialias=%s' % (name, antialias),
+                            sameImages(direct, played, tolerance=2))
+
+if __name__ == '__main__':
+    runTest(main)
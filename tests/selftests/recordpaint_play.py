@@ -0,0 +1,99 @@
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers.recordpaint import RecordPaintDevice
+
+from _testutils import newPainter, renderArray, sameImages, writeResult, \
+    runTest
+
+# check that playing back a recording draws the same as painting
+# directly
+
+width, height = 400, 300
+
+def drawScene(painter):
+    rng = N.random.RandomState(11)
+
+    painter.setPen(qt.QPen(qt.QColor('black'), 2.))
+    painter.drawLine(qt.QLineF(10, 10, 390, 290))
+    painter.drawLines([
+        qt.QLineF(*rng.uniform(0, 300, 4)) for i in range(20)])
+
+    pen = qt.QPen(qt.QColor(0, 100, 0), 3.)
+    pen.setStyle(qt.Qt.DashLine)
+    pen.setCapStyle(qt.Qt.RoundCap)
+    painter.setPen(pen)
+    painter.drawPolyline(qt.QPolygonF([
+        qt.QPointF(x, 150+50*N.sin(x*0.05)) for x in range(0, 400, 5)]))
+
+    painter.setPen(qt.QPen(qt.QColor('blue'), 1.))
+    painter.setBrush(qt.QBrush(qt.QColor(255, 200, 0)))
+    painter.drawRects([
+        qt.QRectF(x, 20, 15, 25) for x in range(20, 200, 20)])
+    # the same state again
+    painter.setPen(qt.QPen(qt.QColor('blue'), 1.))
+    painter.drawEllipse(qt.QRectF(250, 30, 80, 40))
+
+    painter.save()
+    painter.translate(200, 200)
+    painter.rotate(30)
+    painter.scale(1.5, 0.8)
+    painter.setBrush(qt.QBrush(qt.QColor(200, 0, 200, 128)))
+    painter.setPen(qt.Qt.NoPen)
+    painter.drawPolygon(qt.QPolygonF([
+        qt.QPointF(0, 0), qt.QPointF(60, 10), qt.QPointF(30, 50),
+        qt.QPointF(-20, 30)]))
+    painter.restore()
+
+    painter.save()
+    painter.setClipRect(qt.QRectF(50, 180, 120, 80), qt.Qt.IntersectClip)
+    path = qt.QPainterPath()
+    path.addEllipse(qt.QRectF(30, 160, 100, 100))
+    path.addRect(qt.QRectF(80, 200, 100, 80))
+    painter.setPen(qt.QPen(qt.QColor('red'), 1.5))
+    painter.setBrush(qt.QBrush(qt.QColor(0, 128, 255), qt.Qt.Dense4Pattern))
+    painter.drawPath(path)
+    painter.restore()
+
+    painter.save()
+    painter.setOpacity(0.5)
+    painter.setPen(qt.QPen(qt.QColor('black'), 4.))
+    painter.drawPoints(qt.QPolygonF([
+        qt.QPointF(*p) for p in rng.uniform(0, 300, (50, 2))]))
+    painter.setCompositionMode(qt.QPainter.CompositionMode_Multiply)
+    painter.setPen(qt.Qt.NoPen)
+    painter.setBrush(qt.QBrush(qt.QColor(0, 255, 255)))
+    painter.drawRect(qt.QRectF(280, 150, 100, 120))
+    painter.restore()
+
+def main(outfile):
+    region = qt.QRectF(60, 40, 200, 150)
+
+    def drawRegion(painter):
+        painter.setClipRect(region)
+        drawScene(painter)
+
+    def playRegion(painter):
+        painter.setClipRect(region)
+        record.play(painter, region)
+
+    with open(outfile, 'w') as out:
+        for antialias in (False, True):
+            record = RecordPaintDevice(width, height, 96, 96)
+            painter = newPainter(record, antialias=antialias)
+            drawScene(painter)
+            painter.end()
+
+            out.write('antialias %s\n' % antialias)
+            writeResult(out, ' play', sameImages(
+                renderArray(width, height, drawScene, antialias=antialias),
+                renderArray(width, height, record.play, antialias=antialias),
+                tolerance=1))
+
+            # playing back a region, clipped to that region
+            writeResult(out, ' region', sameImages(
+                renderArray(width, height, drawRegion, antialias=antialias),
+                renderArray(width, height, playRegion, antialias=antialias),
+                tolerance=1))
+
+if __name__ == '__main__':
+    runTest(main)
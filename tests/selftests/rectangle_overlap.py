@@ -0,0 +1,65 @@
+import sys
+
+import numpy as N
+from veusz.helpers.qtloops import (
+    RotatedRectangle, RectangleOverlapTester, doPolygonsIntersect)
+
+# check that the grid in RectangleOverlapTester gives the same
+# answers as testing against every rectangle added
+
+class BruteTester:
+    def __init__(self):
+        self.polys = []
+
+    def willOverlap(self, rect):
+        poly = rect.makePolygon()
+        return any(doPolygonsIntersect(poly, p) for p in self.polys)
+
+    def addRect(self, rect):
+        self.polys.append(rect.makePolygon())
+
+def makeRects(rng, num, firstsize):
+    rects = [RotatedRectangle(50, 50, firstsize, firstsize, 0.3)]
+    for i in range(num):
+        size = rng.choice([1., 5., 20., 200.], p=[0.3, 0.4, 0.25, 0.05])
+        rects.append(RotatedRectangle(
+            rng.uniform(-100, 600), rng.uniform(-100, 600),
+            size*rng.uniform(0.2, 3), size*rng.uniform(0.2, 3),
+            rng.uniform(0, 2*N.pi)))
+        if i % 200 == 0:
+            # rectangles too large for the grid
+            rects.append(RotatedRectangle(
+                rng.uniform(0, 500), rng.uniform(0, 500),
+                1e12, rng.uniform(0.5, 2), rng.uniform(0, N.pi)))
+    return rects
+
+def place(tester, brute, rects):
+    """Add rectangles which do not overlap; return mismatch count."""
+    mismatches = 0
+    for r in rects:
+        overlap = tester.willOverlap(r)
+        if overlap != brute.willOverlap(r):
+            mismatches += 1
+        if not overlap:
+            tester.addRect(r)
+            brute.addRect(r)
+    return mismatches
+
+def main(outfile):
+    rng = N.random.RandomState(3)
+    tester = RectangleOverlapTester()
+
+    with open(outfile, 'w') as out:
+        # the first rectangle sets the grid cell size
+        for firstsize in (0.5, 10., 1000.):
+            tester.reset()
+            rects = makeRects(rng, 1500, firstsize)
+            out.write('first %g %s\n' % (
+                firstsize, place(tester, BruteTester(), rects) == 0))
+
+        tester.reset()
+        rect = RotatedRectangle(50, 50, 10, 10, 0)
+        out.write('reset %s\n' % (not tester.willOverlap(rect)))
+
+if __name__ == '__main__':
+    main(sys.argv[1])
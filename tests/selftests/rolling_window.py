@@ -0,0 +1,119 @@
+import sys
+
+import numpy as N
+from veusz.helpers import qtloops
+
+# check the rolling window functions against numpy, including the
+# ends of the data, non-finite values and extreme widths
+
+def windowSlice(i, width):
+    return slice(max(i-width, 0), max(i+width+1, 0))
+
+def refAverage(data, weights, width):
+    if weights is None:
+        weights = N.ones(len(data))
+    size = min(len(data), len(weights))
+    data, weights = data[:size], weights[:size]
+    out = N.full(size, N.nan)
+    for i in range(size):
+        if width < 0:
+            continue
+        d = data[windowSlice(i, width)]
+        w = weights[windowSlice(i, width)]
+        ok = N.isfinite(d) & N.isfinite(w)
+        if ok.any() and N.sum(w[ok]) != 0:
+            out[i] = N.sum(w[ok]*d[ok]) / N.sum(w[ok])
+    return out
+
+def refStatistic(fn, data, width):
+    out = N.full(len(data), N.nan)
+    for i in range(len(data)):
+        if width < 0:
+            continue
+        d = data[windowSlice(i, width)]
+        d = d[N.isfinite(d)]
+        if len(d) > 0:
+            out[i] = fn(d)
+    return out
+
+def close(a, b, scale=0.):
+    """Are the arrays the same, with non-finite values in the same
+    places, to within rounding of values of size scale?"""
+    a, b = N.asarray(a), N.asarray(b)
+    return a.shape == b.shape and N.allclose(
+        a, b, rtol=1e-12, atol=1e-11*scale, equal_nan=True)
+
+def makeData(rng):
+    noisy = rng.normal(size=500)
+    holes = noisy.copy()
+    holes[rng.randint(500, size=60)] = N.nan
+    holes[rng.randint(500, size=10)] = N.inf
+    holes[rng.randint(500, size=10)] = -N.inf
+    # a gap longer than the windows
+    holes[200:260] = N.nan
+
+    return (
+        ('noisy', noisy),
+        ('holes', holes),
+        # repeated values, for the median of equal values
+        ('steps', N.floor(rng.uniform(0, 5, 300))),
+        # large offset, where running sums may drift
+        ('offset', 1e8 + rng.normal(size=2000)),
+        ('allnan', N.full(40, N.nan)),
+        ('single', N.array([3.5])),
+        ('empty', N.array([])),
+    )
+
+def main(outfile):
+    rng = N.random.RandomState(41)
+    stats = (
+        ('median', qtloops.rollingMedian, N.median),
+        ('minimum', qtloops.rollingMinimum, N.min),
+        ('maximum', qtloops.rollingMaximum, N.max),
+    )
+
+    with open(outfile, 'w') as out:
+        for name, data in makeData(rng):
+            size = len(data)
+            widths = (
+                ('0', 0), ('1', 1), ('3', 3), ('17', 17),
+                ('size-1', size-1), ('size', size), ('wide', 3*size+5),
+                ('maxint', 2**31-1), ('negative', -1),
+            )
+            weights = rng.uniform(0, 2, size+10)
+            weights[rng.randint(size+10, size=size//20+1)] = N.nan
+            weights[rng.randint(size+10, size=size//20+1)] = 0
+
+            # running sums are only accurate to within rounding of the
+            # values added and removed
+            finite = data[N.isfinite(data)]
+            scale = N.abs(finite).max() if len(finite) > 0 else 0.
+
+            for wname, width in widths:
+                res = []
+                res.append(close(
+                    qtloops.rollingAverage(data, None, width),
+                    refAverage(data, None, width), scale=scale))
+                res.append(close(
+                    qtloops.rollingAverage(data, weights, width),
+                    refAverage(data, weights, width), scale=scale))
+                for sname, fn, reffn in stats:
+                    res.append(close(
+                        fn(data, width), refStatistic(reffn, data, width)))
+                out.write('%s width=%s %s\n' % (name, wname, all(res)))
+
+            # integer and strided input
+            ints = N.rint(finite*3).astype(N.int32)
+            strided = N.repeat(data, 2)[::2]
+            out.write('%s types %s\n' % (name, all([
+                close(qtloops.rollingAverage(ints, None, 4),
+                      refAverage(ints.astype(N.float64), None, 4),
+                      scale=3*scale),
+                close(qtloops.rollingMedian(ints, 4),
+                      refStatistic(N.median, ints.astype(N.float64), 4)),
+                close(qtloops.rollingMaximum(strided, 4),
+                      refStatistic(N.max, data, 4)),
+            ])))
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,76 @@
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers import threed
+
+from _testutils import renderArray, sameImages, writeResult, runTest
+
+# check that lighting triangles on several threads gives the same
+# image as lighting them on one
+
+size = 400
+
+def makeRoot():
+    root = threed.ObjectContainer()
+    root.objM = threed.rotate3M4(0.6, 0.4, 0.2)
+
+    # enough triangles for several lighting tasks
+    steps = N.linspace(-0.5, 0.5, 120)
+    x, y = N.meshgrid(steps, steps, indexing='ij')
+    heights = 0.2*N.sin(x*9)*N.cos(y*7)
+    surfprop = threed.SurfaceProp(r=0.2, g=0.5, b=0.9, refl=0.7)
+    lineprop = threed.LineProp(r=0.1, g=0.1, b=0.1, refl=0.5, width=0.5)
+    root.addObject(threed.Mesh(
+        threed.ValVector(steps), threed.ValVector(steps),
+        threed.ValVector(N.ravel(heights)), threed.Mesh.Z_DIRN,
+        lineprop, surfprop))
+
+    # colors from an image, translucency, and unlit triangles
+    rng = N.random.RandomState(21)
+    img = qt.QImage(64, 1, qt.QImage.Format_ARGB32)
+    for i in range(64):
+        img.setPixel(i, 0, qt.qRgba(i*4, 255-i*4, 128, 200))
+    colprop = threed.SurfaceProp(refl=0.5)
+    colprop.setRGBs(img)
+    for prop in (colprop, threed.SurfaceProp(r=1, g=0, b=0, refl=0),
+                 threed.SurfaceProp(r=1, g=1, b=0, refl=1, trans=0.4)):
+        for i in range(300):
+            pts = rng.uniform(-0.5, 0.5, (3, 3))
+            root.addObject(threed.Triangle(
+                threed.Vec3(*pts[0]), threed.Vec3(*pts[1]),
+                threed.Vec3(*pts[2]), prop))
+    return root
+
+def render(mode, nthreads, lights=True):
+    scene = threed.Scene(mode)
+    scene.setNumThreads(nthreads)
+    if lights:
+        scene.addLight(threed.Vec3(-1, -1, -2), qt.QColor('white'), 0.6)
+        scene.addLight(threed.Vec3(2, 0.5, -1), qt.QColor(255, 128, 0), 0.4)
+
+    camera = threed.Camera()
+    camera.setPointing(
+        threed.Vec3(0, 0, -2), threed.Vec3(0, 0, 0), threed.Vec3(0, -1, 0))
+    camera.setPerspective(90, 1, 100)
+
+    root = makeRoot()
+    return renderArray(
+        size, size, lambda painter: scene.render(
+            root, painter, camera, 0, 0, size, size, -1))
+
+def main(outfile):
+    modes = (
+        ('painters', threed.Scene.RENDER_PAINTERS),
+        ('bsp', threed.Scene.RENDER_BSP),
+        ('zbuffer', threed.Scene.RENDER_ZBUFFER),
+    )
+
+    with open(outfile, 'w') as out:
+        for name, mode in modes:
+            single = render(mode, 1)
+            writeResult(out, '%s threads' % name, all(
+                sameImages(single, render(mode, n)) for n in (2, 4, 0)))
+            writeResult(out, '%s lit' % name, not sameImages(
+                single, render(mode, 1, False)))
+
+if __name__ == '__main__':
+    runTest(main)
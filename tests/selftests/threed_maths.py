@@ -0,0 +1,143 @@
+import sys
+
+import numpy as N
+from veusz.helpers import threed
+
+# check the 3D vector and matrix maths against numpy
+
+def fromM(m, n):
+    return N.array([[m.get(y, x) for x in range(n)] for y in range(n)])
+
+def toM4(a):
+    m = threed.Mat4()
+    for y in range(4):
+        for x in range(4):
+            m.set(y, x, a[y, x])
+    return m
+
+def toM3(a):
+    m = threed.Mat3()
+    for y in range(3):
+        for x in range(3):
+            m.set(y, x, a[y, x])
+    return m
+
+def fromV(v, n):
+    return N.array([v.get(i) for i in range(n)])
+
+def close(a, b):
+    return N.allclose(a, b, rtol=1e-9, atol=1e-9)
+
+def refRotate(angle, vec):
+    a = vec / N.sqrt(N.sum(vec**2))
+    c, s = N.cos(angle), N.sin(angle)
+    cross = N.array([[0, -a[2], a[1]], [a[2], 0, -a[0]], [-a[1], a[0], 0]])
+    m = N.identity(4)
+    m[:3, :3] = c*N.identity(3) + s*cross + (1-c)*N.outer(a, a)
+    return m
+
+def refRotate3(ax, ay, az):
+    def rot(i, j, angle):
+        m = N.identity(4)
+        m[i, i] = m[j, j] = N.cos(angle)
+        m[j, i] = N.sin(angle)
+        m[i, j] = -N.sin(angle)
+        return m
+    # rotation about x, then y, then z
+    return N.dot(rot(0, 1, az), N.dot(rot(2, 0, ay), rot(1, 2, ax)))
+
+def isIndexError(func):
+    try:
+        func()
+    except ValueError:
+        return True
+    return False
+
+def main(outfile):
+    rng = N.random.RandomState(9)
+    ntests = 200
+
+    results = {}
+    def check(name, ok):
+        results[name] = results.get(name, True) and bool(ok)
+
+    for i in range(ntests):
+        a3, b3 = rng.normal(size=3), rng.normal(size=3)
+        a4 = rng.normal(size=4)
+        m4a, m4b = rng.normal(size=(4, 4)), rng.normal(size=(4, 4))
+        m3 = rng.normal(size=(3, 3))
+        s = rng.normal()
+        angles = rng.uniform(-2*N.pi, 2*N.pi, 3)
+
+        v3a, v3b = threed.Vec3(*a3), threed.Vec3(*b3)
+        v4 = threed.Vec4(*a4)
+        M4a, M4b, M3 = toM4(m4a), toM4(m4b), toM3(m3)
+
+        check('vec3 add', close(fromV(v3a+v3b, 3), a3+b3))
+        check('vec3 sub', close(fromV(v3a-v3b, 3), a3-b3))
+        check('vec3 scale', close(fromV(v3a*s, 3), a3*s))
+        v = threed.Vec3(*a3)
+        v *= s
+        check('vec3 scale inplace', close(fromV(v, 3), a3*s))
+        check('vec3 rad', close(v3a.rad(), N.sqrt(N.sum(a3**2))))
+        check('vec3 rad2', close(v3a.rad2(), N.sum(a3**2)))
+        v = threed.Vec3(*a3)
+        v.normalise()
+        check('vec3 normalise', close(
+            fromV(v, 3), a3/N.sqrt(N.sum(a3**2))))
+        check('vec3 equal',
+              v3a == threed.Vec3(*a3) and v3a != v3b and
+              not (v3a != threed.Vec3(*a3)))
+        check('vec4 add', close(fromV(v4+v4, 4), a4+a4))
+        check('vec4 rad', close(v4.rad(), N.sqrt(N.sum(a4**2))))
+
+        check('mat4 mult', close(fromM(M4a*M4b, 4), N.dot(m4a, m4b)))
+        check('mat4 vec', close(fromV(M4a*v4, 4), N.dot(m4a, a4)))
+        check('vec mat4', close(fromV(v4*M4a, 4), N.dot(a4, m4a)))
+        check('mat4 transpose', close(fromM(M4a.transpose(), 4), m4a.T))
+        check('mat3 vec', close(fromV(M3*v3a, 3), N.dot(m3, a3)))
+        check('vec mat3', close(fromV(v3a*M3, 3), N.dot(a3, m3)))
+        check('mat3 mult', close(fromM(M3*M3, 3), N.dot(m3, m3)))
+
+        check('rotate', close(
+            fromM(threed.rotateM4(s, v3a), 4), refRotate(s, a3)))
+        check('rotate3', close(
+            fromM(threed.rotate3M4(*angles), 4), refRotate3(*angles)))
+        trans = N.identity(4)
+        trans[:3, 3] = a3
+        check('translation', close(
+            fromM(threed.translationM4(v3a), 4), trans))
+        check('scale', close(
+            fromM(threed.scaleM4(v3a), 4), N.diag(N.append(a3, 1))))
+
+        # projections, avoiding dividing by nearly zero
+        p4 = N.dot(m4a, a4)
+        if abs(p4[3]) > 0.1:
+            check('projvec4', close(
+                fromV(threed.calcProjVec(M4a, v4), 3), p4[:3]/p4[3]))
+        p3 = N.dot(m4a, N.append(a3, 1))
+        if abs(p3[3]) > 0.1:
+            check('projvec3', close(
+                fromV(threed.calcProjVec(M4a, v3a), 3), p3[:3]/p3[3]))
+        sc = N.dot(m3, N.array([a3[0], a3[1], 1]))
+        if abs(sc[2]) > 0.1:
+            check('screen', close(
+                fromV(threed.projVecToScreen(M3, v3a), 2), sc[:2]/sc[2]))
+
+    check('identity',
+          close(fromM(threed.identityM4(), 4), N.identity(4)) and
+          close(fromM(threed.identityM3(), 3), N.identity(3)))
+    check('zero', close(fromM(threed.Mat4(), 4), N.zeros((4, 4))))
+
+    with open(outfile, 'w') as out:
+        for name in sorted(results):
+            out.write('%s %s\n' % (name, results[name]))
+        out.write('index errors %s\n' % all([
+            isIndexError(lambda: threed.Vec3().get(3)),
+            isIndexError(lambda: threed.Vec4().set(4, 1.)),
+            isIndexError(lambda: threed.Mat4().get(0, 4)),
+            isIndexError(lambda: threed.Mat3().set(3, 0, 1.)),
+        ]))
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -33,6 +33,7 @@ from .. import datasets
 from . import operations
 from . import mime
 from . import export
+from . import pagecache
 
 def _(text, disambiguation=None, context='CommandInterface'):
     """Translate text."""
@@ -112,6 +113,8 @@ class CommandInterface(qt.QObject):
         self.currentwidget = self.document.basewidget
         self.verbose = False
         self.importpath = []
+        # page caches for export, by directory
+        self.pagecaches = {}
 
         self.document.sigWiped.connect(self.slotWipedDoc)
 
@@ -764,7 +767,8 @@ class CommandInterface(qt.QObject):
 
     def Export(self, filename, color=True, page=[0], dpi=100,
                antialias=True, quality=85, backcolor='#ffffff00',
-               pdfdpi=150, svgdpi=96, svgtextastext=False):
+               pdfdpi=150, svgdpi=96, svgtextastext=False,
+               cachedir=None):
         """Export plot to filename.
 
         color is True or False if color is requested in output file
@@ -777,6 +781,8 @@ class CommandInterface(qt.QObject):
         pdfdpi is the dpi to use when exporting eps or pdf files
         svgdpi is the dpi to use when exporting svg files
         svgtextastext: write text in SVG as text, rather than curves
+        cachedir: if set, a directory to cache recorded pages in, so
+         exporting the same unchanged page again does not repaint it
         """
 
         # compatibility where page was a single number
@@ -785,6 +791,12 @@ class CommandInterface(qt.QObject):
         except TypeError:
             pages = [page]
 
+        cache = None
+        if cachedir:
+            if cachedir not in self.pagecaches:
+                self.pagecaches[cachedir] = pagecache.PageCache(cachedir)
+            cache = self.pagecaches[cachedir]
+
         e = export.AsyncExport(
             self.document,
             color=color,
@@ -794,7 +806,8 @@ class CommandInterface(qt.QObject):
             backcolor=backcolor,
             pdfdpi=pdfdpi,
             svgdpi=svgdpi,
-            svgtextastext=svgtextastext
+            svgtextastext=svgtextastext,
+            pagecache=cache,
         )
         e.add(filename, pages)
         e.finish()
@@ -413,12 +413,23 @@ class Document(qt.QObject):
             if setting.settingdb['docfile_addimportpaths']:
                 fileobj.write('AddImportPath(%s)\n' % utils.rrepr(reldirname))
 
+        self.saveContentsToFile(fileobj, relpath=reldirname)
+
+        self.setModified(False)
+
+    def saveContentsToFile(self, fileobj, relpath=None):
+        """Save the datasets, tags, custom definitions and widgets of
+        the document to a file, as in saveToFile without the header.
+
+        relpath is a directory to save linked files relative to
+        """
+
         # save those datasets which are linked
         # we do this first in case the datasets are overridden below
         savedlinks = {}
         for name, dataset in sorted(self.data.items()):
             dataset.saveLinksToSavedDoc(fileobj, savedlinks,
-                                        relpath=reldirname)
+                                        relpath=relpath)
 
         # save the remaining datasets
         for name, dataset in sorted(self.data.items()):
@@ -433,8 +444,6 @@ class Document(qt.QObject):
         # save the actual tree structure
         fileobj.write(self.basewidget.getSaveText())
 
-        self.setModified(False)
-
     def saveToHDF5File(self, fileobj):
         """Save to HDF5 (h5py) output file given."""
 
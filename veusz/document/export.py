@@ -118,11 +118,7 @@ class ExportBitmapRunnable(ExportRunnable):
             image.fill(backqcolor.rgb())
 
         # paint to the image
-        painter = qt.QPainter(image)
-        painter.setRenderHint(qt.QPainter.Antialiasing, self.aexport.antialias)
-        painter.setRenderHint(qt.QPainter.TextAntialiasing, self.aexport.antialias)
-        self.phelpers[0].renderToPainter(painter)
-        painter.end()
+        self.phelpers[0].renderToImage(image, antialias=self.aexport.antialias)
 
         # write image to disk
         writer = qt.QImageWriter()
@@ -357,7 +353,8 @@ class AsyncExport(qt.QObject):
 
     def __init__(self, doc, color=True, bitmapdpi=100,
                  antialias=True, quality=85, backcolor='#ffffff00',
-                 pdfdpi=150, svgdpi=96, svgtextastext=False):
+                 pdfdpi=150, svgdpi=96, svgtextastext=False,
+                 pagecache=None):
         """Initialise export class. Parameters are:
         doc: document to write
         color: use color or try to use monochrome
@@ -368,6 +365,7 @@ class AsyncExport(qt.QObject):
         pdfdpi: dpi for pdf and eps files
         svgdpi: dpi for svg files
         svgtextastext: write text in SVG as text, rather than curves
+        pagecache: optional pagecache.PageCache to reuse recorded pages
         """
 
         qt.QObject.__init__(self)
@@ -380,6 +378,7 @@ class AsyncExport(qt.QObject):
         self.pdfdpi = pdfdpi
         self.svgdpi = svgdpi
         self.svgtextastext = svgtextastext
+        self.pagecache = pagecache
 
         self.backqcolor = self.doc.evaluate.colors.get(self.backcolor)
 
@@ -444,13 +443,20 @@ class AsyncExport(qt.QObject):
 
         ext = os.path.splitext(filename)[1].lower()
         dpi = self.getDPI(ext)
+        vectoroutput = ext not in {
+            '.png', '.jpg', '.jpeg', '.bmp', '.tiff', '.xpm'}
 
         # render each page to a PaintHelper
         phelpers = []
         for page in pages:
-            size = self.doc.pageSize(page, dpi=dpi, integer=False)
-            phelper = painthelper.PaintHelper(self.doc, size, dpi=dpi)
-            self.doc.paintTo(phelper, page)
+            if self.pagecache is not None:
+                phelper = self.pagecache.getPage(
+                    self.doc, page, dpi, vectoroutput)
+            else:
+                size = self.doc.pageSize(page, dpi=dpi, integer=False)
+                phelper = painthelper.PaintHelper(
+                    self.doc, size, dpi=dpi, vectoroutput=vectoroutput)
+                self.doc.paintTo(phelper, page)
             phelpers.append(phelper)
 
         # single page only formats
@@ -514,7 +520,8 @@ def printPages(doc, printer, pages, scaling=1., antialias=False, setsizes=False)
 
     for count, page in enumerate(filtpages):
         psize = doc.pageSize(page, dpi=dpi, integer=False, scaling=scaling)
-        phelper = painthelper.PaintHelper(doc, psize, dpi=dpi, scaling=scaling)
+        phelper = painthelper.PaintHelper(
+            doc, psize, dpi=dpi, scaling=scaling, vectoroutput=True)
         doc.paintTo(phelper, page)
         phelper.renderToPainter(painter)
 
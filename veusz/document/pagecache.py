@@ -0,0 +1,151 @@
+#    Copyright (C) 2026 Jeremy S. Sanders
+#    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+##############################################################################
+
+"""Cache of recorded pages on disk.
+
+Pages are painted once into a recording, which is saved in the
+cache directory under a hash of the document and the painting
+parameters. Later exports of the same page, in this or another
+process, play back the saved recording rather than painting the
+document again.
+"""
+
+import io
+import os
+import os.path
+import hashlib
+
+from .. import utils
+from . import painthelper
+
+try:
+    from ..helpers.recordpaint import RecordPaintDevice
+except ImportError:
+    RecordPaintDevice = None
+
+def documentHash(doc):
+    """Return a hex hash of the contents of a document.
+
+    This is of the saved text of the document. Linked files are
+    included by name, size and modification time, as their data
+    are not saved in the text."""
+
+    fileobj = io.StringIO()
+
+    links = set(
+        dataset.linked for dataset in doc.data.values()
+        if dataset.linked is not None)
+    for filename in sorted(set(
+            getattr(link, 'filename', None) for link in links) - {None}):
+        try:
+            st = os.stat(filename)
+            fileobj.write('# %r %i %i\n' % (
+                filename, st.st_size, st.st_mtime_ns))
+        except EnvironmentError:
+            pass
+
+    doc.saveContentsToFile(fileobj)
+
+    return hashlib.sha256(fileobj.getvalue().encode('utf-8')).hexdigest()
+
+class RecordedPage:
+    """A page played back from a recording.
+
+    This has the attributes and renderToPainter method of PaintHelper
+    used by export."""
+
+    def __init__(self, record, pagesize, dpi):
+        self.record = record
+        self.pagesize = pagesize
+        self.dpi = dpi
+
+    def renderToPainter(self, painter):
+        """Render saved output to painter."""
+        painter.save()
+        self.record.play(painter)
+        painter.restore()
+
+    def renderToImage(self, image, antialias=True):
+        """Render saved output to an image the size of the page."""
+        painthelper.renderRecordToImage(self.record, image, antialias)
+
+class PageCache:
+    """Cache of page recordings saved in a directory.
+
+    If the native recording module is not available, pages are
+    painted each time and nothing is cached."""
+
+    def __init__(self, directory):
+        self.directory = directory
+        # hashes of documents, by document and changeset
+        self.dochashes = {}
+
+    def docHash(self, doc):
+        """Get hash of document, only recomputing if it has changed."""
+        key = (id(doc), doc.changeset)
+        if key not in self.dochashes:
+            self.dochashes[key] = documentHash(doc)
+        return self.dochashes[key]
+
+    def filename(self, doc, page, dpi, vectoroutput):
+        """Filename in cache for the recording of the page."""
+        key = '%s %s %i %r %r %r' % (
+            utils.version(), self.docHash(doc), page,
+            float(dpi[0]), float(dpi[1]), bool(vectoroutput))
+        name = hashlib.sha256(key.encode('utf-8')).hexdigest()
+        return os.path.join(self.directory, name + '.vzrec')
+
+    def getPage(self, doc, page, dpi, vectoroutput):
+        """Return a recorded page for the page of the document.
+
+        This is loaded from the cache if possible, otherwise the page
+        is painted and saved in the cache. If there is no native
+        recording module, a PaintHelper is returned instead.
+        """
+
+        size = doc.pageSize(page, dpi=dpi, integer=False)
+
+        if RecordPaintDevice is None:
+            phelper = painthelper.PaintHelper(
+                doc, size, dpi=dpi, vectoroutput=vectoroutput)
+            doc.paintTo(phelper, page)
+            return phelper
+
+        filename = self.filename(doc, page, dpi, vectoroutput)
+        if os.path.exists(filename):
+            try:
+                record = RecordPaintDevice.loadFile(filename)
+                return RecordedPage(record, size, dpi)
+            except ValueError:
+                # corrupt or from an incompatible system
+                pass
+
+        # paint the page and flatten its layers into a single recording
+        phelper = painthelper.PaintHelper(
+            doc, size, dpi=dpi, vectoroutput=vectoroutput)
+        doc.paintTo(phelper, page)
+        record = phelper.renderToRecording()
+
+        try:
+            os.makedirs(self.directory, exist_ok=True)
+            record.saveFile(filename)
+        except (EnvironmentError, ValueError):
+            # caching is optional
+            pass
+
+        return RecordedPage(record, size, dpi)
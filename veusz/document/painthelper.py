@@ -21,13 +21,59 @@
 
 from .. import qtall as qt
 from .. import utils
+from ..utils import tracing
+
+# images with at least this many pixels are drawn in tiles by
+# multiple threads, if the native recording module is available
+tiledminpixels = 2048*2048
 
 try:
     from ..helpers.recordpaint import RecordPaintDevice
+    nativerecord = True
 except ImportError:
+    nativerecord = False
+
     # fallback to this if we don't get the native recorded
-    def RecordPaintDevice(width, height, dpix, dpiy):
-        return qt.QPicture()
+    class RecordPaintDevice(qt.QPicture):
+        def __init__(self, width, height, dpix, dpiy):
+            qt.QPicture.__init__(self)
+
+        def play(self, painter, region=None):
+            """Play back everything, ignoring region."""
+            return qt.QPicture.play(self, painter)
+
+def useTiledRender(image):
+    """Should image be drawn in tiles by multiple threads?
+
+    This needs the native recording module, a large enough image,
+    more than one core, and text drawing in other threads (pages
+    almost always hold text)."""
+    return (
+        nativerecord and
+        image.width()*image.height() >= tiledminpixels and
+        qt.QThread.idealThreadCount() > 1 and
+        qt.QFontDatabase.supportsThreadedFontRendering() )
+
+def renderRecordToImage(record, image, antialias=True):
+    """Play back a recording of the page onto an image of the same size.
+
+    Large images are split into tiles drawn by multiple threads, if
+    useTiledRender allows."""
+
+    if useTiledRender(image):
+        hints = 0
+        if antialias:
+            hints = int(qt.QPainter.Antialiasing |
+                        qt.QPainter.TextAntialiasing)
+        record.playTiled(image, hints)
+    else:
+        painter = qt.QPainter(image)
+        painter.setRenderHint(qt.QPainter.Antialiasing, antialias)
+        painter.setRenderHint(qt.QPainter.TextAntialiasing, antialias)
+        painter.save()
+        record.play(painter)
+        painter.restore()
+        painter.end()
 
 class DrawState:
     """Each widget plotted has a recorded state in this object."""
@@ -92,13 +138,19 @@ class RecordPainter(PainterRoot):
     def __init__(self, widget, outdev):
         PainterRoot.__init__(self, outdev)
         self.widget = widget
+        self.tracestart = None
 
     def __enter__(self):
         #print ' '*len(self.helper.widgetstack), self.widget
         self.helper.widgetstack.append(self.widget)
+        if tracing.recording:
+            self.tracestart = tracing.clock()
 
     def __exit__(self, exc_type, exc_value, traceback):
         self.helper.widgetstack.pop()
+        if self.tracestart is not None:
+            tracing.addWidgetTime(self.widget, self.tracestart)
+            self.tracestart = None
 
 class PaintHelper:
     """Helper used when painting widgets.
@@ -113,7 +165,7 @@ class PaintHelper:
 
     def __init__(self, document, pagesize,
                  scaling=1, devicepixelratio=1, dpi=(100, 100),
-                 directpaint=None):
+                 directpaint=None, vectoroutput=False, asyncrender=False):
         """
         pagesize: tuple (pixelw, pixelh), which can be float.
          This is the page size in the coordinates presented to graph drawing.
@@ -122,6 +174,12 @@ class PaintHelper:
         dpi: tuple of X and Y dpi for graph coordinates
         directpaint: use this painter directly, rather than using RecordPainter
           to store each widget painting
+        vectoroutput: output is to a vector format, so widgets should avoid
+          drawing rasterised images where possible
+        asyncrender: output is interactive, so widgets may draw a preview
+          and finish rendering in the background, adding objects with an
+          isFinished() method to pendingrenders. The page should be drawn
+          again when they are finished.
         """
 
         self.document = document
@@ -130,6 +188,9 @@ class PaintHelper:
         # scaling factor, excluding high-DPI factor (for controlgraphs)
         self.cgscale = scaling / devicepixelratio
         self.devicepixelratio = devicepixelratio
+        self.vectoroutput = vectoroutput
+        self.asyncrender = asyncrender
+        self.pendingrenders = []
         self.pixperpt = self.dpi[1] / 72.
 
         # page size in native pixels (without default zoom)
@@ -234,6 +295,28 @@ class PaintHelper:
         """
         self._renderState(self.rootstate, painter)
 
+    def renderToRecording(self):
+        """Render saved output into a single new recording."""
+        record = RecordPaintDevice(
+            int(self.pagesize[0]), int(self.pagesize[1]),
+            int(self.dpi[0]), int(self.dpi[1]))
+        painter = qt.QPainter(record)
+        self.renderToPainter(painter)
+        painter.end()
+        return record
+
+    def renderToImage(self, image, antialias=True):
+        """Render saved output to an image the size of the page."""
+        if useTiledRender(image):
+            # flattening the layers is cheap compared to drawing
+            renderRecordToImage(self.renderToRecording(), image, antialias)
+        else:
+            painter = qt.QPainter(image)
+            painter.setRenderHint(qt.QPainter.Antialiasing, antialias)
+            painter.setRenderHint(qt.QPainter.TextAntialiasing, antialias)
+            self.renderToPainter(painter)
+            painter.end()
+
     def _renderState(self, state, painter, indent=0):
         """Render state to painter."""
 
@@ -284,7 +367,9 @@ class PaintHelper:
             # this makes the small image draw from x-box->x+box, y-box->y+box
             # translate would get overriden by coordinate system playback
             painter.setWindow(x-box,y-box,box*2+1,box*2+1)
-            state.record.play(painter)
+            # only play back items near the point
+            state.record.play(
+                painter, qt.QRectF(x-box, y-box, box*2+1, box*2+1))
             painter.end()
             newimg = pixmap.toImage()
 
@@ -0,0 +1,571 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+// Benchmark of the kernels of the qtloops, recordpaint and _nc_cntr
+// helper modules, using synthetic inputs of parameterized size and
+// drawing to offscreen images. The results are written to stdout as
+// JSON. tests/runselftest.py checks the output of the same code is
+// correct; this only measures how long it takes.
+//
+// Python is embedded, only to make the numpy arrays which some
+// kernels take as input, and to call the contouring module.
+
+/*
+  This is built by "python3 setup.py build_bench", into build/bench
+  (it is not installed).
+
+  Usage: kernelbench [repeats] [points] [pixels]
+
+  points is the number of points in lines and datasets (default
+  100000) and pixels is the width and height of images (default
+  1000). Contours are traced on a grid of pixels/2 points square.
+*/
+
+#include <Python.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtGui/QPainterPath>
+#include <QtGui/QPolygonF>
+
+#include "beziers.h"
+#include "numpyfuncs.h"
+#include "polygonclip.h"
+#include "polylineclip.h"
+#include "qtloops.h"
+#include "qtloops_helpers.h"
+#include "recordpaintdevice.h"
+
+extern "C" PyObject* PyInit__nc_cntr(void);
+
+namespace
+{
+  typedef std::mt19937 RandomGen;
+
+  double uniform(RandomGen& gen, double a, double b)
+  {
+    return std::uniform_real_distribution<double>(a, b)(gen);
+  }
+
+  // Python objects used to make arrays
+  PyObject* numpymod = 0;
+
+  // make a float64 numpy array (or another dtype) from values,
+  // reshaped to rows*cols if rows is nonzero
+  PyObject* makeArray(const std::vector<double>& vals, int rows=0,
+                      int cols=0, const char* dtype=0)
+  {
+    PyObject* bytes = PyBytes_FromStringAndSize(
+      reinterpret_cast<const char*>(vals.data()), vals.size()*sizeof(double));
+    PyObject* arr = PyObject_CallMethod(numpymod, "frombuffer", "Os",
+                                        bytes, "float64");
+    Py_DECREF(bytes);
+    if( arr != 0 && rows != 0 )
+      {
+        PyObject* shaped = PyObject_CallMethod(arr, "reshape", "ii",
+                                               rows, cols);
+        Py_DECREF(arr);
+        arr = shaped;
+      }
+    if( arr != 0 && dtype != 0 )
+      {
+        PyObject* conv = PyObject_CallMethod(arr, "astype", "s", dtype);
+        Py_DECREF(arr);
+        arr = conv;
+      }
+    if( arr == 0 )
+      {
+        PyErr_Print();
+        std::exit(1);
+      }
+    return arr;
+  }
+
+  struct Result
+  {
+    std::string kernel, variant;
+    long long size;
+    unsigned repeats;
+    double mean, min;
+  };
+
+  std::vector<Result> results;
+  unsigned repeats = 5;
+
+  // time func over repeats calls, after an untimed call to warm up
+  template<class Func> void bench(const char* kernel, const char* variant,
+                                  long long size, Func func)
+  {
+    func();
+
+    Result r;
+    r.kernel = kernel;
+    r.variant = variant;
+    r.size = size;
+    r.repeats = repeats;
+    r.mean = 0;
+    r.min = 1e300;
+    for(unsigned i=0; i<repeats; ++i)
+      {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        const double t = std::chrono::duration<double, std::milli>
+          (std::chrono::steady_clock::now()-start).count();
+        r.mean += t;
+        r.min = std::min(r.min, t);
+      }
+    r.mean /= repeats;
+    results.push_back(r);
+  }
+
+  // a blank image to draw on
+  QImage makeImage(int pixels)
+  {
+    QImage img(pixels, pixels, QImage::Format_ARGB32_Premultiplied);
+    img.fill(Qt::white);
+    return img;
+  }
+
+  // random walk of n points, which wanders outside the square of size
+  QPolygonF makeWalk(RandomGen& gen, int n, double size)
+  {
+    QPolygonF poly;
+    poly.reserve(n);
+    double x = size/2, y = size/2;
+    const double step = size*4/std::sqrt(double(n));
+    for(int i=0; i<n; ++i)
+      {
+        x += uniform(gen, -step, step);
+        y += uniform(gen, -step, step);
+        poly << QPointF(x, y);
+      }
+    return poly;
+  }
+
+  void benchImages(RandomGen& gen, int pixels)
+  {
+    // values from 0 to 1, with some nans (transparent)
+    std::vector<double> vals(size_t(pixels)*pixels);
+    for(int y=0; y<pixels; ++y)
+      for(int x=0; x<pixels; ++x)
+        vals[size_t(y)*pixels+x] = (x+y)%97 == 0 ? NAN :
+          0.5+0.5*std::sin(x*0.02)*std::cos(y*0.03);
+    PyObject* data = makeArray(vals, pixels, pixels);
+
+    // BGRA colors of a colormap
+    const std::vector<double> cmap = {
+      0, 0, 0, 255,  255, 0, 0, 255,  0, 255, 0, 255,
+      0, 0, 255, 255,  255, 255, 255, 255 };
+    PyObject* colors = makeArray(cmap, 5, 4, "intc");
+
+    {
+      const Numpy2DObj d(data);
+      const Numpy2DIntObj c(colors);
+      const long long npix = (long long)(pixels)*pixels;
+      bench("numpyToQImage", "table", npix,
+            [&]() { numpyToQImage(d, c); });
+      bench("numpyToQImage", "exact", npix,
+            [&]() { numpyToQImage(d, c, false, true); });
+    }
+
+    // resample a smaller image onto the whole output with
+    // nonlinear pixel edges
+    const int inw = std::max(pixels/4, 2);
+    std::vector<double> small(size_t(inw)*inw);
+    for(size_t i=0; i<small.size(); ++i)
+      small[i] = uniform(gen, 0, 1);
+    PyObject* smalldata = makeArray(small, inw, inw);
+    std::vector<double> edges(inw+1);
+    for(int i=0; i<=inw; ++i)
+      edges[i] = pixels * std::pow(double(i)/inw, 2);
+    PyObject* edgearr = makeArray(edges);
+    {
+      const Numpy2DObj d(smalldata);
+      const Numpy2DIntObj c(colors);
+      const QImage inimg(numpyToQImage(d, c));
+      const Numpy1DObj e(edgearr);
+      bench("resampleNonlinearImage", "nearest",
+            (long long)(pixels)*pixels, [&]()
+            {
+              resampleNonlinearImage(inimg, 0, 0, pixels, pixels, e, e);
+            });
+      bench("resampleNonlinearImage", "bilinear",
+            (long long)(pixels)*pixels, [&]()
+            {
+              resampleNonlinearImageBilinear(inimg, 0, 0, pixels, pixels,
+                                             e, e);
+            });
+    }
+
+    Py_DECREF(edgearr);
+    Py_DECREF(smalldata);
+    Py_DECREF(colors);
+    Py_DECREF(data);
+  }
+
+  void benchDrawing(RandomGen& gen, int npts, int pixels)
+  {
+    QImage img(makeImage(pixels));
+    const QRectF clip(0, 0, pixels, pixels);
+
+    // markers at random positions, some outside the image
+    std::vector<double> xs(npts), ys(npts);
+    for(int i=0; i<npts; ++i)
+      {
+        xs[i] = uniform(gen, -0.1*pixels, 1.1*pixels);
+        ys[i] = uniform(gen, -0.1*pixels, 1.1*pixels);
+      }
+    PyObject* xarr = makeArray(xs);
+    PyObject* yarr = makeArray(ys);
+    {
+      const Numpy1DObj x(xarr), y(yarr);
+      QPainterPath marker;
+      marker.addEllipse(QRectF(-3, -3, 6, 6));
+      for(int decimate=0; decimate<2; ++decimate)
+        bench("plotPathsToPainter", decimate ? "decimate" : "all", npts,
+              [&]()
+              {
+                QPainter painter(&img);
+                painter.setRenderHint(QPainter::Antialiasing);
+                painter.setPen(QPen(Qt::black, 1));
+                painter.setBrush(Qt::red);
+                plotPathsToPainter(painter, marker, x, y, 0, &clip, 0,
+                                   false, decimate);
+              });
+    }
+    Py_DECREF(yarr);
+    Py_DECREF(xarr);
+
+    const QPolygonF walk(makeWalk(gen, npts, pixels));
+    bench("plotClippedPolyline", "walk", npts, [&]()
+          {
+            QPainter painter(&img);
+            painter.setRenderHint(QPainter::Antialiasing);
+            plotClippedPolyline(painter, clip, walk);
+          });
+
+    // star shaped polygon, cut by the edges of a smaller clip
+    QPolygonF star;
+    star.reserve(npts);
+    for(int i=0; i<npts; ++i)
+      {
+        const double theta = 2*M_PI*i/npts;
+        const double r = pixels*(0.3 + 0.25*(i%2));
+        star << QPointF(pixels/2+r*std::cos(theta),
+                        pixels/2+r*std::sin(theta));
+      }
+    const QRectF smallclip(pixels*0.2, pixels*0.2, pixels*0.6, pixels*0.6);
+    bench("polygonClip", "star", npts, [&]()
+          {
+            QPolygonF out;
+            polygonClip(star, smallclip, out);
+          });
+  }
+
+  void benchLines(RandomGen& gen, int npts, int pixels)
+  {
+    // closed contour-like lines, each of 1000 points
+    const int perline = 1000;
+    const int nlines = std::max(npts/perline, 1);
+    std::vector<QPolygonF> lines;
+    for(int l=0; l<nlines; ++l)
+      {
+        const double cx = uniform(gen, 0, pixels);
+        const double cy = uniform(gen, 0, pixels);
+        const double r = uniform(gen, 0.05, 0.3)*pixels;
+        QPolygonF poly;
+        for(int i=0; i<=perline; ++i)
+          {
+            const double theta = 2*M_PI*i/perline;
+            poly << QPointF(cx+r*std::cos(theta), cy+r*std::sin(theta));
+          }
+        lines.push_back(poly);
+      }
+    bench("LineLabeller::process", "circles", (long long)(nlines)*perline,
+          [&]()
+          {
+            LineLabeller labeller(QRectF(0, 0, pixels, pixels), true);
+            for(auto const& poly : lines)
+              labeller.addLine(poly, QSizeF(40, 12));
+            labeller.process();
+          });
+
+    // noisy sine curve to fit with beziers
+    std::vector<QPointF> data(npts);
+    for(int i=0; i<npts; ++i)
+      data[i] = QPointF(i*double(pixels)/npts,
+                        pixels/2*(1+0.8*std::sin(i*20.0/npts)) +
+                        uniform(gen, -1, 1));
+    const unsigned maxbez = std::max(npts/4, 1);
+    std::vector<QPointF> bezier(4*maxbez);
+    bench("sp_bezier_fit_cubic_r", "sine", npts, [&]()
+          {
+            sp_bezier_fit_cubic_r(bezier.data(), data.data(), npts, 0.5,
+                                  maxbez);
+          });
+
+    // data for binning and smoothing
+    std::vector<double> vals(npts);
+    for(int i=0; i<npts; ++i)
+      vals[i] = i%1000 == 0 ? NAN : uniform(gen, 0, 1);
+    PyObject* valarr = makeArray(vals);
+    {
+      const Numpy1DObj v(valarr);
+      int nout;
+      double* out;
+      bench("binData", "10", npts, [&]()
+            {
+              binData(v, 10, true, &nout, &out);
+              delete[] out;
+            });
+      bench("rollingAverage", "50", npts, [&]()
+            {
+              rollingAverage(v, 0, 50, &nout, &out);
+              delete[] out;
+            });
+    }
+    Py_DECREF(valarr);
+  }
+
+  void benchContours(int grid)
+  {
+    PyObject* cntrmod = PyImport_ImportModule("_nc_cntr");
+    if( cntrmod == 0 )
+      {
+        PyErr_Print();
+        std::exit(1);
+      }
+
+    std::vector<double> xs, ys, zs;
+    for(int j=0; j<grid; ++j)
+      for(int i=0; i<grid; ++i)
+        {
+          const double x = i*10./grid, y = j*10./grid;
+          xs.push_back(x);
+          ys.push_back(y);
+          zs.push_back(std::sin(x)*std::cos(y*1.3) + 0.1*std::sin(x*y));
+        }
+    PyObject* xarr = makeArray(xs, grid, grid);
+    PyObject* yarr = makeArray(ys, grid, grid);
+    PyObject* zarr = makeArray(zs, grid, grid);
+    PyObject* cntr = PyObject_CallMethod(cntrmod, "Cntr", "OOO",
+                                         xarr, yarr, zarr);
+    if( cntr == 0 )
+      {
+        PyErr_Print();
+        std::exit(1);
+      }
+
+    // each call traces one level with cntr_trace
+    const long long npts = (long long)(grid)*grid;
+    auto trace = [&](double l1, double l2)
+      {
+        for(int i=0; i<10; ++i)
+          {
+            PyObject* res = PyObject_CallMethod(cntr, "trace", "dd",
+                                                -0.9+0.18*i+l1,
+                                                -0.9+0.18*i+l2);
+            if( res == 0 )
+              {
+                PyErr_Print();
+                std::exit(1);
+              }
+            Py_DECREF(res);
+          }
+      };
+    bench("cntr_trace", "lines", npts, [&]() { trace(0, -1e100); });
+    bench("cntr_trace", "filled", npts, [&]() { trace(0, 0.18); });
+
+    // the same lines traced in one call, in one thread
+    std::vector<double> levels;
+    for(int i=0; i<10; ++i)
+      levels.push_back(-0.9+0.18*i);
+    PyObject* levelarr = makeArray(levels);
+    PyObject* args = Py_BuildValue("(O)", levelarr);
+    PyObject* kwds = Py_BuildValue("{s:i}", "nthreads", 1);
+    PyObject* tracelevels = PyObject_GetAttrString(cntr, "trace_levels");
+    if( args == 0 || kwds == 0 || tracelevels == 0 )
+      {
+        PyErr_Print();
+        std::exit(1);
+      }
+    bench("cntr_trace", "levels", npts, [&]()
+          {
+            PyObject* res = PyObject_Call(tracelevels, args, kwds);
+            if( res == 0 )
+              {
+                PyErr_Print();
+                std::exit(1);
+              }
+            Py_DECREF(res);
+          });
+    Py_DECREF(tracelevels);
+    Py_DECREF(kwds);
+    Py_DECREF(args);
+    Py_DECREF(levelarr);
+
+    Py_DECREF(cntr);
+    Py_DECREF(zarr);
+    Py_DECREF(yarr);
+    Py_DECREF(xarr);
+    Py_DECREF(cntrmod);
+  }
+
+  // draw a plot-like set of items into painter
+  void drawPlot(QPainter& painter, const QPolygonF& walk,
+                const std::vector<QPointF>& pts, int pixels)
+  {
+    painter.setPen(QPen(Qt::blue, 1.5));
+    painter.drawPolyline(walk);
+
+    QPainterPath marker;
+    marker.addEllipse(QRectF(-3, -3, 6, 6));
+    painter.setPen(QPen(Qt::black, 0.5));
+    painter.setBrush(Qt::red);
+    for(auto const& pt : pts)
+      painter.drawPath(marker.translated(pt));
+
+    painter.setPen(Qt::black);
+    for(int i=0; i<=10; ++i)
+      {
+        const double x = i*pixels/10.;
+        painter.drawLine(QPointF(x, pixels-10), QPointF(x, pixels));
+        painter.drawText(QPointF(x, pixels-12), QString::number(i));
+      }
+  }
+
+  void benchRecording(RandomGen& gen, int npts, int pixels)
+  {
+    const QPolygonF walk(makeWalk(gen, npts, pixels));
+    std::vector<QPointF> pts(std::max(npts/10, 1));
+    for(auto& pt : pts)
+      pt = QPointF(uniform(gen, 0, pixels), uniform(gen, 0, pixels));
+    const long long nitems = walk.size() + pts.size();
+
+    bench("RecordPaintDevice", "record", nitems, [&]()
+          {
+            RecordPaintDevice dev(pixels, pixels, 96, 96);
+            QPainter painter(&dev);
+            drawPlot(painter, walk, pts, pixels);
+          });
+
+    RecordPaintDevice dev(pixels, pixels, 96, 96);
+    {
+      QPainter painter(&dev);
+      drawPlot(painter, walk, pts, pixels);
+    }
+
+    QImage img(makeImage(pixels));
+    bench("RecordPaintDevice", "play", nitems, [&]()
+          {
+            QPainter painter(&img);
+            painter.setRenderHint(QPainter::Antialiasing);
+            dev.play(painter);
+          });
+    bench("RecordPaintDevice", "playTiled", nitems, [&]()
+          {
+            dev.playTiled(img, QPainter::Antialiasing, 256);
+          });
+  }
+
+  // write string as a JSON string
+  void printJSONString(const std::string& s)
+  {
+    std::putchar('"');
+    for(char c : s)
+      {
+        if( c == '"' || c == '\\' )
+          std::putchar('\\');
+        std::putchar(c);
+      }
+    std::putchar('"');
+  }
+
+  void printResults(int npts, int pixels)
+  {
+    std::printf("{\n  \"repeats\": %u,\n  \"points\": %d,\n"
+                "  \"pixels\": %d,\n  \"units\": \"ms\",\n"
+                "  \"results\": [\n", repeats, npts, pixels);
+    for(size_t i=0; i<results.size(); ++i)
+      {
+        const Result& r = results[i];
+        std::printf("    {\"kernel\": ");
+        printJSONString(r.kernel);
+        std::printf(", \"variant\": ");
+        printJSONString(r.variant);
+        std::printf(", \"size\": %lld, \"repeats\": %u,"
+                    " \"mean\": %.4f, \"min\": %.4f}%s\n",
+                    r.size, r.repeats, r.mean, r.min,
+                    i+1 < results.size() ? "," : "");
+      }
+    std::printf("  ]\n}\n");
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  // draw without needing a display
+  if( qgetenv("QT_QPA_PLATFORM").isEmpty() )
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  // needed for drawing text and paths to a QImage
+  QGuiApplication app(argc, argv);
+
+  repeats = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 5;
+  const int npts = argc > 2 ? std::max(std::atoi(argv[2]), 10) : 100000;
+  const int pixels = argc > 3 ? std::max(std::atoi(argv[3]), 16) : 1000;
+
+  PyImport_AppendInittab("_nc_cntr", PyInit__nc_cntr);
+  Py_Initialize();
+  numpymod = PyImport_ImportModule("numpy");
+  if( numpymod == 0 )
+    {
+      PyErr_Print();
+      return 1;
+    }
+  do_numpy_init_package();
+
+  RandomGen gen(42);
+  try
+    {
+      benchImages(gen, pixels);
+      benchDrawing(gen, npts, pixels);
+      benchLines(gen, npts, pixels);
+      benchContours(pixels/2);
+      benchRecording(gen, npts, pixels);
+    }
+  catch( const char* msg )
+    {
+      std::fprintf(stderr, "Error: %s\n", msg);
+      return 1;
+    }
+
+  printResults(npts, pixels);
+
+  Py_DECREF(numpymod);
+  Py_Finalize();
+  return 0;
+}
@@ -0,0 +1,88 @@
+// -*-c++-*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Small threading helpers shared by the native helper modules
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// number of threads to use if requested is 0 (the number of cores)
+inline unsigned parallelNumThreads(unsigned requested=0)
+{
+  if(requested != 0)
+    return requested;
+  const unsigned n = std::thread::hardware_concurrency();
+  return n==0 ? 1 : n;
+}
+
+// is the current thread running tasks for parallelFor?
+inline bool& parallelInTask()
+{
+  static thread_local bool intask = false;
+  return intask;
+}
+
+// Call func(i) for i in 0..ntasks-1 using up to nthreads threads
+// (including the calling thread). Each thread takes the next task
+// from a shared counter, so tasks of uneven size balance
+// themselves. func must be safe to call concurrently for different
+// i and must not throw. Calls made from inside a task run serially,
+// so that nested loops do not multiply the number of threads.
+template<class Func> void parallelFor(unsigned ntasks, unsigned nthreads,
+                                      Func func)
+{
+  nthreads = std::min(nthreads, ntasks);
+  if(nthreads <= 1 || parallelInTask())
+    {
+      for(unsigned i=0; i<ntasks; ++i)
+        func(i);
+      return;
+    }
+
+  std::atomic<unsigned> next(0);
+  auto worker = [&]()
+    {
+      const bool oldintask = parallelInTask();
+      parallelInTask() = true;
+      for(;;)
+        {
+          const unsigned i = next++;
+          if(i >= ntasks)
+            break;
+          func(i);
+        }
+      parallelInTask() = oldintask;
+    };
+
+  std::vector<std::thread> threads;
+  threads.reserve(nthreads-1);
+  for(unsigned t=1; t<nthreads; ++t)
+    threads.push_back(std::thread(worker));
+  worker();
+  for(auto& t : threads)
+    t.join();
+}
+
+#endif
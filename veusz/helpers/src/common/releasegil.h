@@ -1,4 +1,6 @@
-//    Copyright (C) 2011 Jeremy S. Sanders
+// -*-c++-*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
 //    Email: Jeremy Sanders <jeremy@jeremysanders.net>
 //
 //    This program is free software; you can redistribute it and/or modify
@@ -16,16 +18,30 @@
 //    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 /////////////////////////////////////////////////////////////////////////////
 
-#ifndef PAINTELEMENT_H
-#define PAINTELEMENT_H
+#ifndef RELEASEGIL_H
+#define RELEASEGIL_H
 
-class QPainter;
-class QTransform;
+#include <Python.h>
 
-class PaintElement {
-public:
-  virtual ~PaintElement() {};
-  virtual void paint(QPainter& painter, const QTransform& origtransform) = 0;
-};
+// Call func() with the GIL released, so that other Python threads
+// can run while it works. func must not use Python objects (inputs
+// should be converted before calling). As exceptions cannot be
+// thrown across the release, a const char* thrown by func is
+// returned once the GIL is held again, otherwise 0 is returned.
+template<class Func> const char* callWithoutGIL(Func func)
+{
+  const char* errmsg = 0;
+  Py_BEGIN_ALLOW_THREADS
+  try
+    {
+      func();
+    }
+  catch( const char *msg )
+    {
+      errmsg = msg;
+    }
+  Py_END_ALLOW_THREADS
+  return errmsg;
+}
 
 #endif
@@ -0,0 +1,195 @@
+// -*-c++-*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef TRACING_H
+#define TRACING_H
+
+// Timers and counters for the hot paths of the native helper modules
+//
+// These are only compiled in if VEUSZ_TRACING is defined (see the
+// --enable-tracing option of build_ext), otherwise the macros below
+// do nothing and their arguments are not evaluated.
+//
+//   TRACE_SCOPE("module.stage") times the rest of the enclosing block
+//   TRACE_COUNT("module.items", n) adds n to a counter
+//
+// Each named stat keeps a count (the number of scopes timed, or the
+// total of the counter) and the total time spent in its scopes. If
+// recording is switched on, each timed scope is also kept as an
+// event, which can be written as a Chrome trace by
+// veusz.utils.tracing. Each module has its own stats, which are read
+// through the functions in tracingpy.h.
+
+#ifdef VEUSZ_TRACING
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+extern "C" __declspec(dllimport) unsigned long __stdcall
+GetCurrentThreadId(void);
+#else
+#include <pthread.h>
+#endif
+
+// maximum number of events recorded before dropping them
+#define TRACE_MAX_EVENTS (1<<20)
+
+struct TraceStat
+{
+  TraceStat(const std::string& _name) : name(_name), count(0), nanosecs(0)
+  {
+  }
+
+  const std::string name;
+  std::atomic<unsigned long long> count;
+  std::atomic<long long> nanosecs;
+};
+
+struct TraceEvent
+{
+  const TraceStat* stat;
+  unsigned long tid;
+  long long start, duration;
+};
+
+class TraceRegistry
+{
+public:
+  TraceRegistry() : recording(false), ndropped(0)
+  {
+  }
+
+  // the registry of this module
+  static TraceRegistry& instance()
+  {
+    static TraceRegistry reg;
+    return reg;
+  }
+
+  // id of the current thread (the same as given by Python)
+  static unsigned long threadId()
+  {
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#else
+    return (unsigned long) pthread_self();
+#endif
+  }
+
+  // monotonic time in nanoseconds
+  static long long now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // get stat with name, making it if necessary (the reference stays
+  // valid, so can be kept)
+  TraceStat& stat(const char* name)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<TraceStat>& s = stats[name];
+    if( !s )
+      s.reset(new TraceStat(name));
+    return *s;
+  }
+
+  void addEvent(const TraceStat& s, long long start, long long duration)
+  {
+    const unsigned long tid = threadId();
+    std::lock_guard<std::mutex> lock(mutex);
+    if( events.size() < TRACE_MAX_EVENTS )
+      events.push_back(TraceEvent{&s, tid, start, duration});
+    else
+      ++ndropped;
+  }
+
+  // zero stats and remove any recorded events
+  void reset()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(auto& s : stats)
+      {
+        s.second->count = 0;
+        s.second->nanosecs = 0;
+      }
+    events.clear();
+    ndropped = 0;
+  }
+
+public:
+  std::atomic<bool> recording;
+  std::mutex mutex;
+  std::map< std::string, std::unique_ptr<TraceStat> > stats;
+  std::vector<TraceEvent> events;
+  unsigned long long ndropped;
+};
+
+// times its lifetime, adding it to the stat given
+class TraceTimer
+{
+public:
+  TraceTimer(TraceStat& _stat)
+    : stat(_stat), start(TraceRegistry::now())
+  {
+  }
+  ~TraceTimer()
+  {
+    const long long duration = TraceRegistry::now() - start;
+    ++stat.count;
+    stat.nanosecs += duration;
+    TraceRegistry& reg = TraceRegistry::instance();
+    if( reg.recording )
+      reg.addEvent(stat, start, duration);
+  }
+
+private:
+  TraceStat& stat;
+  const long long start;
+};
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+
+#define TRACE_SCOPE(name)                                               \
+  static TraceStat& TRACE_JOIN(_tracestat, __LINE__) =                  \
+    TraceRegistry::instance().stat(name);                               \
+  TraceTimer TRACE_JOIN(_tracetimer, __LINE__)(TRACE_JOIN(_tracestat, __LINE__))
+
+#define TRACE_COUNT(name, n)                                            \
+  do {                                                                  \
+    static TraceStat& _tracestat = TraceRegistry::instance().stat(name); \
+    _tracestat.count += (n);                                            \
+  } while(0)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_COUNT(name, n) do { } while(0)
+
+#endif
+
+#endif
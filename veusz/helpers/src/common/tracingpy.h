@@ -0,0 +1,108 @@
+// -*-c++-*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef TRACINGPY_H
+#define TRACINGPY_H
+
+#include <Python.h>
+#include "tracing.h"
+
+// Functions for the Python interface to the stats of each module
+// (which should be called with the GIL held)
+
+inline bool traceEnabled()
+{
+#ifdef VEUSZ_TRACING
+  return true;
+#else
+  return false;
+#endif
+}
+
+// dict of stat names to (count, total seconds)
+inline PyObject* traceStatsDict()
+{
+  PyObject* dict = PyDict_New();
+#ifdef VEUSZ_TRACING
+  TraceRegistry& reg = TraceRegistry::instance();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  for(const auto& s : reg.stats)
+    {
+      PyObject* val = Py_BuildValue("(Kd)", s.second->count.load(),
+                                    s.second->nanosecs.load()*1e-9);
+      PyDict_SetItemString(dict, s.first.c_str(), val);
+      Py_DECREF(val);
+    }
+  if( reg.ndropped > 0 )
+    {
+      PyObject* val = Py_BuildValue("(Kd)", reg.ndropped, 0.);
+      PyDict_SetItemString(dict, "trace.droppedevents", val);
+      Py_DECREF(val);
+    }
+#endif
+  return dict;
+}
+
+// list of recorded events, as (name, thread id, start, duration),
+// with times in microseconds
+inline PyObject* traceEventsList()
+{
+  PyObject* list = PyList_New(0);
+#ifdef VEUSZ_TRACING
+  TraceRegistry& reg = TraceRegistry::instance();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  for(const auto& e : reg.events)
+    {
+      PyObject* val = Py_BuildValue("(skdd)", e.stat->name.c_str(),
+                                    e.tid, e.start*1e-3, e.duration*1e-3);
+      PyList_Append(list, val);
+      Py_DECREF(val);
+    }
+#endif
+  return list;
+}
+
+// current time of the clock used for events, in microseconds
+inline double traceClock()
+{
+#ifdef VEUSZ_TRACING
+  return TraceRegistry::now()*1e-3;
+#else
+  return 0;
+#endif
+}
+
+inline void traceSetRecording(bool on)
+{
+#ifdef VEUSZ_TRACING
+  TraceRegistry::instance().recording = on;
+#else
+  (void)on;
+#endif
+}
+
+inline void traceReset()
+{
+#ifdef VEUSZ_TRACING
+  TraceRegistry::instance().reset();
+#endif
+}
+
+#endif
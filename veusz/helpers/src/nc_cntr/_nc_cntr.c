@@ -66,8 +66,10 @@ Agreement.
 
 #include <Python.h>
 #include "structmember.h"
+#include "pythread.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
 
@@ -1454,30 +1456,90 @@ build_cntr_list_v2(long *np, double *xp, double *yp, int nparts, long ntotal)
     return NULL;
 }
 
+/* Build a tuple (XY, offsets), where XY is a 2-D array, shape (N,2),
+   of the points of all the curves, and offsets is a 1-D array of
+   nparts+1 indices into XY of the start of each curve, followed by N.
+   Curve i is XY[offsets[i]:offsets[i+1]].
+*/
+static PyObject *
+build_cntr_flat(long *np, double *xp, double *yp, int nparts)
+{
+    PyArrayObject *xyv, *offv;
+    npy_intp dims[2];
+    double *data;
+    npy_intp *offsets;
+    long i, j, k;
+
+    dims[0] = nparts+1;
+    offv = (PyArrayObject *) PyArray_SimpleNew(1, dims, NPY_INTP);
+    if (offv == NULL) return NULL;
+    offsets = (npy_intp*)PyArray_DATA(offv);
+    offsets[0] = 0;
+    for (i = 0; i < nparts; i++)
+        offsets[i+1] = offsets[i] + np[i];
+
+    /* the number of points written, which may be fewer than the
+       number counted in the first pass of tracing */
+    dims[0] = offsets[nparts];
+    dims[1] = 2;
+    xyv = (PyArrayObject *) PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+    if (xyv == NULL)
+    {
+        Py_DECREF(offv);
+        return NULL;
+    }
+    data = (double*)PyArray_DATA(xyv);
+    for (j = 0, k = 0; j < dims[0]; j++)
+    {
+        data[k++] = xp[j];
+        data[k++] = yp[j];
+    }
 
+    return Py_BuildValue("(NN)", xyv, offv);
+}
 
-/* cntr_trace is called once per contour level or level pair.
-   If nlevels is 1, a set of contour lines will be returned; if nlevels
-   is 2, the set of polygons bounded by the levels will be returned.
-   If points is True, the lines will be returned as a list of list
-   of points; otherwise, as a list of tuples of vectors.
+/* The points of the curves traced for a level or level pair.
+   This is filled without using the Python API (or holding the GIL),
+   so can be made in other threads.
 */
+typedef struct
+{
+    double *xp, *yp;            /* points of all the curves */
+    long *nseg;                 /* number of points in each curve */
+    long nparts, ntotal;        /* number of curves and points */
+    int err;                    /* one of the TRACE_ values below */
+} Ctrace;
 
-static PyObject *
-cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
+#define TRACE_OK        0
+#define TRACE_NOMEM     1
+#define TRACE_OVERFLOW  2
+#define TRACE_NEGATIVE  3
+
+static void
+free_trace(Ctrace *res)
 {
-    PyObject *c_list;
-    double *xp0;
-    double *yp0;
-    long *nseg0;
-    int iseg;
+    free(res->xp); free(res->yp); free(res->nseg);
+    res->xp = res->yp = NULL;
+    res->nseg = NULL;
+}
 
-    /* long nchunk = 30; was hardwired */
+/* trace the curves for a level, or pair of levels if nlevels is 2,
+   into res, returning the TRACE_ error value */
+static int
+trace_curves(Csite *site, const double levels[], int nlevels, long nchunk,
+             Ctrace *res)
+{
     long n;
     long nparts = 0;
     long ntotal = 0;
     long nparts2 = 0;
     long ntotal2 = 0;
+    long iseg;
+
+    res->xp = res->yp = NULL;
+    res->nseg = NULL;
+    res->nparts = res->ntotal = 0;
+    res->err = TRACE_OK;
 
     site->zlevel[0] = levels[0];
     site->zlevel[1] = levels[0];
@@ -1505,34 +1567,33 @@ cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
             ntotal -= n;
         }
     }
-    xp0 = (double *) PyMem_Malloc(ntotal * sizeof(double));
-    yp0 = (double *) PyMem_Malloc(ntotal * sizeof(double));
-    nseg0 = (long *) PyMem_Malloc(nparts * sizeof(long));
-    if (xp0 == NULL || yp0 == NULL || nseg0 == NULL)
+    /* allocate at least one item, as malloc(0) may return NULL */
+    res->xp = (double *) malloc((ntotal+1) * sizeof(double));
+    res->yp = (double *) malloc((ntotal+1) * sizeof(double));
+    res->nseg = (long *) malloc((nparts+1) * sizeof(long));
+    if (res->xp == NULL || res->yp == NULL || res->nseg == NULL)
     {
-	PyErr_NoMemory();
-	goto error;
+        res->err = TRACE_NOMEM;
+        goto error;
     }
 
     /* second pass */
-    site->xcp = xp0;
-    site->ycp = yp0;
+    site->xcp = res->xp;
+    site->ycp = res->yp;
     iseg = 0;
     for (;;iseg++)
     {
         n = curve_tracer (site, 1);
-        if (ntotal2 + n > ntotal)
+        if (ntotal2 + n > ntotal || (n > 0 && nparts2 >= nparts))
         {
-            PyErr_SetString(PyExc_RuntimeError,
-                "curve_tracer: ntotal2, pass 2 exceeds ntotal, pass 1");
+            res->err = TRACE_OVERFLOW;
             goto error;
         }
         if (n == 0)
             break;
         if (n > 0)
         {
-            /* could add array bounds checking */
-            nseg0[iseg] = n;
+            res->nseg[iseg] = n;
             site->xcp += n;
             site->ycp += n;
             ntotal2 += n;
@@ -1540,29 +1601,667 @@ cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
         }
         else
         {
-            PyErr_SetString(PyExc_RuntimeError,
-                "Negative n from curve_tracer in pass 2");
+            res->err = TRACE_NEGATIVE;
             goto error;
         }
     }
 
+    res->nparts = nparts;
+    res->ntotal = ntotal;
+    site->xcp = NULL; site->ycp = NULL;
+    return TRACE_OK;
+
+    error:
+    free_trace(res);
+    site->xcp = NULL; site->ycp = NULL;
+    return res->err;
+}
 
-    if (points)
+/* make the Python list of curves from a trace, or set an exception
+   and return NULL if tracing failed */
+static PyObject *
+build_trace_list(Ctrace *res, int points, int flat)
+{
+    switch (res->err)
     {
-        c_list = build_cntr_list_p(nseg0, xp0, yp0, nparts, ntotal);
+    case TRACE_OK:
+        break;
+    case TRACE_NOMEM:
+        return PyErr_NoMemory();
+    case TRACE_OVERFLOW:
+        PyErr_SetString(PyExc_RuntimeError,
+            "curve_tracer: ntotal2, pass 2 exceeds ntotal, pass 1");
+        return NULL;
+    default:
+        PyErr_SetString(PyExc_RuntimeError,
+            "Negative n from curve_tracer in pass 2");
+        return NULL;
+    }
+
+    if (flat)
+    {
+        return build_cntr_flat(res->nseg, res->xp, res->yp, res->nparts);
+    }
+    else if (points)
+    {
+        return build_cntr_list_p(res->nseg, res->xp, res->yp,
+                                 res->nparts, res->ntotal);
     }
     else
     {
-        c_list = build_cntr_list_v2(nseg0, xp0, yp0, nparts, ntotal);
+        return build_cntr_list_v2(res->nseg, res->xp, res->yp,
+                                  res->nparts, res->ntotal);
     }
-    PyMem_Free(xp0); PyMem_Free(yp0); PyMem_Free(nseg0);
-    site->xcp = NULL; site->ycp = NULL;
+}
+
+/******* Tracing of contouring.************/
+
+/* Counters and timers for tracing how long contouring takes, like
+   those given by helpers/src/common/tracing.h for the C++ modules.
+   They are only compiled in if VEUSZ_TRACING is defined, and are
+   only changed with the GIL held.
+*/
+
+enum { STAT_TRACE, STAT_TRACE_LEVELS, STAT_LEVELS, STAT_CURVES,
+       STAT_POINTS, NUM_STATS };
+
+#ifdef VEUSZ_TRACING
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+typedef struct
+{
+    const char *name;
+    unsigned long long count;
+    double secs;
+} Cstat;
+
+typedef struct
+{
+    int stat;
+    unsigned long tid;
+    double start, duration;     /* microseconds */
+} Cevent;
+
+static Cstat trace_stats[NUM_STATS] = {
+    {"cntr.trace", 0, 0.}, {"cntr.trace_levels", 0, 0.},
+    {"cntr.levels", 0, 0.}, {"cntr.curves", 0, 0.},
+    {"cntr.points", 0, 0.}
+};
+
+/* maximum number of events recorded, as in tracing.h */
+#define TRACE_MAX_EVENTS (1<<20)
+
+static int trace_recording = 0;
+static Cevent *trace_events = NULL;
+static long trace_nevents = 0, trace_maxevents = 0;
+
+/* monotonic time in microseconds, from the same clock as the C++
+   modules use */
+static double
+trace_clock(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e6 + ts.tv_nsec*1e-3;
+#endif
+}
+
+/* add time since start to stat, recording an event if enabled */
+static void
+trace_add_time(int stat, double start)
+{
+    double duration = trace_clock() - start;
+    trace_stats[stat].count++;
+    trace_stats[stat].secs += duration*1e-6;
+
+    if (!trace_recording || trace_nevents >= TRACE_MAX_EVENTS)
+        return;
+    if (trace_nevents == trace_maxevents)
+    {
+        long newmax = trace_maxevents == 0 ? 1024 : trace_maxevents*2;
+        Cevent *newevents = (Cevent *) PyMem_Realloc(
+            trace_events, sizeof(Cevent) * newmax);
+        if (newevents == NULL)
+            return;
+        trace_events = newevents;
+        trace_maxevents = newmax;
+    }
+    trace_events[trace_nevents].stat = stat;
+    trace_events[trace_nevents].tid = PyThread_get_thread_ident();
+    trace_events[trace_nevents].start = start;
+    trace_events[trace_nevents].duration = duration;
+    trace_nevents++;
+}
+
+/* add the curves and points of a traced level to the counters */
+static void
+trace_add_result(const Ctrace *res)
+{
+    trace_stats[STAT_LEVELS].count++;
+    trace_stats[STAT_CURVES].count += res->nparts;
+    trace_stats[STAT_POINTS].count += res->ntotal;
+}
+
+#define TRACE_C_START(var) double var = trace_clock()
+#define TRACE_C_TIME(stat, var) trace_add_time(stat, var)
+#define TRACE_C_RESULT(res) trace_add_result(res)
+
+#else
+
+#define TRACE_C_START(var) int var = 0
+#define TRACE_C_TIME(stat, var) (void) var
+#define TRACE_C_RESULT(res)
+
+#endif
+
+/* the trace functions of the module, as given by tracingpy.h in the
+   C++ modules */
+
+static PyObject *
+module_traceEnabled(PyObject *self, PyObject *args)
+{
+#ifdef VEUSZ_TRACING
+    Py_RETURN_TRUE;
+#else
+    Py_RETURN_FALSE;
+#endif
+}
+
+static PyObject *
+module_traceStats(PyObject *self, PyObject *args)
+{
+    PyObject *dict = PyDict_New();
+#ifdef VEUSZ_TRACING
+    int i;
+    for (i = 0; dict != NULL && i < NUM_STATS; i++)
+    {
+        PyObject *val = Py_BuildValue("(Kd)", trace_stats[i].count,
+                                      trace_stats[i].secs);
+        if (val == NULL ||
+            PyDict_SetItemString(dict, trace_stats[i].name, val))
+        {
+            Py_XDECREF(val);
+            Py_DECREF(dict);
+            return NULL;
+        }
+        Py_DECREF(val);
+    }
+#endif
+    return dict;
+}
+
+static PyObject *
+module_traceEvents(PyObject *self, PyObject *args)
+{
+    PyObject *list = PyList_New(0);
+#ifdef VEUSZ_TRACING
+    long i;
+    for (i = 0; list != NULL && i < trace_nevents; i++)
+    {
+        const Cevent *e = &trace_events[i];
+        PyObject *val = Py_BuildValue("(skdd)", trace_stats[e->stat].name,
+                                      e->tid, e->start, e->duration);
+        if (val == NULL || PyList_Append(list, val))
+        {
+            Py_XDECREF(val);
+            Py_DECREF(list);
+            return NULL;
+        }
+        Py_DECREF(val);
+    }
+#endif
+    return list;
+}
+
+static PyObject *
+module_traceClock(PyObject *self, PyObject *args)
+{
+#ifdef VEUSZ_TRACING
+    return PyFloat_FromDouble(trace_clock());
+#else
+    return PyFloat_FromDouble(0.);
+#endif
+}
+
+static PyObject *
+module_traceSetRecording(PyObject *self, PyObject *args)
+{
+    int on;
+    if (!PyArg_ParseTuple(args, "p", &on))
+        return NULL;
+#ifdef VEUSZ_TRACING
+    trace_recording = on;
+#endif
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+module_traceReset(PyObject *self, PyObject *args)
+{
+#ifdef VEUSZ_TRACING
+    int i;
+    for (i = 0; i < NUM_STATS; i++)
+    {
+        trace_stats[i].count = 0;
+        trace_stats[i].secs = 0.;
+    }
+    PyMem_Free(trace_events);
+    trace_events = NULL;
+    trace_nevents = trace_maxevents = 0;
+#endif
+    Py_RETURN_NONE;
+}
+
+/* cntr_trace is called once per contour level or level pair.
+   If nlevels is 1, a set of contour lines will be returned; if nlevels
+   is 2, the set of polygons bounded by the levels will be returned.
+   If points is True, the lines will be returned as a list of list
+   of points; otherwise, as a list of tuples of vectors.
+   If flat is True, all the lines are returned in a single array of
+   points, with an array of the offsets of each line.
+*/
+
+static PyObject *
+cntr_trace(Csite *site, double levels[], int nlevels, int points,
+           int flat, long nchunk)
+{
+    PyObject *c_list;
+    Ctrace res;
+    TRACE_C_START(tstart);
+
+    /* long nchunk = 30; was hardwired */
+    Py_BEGIN_ALLOW_THREADS
+    trace_curves(site, levels, nlevels, nchunk, &res);
+    Py_END_ALLOW_THREADS
+    TRACE_C_RESULT(&res);
+    c_list = build_trace_list(&res, points, flat);
+    free_trace(&res);
+    TRACE_C_TIME(STAT_TRACE, tstart);
     return c_list;
+}
 
-    error:
-    PyMem_Free(xp0); PyMem_Free(yp0); PyMem_Free(nseg0);
-    site->xcp = NULL; site->ycp = NULL;
-    return NULL;
+/* Tracing many levels at once, in several threads.
+
+   Each thread has its own copy of the mesh sized data and
+   triangulation arrays, and shares the read-only coordinates, values
+   and region array. Saddle zones are decided by the first level
+   traced through them, and the decision is kept in the triangulation
+   array for later levels, so that the contours of different levels
+   do not cross. To give the same result as calling trace for each
+   level in turn, the levels are split into groups which do not share
+   a saddle zone. Threads take the next group from a shared counter,
+   and trace its levels in order, starting with the triangulation of
+   the Cntr. The decisions made are copied back into the Cntr when all
+   the threads have finished.
+*/
+typedef struct
+{
+    const Csite *mesh;          /* site with the mesh to trace */
+    const double *levels;
+    long ntasks;                /* number of levels or level pairs */
+    int filled;                 /* tasks are pairs of adjacent levels */
+    long nchunk;
+    long ngroups;               /* number of groups of tasks */
+    long *groups;               /* first task of each group, and ntasks */
+    long next;                  /* next group to do, protected by lock */
+    PyThread_type_lock lock;
+    Ctrace *results;            /* result for each task */
+} Cbatch;
+
+typedef struct
+{
+    Cbatch *batch;
+    short *triangle;            /* triangulation of this worker */
+    PyThread_type_lock done;    /* released when worker is finished */
+} Cworker;
+
+/* first index in the sorted vals with vals[i] >= v */
+static long
+batch_lower_bound(const double vals[], long n, double v)
+{
+    long lo = 0, hi = n;
+    while (lo < hi)
+    {
+        long mid = lo + (hi - lo) / 2;
+        if (vals[mid] < v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Split the tasks of batch into groups, so that no zone can be a
+   saddle zone in tasks of two groups. A zone is a saddle zone at
+   level L if one pair of diagonally opposite corners is above L and
+   the other is not, so for L in [lo, hi). Values which are not above
+   any level (NaN) are taken as -inf. If the levels are not sorted, or
+   there is no memory, all tasks are in one group. */
+static void
+batch_make_groups(Cbatch *batch)
+{
+    const Csite *mesh = batch->mesh;
+    const double *z = mesh->z;
+    long imax = mesh->imax;
+    long jmax = mesh->jmax;
+    long ntasks = batch->ntasks;
+    long nlev = batch->filled ? ntasks+1 : ntasks;
+    double *tmin = NULL, *tmax = NULL;
+    long *cross = NULL;
+    long i, j, t, n;
+
+    batch->ngroups = ntasks > 0 ? 1 : 0;
+    batch->groups[0] = 0;
+    batch->groups[batch->ngroups] = ntasks;
+    if (ntasks < 2)
+        return;
+    for (i = 1; i < nlev; i++)
+        if (!(batch->levels[i] >= batch->levels[i-1]))
+            return;
+
+    /* range of levels traced by each task, both sorted */
+    tmin = (double *) malloc(sizeof(double) * ntasks);
+    tmax = (double *) malloc(sizeof(double) * ntasks);
+    cross = (long *) calloc(ntasks+1, sizeof(long));
+    if (tmin == NULL || tmax == NULL || cross == NULL)
+        goto finish;
+    for (t = 0; t < ntasks; t++)
+    {
+        tmin[t] = batch->levels[t];
+        tmax[t] = batch->filled ? batch->levels[t+1] : tmin[t];
+    }
+
+    /* count the zones whose saddle tasks span each pair of tasks */
+    for (j = 1; j < jmax; j++)
+        for (i = 1; i < imax; i++)
+        {
+            long ij = i + j * imax;
+            double c[4], lo, hi;
+            long first, last;
+            int k;
+
+            c[0] = z[ij - imax - 1];
+            c[1] = z[ij];
+            c[2] = z[ij - imax];
+            c[3] = z[ij - 1];
+            for (k = 0; k < 4; k++)
+                if (!(c[k] > -HUGE_VAL))
+                    c[k] = -HUGE_VAL;
+
+            /* corners 0 and 1 above, or corners 2 and 3 above */
+            lo = c[2] > c[3] ? c[2] : c[3];
+            hi = c[0] < c[1] ? c[0] : c[1];
+            if (!(lo < hi))
+            {
+                lo = c[0] > c[1] ? c[0] : c[1];
+                hi = c[2] < c[3] ? c[2] : c[3];
+                if (!(lo < hi))
+                    continue;
+            }
+
+            /* tasks with tmax >= lo and tmin < hi */
+            first = batch_lower_bound(tmax, ntasks, lo);
+            last = batch_lower_bound(tmin, ntasks, hi) - 1;
+            if (first < last)
+            {
+                cross[first]++;
+                cross[last]--;
+            }
+        }
+
+    /* split where no zone spans the boundary */
+    n = 1;
+    for (t = 0; t < ntasks-1; t++)
+    {
+        if (t > 0)
+            cross[t] += cross[t-1];
+        if (cross[t] == 0)
+            batch->groups[n++] = t+1;
+    }
+    batch->ngroups = n;
+    batch->groups[n] = ntasks;
+
+    finish:
+    free(tmin);
+    free(tmax);
+    free(cross);
+}
+
+static void
+batch_run(Cbatch *batch, short *triangle)
+{
+    const Csite *mesh = batch->mesh;
+    long nreg = mesh->imax * mesh->jmax + mesh->imax + 1;
+    Csite site = *mesh;
+    long group, task;
+
+    site.data = (Cdata *) malloc(sizeof(Cdata) * nreg);
+    site.triangle = triangle;
+
+    for (;;)
+    {
+        PyThread_acquire_lock(batch->lock, WAIT_LOCK);
+        group = batch->next++;
+        PyThread_release_lock(batch->lock);
+        if (group >= batch->ngroups)
+            break;
+
+        for (task = batch->groups[group]; task < batch->groups[group+1];
+             task++)
+        {
+            double levels[2];
+            int nlevels = 1;
+
+            if (site.data == NULL || site.triangle == NULL)
+            {
+                batch->results[task].err = TRACE_NOMEM;
+                continue;
+            }
+
+            levels[0] = batch->levels[task];
+            levels[1] = levels[0];
+            if (batch->filled)
+            {
+                levels[1] = batch->levels[task+1];
+                if (levels[1] > levels[0])
+                    nlevels = 2;
+            }
+
+            trace_curves(&site, levels, nlevels, batch->nchunk,
+                         &batch->results[task]);
+        }
+    }
+
+    free(site.data);
+}
+
+/* a copy of the triangulation of mesh, or NULL */
+static short *
+batch_copy_triangle(const Csite *mesh)
+{
+    long ijmax = mesh->imax * mesh->jmax;
+    short *triangle = (short *) malloc(sizeof(short) * ijmax);
+    if (triangle != NULL)
+        memcpy(triangle, mesh->triangle, sizeof(short) * ijmax);
+    return triangle;
+}
+
+/* copy the saddle decisions made in triangle into mesh */
+static void
+batch_merge_triangle(Csite *mesh, const short *triangle)
+{
+    long ijmax = mesh->imax * mesh->jmax;
+    long i;
+    if (triangle == NULL)
+        return;
+    for (i = 0; i < ijmax; i++)
+        if (triangle[i])
+            mesh->triangle[i] = triangle[i];
+}
+
+static void
+batch_worker(void *arg)
+{
+    Cworker *worker = (Cworker *) arg;
+    batch_run(worker->batch, worker->triangle);
+    PyThread_release_lock(worker->done);
+}
+
+/* number of threads to use by default (the number of cores) */
+static long
+default_num_threads(void)
+{
+    long n = 1;
+    PyObject *os = PyImport_ImportModule("os");
+    if (os != NULL)
+    {
+        PyObject *count = PyObject_CallMethod(os, "cpu_count", NULL);
+        if (count != NULL && count != Py_None)
+            n = PyLong_AsLong(count);
+        Py_XDECREF(count);
+        Py_DECREF(os);
+    }
+    PyErr_Clear();
+    return n < 1 ? 1 : n;
+}
+
+static PyObject *
+cntr_trace_levels(Csite *site, const double levels[], long nlevels,
+                  int filled, int points, int flat, long nchunk,
+                  long nthreads)
+{
+    Cbatch batch;
+    Cworker *workers = NULL;
+    short *triangle = NULL;
+    PyObject *all_levels = NULL;
+    long i, nworkers = 0;
+    TRACE_C_START(tstart);
+
+    batch.mesh = site;
+    batch.levels = levels;
+    batch.ntasks = filled ? nlevels-1 : nlevels;
+    batch.filled = filled;
+    batch.nchunk = nchunk;
+    batch.next = 0;
+    if (batch.ntasks < 0)
+        batch.ntasks = 0;
+
+    batch.results = (Ctrace *) PyMem_Malloc(
+        sizeof(Ctrace) * (batch.ntasks+1));
+    batch.groups = (long *) PyMem_Malloc(sizeof(long) * (batch.ntasks+1));
+    batch.lock = PyThread_allocate_lock();
+    for (i = 0; batch.results != NULL && i < batch.ntasks; i++)
+    {
+        batch.results[i].xp = batch.results[i].yp = NULL;
+        batch.results[i].nseg = NULL;
+        batch.results[i].err = TRACE_OK;
+    }
+    if (batch.results == NULL || batch.groups == NULL || batch.lock == NULL)
+    {
+        PyErr_NoMemory();
+        goto finish;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    batch_make_groups(&batch);
+    triangle = batch_copy_triangle(site);
+    Py_END_ALLOW_THREADS
+
+    /* start the other threads, this thread being the first worker */
+    if (nthreads <= 0)
+        nthreads = default_num_threads();
+    if (nthreads > batch.ngroups)
+        nthreads = batch.ngroups;
+    if (nthreads > 1)
+    {
+        workers = (Cworker *) PyMem_Malloc(sizeof(Cworker) * nthreads);
+        if (workers == NULL)
+        {
+            PyErr_NoMemory();
+            goto finish;
+        }
+        for (i = 1; i < nthreads; i++)
+        {
+            Cworker *w = &workers[nworkers];
+            w->batch = &batch;
+            w->triangle = batch_copy_triangle(site);
+            w->done = PyThread_allocate_lock();
+            if (w->triangle == NULL || w->done == NULL)
+            {
+                free(w->triangle);
+                if (w->done != NULL)
+                    PyThread_free_lock(w->done);
+                break;
+            }
+            PyThread_acquire_lock(w->done, WAIT_LOCK);
+            if (PyThread_start_new_thread(batch_worker, w) ==
+                (unsigned long) -1)
+            {
+                /* carry on with fewer threads */
+                PyThread_release_lock(w->done);
+                PyThread_free_lock(w->done);
+                free(w->triangle);
+                break;
+            }
+            nworkers++;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    batch_run(&batch, triangle);
+    batch_merge_triangle(site, triangle);
+    for (i = 0; i < nworkers; i++)
+    {
+        PyThread_acquire_lock(workers[i].done, WAIT_LOCK);
+        PyThread_release_lock(workers[i].done);
+        PyThread_free_lock(workers[i].done);
+        batch_merge_triangle(site, workers[i].triangle);
+        free(workers[i].triangle);
+    }
+    Py_END_ALLOW_THREADS
+
+    /* build the output for each level */
+    all_levels = PyList_New(batch.ntasks);
+    if (all_levels == NULL)
+        goto finish;
+    for (i = 0; i < batch.ntasks; i++)
+    {
+        PyObject *c_list;
+        TRACE_C_RESULT(&batch.results[i]);
+        c_list = build_trace_list(&batch.results[i], points, flat);
+        if (c_list == NULL || PyList_SetItem(all_levels, i, c_list))
+        {
+            Py_DECREF(all_levels);
+            all_levels = NULL;
+            goto finish;
+        }
+    }
+
+    finish:
+    if (batch.results != NULL)
+    {
+        for (i = 0; i < batch.ntasks; i++)
+            free_trace(&batch.results[i]);
+        PyMem_Free(batch.results);
+    }
+    if (batch.lock != NULL)
+        PyThread_free_lock(batch.lock);
+    PyMem_Free(batch.groups);
+    PyMem_Free(workers);
+    free(triangle);
+    TRACE_C_TIME(STAT_TRACE_LEVELS, tstart);
+    return all_levels;
 }
 
 /******* Make an extension type.  Based on the tutorial.************/
@@ -1571,13 +2270,29 @@ cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
    by xpa, ypa, zpa, and mpa, so we include them in the
    structure so we can ensure they are not deleted until
    we have finished using them.
+   As tracing is done without the GIL, lock is held while site is
+   used, so that it is not changed by another thread at the same time.
 */
 typedef struct {
     PyObject_HEAD
     PyArrayObject *xpa, *ypa, *zpa, *mpa;
     Csite *site;
+    PyThread_type_lock lock;
 } Cntr;
 
+/* acquire the lock of the Cntr, letting other threads run while
+   waiting for it */
+static void
+Cntr_lock(Cntr* self)
+{
+    if (!PyThread_acquire_lock(self->lock, NOWAIT_LOCK))
+    {
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(self->lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+}
+
 
 static int
 Cntr_clear(Cntr* self)
@@ -1608,6 +2323,8 @@ static void
 Cntr_dealloc(Cntr* self)
 {
     Cntr_clear(self);
+    if (self->lock != NULL)
+        PyThread_free_lock(self->lock);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -1619,6 +2336,7 @@ Cntr_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     self = (Cntr *)type->tp_alloc(type, 0);
     if (self != NULL)
     {
+        self->lock = NULL;
         self->site = cntr_new();
         if (self->site == NULL)
         {
@@ -1627,6 +2345,13 @@ Cntr_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
             Py_XDECREF(self);
             return NULL;
         }
+        self->lock = PyThread_allocate_lock();
+        if (self->lock == NULL)
+        {
+            PyErr_NoMemory();
+            Py_XDECREF(self);
+            return NULL;
+        }
         self->xpa = NULL;
         self->ypa = NULL;
         self->zpa = NULL;
@@ -1641,7 +2366,7 @@ Cntr_init(Cntr *self, PyObject *args, PyObject *kwds)
 {
     static char *kwlist[] = {"x", "y", "z", "mask", NULL};
     PyObject *xarg, *yarg, *zarg, *marg;
-    PyArrayObject *xpa, *ypa, *zpa, *mpa;
+    PyArrayObject *xpa, *ypa, *zpa, *mpa, *tmp;
     long iMax, jMax;
     char *mask;
 
@@ -1694,18 +2419,26 @@ Cntr_init(Cntr *self, PyObject *args, PyObject *kwds)
     }
     if (mpa) mask = PyArray_DATA(mpa);
     else     mask = NULL;
+    Cntr_lock(self);
     if ( cntr_init(self->site, iMax, jMax, (double *)PyArray_DATA(xpa),
 		   (double *)PyArray_DATA(ypa),
 		   (double *)PyArray_DATA(zpa), mask))
     {
+        PyThread_release_lock(self->lock);
         PyErr_SetString(PyExc_MemoryError,
             "Memory allocation failure in cntr_init");
         goto error;
     }
-    self->xpa = xpa;
-    self->ypa = ypa;
-    self->zpa = zpa;
-    self->mpa = mpa;
+    /* keep the new arrays, releasing any from before */
+    tmp = self->xpa; self->xpa = xpa; xpa = tmp;
+    tmp = self->ypa; self->ypa = ypa; ypa = tmp;
+    tmp = self->zpa; self->zpa = zpa; zpa = tmp;
+    tmp = self->mpa; self->mpa = mpa; mpa = tmp;
+    PyThread_release_lock(self->lock);
+    Py_XDECREF(xpa);
+    Py_XDECREF(ypa);
+    Py_XDECREF(zpa);
+    Py_XDECREF(mpa);
     return 0;
 
     error:
@@ -1720,19 +2453,71 @@ static PyObject *
 Cntr_trace(Cntr *self, PyObject *args, PyObject *kwds)
 {
     double levels[2] = {0.0, -1e100};
+    PyObject *result;
     int nlevels = 2;
     int points = 0;
     long nchunk = 0L;
-    static char *kwlist[] = {"level0", "level1", "points", "nchunk", NULL};
+    int flat = 0;
+    static char *kwlist[] = {"level0", "level1", "points", "nchunk",
+                             "flat", NULL};
 
-    if (! PyArg_ParseTupleAndKeywords(args, kwds, "d|dil", kwlist,
-                                      levels, levels+1, &points, &nchunk))
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "d|dili", kwlist,
+                                      levels, levels+1, &points, &nchunk,
+                                      &flat))
     {
         return NULL;
     }
     if (levels[1] == -1e100 || levels[1] <= levels[0])
         nlevels = 1;
-    return cntr_trace(self->site, levels, nlevels, points, nchunk);
+    if (self->site == NULL || self->site->z == NULL)
+    {
+        PyErr_SetString(PyExc_ValueError, "Cntr is not initialised");
+        return NULL;
+    }
+
+    Cntr_lock(self);
+    result = cntr_trace(self->site, levels, nlevels, points, flat, nchunk);
+    PyThread_release_lock(self->lock);
+    return result;
+}
+
+static PyObject *
+Cntr_trace_levels(Cntr *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *larg;
+    PyArrayObject *lpa;
+    PyObject *result;
+    int filled = 0;
+    int points = 0;
+    long nchunk = 0L;
+    long nthreads = 0L;
+    int flat = 0;
+    static char *kwlist[] = {"levels", "filled", "points", "nchunk",
+                             "nthreads", "flat", NULL};
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "O|iilli", kwlist,
+                                      &larg, &filled, &points, &nchunk,
+                                      &nthreads, &flat))
+    {
+        return NULL;
+    }
+    if (self->site == NULL || self->site->z == NULL)
+    {
+        PyErr_SetString(PyExc_ValueError, "Cntr is not initialised");
+        return NULL;
+    }
+
+    lpa = (PyArrayObject *) PyArray_ContiguousFromObject(larg, NPY_DOUBLE,
+                                                         1, 1);
+    if (lpa == NULL)
+        return NULL;
+    Cntr_lock(self);
+    result = cntr_trace_levels(self->site, (double *)PyArray_DATA(lpa),
+                               (long)PyArray_DIMS(lpa)[0], filled,
+                               points, flat, nchunk, nthreads);
+    PyThread_release_lock(self->lock);
+    Py_DECREF(lpa);
+    return result;
 }
 
 static PyMethodDef Cntr_methods[] = {
@@ -1746,6 +2531,22 @@ static PyMethodDef Cntr_methods[] = {
      "        vector pairs; otherwise, return a list of lists of points.\n"
      "    Optional argument: nchunk; approximate number of grid points\n"
      "        per chunk. 0 (default) for no chunking.\n"
+     "    Optional argument: flat; if nonzero, return a tuple (xy, offsets)\n"
+     "        instead, where xy is an (N,2) array of the points of all the\n"
+     "        lines, and line i is xy[offsets[i]:offsets[i+1]].\n"
+    },
+    {"trace_levels", (PyCFunction)Cntr_trace_levels,
+     METH_VARARGS | METH_KEYWORDS,
+     "Return a list of the results of trace for each of a set of levels,\n"
+     "traced in several threads. The result is the same as calling trace\n"
+     "for each level in turn.\n\n"
+     "    Required argument: levels, a 1D array of contour levels\n"
+     "    Optional argument: filled; if 0 (default), trace lines at each\n"
+     "        level; otherwise trace polygons between each pair of\n"
+     "        adjacent levels.\n"
+     "    Optional arguments: points, nchunk and flat, as for trace.\n"
+     "    Optional argument: nthreads; maximum number of threads to use,\n"
+     "        or 0 (default) for the number of cores.\n"
     },
     {NULL}  /* Sentinel */
 };
@@ -1792,6 +2593,19 @@ static PyTypeObject CntrType = {
 };
 
 static PyMethodDef module_methods[] = {
+  {"traceEnabled", module_traceEnabled, METH_NOARGS,
+   "Were timers and counters compiled into the module?"},
+  {"traceStats", module_traceStats, METH_NOARGS,
+   "Return dict of stat names to (count, total seconds)."},
+  {"traceEvents", module_traceEvents, METH_NOARGS,
+   "Return list of recorded events (name, thread id, start, duration),\n"
+   "with times in microseconds."},
+  {"traceClock", module_traceClock, METH_NOARGS,
+   "Return time of the clock used for events, in microseconds."},
+  {"traceSetRecording", module_traceSetRecording, METH_VARARGS,
+   "Set whether timed events are recorded."},
+  {"traceReset", module_traceReset, METH_NOARGS,
+   "Zero stats and remove recorded events."},
   {NULL}  /* Sentinel */
 };
 
@@ -96,9 +96,7 @@ static void estimate_bi(QPointF b[4], unsigned ei,
                         QPointF const data[], double const u[], unsigned len);
 static void reparameterize(QPointF const d[], unsigned len, double u[], BezierCurve const bezCurve);
 static double NewtonRaphsonRootFind(BezierCurve const Q, QPointF const &P, double u);
-static QPointF sp_darray_center_tangent(QPointF const d[], unsigned center, unsigned length);
 static QPointF sp_darray_right_tangent(QPointF const d[], unsigned const len);
-static unsigned copy_without_nans_or_adjacent_duplicates(QPointF const src[], unsigned src_len, QPointF dest[]);
 static void chord_length_parameterize(QPointF const d[], double u[], unsigned len);
 static double compute_max_error_ratio(QPointF const d[], double const u[], unsigned len,
                                       BezierCurve const bezCurve, double tolerance,
@@ -195,7 +193,7 @@ sp_bezier_fit_cubic_r(QPointF bezier[], QPointF const data[],
  * adjacent points with equal x and y.
  * \return length of dest
  */
-static unsigned
+unsigned
 copy_without_nans_or_adjacent_duplicates(QPointF const src[], unsigned src_len, QPointF dest[])
 {
   unsigned si = 0;
@@ -844,7 +842,7 @@ sp_darray_right_tangent(QPointF const d[], unsigned const len, double const tole
  * \pre (0 \< center \< len - 1) and d is uniqued (at least in 
  * the immediate vicinity of \a center).
  */
-static QPointF
+QPointF
 sp_darray_center_tangent(QPointF const d[],
                          unsigned const center,
                          unsigned const len)
@@ -43,6 +43,12 @@ QPointF sp_darray_left_tangent(QPointF const d[], unsigned const len,
 			       double const tolerance_sq);
 QPointF sp_darray_right_tangent(QPointF const d[], unsigned const length,
 				double const tolerance_sq);
+QPointF sp_darray_center_tangent(QPointF const d[], unsigned center,
+				 unsigned length);
+
+unsigned copy_without_nans_or_adjacent_duplicates(QPointF const src[],
+						  unsigned src_len,
+						  QPointF dest[]);
 
 
 #endif /* SP_BEZIERS_H */
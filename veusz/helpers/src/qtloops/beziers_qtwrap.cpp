@@ -16,8 +16,15 @@
 //    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 /////////////////////////////////////////////////////////////////////////////
 
+#include <cmath>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <vector>
+
 #include "beziers.h"
 #include "beziers_qtwrap.h"
+#include "parallel.h"
 
 QPolygonF bezier_fit_cubic_single( const QPolygonF& data, double error )
 {
@@ -49,3 +56,180 @@ QPolygonF bezier_fit_cubic_multi( const QPolygonF& data, double error,
     return QPolygonF();
 }
 
+namespace
+{
+  // inputs with more points than this are split into pieces of about
+  // this size to fit in parallel
+  const unsigned BEZIER_PIECE_POINTS = 1024;
+
+  // pieces are split at a corner if one is found in the last
+  // BEZIER_CORNER_SEARCH points before the piece becomes too long
+  const unsigned BEZIER_CORNER_SEARCH = 256;
+
+  // number of fits kept by bezier_fit_cubic_cached
+  const unsigned BEZIER_CACHE_SIZE = 16;
+
+  // points from start to end (inclusive) fitted with the tangents
+  // given at each end (zero if unconstrained)
+  struct BezierPiece
+  {
+    unsigned start, end;
+    QPointF tHat1, tHat2;
+  };
+
+  // cosine of the turn at point i of d (-1 for a reversal)
+  double turnCos(const QPointF* d, unsigned i)
+  {
+    const QPointF a = d[i]-d[i-1];
+    const QPointF b = d[i+1]-d[i];
+    return (a.x()*b.x() + a.y()*b.y()) /
+      std::sqrt((a.x()*a.x() + a.y()*a.y()) * (b.x()*b.x() + b.y()*b.y()));
+  }
+
+  // split uniqued data into pieces at most BEZIER_PIECE_POINTS long
+  // The sharpest turn near the end of a piece is chosen as its end,
+  // where the tangents are unconstrained if it is a corner (turning
+  // by more than 90 degrees). Otherwise the pieces meet smoothly,
+  // with the tangent at the join as sp_bezier_fit_cubic_full uses
+  // when it splits a curve.
+  std::vector<BezierPiece> splitBezierPieces(const QPointF* d, unsigned len)
+  {
+    std::vector<BezierPiece> pieces;
+    BezierPiece piece;
+    piece.start = 0;
+    piece.tHat1 = QPointF(0, 0);
+
+    while( len - piece.start > BEZIER_PIECE_POINTS )
+      {
+        const unsigned last = piece.start + BEZIER_PIECE_POINTS - 1;
+        unsigned split = last;
+        double splitcos = turnCos(d, last);
+        for(unsigned i = last-BEZIER_CORNER_SEARCH; i < last; ++i)
+          {
+            const double c = turnCos(d, i);
+            if( c < splitcos )
+              {
+                split = i;
+                splitcos = c;
+              }
+          }
+
+        piece.end = split;
+        QPointF tHat1;
+        if( splitcos < 0 )
+          {
+            // corner
+            piece.tHat2 = tHat1 = QPointF(0, 0);
+          }
+        else
+          {
+            piece.tHat2 = sp_darray_center_tangent(d, split, len);
+            tHat1 = -piece.tHat2;
+          }
+        pieces.push_back(piece);
+
+        piece.start = split;
+        piece.tHat1 = tHat1;
+      }
+
+    piece.end = len-1;
+    piece.tHat2 = QPointF(0, 0);
+    pieces.push_back(piece);
+    return pieces;
+  }
+
+  // 64 bit FNV-1a hash of the bytes of the points
+  quint64 hashPoints(const QPolygonF& data)
+  {
+    const unsigned char* p =
+      reinterpret_cast<const unsigned char*>(data.constData());
+    const size_t n = size_t(data.size())*sizeof(QPointF);
+    quint64 h = 14695981039346656037ULL;
+    for(size_t i=0; i<n; ++i)
+      h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+  }
+
+  // recently fitted curves, most recent first
+  struct BezierCacheEntry
+  {
+    quint64 hash;
+    double error;
+    QPolygonF data, fit;
+  };
+  std::list<BezierCacheEntry> bezierCache;
+  std::mutex bezierCacheMutex;
+}
+
+QPolygonF bezier_fit_cubic_parallel(const QPolygonF& data, double error)
+{
+  if( data.isEmpty() )
+    return QPolygonF();
+
+  QPolygonF uniqued(data.size());
+  const unsigned len = copy_without_nans_or_adjacent_duplicates(
+    data.constData(), data.size(), uniqued.data());
+  if( len < 2 )
+    return QPolygonF();
+
+  // short inputs are fitted as by bezier_fit_cubic_multi
+  const std::vector<BezierPiece> pieces =
+    splitBezierPieces(uniqued.constData(), len);
+
+  std::vector<QPolygonF> fits(pieces.size());
+  std::vector<int> nsegs(pieces.size());
+  parallelFor(pieces.size(), parallelNumThreads(), [&](unsigned i)
+    {
+      const BezierPiece& piece = pieces[i];
+      const unsigned plen = piece.end - piece.start + 1;
+      fits[i].resize(4*(plen+1));
+      nsegs[i] = sp_bezier_fit_cubic_full(
+        fits[i].data(), NULL, uniqued.constData()+piece.start, plen,
+        piece.tHat1, piece.tHat2, error, plen+1);
+    });
+
+  QPolygonF out;
+  for(size_t i=0; i<pieces.size(); ++i)
+    {
+      if( nsegs[i] < 0 )
+        return QPolygonF();
+      for(int j=0; j<nsegs[i]*4; ++j)
+        out << fits[i][j];
+    }
+  return out;
+}
+
+QPolygonF bezier_fit_cubic_cached(const QPolygonF& data, double error)
+{
+  const quint64 hash = hashPoints(data);
+  const size_t bytes = size_t(data.size())*sizeof(QPointF);
+
+  {
+    std::lock_guard<std::mutex> lock(bezierCacheMutex);
+    for(auto it = bezierCache.begin(); it != bezierCache.end(); ++it)
+      if( it->hash == hash && it->error == error &&
+          it->data.size() == data.size() &&
+          std::memcmp(it->data.constData(), data.constData(), bytes) == 0 )
+        {
+          // move to front, as most recently used
+          bezierCache.splice(bezierCache.begin(), bezierCache, it);
+          return it->fit;
+        }
+  }
+
+  const QPolygonF fit = bezier_fit_cubic_parallel(data, error);
+
+  {
+    std::lock_guard<std::mutex> lock(bezierCacheMutex);
+    BezierCacheEntry entry;
+    entry.hash = hash;
+    entry.error = error;
+    entry.data = data;
+    entry.fit = fit;
+    bezierCache.push_front(entry);
+    if( bezierCache.size() > BEZIER_CACHE_SIZE )
+      bezierCache.pop_back();
+  }
+
+  return fit;
+}
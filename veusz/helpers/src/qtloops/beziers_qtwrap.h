@@ -27,4 +27,13 @@ QPolygonF bezier_fit_cubic_single(const QPolygonF& data, double error);
 QPolygonF bezier_fit_cubic_multi(const QPolygonF& data, double error,
 				 unsigned max_beziers);
 
+// As bezier_fit_cubic_multi, with as many beziers as needed. Long
+// inputs are split into pieces, at corners where possible, which are
+// fitted in parallel.
+QPolygonF bezier_fit_cubic_parallel(const QPolygonF& data, double error);
+
+// As bezier_fit_cubic_parallel, but returning the previous result if
+// the same data were recently fitted with the same error.
+QPolygonF bezier_fit_cubic_cached(const QPolygonF& data, double error);
+
 #endif
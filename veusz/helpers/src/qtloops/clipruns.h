@@ -0,0 +1,73 @@
+// -*- mode: C++; -*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef CLIPRUNS_H
+#define CLIPRUNS_H
+
+#include <QPointF>
+#include <QRectF>
+
+// Finding runs of points inside a clipping rectangle, so that the
+// clippers only need to handle points near where lines cross the
+// edges one at a time.
+//
+// Points are tested in blocks without branches, which the compiler
+// can vectorize, and only the block containing the end of the run is
+// tested point by point. NaN coordinates are never inside.
+
+class ClipRuns
+{
+public:
+  // points inside rect (including its edges) are counted as inside
+  ClipRuns(const QRectF& rect)
+    : left(rect.left()), right(rect.right()),
+      top(rect.top()), bottom(rect.bottom())
+  {
+  }
+
+  inline bool inside(const QPointF& pt) const
+  {
+    return (pt.x() >= left) & (pt.x() <= right) &
+      (pt.y() >= top) & (pt.y() <= bottom);
+  }
+
+  // number of points at the start of pts[0:n] which are inside
+  int countInside(const QPointF* pts, int n) const
+  {
+    int i = 0;
+    for( ; i+BLOCK <= n; i += BLOCK )
+      {
+        bool all = true;
+        for(int j=0; j<BLOCK; ++j)
+          all &= inside(pts[i+j]);
+        if( !all )
+          break;
+      }
+    while( i < n && inside(pts[i]) )
+      ++i;
+    return i;
+  }
+
+private:
+  enum { BLOCK = 8 };
+  double left, right, top, bottom;
+};
+
+#endif
@@ -0,0 +1,155 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "parallel.h"
+#include "imagepyramid.h"
+#include "isnan.h"
+
+namespace
+{
+  // output rows of a level computed by each thread task
+  const int PYRAMID_TASK_ROWS = 64;
+
+  // combine the four values of a block, ignoring NaNs
+  inline double reduce4(const double v[4], ImagePyramid::Reduction r)
+  {
+    double out = std::numeric_limits<double>::quiet_NaN();
+    int n = 0;
+    for(int i=0; i<4; ++i)
+      {
+        if(isNaN(v[i]))
+          continue;
+        if(n == 0)
+          out = v[i];
+        else
+          switch(r)
+            {
+            case ImagePyramid::MEAN: out += v[i]; break;
+            case ImagePyramid::MINIMUM: out = std::min(out, v[i]); break;
+            case ImagePyramid::MAXIMUM: out = std::max(out, v[i]); break;
+            }
+        ++n;
+      }
+    if(r == ImagePyramid::MEAN && n > 1)
+      out /= n;
+    return out;
+  }
+
+  // make a level half the size of the input, where get(x,y) returns
+  // input values
+  template<class Get> void halveLevel(Get get, int inwidth, int inheight,
+                                      ImagePyramid::Reduction r,
+                                      std::vector<double>& vals)
+  {
+    const int width = inwidth/2;
+    const int height = inheight/2;
+    vals.resize(size_t(width)*height);
+
+    const unsigned ntasks = (height+PYRAMID_TASK_ROWS-1)/PYRAMID_TASK_ROWS;
+    parallelFor(ntasks, parallelNumThreads(), [&](unsigned task)
+      {
+        const int y1 = int(task)*PYRAMID_TASK_ROWS;
+        const int y2 = std::min(y1+PYRAMID_TASK_ROWS, height);
+        for(int y=y1; y<y2; ++y)
+          {
+            double* out = &vals[size_t(y)*width];
+            for(int x=0; x<width; ++x)
+              {
+                const double v[4] = {
+                  get(2*x, 2*y), get(2*x+1, 2*y),
+                  get(2*x, 2*y+1), get(2*x+1, 2*y+1)
+                };
+                out[x] = reduce4(v, r);
+              }
+          }
+      });
+  }
+}
+
+ImagePyramid::ImagePyramid(const Numpy2DObj& data, Reduction reduction)
+  : srcwidth(data.dims[1]), srcheight(data.dims[0])
+{
+  int width = srcwidth;
+  int height = srcheight;
+  while(width >= 2 && height >= 2)
+    {
+      levels.push_back(Level());
+      Level& lev = levels.back();
+
+      if(levels.size() == 1)
+        halveLevel([&data](int x, int y) { return data(x, y); },
+                   width, height, reduction, lev.vals);
+      else
+        {
+          const Level& prev = levels[levels.size()-2];
+          halveLevel([&prev](int x, int y) {
+              return prev.vals[size_t(y)*prev.width+x]; },
+            width, height, reduction, lev.vals);
+        }
+
+      width /= 2;
+      height /= 2;
+      lev.width = width;
+      lev.height = height;
+    }
+}
+
+int ImagePyramid::levelWidth(int level) const
+{
+  if(level < 0 || level >= numLevels())
+    throw "Invalid pyramid level";
+  return level == 0 ? srcwidth : levels[level-1].width;
+}
+
+int ImagePyramid::levelHeight(int level) const
+{
+  if(level < 0 || level >= numLevels())
+    throw "Invalid pyramid level";
+  return level == 0 ? srcheight : levels[level-1].height;
+}
+
+int ImagePyramid::levelForScale(double scale) const
+{
+  if(!(scale > 0) || scale >= 0.5)
+    return 0;
+  const int level = int(std::floor(std::log2(1/scale)));
+  return std::min(level, numLevels()-1);
+}
+
+void ImagePyramid::levelRegion(int level, int x0, int y0, int x1, int y1,
+                               std::vector<double>& out) const
+{
+  if(level < 1 || level >= numLevels())
+    throw "Invalid pyramid level";
+  const Level& lev = levels[level-1];
+  if(x0 < 0 || y0 < 0 || x1 > lev.width || y1 > lev.height ||
+     x1 < x0 || y1 < y0)
+    throw "Invalid pyramid region";
+
+  out.resize(size_t(x1-x0)*(y1-y0));
+  double* o = out.data();
+  for(int y=y0; y<y1; ++y)
+    {
+      const double* row = &lev.vals[size_t(y)*lev.width];
+      o = std::copy(row+x0, row+x1, o);
+    }
+}
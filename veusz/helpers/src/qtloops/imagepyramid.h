@@ -0,0 +1,73 @@
+// -*- mode: C++; -*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <vector>
+#include "qtloops_helpers.h"
+
+// Multi-resolution copies of 2D image data, for drawing large images
+// at a lower resolution when zoomed out.
+//
+// Level 0 is the source data, which is not copied (the caller keeps
+// the array). Each further level halves the size of the previous one
+// by combining 2x2 blocks of pixels, dropping any odd row or column
+// at the end. NaN values are ignored when combining, so a pixel of a
+// level is only NaN if all its source pixels are. Levels are stored
+// as doubles, like the source, so take at most a third of its memory.
+//
+// MINIMUM and MAXIMUM reductions keep narrow features visible, and
+// commute with the monotonic colour scalings, unlike MEAN.
+class ImagePyramid
+{
+public:
+  enum Reduction { MEAN, MINIMUM, MAXIMUM };
+
+  ImagePyramid(const Numpy2DObj& data, Reduction reduction=MEAN);
+
+  // number of levels, including the source
+  int numLevels() const { return int(levels.size())+1; }
+  int levelWidth(int level) const;
+  int levelHeight(int level) const;
+
+  // the lowest resolution level which still has at least one pixel
+  // per output pixel, if the source is drawn with scale output
+  // pixels per source pixel
+  int levelForScale(double scale) const;
+
+  // copy the region x0<=x<x1, y0<=y<y1 of level (>=1) into out as
+  // rows of doubles (throws const char* if the region is invalid)
+  void levelRegion(int level, int x0, int y0, int x1, int y1,
+                   std::vector<double>& out) const;
+
+private:
+  struct Level
+  {
+    int width, height;
+    std::vector<double> vals;
+  };
+
+  // levels 1 onwards
+  std::vector<Level> levels;
+  int srcwidth, srcheight;
+};
+
+#endif
@@ -17,7 +17,11 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include "numpyfuncs.h"
+#include <deque>
+#include <iterator>
 #include <limits>
+#include <set>
+#include "parallel.h"
 #include "isnan.h"
 
 namespace {
@@ -25,6 +29,97 @@ namespace {
   {
     return (a<b) ? a : b;
   }
+
+  // number of input values to bin in each thread task
+  const int BIN_TASK_SIZE = 65536;
+
+  // compensated (Kahan) sum, so that adding and later subtracting
+  // values in a rolling window does not accumulate rounding errors
+  class KahanSum
+  {
+  public:
+    KahanSum() : sum(0), comp(0) {}
+
+    void add(double v)
+    {
+      const double y = v - comp;
+      const double t = sum + y;
+      comp = (t - sum) - y;
+      sum = t;
+    }
+
+    double value() const { return sum; }
+
+  private:
+    double sum, comp;
+  };
+
+  // Slide a window of width points either side of each index i from
+  // 0 to size-1, calling add(j) as index j enters the window,
+  // remove(j) as it leaves and output(i) for each position.
+  template<class Add, class Remove, class Output>
+  void slideWindow(int size, int width, Add add, Remove remove,
+                   Output output)
+  {
+    // a negative width gives an empty window, and wider windows than
+    // the data are the same as the whole data (avoiding overflow)
+    if( width < 0 )
+      {
+        for(int i = 0; i < size; ++i)
+          output(i);
+        return;
+      }
+    width = min(width, size);
+
+    for(int i = 0; i < width; ++i)
+      add(i);
+    for(int i = 0; i < size; ++i)
+      {
+        if( i+width < size )
+          add(i+width);
+        if( i-width-1 >= 0 )
+          remove(i-width-1);
+        output(i);
+      }
+  }
+
+  // rolling minimum (if less is std::less) or maximum using a
+  // monotonic deque of indices, so each value is added and removed
+  // once
+  template<class Compare> void rollingExtreme(const Numpy1DObj& indata,
+                                              int width, Compare less,
+                                              int* numoutbins,
+                                              double** outdata)
+  {
+    const int size = indata.dim;
+    *numoutbins = size;
+    double *out = new double[size];
+    *outdata = out;
+
+    std::deque<int> window;
+    slideWindow(
+      size, width,
+      [&](int j)
+      {
+        const double v = indata(j);
+        if( !isFinite(v) )
+          return;
+        while( !window.empty() && !less(indata(window.back()), v) )
+          window.pop_back();
+        window.push_back(j);
+      },
+      [&](int j)
+      {
+        if( !window.empty() && window.front() == j )
+          window.pop_front();
+      },
+      [&](int i)
+      {
+        out[i] = window.empty() ?
+          std::numeric_limits<double>::quiet_NaN() :
+          indata(window.front());
+      });
+  }
 }
 
 void binData(const Numpy1DObj& indata, int binning,
@@ -41,36 +136,38 @@ void binData(const Numpy1DObj& indata, int binning,
   double *out = new double[size];
   *outdata = out;
 
-  // do binning
-  double sum = 0.;
-  int ct = 0;
-  for(int i = 0 ; i < indata.dim; ++i)
+  // bins are independent, so are computed in parallel for large
+  // inputs in blocks of whole bins
+  const int binspertask = std::max(1, BIN_TASK_SIZE / binning);
+  const unsigned ntasks = (size + binspertask - 1) / binspertask;
+
+  parallelFor(ntasks, parallelNumThreads(), [&](unsigned task)
     {
-      // include new data
-      if ( isFinite( indata(i) ) )
-	{
-	  sum += indata(i);
-	  ct += 1;
-	}
-
-      // every bin or at end of array
-      if ( i % binning == binning-1 || i == indata.dim-1 )
-	{
-	  if( ct == 0 )
-	    {
-	      out[i / binning] = std::numeric_limits<double>::quiet_NaN();
-	    }
-	  else
-	    {
-	      if( average )
-		out[i / binning] = sum / ct;
-	      else
-		out[i / binning] = sum;
-	    }
-	  sum = 0;
-	  ct = 0;
-	}
-    }
+      const int bin1 = int(task) * binspertask;
+      const int bin2 = min(bin1 + binspertask, size);
+      for(int bin = bin1; bin < bin2; ++bin)
+        {
+          const int i2 = min((bin+1)*binning, indata.dim);
+          double sum = 0.;
+          int ct = 0;
+          for(int i = bin*binning; i < i2; ++i)
+            {
+              const double v = indata(i);
+              if ( isFinite(v) )
+                {
+                  sum += v;
+                  ct += 1;
+                }
+            }
+
+          if( ct == 0 )
+            out[bin] = std::numeric_limits<double>::quiet_NaN();
+          else if( average )
+            out[bin] = sum / ct;
+          else
+            out[bin] = sum;
+        }
+    });
 }
 
 void rollingAverage(const Numpy1DObj& indata,
@@ -88,39 +185,138 @@ void rollingAverage(const Numpy1DObj& indata,
   double *out = new double[size];
   *outdata = out;
 
-  for(int i = 0 ; i < size; ++i)
+  // running sums of values (times weights) and weights of the
+  // finite points in the window with non-zero weights, and the number
+  // of them (so that rounding cannot leave a sum of weights which
+  // should be zero)
+  KahanSum sum, ct;
+  int numweighted = 0;
+
+  // weight of a point, and whether it is included (finite, with a
+  // non-zero weight)
+  auto weight = [&](int j) -> double
+    {
+      return weights == 0 ? 1. : (*weights)(j);
+    };
+  auto weighted = [&](int j)
+    {
+      return isFinite(indata(j)) && isFinite(weight(j)) && weight(j) != 0.;
+    };
+
+  slideWindow(
+    size, width,
+    [&](int j)
+    {
+      if( weighted(j) )
+        {
+          const double w = weight(j);
+          sum.add(w*indata(j));
+          ct.add(w);
+          ++numweighted;
+        }
+    },
+    [&](int j)
+    {
+      if( weighted(j) )
+        {
+          const double w = weight(j);
+          sum.add(-w*indata(j));
+          ct.add(-w);
+          if( --numweighted == 0 )
+            {
+              // start again from exactly zero
+              sum = KahanSum();
+              ct = KahanSum();
+            }
+        }
+    },
+    [&](int i)
+    {
+      if( numweighted != 0 && ct.value() != 0. )
+        out[i] = sum.value() / ct.value();
+      else
+        out[i] = std::numeric_limits<double>::quiet_NaN();
+    });
+}
+
+void rollingMedian(const Numpy1DObj& indata, int width,
+		   int* numoutbins, double** outdata)
+{
+  const int size = indata.dim;
+  *numoutbins = size;
+  double *out = new double[size];
+  *outdata = out;
+
+  // the window is split into the lower and upper halves of the
+  // values, with the lower half holding the extra value if the
+  // number is odd
+  std::multiset<double> lower, upper;
+
+  auto rebalance = [&]()
     {
-      double ct = 0.;
-      double sum = 0.;
-
-      // iterate over rolling width
-      for(int di = -width; di <= width; ++di)
-	{
-	  const int ri = di+i;
-	  if ( ri >= 0 && ri < size && isFinite(indata(ri)) )
-	    {
-	      if( weights != 0 )
-		{
-		  // weighted average
-		  const double w = (*weights)(ri);
-		  if( isFinite(w) )
-		    {
-		      ct += w;
-		      sum += w*indata(ri);
-		    }
-		}
-	      else
-		{
-		  // standard average
-		  ct += 1;
-		  sum += indata(ri);
-		}
-	    }
-	}
-
-      if( ct != 0. )
-	out[i] = sum / ct;
+      if( lower.size() > upper.size()+1 )
+        {
+          auto it = std::prev(lower.end());
+          upper.insert(*it);
+          lower.erase(it);
+        }
+      else if( upper.size() > lower.size() )
+        {
+          auto it = upper.begin();
+          lower.insert(*it);
+          upper.erase(it);
+        }
+    };
+
+  slideWindow(
+    size, width,
+    [&](int j)
+    {
+      const double v = indata(j);
+      if( !isFinite(v) )
+        return;
+      if( lower.empty() || v <= *lower.rbegin() )
+        lower.insert(v);
       else
-	out[i] = std::numeric_limits<double>::quiet_NaN();
-    }
+        upper.insert(v);
+      rebalance();
+    },
+    [&](int j)
+    {
+      const double v = indata(j);
+      if( !isFinite(v) )
+        return;
+      // values in upper are never less than those in lower, so v is
+      // in lower if it is not more than its largest value
+      if( !lower.empty() && v <= *lower.rbegin() )
+        lower.erase(lower.find(v));
+      else
+        upper.erase(upper.find(v));
+      rebalance();
+    },
+    [&](int i)
+    {
+      if( lower.empty() )
+        out[i] = std::numeric_limits<double>::quiet_NaN();
+      else if( lower.size() > upper.size() )
+        out[i] = *lower.rbegin();
+      else
+        out[i] = 0.5*(*lower.rbegin() + *upper.begin());
+    });
+}
+
+void rollingMinimum(const Numpy1DObj& indata, int width,
+		    int* numoutbins, double** outdata)
+{
+  rollingExtreme(indata, width,
+                 [](double a, double b) { return a < b; },
+                 numoutbins, outdata);
+}
+
+void rollingMaximum(const Numpy1DObj& indata, int width,
+		    int* numoutbins, double** outdata)
+{
+  rollingExtreme(indata, width,
+                 [](double a, double b) { return a > b; },
+                 numoutbins, outdata);
 }
@@ -35,4 +35,13 @@ void rollingAverage(const Numpy1DObj& indata,
 		    int width,
 		    int* numoutbins, double** outdata);
 
+// rolling median, minimum and maximum of the finite values within
+// width points either side of each point
+void rollingMedian(const Numpy1DObj& indata, int width,
+		   int* numoutbins, double** outdata);
+void rollingMinimum(const Numpy1DObj& indata, int width,
+		    int* numoutbins, double** outdata);
+void rollingMaximum(const Numpy1DObj& indata, int width,
+		    int* numoutbins, double** outdata);
+
 #endif
@@ -22,6 +22,8 @@
 
 #include <cmath>
 #include "polygonclip.h"
+#include "clipruns.h"
+#include "tracing.h"
 
 using std::abs;
 
@@ -133,6 +135,22 @@ namespace
 	output << pt;
     }
 
+    // have all the stages had their first point?
+    bool started() const
+    {
+      return !(leftis1st || rightis1st || topis1st || bottomis1st);
+    }
+
+    // pass points which are inside all the edges straight to the
+    // output, which is what the stages would do if the last point
+    // was also inside and passed through them all
+    void writeInsidePoints(const QPointF* pts, int n)
+    {
+      for(int i=0; i<n; ++i)
+	writeClipPoint(pts[i]);
+      leftlast = rightlast = toplast = bottomlast = pts[n-1];
+    }
+
     /* location of corners of clip rectangle */
     QRectF clip;
  
@@ -156,11 +174,38 @@ void polygonClip(const QPolygonF& inpoly,
 {
   // construct initial state
   State state(cliprect, out);
+  const ClipRuns runs(cliprect);
 
-  // do the clipping
-  for(QPolygonF::const_iterator pt = inpoly.begin(); pt != inpoly.end(); ++pt)
+  const QPointF* pts = inpoly.constData();
+  const int n = inpoly.size();
+
+  // if all the points are inside, each of the four stages holds back
+  // its first point until the end, so the output is the input
+  // rotated by four points
+  if( n > 0 && runs.countInside(pts, n) == n )
     {
-      state.leftClipPoint(*pt);
+      out.reserve(out.size() + n);
+      for(int i=0; i<n; ++i)
+	state.writeClipPoint(pts[(i+4) % n]);
+      return;
+    }
+
+  // do the clipping, skipping the stages for runs of points inside
+  // after a point which was inside
+  for(int i=0; i<n; )
+    {
+      state.leftClipPoint(pts[i]);
+      ++i;
+      if( i < n && state.started() && runs.inside(pts[i-1]) &&
+	  runs.inside(pts[i]) )
+	{
+	  const int run = runs.countInside(pts+i, n-i);
+	  if( run > 0 )
+	    {
+	      state.writeInsidePoints(pts+i, run);
+	      i += run;
+	    }
+	}
     }
 
   // complete
@@ -175,6 +220,9 @@ void plotClippedPolygon(QPainter& painter,
 			const QPolygonF& inpoly,
 			bool autoexpand)
 {
+  TRACE_SCOPE("qtloops.plotClippedPolygon");
+  TRACE_COUNT("qtloops.polygon.pointsclipped", inpoly.size());
+
   if ( autoexpand )
     {
       const qreal lw = painter.pen().widthF();
@@ -184,5 +232,6 @@ void plotClippedPolygon(QPainter& painter,
 
   QPolygonF plt;
   polygonClip(inpoly, rect, plt);
+  TRACE_COUNT("qtloops.polygon.pointsdrawn", plt.size());
   painter.drawPolygon(plt);
 }
@@ -24,6 +24,8 @@
 #include <QPen>
 
 #include <polylineclip.h>
+#include "clipruns.h"
+#include "tracing.h"
 
 using std::fabs;
 
@@ -84,8 +86,14 @@ namespace
     void fixPt(QPointF& pt) const;
     bool clipLine(QPointF& pt1, QPointF& pt2) const;
 
+    // runs of points which clipLine leaves unchanged, as they are
+    // inside the rectangle and too far from its edges to be moved
+    // by fixPt
+    const ClipRuns& insideRuns() const { return runs; }
+
   private:
     QRectF clip;
+    ClipRuns runs;
   };
 
 
@@ -106,6 +114,11 @@ namespace
     // do clipping on the polyline
     void clipPolyline(const QPolygonF& poly);
 
+  private:
+    // add clipped line from p1 to p2 to pout, emitting pout if the
+    // line does not continue it
+    void addLine(QPolygonF& pout, const QPointF& p1, const QPointF& p2);
+
   private:
     _Clipper _clipper;
   };
@@ -115,7 +128,8 @@ namespace
 ////////////////////////////////////////////////////////////////////////
 
 _Clipper::_Clipper(const QRectF& cliprect)
-  : clip(cliprect)
+  : clip(cliprect),
+    runs(cliprect.adjusted(1e-4, 1e-4, -1e-4, -1e-4))
 {
 }
 
@@ -226,46 +240,33 @@ void _PolyClipper::clipPolyline(const QPolygonF& poly)
   // output goes here
   QPolygonF pout;
 
-  QPolygonF::const_iterator polyiter = poly.begin();
-  QPointF lastpt = *polyiter;
-  polyiter++;
+  const QPointF* pts = poly.constData();
+  const int n = poly.size();
+  const ClipRuns& runs = _clipper.insideRuns();
 
-  for( ; polyiter != poly.end(); ++polyiter )
+  for(int i = 1; i < n; )
     {
-      QPointF p1 = lastpt;
-      QPointF p2 = *polyiter;
+      // lines between runs of points inside need no clipping
+      const int run = runs.inside(pts[i-1]) && runs.inside(pts[i]) ?
+        runs.countInside(pts+i-1, n-i+1) : 0;
+      if( run >= 2 )
+        {
+          if( pout.isEmpty() )
+            pout.reserve(run);
+          for(int j = i; j < i-1+run; ++j)
+            addLine(pout, pts[j-1], pts[j]);
+          i += run-1;
+          if( i >= n )
+            break;
+        }
+
+      QPointF p1 = pts[i-1];
+      QPointF p2 = pts[i];
 
       bool plotline = _clipper.clipLine(p1, p2);
       if( plotline )
         {
-          if( pout.isEmpty() )
-            {
-              // add first line
-              pout << p1;
-              if( ! smallDelta(p1, p2) )
-                pout << p2;
-            }
-          else
-            {
-              if( p1 == pout.last() )
-                {
-                  if( ! smallDelta(p1, p2) )
-                    // extend polyline
-                    pout << p2;
-                }
-              else
-                {
-                  // paint existing line
-                  if( pout.size() >= 2 )
-                    emitPolyline(pout);
-
-                  // start new line
-                  pout.clear();
-                  pout << p1;
-                  if( ! smallDelta(p1, p2) )
-                    pout << p2;
-                }
-            }
+          addLine(pout, p1, p2);
         }
       else
         {
@@ -279,14 +280,46 @@ void _PolyClipper::clipPolyline(const QPolygonF& poly)
           pout.clear();
         }
 
-
-      lastpt = *polyiter;
+      ++i;
     }
 
   if( pout.size() >= 2 )
     emitPolyline(pout);
 }
 
+void _PolyClipper::addLine(QPolygonF& pout, const QPointF& p1,
+                           const QPointF& p2)
+{
+  if( pout.isEmpty() )
+    {
+      // add first line
+      pout << p1;
+      if( ! smallDelta(p1, p2) )
+        pout << p2;
+    }
+  else
+    {
+      if( p1 == pout.last() )
+        {
+          if( ! smallDelta(p1, p2) )
+            // extend polyline
+            pout << p2;
+        }
+      else
+        {
+          // paint existing line
+          if( pout.size() >= 2 )
+            emitPolyline(pout);
+
+          // start new line
+          pout.clear();
+          pout << p1;
+          if( ! smallDelta(p1, p2) )
+            pout << p2;
+        }
+    }
+}
+
 // class used for drawing clipped polylines
 
 class PlotDrawCallback : public _PolyClipper
@@ -299,6 +332,7 @@ class PlotDrawCallback : public _PolyClipper
 
   void emitPolyline(const QPolygonF& poly)
   {
+    TRACE_COUNT("qtloops.polyline.pointsdrawn", poly.size());
     _painter.drawPolyline(poly);
   }
 
@@ -312,6 +346,9 @@ void plotClippedPolyline(QPainter& painter,
                          const QPolygonF& poly,
                          bool autoexpand)
 {
+  TRACE_SCOPE("qtloops.plotClippedPolyline");
+  TRACE_COUNT("qtloops.polyline.pointsclipped", poly.size());
+
   // if autoexpand, expand rectangle by line width
   if ( autoexpand )
     {
@@ -451,30 +488,152 @@ QPolygonF RotatedRectangle::makePolygon() const
   return poly;
 }
 
+namespace
+{
+  // maximum number of grid cells a rectangle is binned into
+  const int OVERLAP_MAX_CELLS = 64;
+}
+
 RectangleOverlapTester::RectangleOverlapTester()
+  : _cellsize(0), _stamp(0)
 {
 }
 
+RectangleOverlapTester::Placed
+RectangleOverlapTester::makePlaced(const RotatedRectangle& rect)
+{
+  Placed p;
+  p.poly = rect.makePolygon();
+  p.x1 = p.y1 = std::numeric_limits<double>::max();
+  p.x2 = p.y2 = std::numeric_limits<double>::lowest();
+  for(auto const& pt : p.poly)
+    {
+      p.x1 = std::min(p.x1, pt.x());
+      p.x2 = std::max(p.x2, pt.x());
+      p.y1 = std::min(p.y1, pt.y());
+      p.y2 = std::max(p.y2, pt.y());
+    }
+  return p;
+}
+
+bool RectangleOverlapTester::cellRange(const Placed& p, int& cx1, int& cy1,
+                                       int& cx2, int& cy2) const
+{
+  // also excludes NaN
+  const double lim = 1e9;
+  const double sx1 = p.x1/_cellsize;
+  const double sx2 = p.x2/_cellsize;
+  const double sy1 = p.y1/_cellsize;
+  const double sy2 = p.y2/_cellsize;
+  if( !(sx1 > -lim && sx2 < lim && sy1 > -lim && sy2 < lim) )
+    return false;
+
+  cx1 = int(std::floor(sx1));
+  cx2 = int(std::floor(sx2));
+  cy1 = int(std::floor(sy1));
+  cy2 = int(std::floor(sy2));
+  return double(cx2-cx1+1)*(cy2-cy1+1) <= OVERLAP_MAX_CELLS;
+}
+
 bool RectangleOverlapTester::willOverlap(const RotatedRectangle& rect) const
 {
-  const QPolygonF thispoly(rect.makePolygon());
+  if( _placed.empty() )
+    return false;
+
+  const Placed thisp(makePlaced(rect));
+
+  // the exact test counts touching polygons as overlapping, so the
+  // bounding box test does too
+  auto overlaps = [&](int idx)
+    {
+      const Placed& o = _placed[idx];
+      if( o.x2 < thisp.x1 || thisp.x2 < o.x1 ||
+          o.y2 < thisp.y1 || thisp.y2 < o.y1 )
+        return false;
+      return doPolygonsIntersect(thisp.poly, o.poly);
+    };
+
+  int cx1, cy1, cx2, cy2;
+  if( _cellsize <= 0 || !cellRange(thisp, cx1, cy1, cx2, cy2) )
+    {
+      // test everything for large or non-finite rectangles
+      for(int idx=0; idx<int(_placed.size()); ++idx)
+        if( overlaps(idx) )
+          return true;
+      return false;
+    }
+
+  for(int idx : _unbinned)
+    if( overlaps(idx) )
+      return true;
 
-  for(auto const &ir : _rects)
+  // new stamp to mark the rectangles tested
+  if( ++_stamp == 0 )
     {
-      if( doPolygonsIntersect(thispoly, ir.makePolygon()) )
-        return true;
+      std::fill(_stamps.begin(), _stamps.end(), 0);
+      _stamp = 1;
     }
 
+  for(int cy=cy1; cy<=cy2; ++cy)
+    for(int cx=cx1; cx<=cx2; ++cx)
+      {
+        auto cell = _cells.find(cellKey(cx, cy));
+        if( cell == _cells.end() )
+          continue;
+        for(int idx : cell->second)
+          {
+            if( _stamps[idx] == _stamp )
+              continue;
+            _stamps[idx] = _stamp;
+            if( overlaps(idx) )
+              return true;
+          }
+      }
+
   return false;
 }
 
-void RectangleOverlapTester::debug(QPainter& painter) const
+void RectangleOverlapTester::addRect(const RotatedRectangle& rect)
 {
-  for(auto const &rect : _rects)
+  const int idx = int(_placed.size());
+  _placed.push_back(makePlaced(rect));
+  _stamps.push_back(0);
+  const Placed& p = _placed.back();
+
+  // choose cells the size of the first (finite) rectangle
+  if( _cellsize <= 0 )
+    {
+      const double size = std::max(p.x2-p.x1, p.y2-p.y1);
+      if( size > 0 && size < std::numeric_limits<double>::max() )
+        _cellsize = size;
+    }
+
+  int cx1, cy1, cx2, cy2;
+  if( _cellsize <= 0 || !cellRange(p, cx1, cy1, cx2, cy2) )
     {
-      QPolygonF poly = rect.makePolygon();
-      painter.drawPolygon(poly);
+      _unbinned.push_back(idx);
+      return;
     }
+
+  for(int cy=cy1; cy<=cy2; ++cy)
+    for(int cx=cx1; cx<=cx2; ++cx)
+      _cells[cellKey(cx, cy)].push_back(idx);
+}
+
+void RectangleOverlapTester::reset()
+{
+  _placed.clear();
+  _cells.clear();
+  _unbinned.clear();
+  _stamps.clear();
+  _cellsize = 0;
+  _stamp = 0;
+}
+
+void RectangleOverlapTester::debug(QPainter& painter) const
+{
+  for(auto const &p : _placed)
+    painter.drawPolygon(p.poly);
 }
 
 ///////////////////////////////////////////////////////
@@ -27,6 +27,9 @@
 #include <QVector>
 #include <QSizeF>
 
+#include <unordered_map>
+#include <vector>
+
 // clip a line made up of the points given, returning true
 // if is in region or false if not
 bool clipLine(const QRectF& clip, QPointF& pt1, QPointF& pt2);
@@ -104,19 +107,52 @@ private:
   QVector<QSizeF> _textsizes;
 };
 
+// The rectangles added are binned into a uniform grid by their
+// bounding boxes, so that only nearby rectangles are tested exactly
 class RectangleOverlapTester
 {
 public:
   RectangleOverlapTester();
   bool willOverlap(const RotatedRectangle& rect) const;
-  void addRect(const RotatedRectangle& rect) { _rects.append(rect); };
-  void reset() { _rects.clear(); };
+  void addRect(const RotatedRectangle& rect);
+  void reset();
 
   // debug by drawing all the rectangles
   void debug(QPainter& painter) const;
 
 private:
-  QVector<RotatedRectangle> _rects;
+  // polygon and bounding box of an added rectangle
+  struct Placed
+  {
+    QPolygonF poly;
+    double x1, y1, x2, y2;
+  };
+
+  static Placed makePlaced(const RotatedRectangle& rect);
+
+  // get range of grid cells covering bounding box, returning false
+  // if it is not finite or covers too many cells
+  bool cellRange(const Placed& p, int& cx1, int& cy1,
+                 int& cx2, int& cy2) const;
+
+  static quint64 cellKey(int cx, int cy)
+  {
+    return (quint64(quint32(cx)) << 32) | quint32(cy);
+  }
+
+private:
+  std::vector<Placed> _placed;
+
+  // size of grid cells (set from the first rectangle)
+  double _cellsize;
+  // indices of rectangles overlapping each cell
+  std::unordered_map<quint64, std::vector<int> > _cells;
+  // rectangles not in the grid, which are always tested
+  std::vector<int> _unbinned;
+
+  // for testing each rectangle only once in willOverlap
+  mutable std::vector<unsigned> _stamps;
+  mutable unsigned _stamp;
 };
 
 #endif
@@ -0,0 +1,184 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "isnan.h"
+#include "polylinereduce.h"
+
+namespace
+{
+  inline bool finitePt(const QPointF& pt)
+  {
+    return isFinite(pt.x()) && isFinite(pt.y());
+  }
+
+  // keep first, min, max and last points of each run in a column
+  void minMaxReduce(const QPolygonF& poly, qreal colwidth, QPolygonF& out)
+  {
+    const int size = poly.size();
+    const qreal scale = 1/colwidth;
+
+    int first = 0, minidx = 0, maxidx = 0;
+    qreal col = 0;
+    bool inrun = false;
+
+    // add the points of the run ending at last, in order
+    auto emitRun = [&](int last)
+      {
+        int idxs[4] = {first, std::min(minidx, maxidx),
+                       std::max(minidx, maxidx), last};
+        out << poly[idxs[0]];
+        for(int i=1; i<4; ++i)
+          if( idxs[i] != idxs[i-1] )
+            out << poly[idxs[i]];
+      };
+
+    for(int i=0; i<size; ++i)
+      {
+        const QPointF& pt = poly[i];
+        if( !finitePt(pt) )
+          {
+            if( inrun )
+              emitRun(i-1);
+            inrun = false;
+            out << pt;
+            continue;
+          }
+
+        const qreal c = std::floor(pt.x()*scale);
+        if( inrun && c == col )
+          {
+            if( pt.y() < poly[minidx].y() )
+              minidx = i;
+            if( pt.y() > poly[maxidx].y() )
+              maxidx = i;
+          }
+        else
+          {
+            if( inrun )
+              emitRun(i-1);
+            inrun = true;
+            col = c;
+            first = minidx = maxidx = i;
+          }
+      }
+    if( inrun )
+      emitRun(size-1);
+  }
+
+  // squared distance of pt from line segment a-b
+  inline qreal segDist2(const QPointF& pt, const QPointF& a, const QPointF& b)
+  {
+    const qreal dx = b.x()-a.x();
+    const qreal dy = b.y()-a.y();
+    const qreal len2 = dx*dx + dy*dy;
+    qreal t = 0;
+    if( len2 > 0 )
+      t = std::max(qreal(0), std::min(qreal(1),
+        ((pt.x()-a.x())*dx + (pt.y()-a.y())*dy) / len2));
+    const qreal ex = a.x() + t*dx - pt.x();
+    const qreal ey = a.y() + t*dy - pt.y();
+    return ex*ex + ey*ey;
+  }
+
+  // Douglas-Peucker simplification of the finite points start to end
+  // inclusive, setting keep for points to keep
+  void douglasPeucker(const QPolygonF& poly, int start, int end,
+                      qreal tol2, std::vector<char>& keep)
+  {
+    keep[start] = keep[end] = 1;
+
+    std::vector< std::pair<int,int> > stack;
+    stack.push_back(std::make_pair(start, end));
+    while( !stack.empty() )
+      {
+        const int i1 = stack.back().first;
+        const int i2 = stack.back().second;
+        stack.pop_back();
+
+        qreal maxd2 = -1;
+        int maxi = -1;
+        for(int i=i1+1; i<i2; ++i)
+          {
+            const qreal d2 = segDist2(poly[i], poly[i1], poly[i2]);
+            if( d2 > maxd2 )
+              {
+                maxd2 = d2;
+                maxi = i;
+              }
+          }
+
+        if( maxi >= 0 && maxd2 > tol2 )
+          {
+            keep[maxi] = 1;
+            stack.push_back(std::make_pair(i1, maxi));
+            stack.push_back(std::make_pair(maxi, i2));
+          }
+      }
+  }
+
+  void simplify(const QPolygonF& poly, qreal tolerance, QPolygonF& out)
+  {
+    const int size = poly.size();
+    std::vector<char> keep(size, 0);
+
+    // simplify each run of finite points separately
+    int start = -1;
+    for(int i=0; i<=size; ++i)
+      {
+        const bool finite = i < size && finitePt(poly[i]);
+        if( finite && start < 0 )
+          start = i;
+        else if( !finite )
+          {
+            if( start >= 0 )
+              douglasPeucker(poly, start, i-1, tolerance*tolerance, keep);
+            if( i < size )
+              keep[i] = 1;
+            start = -1;
+          }
+      }
+
+    for(int i=0; i<size; ++i)
+      if( keep[i] )
+        out << poly[i];
+  }
+}
+
+QPolygonF reducePolyline(const QPolygonF& poly, qreal colwidth,
+                         qreal tolerance)
+{
+  QPolygonF out;
+  if( colwidth > 0 )
+    minMaxReduce(poly, colwidth, out);
+  else
+    out = poly;
+
+  if( tolerance > 0 )
+    {
+      QPolygonF simple;
+      simplify(out, tolerance, simple);
+      return simple;
+    }
+
+  return out;
+}
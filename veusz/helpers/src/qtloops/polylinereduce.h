@@ -0,0 +1,45 @@
+// -*- mode: C++; -*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYLINEREDUCE_H
+#define POLYLINEREDUCE_H
+
+#include <QPolygonF>
+
+// Reduce the number of points in a polyline before clipping and
+// drawing it.
+//
+// If colwidth > 0, runs of consecutive points in the same column of
+// width colwidth (columns starting at x=0) are replaced by the first,
+// minimum y, maximum y and last points of the run, in their original
+// order. If colwidth is the width of a pixel, the line rasterises the
+// same, as the vertical extent covered in each column and the lines
+// between columns are unchanged.
+//
+// If tolerance > 0, the line is then simplified using the
+// Douglas-Peucker algorithm, removing points which are closer than
+// tolerance to the simplified line. This changes the output, but by
+// no more than tolerance.
+//
+// Non-finite points are kept, so that breaks in the line remain.
+QPolygonF reducePolyline(const QPolygonF& poly, qreal colwidth,
+                         qreal tolerance = 0);
+
+#endif
@@ -17,15 +17,23 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <unordered_set>
 
 #include "qtloops.h"
 #include "isnan.h"
+#include "clipruns.h"
+#include "parallel.h"
+#include "tracing.h"
 #include "polylineclip.h"
 #include "polygonclip.h"
 
 #include <QBrush>
 #include <QColor>
 #include <QLineF>
+#include <QPaintEngine>
 #include <QPen>
 #include <QPointF>
 #include <QTransform>
@@ -72,7 +80,7 @@ void addNumpyToPolygonF(QPolygonF& poly, const Tuple2Ptrs& d)
 	  // add point if point in two columns
 	  if( row < d.dims[col] && row < d.dims[col+1] )
 	    {
-	      const QPointF pt(d.data[col][row], d.data[col+1][row]);
+	      const QPointF pt((*d.data[col])(row), (*d.data[col+1])(row));
 	      if( ! smallDelta(pt, lastpt) )
 		{
 		  poly << pt;
@@ -103,7 +111,7 @@ void addNumpyPolygonToPath(QPainterPath &path, const Tuple2Ptrs& d,
 	  // add point if point in two columns
 	  if( row < d.dims[col] && row < d.dims[col+1] )
 	    {
-	      const QPointF pt(d.data[col][row], d.data[col+1][row]);
+	      const QPointF pt((*d.data[col])(row), (*d.data[col+1])(row));
 	      poly << pt;
 	      ifany = true;
 	    }
@@ -131,6 +139,68 @@ void addNumpyPolygonToPath(QPainterPath &path, const Tuple2Ptrs& d,
     }
 }
 
+namespace
+{
+  // make the polygon of line i of lines stored with offsets,
+  // skipping non-finite points, and repeated points as in
+  // addNumpyToPolygonF
+  void flatLinePolygon(const Numpy1DObj& x, const Numpy1DObj& y,
+                       const Numpy1DObj& offsets, int i, QPolygonF& poly)
+  {
+    const double start = offsets(i);
+    const double end = offsets(i+1);
+    if( !(start >= 0 && start <= end && end <= std::min(x.dim, y.dim)) )
+      throw "Invalid offsets of lines";
+
+    poly.resize(0);
+    poly.reserve(int(end-start));
+    QPointF lastpt(-1e6, -1e6);
+    for(int j=int(start); j<int(end); ++j)
+      {
+        const QPointF pt(x(j), y(j));
+        if( isFinite(pt.x()) && isFinite(pt.y()) && ! smallDelta(pt, lastpt) )
+          {
+            poly << pt;
+            lastpt = pt;
+          }
+      }
+  }
+}
+
+void addNumpyLinesToLabeller(LineLabeller& labeller,
+                             const Numpy1DObj& x, const Numpy1DObj& y,
+                             const Numpy1DObj& offsets, QSizeF textsize)
+{
+  QPolygonF poly;
+  for(int i=0; i < offsets.dim-1; ++i)
+    {
+      flatLinePolygon(x, y, offsets, i, poly);
+      labeller.addLine(poly, textsize);
+    }
+}
+
+void addNumpyPolygonsToPath(QPainterPath& path,
+                            const Numpy1DObj& x, const Numpy1DObj& y,
+                            const Numpy1DObj& offsets,
+                            const QRectF* clip)
+{
+  QPolygonF poly, clippedpoly;
+  for(int i=0; i < offsets.dim-1; ++i)
+    {
+      flatLinePolygon(x, y, offsets, i, poly);
+      if( clip != 0 )
+        {
+          clippedpoly.resize(0);
+          polygonClip(poly, *clip, clippedpoly);
+          path.addPolygon(clippedpoly);
+        }
+      else
+        {
+          path.addPolygon(poly);
+        }
+    }
+}
+
 // Scale path by scale given. Puts output in out.
 QPainterPath scalePath(const QPainterPath& path, qreal scale)
 {
@@ -158,13 +228,652 @@ QPainterPath scalePath(const QPainterPath& path, qreal scale)
   return out;
 }
 
+namespace
+{
+  // minimum number of markers to use sprites or merged paths for
+  const int MARKER_BATCH_MIN = 16;
+  // largest number of sprites to make for a set of markers
+  const int MARKER_MAX_SPRITES = 1024;
+  // largest sprite width or height in pixels
+  const int MARKER_MAX_SPRITE_SIZE = 256;
+  // sprites are made for positions rounded to 1/MARKER_SUBPIXEL pixels
+  const int MARKER_SUBPIXEL = 4;
+  // maximum number of grid cells a merged marker can occupy
+  const int MARKER_MAX_CELLS = 16;
+
+  // Draws each marker separately by translating the painter. This is
+  // the fallback for the other marker drawers.
+  class DirectMarkerDrawer
+  {
+  public:
+    DirectMarkerDrawer(QPainter& _painter, const QPainterPath& _path,
+                       bool _scaleline)
+      : painter(_painter), path(_path), scaleline(_scaleline),
+        origtrans(_painter.worldTransform())
+    {
+    }
+
+    void draw(const QPointF& pt, const QRgb* col, qreal s)
+    {
+      painter.setWorldTransform(origtrans);
+      painter.translate(pt);
+
+      if( col != 0 )
+        painter.setBrush( QBrush(QColor::fromRgba(*col)) );
+
+      if( s == 1 )
+        {
+          painter.drawPath(path);
+        }
+      else if( scaleline )
+        {
+          painter.scale(s, s);
+          painter.drawPath(path);
+        }
+      else
+        {
+          painter.drawPath( scalePath(path, s) );
+        }
+
+      painter.setWorldTransform(origtrans);
+    }
+
+    void finish()
+    {
+    }
+
+  private:
+    QPainter& painter;
+    const QPainterPath& path;
+    bool scaleline;
+    QTransform origtrans;
+  };
+
+  // largest distance the pen draws outside a path
+  qreal penMargin(const QPen& pen)
+  {
+    if( pen.style() == Qt::NoPen )
+      return 0;
+    // miter joins can extend by the miter limit times half the
+    // width, and square caps by half the width
+    return std::max(pen.widthF(), qreal(1)) *
+      std::max(pen.miterLimit()*0.5, qreal(1));
+  }
+
+  // Draws markers to a raster device by rendering each distinct
+  // marker (color, size and subpixel offset) to a sprite, then drawing
+  // the sprites at the marker positions.
+  class SpriteMarkerDrawer
+  {
+  public:
+    SpriteMarkerDrawer(QPainter& _painter, const QPainterPath& _path,
+                       bool _scaleline)
+      : painter(_painter), path(_path), scaleline(_scaleline),
+        direct(_painter, _path, _scaleline),
+        origtrans(_painter.worldTransform()),
+        devM(_painter.deviceTransform()),
+        pathbox(_path.controlPointRect()),
+        pen(_painter.pen()),
+        brushcol(_painter.brush().color().rgba()),
+        nobrush(_painter.brush().style() == Qt::NoBrush),
+        identity(false)
+    {
+    }
+
+    // can sprites be drawn to this painter? They need a raster
+    // device with no rotation or shear and simple brushes
+    static bool usable(QPainter& painter)
+    {
+      const QPaintEngine* engine = painter.paintEngine();
+      if( engine == 0 || engine->type() != QPaintEngine::Raster )
+        return false;
+      if( painter.device()->devicePixelRatioF() != 1 )
+        return false;
+      if( painter.compositionMode() != QPainter::CompositionMode_SourceOver ||
+          painter.opacity() != 1 )
+        return false;
+      // sprites are drawn with the world transform reset, so the
+      // view transform has to be the identity
+      if( painter.deviceTransform() != painter.worldTransform() )
+        return false;
+      const QTransform& m = painter.deviceTransform();
+      if( m.type() > QTransform::TxScale || m.m11() <= 0 || m.m22() <= 0 )
+        return false;
+      const Qt::BrushStyle bs = painter.brush().style();
+      if( bs != Qt::NoBrush && bs != Qt::SolidPattern )
+        return false;
+      if( painter.pen().style() != Qt::NoPen &&
+          painter.pen().brush().style() != Qt::SolidPattern )
+        return false;
+      return true;
+    }
+
+    void draw(const QPointF& pt, const QRgb* col, qreal s)
+    {
+      if( !(s > 0 && isFinite(s)) )
+        {
+          direct.draw(pt, col, s);
+          identity = false;
+          return;
+        }
+
+      const QPointF dpt = devM.map(pt);
+      int ix = int(std::floor(dpt.x()));
+      int iy = int(std::floor(dpt.y()));
+      int fx = int((dpt.x()-ix)*MARKER_SUBPIXEL + 0.5);
+      int fy = int((dpt.y()-iy)*MARKER_SUBPIXEL + 0.5);
+      if( fx == MARKER_SUBPIXEL )
+        { ++ix; fx = 0; }
+      if( fy == MARKER_SUBPIXEL )
+        { ++iy; fy = 0; }
+
+      SpriteKey key;
+      key.col = col != 0 ? *col : brushcol;
+      key.scale = s;
+      key.fx = fx;
+      key.fy = fy;
+
+      const Sprite* sprite = getSprite(key);
+      if( sprite == 0 )
+        {
+          direct.draw(pt, col, s);
+          identity = false;
+          return;
+        }
+
+      if( !identity )
+        {
+          painter.setWorldTransform(QTransform());
+          identity = true;
+        }
+      painter.drawImage(QPoint(ix-sprite->ox, iy-sprite->oy), sprite->img);
+    }
+
+    void finish()
+    {
+      painter.setWorldTransform(origtrans);
+    }
+
+  private:
+    struct SpriteKey
+    {
+      QRgb col;
+      qreal scale;
+      int fx, fy;
+
+      bool operator<(const SpriteKey& o) const
+      {
+        if( col != o.col ) return col < o.col;
+        if( scale != o.scale ) return scale < o.scale;
+        if( fx != o.fx ) return fx < o.fx;
+        return fy < o.fy;
+      }
+    };
+
+    struct Sprite
+    {
+      QImage img;
+      // position of marker origin in image
+      int ox, oy;
+    };
+
+    // returns 0 if sprite cannot be made
+    const Sprite* getSprite(const SpriteKey& key)
+    {
+      std::map<SpriteKey, Sprite>::const_iterator it = sprites.find(key);
+      if( it != sprites.end() )
+        return it->second.img.isNull() ? 0 : &(it->second);
+      if( int(sprites.size()) >= MARKER_MAX_SPRITES )
+        return 0;
+
+      Sprite& sprite = sprites[key];
+
+      // device pixels covered by the marker, relative to its origin
+      const qreal sx = devM.m11();
+      const qreal sy = devM.m22();
+      qreal margin = penMargin(pen);
+      if( !pen.isCosmetic() )
+        margin *= std::max(sx, sy) * (scaleline ? key.scale : 1);
+      margin += 2;
+      const qreal x1 = pathbox.left()*key.scale*sx - margin;
+      const qreal y1 = pathbox.top()*key.scale*sy - margin;
+      const qreal x2 = pathbox.right()*key.scale*sx + margin;
+      const qreal y2 = pathbox.bottom()*key.scale*sy + margin;
+      if( !(x2-x1 < MARKER_MAX_SPRITE_SIZE && y2-y1 < MARKER_MAX_SPRITE_SIZE) )
+        return 0;
+
+      sprite.ox = int(std::ceil(-x1));
+      sprite.oy = int(std::ceil(-y1));
+      const int w = sprite.ox + int(std::ceil(x2)) + 1;
+      const int h = sprite.oy + int(std::ceil(y2)) + 1;
+      QImage img(w, h, QImage::Format_ARGB32_Premultiplied);
+      img.fill(0);
+
+      // draw the marker as the direct method would at this offset
+      QPainter p(&img);
+      p.setRenderHints(painter.renderHints());
+      p.setPen(pen);
+      if( nobrush )
+        p.setBrush(QBrush());
+      else
+        p.setBrush( QBrush(QColor::fromRgba(key.col)) );
+      p.translate(sprite.ox + key.fx*(1./MARKER_SUBPIXEL),
+                  sprite.oy + key.fy*(1./MARKER_SUBPIXEL));
+      p.scale(sx, sy);
+      if( key.scale == 1 )
+        {
+          p.drawPath(path);
+        }
+      else if( scaleline )
+        {
+          p.scale(key.scale, key.scale);
+          p.drawPath(path);
+        }
+      else
+        {
+          p.drawPath( scalePath(path, key.scale) );
+        }
+      p.end();
+
+      sprite.img = img;
+      return &sprite;
+    }
+
+  private:
+    QPainter& painter;
+    const QPainterPath& path;
+    bool scaleline;
+    DirectMarkerDrawer direct;
+    QTransform origtrans, devM;
+    QRectF pathbox;
+    QPen pen;
+    QRgb brushcol;
+    bool nobrush;
+    // whether the world transform has been reset
+    bool identity;
+    std::map<SpriteKey, Sprite> sprites;
+  };
+
+  // Draws markers to a vector device by merging markers with the same
+  // brush into a single path. Markers are only merged if they do not
+  // overlap, so that the output looks the same as drawing them
+  // separately. Overlaps are found using a grid of cells the size of
+  // a marker.
+  class MergedMarkerDrawer
+  {
+  public:
+    MergedMarkerDrawer(QPainter& _painter, const QPainterPath& _path,
+                       bool _scaleline)
+      : painter(_painter), path(_path), scaleline(_scaleline),
+        direct(_painter, _path, _scaleline),
+        pathbox(_path.controlPointRect()),
+        margin(penMargin(_painter.pen())),
+        cellsize(0), groupcol(0), groupscale(1), hascol(false)
+    {
+      // cosmetic pens have widths in device pixels
+      if( _painter.pen().isCosmetic() )
+        {
+          const QTransform& m = _painter.deviceTransform();
+          const qreal devscale = std::sqrt(std::abs(m.determinant()));
+          margin = devscale > 0 ? margin/devscale : 0;
+        }
+      group.setFillRule(_path.fillRule());
+    }
+
+    // can markers be merged? This is done for devices other than
+    // raster ones, if dashes do not need to restart for each marker
+    static bool usable(QPainter& painter)
+    {
+      const QPaintEngine* engine = painter.paintEngine();
+      if( engine == 0 || engine->type() == QPaintEngine::Raster )
+        return false;
+      const Qt::PenStyle ps = painter.pen().style();
+      return ps == Qt::NoPen || ps == Qt::SolidLine;
+    }
+
+    void draw(const QPointF& pt, const QRgb* col, qreal s)
+    {
+      if( !(s > 0 && isFinite(s)) )
+        {
+          flush();
+          direct.draw(pt, col, s);
+          return;
+        }
+
+      // the pen scales with the markers for scaleline
+      const qreal m = scaleline ? margin*s : margin;
+      const QRectF box(pt.x()+pathbox.left()*s-m, pt.y()+pathbox.top()*s-m,
+                       pathbox.width()*s+2*m, pathbox.height()*s+2*m);
+      if( cellsize <= 0 )
+        cellsize = std::max(std::max(box.width(), box.height()), qreal(1e-6));
+
+      const qint64 cx1 = qint64(std::floor(box.left()/cellsize));
+      const qint64 cx2 = qint64(std::floor(box.right()/cellsize));
+      const qint64 cy1 = qint64(std::floor(box.top()/cellsize));
+      const qint64 cy2 = qint64(std::floor(box.bottom()/cellsize));
+      if( (cx2-cx1+1)*(cy2-cy1+1) > MARKER_MAX_CELLS )
+        {
+          // too large to track, so draw on its own
+          flush();
+          direct.draw(pt, col, s);
+          return;
+        }
+
+      const bool samebrush = (col == 0 || (hascol && *col == groupcol)) &&
+        (!scaleline || s == groupscale);
+      bool overlap = false;
+      if( samebrush )
+        for(qint64 cy=cy1; cy<=cy2 && !overlap; ++cy)
+          for(qint64 cx=cx1; cx<=cx2 && !overlap; ++cx)
+            overlap = cells.count(cellKey(cx, cy)) != 0;
+      if( !samebrush || overlap )
+        flush();
+
+      for(qint64 cy=cy1; cy<=cy2; ++cy)
+        for(qint64 cx=cx1; cx<=cx2; ++cx)
+          cells.insert(cellKey(cx, cy));
+
+      if( col != 0 )
+        {
+          groupcol = *col;
+          hascol = true;
+        }
+      groupscale = s;
+
+      if( s == 1 )
+        group.addPath(path.translated(pt));
+      else if( scaleline )
+        // drawn with the painter scaled by s
+        group.addPath(path.translated(pt/s));
+      else
+        group.addPath(scalePath(path, s).translated(pt));
+    }
+
+    void finish()
+    {
+      flush();
+    }
+
+  private:
+    static quint64 cellKey(qint64 cx, qint64 cy)
+    {
+      return (quint64(cx) << 32) ^ quint64(quint32(cy));
+    }
+
+    void flush()
+    {
+      if( !group.isEmpty() )
+        {
+          if( hascol )
+            painter.setBrush( QBrush(QColor::fromRgba(groupcol)) );
+          if( scaleline && groupscale != 1 )
+            {
+              painter.save();
+              painter.scale(groupscale, groupscale);
+              painter.drawPath(group);
+              painter.restore();
+            }
+          else
+            {
+              painter.drawPath(group);
+            }
+
+          group = QPainterPath();
+          group.setFillRule(path.fillRule());
+        }
+      cells.clear();
+    }
+
+  private:
+    QPainter& painter;
+    const QPainterPath& path;
+    bool scaleline;
+    DirectMarkerDrawer direct;
+    QRectF pathbox;
+    qreal margin, cellsize;
+    QPainterPath group;
+    QRgb groupcol;
+    qreal groupscale;
+    bool hascol;
+    std::unordered_set<quint64> cells;
+  };
+
+  // Skips markers which would be drawn entirely over pixels already
+  // covered by earlier markers. The covered pixels are kept in a
+  // bitmap of the device pixels. The footprint of each marker size is
+  // rasterised once, taking the fully covered pixels (shrunk by a
+  // pixel) as those it covers, and the pixels it touches (grown by a
+  // pixel) as those which must already be covered to skip it.
+  class MarkerDecimator
+  {
+  public:
+    MarkerDecimator(QPainter& _painter, const QPainterPath& _path,
+                    bool _scaleline, const QRectF& cliprect)
+      : painter(_painter), path(_path), scaleline(_scaleline),
+        devM(_painter.deviceTransform()),
+        x0(0), y0(0), width(0), height(0)
+    {
+      const QRect devrect(0, 0, _painter.device()->width(),
+                          _painter.device()->height());
+      const QRect r = devM.mapRect(cliprect).toAlignedRect().intersected(devrect);
+      if( r.isValid() )
+        {
+          x0 = r.left(); y0 = r.top();
+          width = r.width(); height = r.height();
+          bitmap.assign(size_t(width)*height, 0);
+        }
+    }
+
+    // Can markers be decimated? Markers are all drawn the same way,
+    // so they must be opaque and not have varying colors. A marker
+    // with an outline of a different color to its fill is not the
+    // same on top of other markers, so the two colors must match.
+    static bool usable(QPainter& painter)
+    {
+      if( painter.device() == 0 )
+        return false;
+      if( painter.compositionMode() != QPainter::CompositionMode_SourceOver ||
+          painter.opacity() != 1 )
+        return false;
+      const QTransform& m = painter.deviceTransform();
+      if( m.type() > QTransform::TxScale || m.m11() <= 0 || m.m22() <= 0 )
+        return false;
+      const QBrush& brush = painter.brush();
+      if( brush.style() != Qt::NoBrush &&
+          !(brush.style() == Qt::SolidPattern && brush.color().alpha() == 255) )
+        return false;
+      const QPen& pen = painter.pen();
+      if( pen.style() != Qt::NoPen &&
+          !(pen.brush().style() == Qt::SolidPattern &&
+            pen.color().alpha() == 255) )
+        return false;
+      if( pen.style() != Qt::NoPen && brush.style() != Qt::NoBrush &&
+          pen.color().rgba() != brush.color().rgba() )
+        return false;
+      return true;
+    }
+
+    // should the marker at pt with scale s be drawn? If so, add the
+    // pixels it covers to the bitmap
+    bool draw(const QPointF& pt, qreal s)
+    {
+      if( bitmap.empty() || !(s > 0 && isFinite(s)) )
+        return true;
+
+      const Footprint* fp = getFootprint(s);
+      if( fp == 0 )
+        return true;
+
+      const QPointF dpt = devM.map(pt);
+      const int px = int(std::floor(dpt.x()+0.5)) - x0;
+      const int py = int(std::floor(dpt.y()+0.5)) - y0;
+
+      bool covered = true;
+      for(size_t i=0, n=fp->touched.size(); i<n && covered; ++i)
+        {
+          const int x = px + fp->touched[i].x();
+          const int y = py + fp->touched[i].y();
+          covered = x >= 0 && y >= 0 && x < width && y < height &&
+            bitmap[size_t(y)*width+x];
+        }
+      if( covered )
+        return false;
+
+      for(auto const& off : fp->covered)
+        {
+          const int x = px + off.x();
+          const int y = py + off.y();
+          if( x >= 0 && y >= 0 && x < width && y < height )
+            bitmap[size_t(y)*width+x] = 1;
+        }
+      return true;
+    }
+
+  private:
+    struct Footprint
+    {
+      // pixel offsets from the marker position
+      std::vector<QPoint> covered, touched;
+    };
+
+    // returns 0 if the marker size is not decimated
+    const Footprint* getFootprint(qreal s)
+    {
+      std::map<qreal, Footprint>::const_iterator it = footprints.find(s);
+      if( it != footprints.end() )
+        return it->second.touched.empty() ? 0 : &(it->second);
+      if( int(footprints.size()) >= MARKER_MAX_SPRITES )
+        return 0;
+
+      Footprint& fp = footprints[s];
+
+      const qreal sx = devM.m11();
+      const qreal sy = devM.m22();
+      const QPen& pen = painter.pen();
+      qreal margin = penMargin(pen);
+      if( !pen.isCosmetic() )
+        margin *= std::max(sx, sy) * (scaleline ? s : 1);
+      margin += 2;
+      const QRectF pathbox = path.controlPointRect();
+      const qreal x1 = pathbox.left()*s*sx - margin;
+      const qreal y1 = pathbox.top()*s*sy - margin;
+      const qreal x2 = pathbox.right()*s*sx + margin;
+      const qreal y2 = pathbox.bottom()*s*sy + margin;
+      if( !(x2-x1 < MARKER_MAX_SPRITE_SIZE && y2-y1 < MARKER_MAX_SPRITE_SIZE) )
+        return 0;
+
+      // draw the marker in opaque black to get its coverage
+      const int ox = int(std::ceil(-x1));
+      const int oy = int(std::ceil(-y1));
+      const int w = ox + int(std::ceil(x2)) + 1;
+      const int h = oy + int(std::ceil(y2)) + 1;
+      QImage img(w, h, QImage::Format_ARGB32_Premultiplied);
+      img.fill(0);
+      {
+        QPainter p(&img);
+        p.setRenderHints(painter.renderHints());
+        QPen mpen(pen);
+        if( mpen.style() != Qt::NoPen )
+          mpen.setColor(Qt::black);
+        p.setPen(mpen);
+        if( painter.brush().style() == Qt::NoBrush )
+          p.setBrush(QBrush());
+        else
+          p.setBrush(QBrush(Qt::black));
+        p.translate(ox, oy);
+        p.scale(sx, sy);
+        if( scaleline )
+          {
+            p.scale(s, s);
+            p.drawPath(path);
+          }
+        else
+          {
+            p.drawPath( scalePath(path, s) );
+          }
+      }
+
+      // markers are positioned to the nearest pixel, so shrink the
+      // covered area and grow the touched area by a pixel
+      auto alpha = [&img, w, h](int x, int y)
+        {
+          if( x < 0 || y < 0 || x >= w || y >= h )
+            return 0;
+          return qAlpha(reinterpret_cast<const QRgb*>(img.constScanLine(y))[x]);
+        };
+      for(int y=0; y<h; ++y)
+        for(int x=0; x<w; ++x)
+          {
+            bool anytouch = false;
+            bool allfull = true;
+            for(int dy=-1; dy<=1; ++dy)
+              for(int dx=-1; dx<=1; ++dx)
+                {
+                  const int a = alpha(x+dx, y+dy);
+                  anytouch = anytouch || a > 0;
+                  allfull = allfull && a == 255;
+                }
+            if( anytouch )
+              fp.touched.push_back(QPoint(x-ox, y-oy));
+            if( allfull )
+              fp.covered.push_back(QPoint(x-ox, y-oy));
+          }
+
+      return fp.touched.empty() ? 0 : &fp;
+    }
+
+  private:
+    QPainter& painter;
+    const QPainterPath& path;
+    bool scaleline;
+    QTransform devM;
+    // device pixel range of bitmap
+    int x0, y0, width, height;
+    std::vector<unsigned char> bitmap;
+    std::map<qreal, Footprint> footprints;
+  };
+
+  template<class Drawer>
+  void plotMarkers(Drawer& drawer,
+                   const Numpy1DObj& x, const Numpy1DObj& y,
+                   const Numpy1DObj* scaling,
+                   const QImage* colorimg,
+                   const QRectF& cliprect, int size,
+                   MarkerDecimator* decimator)
+  {
+    // keep track of duplicate points
+    QPointF lastpt(-1e6, -1e6);
+
+    for(int i = 0; i < size; ++i)
+      {
+        const QPointF pt(x(i), y(i));
+        if( cliprect.contains(pt) && ! smallDelta(lastpt, pt) )
+          {
+            QRgb col;
+            if( colorimg != 0 )
+              col = colorimg->pixel(i, 0);
+            const qreal s = scaling != 0 ? (*scaling)(i) : 1;
+
+            if( decimator == 0 || decimator->draw(pt, s) )
+              drawer.draw(pt, colorimg != 0 ? &col : 0, s);
+            lastpt = pt;
+          }
+      }
+
+    drawer.finish();
+  }
+}
+
 void plotPathsToPainter(QPainter& painter, QPainterPath& path,
 			const Numpy1DObj& x, const Numpy1DObj& y,
 			const Numpy1DObj* scaling,
 			const QRectF* clip,
 			const QImage* colorimg,
-			bool scaleline)
+			bool scaleline,
+			bool decimate)
 {
+  TRACE_SCOPE("qtloops.plotPathsToPainter");
+
   QRectF cliprect( QPointF(-32767,-32767), QPointF(32767,32767) );
   if( clip != 0 )
     {
@@ -176,11 +885,6 @@ void plotPathsToPainter(QPainter& painter, QPainterPath& path,
   cliprect.adjust(pathbox.left(), pathbox.top(),
 		  pathbox.bottom(), pathbox.right());
 
-  // keep track of duplicate points
-  QPointF lastpt(-1e6, -1e6);
-  // keep original transformation for restoration after each iteration
-  QTransform origtrans(painter.worldTransform());
-
   // number of iterations
   int size = std::min(x.dim, y.dim);
 
@@ -190,118 +894,295 @@ void plotPathsToPainter(QPainter& painter, QPainterPath& path,
   // too few scaling points
   if( scaling != 0 )
     size = std::min(size, scaling->dim);
+  TRACE_COUNT("qtloops.markers.points", size);
+
+  // skip hidden markers, unless they vary in color
+  MarkerDecimator* decimator = 0;
+  if( decimate && size >= MARKER_BATCH_MIN && colorimg == 0 &&
+      MarkerDecimator::usable(painter) )
+    decimator = new MarkerDecimator(painter, path, scaleline, cliprect);
 
-  // draw each path
-  for(int i = 0; i < size; ++i)
+  // Markers are drawn as sprites on raster devices, or merged into
+  // paths on others, unless there are only a few
+  if( size < MARKER_BATCH_MIN )
     {
-      const QPointF pt(x(i), y(i));
-      if( cliprect.contains(pt) && ! smallDelta(lastpt, pt) )
-	{
-	  painter.translate(pt);
+      DirectMarkerDrawer drawer(painter, path, scaleline);
+      plotMarkers(drawer, x, y, scaling, colorimg, cliprect, size, decimator);
+    }
+  else if( SpriteMarkerDrawer::usable(painter) )
+    {
+      SpriteMarkerDrawer drawer(painter, path, scaleline);
+      plotMarkers(drawer, x, y, scaling, colorimg, cliprect, size, decimator);
+    }
+  else if( MergedMarkerDrawer::usable(painter) )
+    {
+      MergedMarkerDrawer drawer(painter, path, scaleline);
+      plotMarkers(drawer, x, y, scaling, colorimg, cliprect, size, decimator);
+    }
+  else
+    {
+      DirectMarkerDrawer drawer(painter, path, scaleline);
+      plotMarkers(drawer, x, y, scaling, colorimg, cliprect, size, decimator);
+    }
 
-	  if( colorimg != 0 )
-	    {
-	      // get color from pixel and create a new brush
-	      QBrush b( QColor::fromRgba(colorimg->pixel(i, 0)) );
-	      painter.setBrush(b);
-	    }
+  delete decimator;
+}
 
-	  if( scaling == 0 )
-	    {
-	      painter.drawPath(path);
-	    }
-	  else
-	    {
-	      // scale point if requested
-	      const qreal s = (*scaling)(i);
-	      if( scaleline )
-		{
-		  painter.scale(s, s);
-		  painter.drawPath(path);
-		}
-	      else
-		{
-		  painter.drawPath( scalePath(path, s) );
-		}
-	    }
+QImage pointDensityImage(const Numpy1DObj& x, const Numpy1DObj& y,
+                         const QRectF& bounds, int width, int height,
+                         const QColor& color)
+{
+  if( width <= 0 || height <= 0 )
+    throw "Image size must be positive";
+
+  // count the points in each pixel
+  std::vector<unsigned> counts(size_t(width)*height, 0);
+  const qreal sx = width / bounds.width();
+  const qreal sy = height / bounds.height();
+  const int size = std::min(x.dim, y.dim);
+  unsigned maxcount = 0;
+  for(int i=0; i<size; ++i)
+    {
+      const qreal fx = (x(i)-bounds.left())*sx;
+      const qreal fy = (y(i)-bounds.top())*sy;
+      // also excludes non finite values
+      if( fx >= 0 && fy >= 0 && fx < width && fy < height )
+        {
+          unsigned& c = counts[size_t(int(fy))*width+int(fx)];
+          ++c;
+          maxcount = std::max(maxcount, c);
+        }
+    }
 
-	  painter.setWorldTransform(origtrans);
-	  lastpt = pt;
-	}
+  // alpha is proportional to log count, relative to the maximum
+  QImage img(width, height, QImage::Format_ARGB32_Premultiplied);
+  img.fill(0);
+  const QRgb col = color.rgba();
+  const double lognorm = maxcount > 0 ? qAlpha(col)/std::log1p(maxcount) : 0;
+  for(int py=0; py<height; ++py)
+    {
+      QRgb* scanline = reinterpret_cast<QRgb*>(img.scanLine(py));
+      const unsigned* crow = &counts[size_t(py)*width];
+      for(int px=0; px<width; ++px)
+        if( crow[px] > 0 )
+          {
+            const int a = clipval(int(std::log1p(crow[px])*lognorm + 0.5),
+                                  0, 255);
+            scanline[px] = qPremultiply(qRgba(qRed(col), qGreen(col),
+                                              qBlue(col), a));
+          }
     }
+
+  return img;
 }
 
-void plotLinesToPainter(QPainter& painter,
-			const Numpy1DObj& x1, const Numpy1DObj& y1,
-			const Numpy1DObj& x2, const Numpy1DObj& y2,
-			const QRectF* clip, bool autoexpand)
+namespace
 {
-  const int maxsize = min(x1.dim, x2.dim, y1.dim, y2.dim);
+  // number of lines or boxes tested together for being inside the clip
+#define QTLOOPS_CLIP_BLOCK 8
 
-  // if autoexpand, expand rectangle by line width
-  QRectF clipcopy;
-  if ( clip != 0 && autoexpand )
-    {
-      const qreal lw = painter.pen().widthF();
-      qreal x1, y1, x2, y2;
-      clip->getCoords(&x1, &y1, &x2, &y2);
-      clipcopy.setCoords(x1, y1, x2, y2);
-      clipcopy.adjust(-lw, -lw, lw, lw);
-    }
+  // clipping rectangle for lines or boxes, expanded by the line width
+  QRectF penClipRect(const QPainter& painter, const QRectF& clip)
+  {
+    const qreal lw = painter.pen().widthF();
+    return clip.normalized().adjusted(-lw, -lw, lw, lw);
+  }
 
-  if( maxsize != 0 )
-    {
-      QVector<QLineF> lines;
-      for(int i = 0; i < maxsize; ++i)
-	{
-	  QPointF pt1(x1(i), y1(i));
-	  QPointF pt2(x2(i), y2(i));
-	  if( clip != 0 )
-	    {
-	      if( clipLine(clipcopy, pt1, pt2) )
-		lines << QLineF(pt1, pt2);
-	    }
-	  else
-	    lines << QLineF(pt1, pt2);
-	}
+  // total number of items in sets of four arrays
+  int numSetItems(const Numpy1DObj* const* arrays, int nsets)
+  {
+    int total = 0;
+    for(int s=0; s<nsets; ++s)
+      {
+        const Numpy1DObj* const* a = arrays + s*4;
+        total += min(a[0]->dim, a[1]->dim, a[2]->dim, a[3]->dim);
+      }
+    return total;
+  }
+
+  inline void setItemCoords(QLineF& line, double x1, double y1,
+                            double x2, double y2)
+  {
+    line.setLine(x1, y1, x2, y2);
+  }
+  inline void setItemCoords(QRectF& rect, double x1, double y1,
+                            double x2, double y2)
+  {
+    rect.setCoords(x1, y1, x2, y2);
+  }
 
+  // read the coordinates of the sets of four arrays into out, as
+  // x1, y1, x2, y2 for each item
+  template<class T> void gatherSets(const Numpy1DObj* const* arrays,
+                                    int nsets, T* out)
+  {
+    for(int s=0; s<nsets; ++s)
+      {
+        const Numpy1DObj* const* a = arrays + s*4;
+        const int n = min(a[0]->dim, a[1]->dim, a[2]->dim, a[3]->dim);
+        const double* d[4];
+        for(int j=0; j<4; ++j)
+          d[j] = a[j]->contiguousDoubles();
+
+        if( d[0]!=0 && d[1]!=0 && d[2]!=0 && d[3]!=0 )
+          for(int i=0; i<n; ++i)
+            setItemCoords(out[i], d[0][i], d[1][i], d[2][i], d[3][i]);
+        else
+          for(int i=0; i<n; ++i)
+            setItemCoords(out[i], (*a[0])(i), (*a[1])(i),
+                          (*a[2])(i), (*a[3])(i));
+        out += n;
+      }
+  }
+
+  // clip lines in place, removing those outside, and returning the
+  // number left
+  // Blocks of lines which are entirely inside are tested without
+  // branches, so only lines near the edges are clipped one by one.
+  int clipLinesInPlace(const QRectF& clip, QLineF* lines, int n)
+  {
+    const ClipRuns runs(clip);
+    int nout = 0;
+    int i = 0;
+    while( i < n )
+      {
+        const int blockend = std::min(i+QTLOOPS_CLIP_BLOCK, n);
+        bool all = true;
+        for(int j=i; j<blockend; ++j)
+          all &= runs.inside(lines[j].p1()) & runs.inside(lines[j].p2());
+
+        if( all )
+          for( ; i<blockend; ++i)
+            lines[nout++] = lines[i];
+        else
+          for( ; i<blockend; ++i)
+            {
+              QPointF pt1(lines[i].p1());
+              QPointF pt2(lines[i].p2());
+              if( clipLine(clip, pt1, pt2) )
+                lines[nout++] = QLineF(pt1, pt2);
+            }
+      }
+    return nout;
+  }
+
+  // normalize boxes and clip them in place, removing those outside,
+  // and returning the number left
+  int clipBoxesInPlace(const QRectF& clip, QRectF* rects, int n)
+  {
+    const double left = clip.left(), right = clip.right();
+    const double top = clip.top(), bottom = clip.bottom();
+    int nout = 0;
+    int i = 0;
+    while( i < n )
+      {
+        const int blockend = std::min(i+QTLOOPS_CLIP_BLOCK, n);
+        bool all = true;
+        for(int j=i; j<blockend; ++j)
+          {
+            rects[j] = rects[j].normalized();
+            all &= (rects[j].left() >= left) & (rects[j].right() <= right) &
+              (rects[j].top() >= top) & (rects[j].bottom() <= bottom);
+          }
+
+        if( all )
+          for( ; i<blockend; ++i)
+            rects[nout++] = rects[i];
+        else
+          for( ; i<blockend; ++i)
+            if( clip.intersects(rects[i]) )
+              rects[nout++] = clip.intersected(rects[i]);
+      }
+    return nout;
+  }
+
+  void plotLineArraysToPainter(QPainter& painter,
+                               const Numpy1DObj* const* arrays, int nsets,
+                               const QRectF* clip, bool autoexpand)
+  {
+    TRACE_SCOPE("qtloops.plotLines");
+    QVector<QLineF> lines(numSetItems(arrays, nsets));
+    if( lines.isEmpty() )
+      return;
+    TRACE_COUNT("qtloops.lines.clipped", lines.size());
+    gatherSets(arrays, nsets, lines.data());
+
+    // the clip is only used if autoexpand, as it always has been
+    if( clip != 0 && autoexpand )
+      {
+        const int n = clipLinesInPlace(
+          penClipRect(painter, *clip), lines.data(), lines.size());
+        lines.resize(n);
+      }
+
+    TRACE_COUNT("qtloops.lines.drawn", lines.size());
+    if( ! lines.isEmpty() )
       painter.drawLines(lines);
-    }
+  }
+
+  void plotBoxArraysToPainter(QPainter& painter,
+                              const Numpy1DObj* const* arrays, int nsets,
+                              const QRectF* clip, bool autoexpand)
+  {
+    TRACE_SCOPE("qtloops.plotBoxes");
+    QVector<QRectF> rects(numSetItems(arrays, nsets));
+    if( rects.isEmpty() )
+      return;
+    TRACE_COUNT("qtloops.boxes.clipped", rects.size());
+    gatherSets(arrays, nsets, rects.data());
+
+    // without a clip (or autoexpand), boxes are still limited to the
+    // coordinate range
+    const QRectF cliprect =
+      clip != 0 && autoexpand ? penClipRect(painter, *clip) :
+      QRectF(QPointF(-32767,-32767), QPointF(32767,32767));
+    rects.resize(clipBoxesInPlace(cliprect, rects.data(), rects.size()));
+
+    TRACE_COUNT("qtloops.boxes.drawn", rects.size());
+    if( ! rects.isEmpty() )
+      painter.drawRects(rects);
+  }
+
+  // check the arrays of a tuple are in sets of four
+  void checkArraySets(const Tuple2Ptrs& sets)
+  {
+    if( sets.data.size() % 4 != 0 )
+      throw "Arrays should be given in sets of x1, y1, x2, y2";
+  }
 }
 
-void plotBoxesToPainter(QPainter& painter,
+void plotLinesToPainter(QPainter& painter,
 			const Numpy1DObj& x1, const Numpy1DObj& y1,
 			const Numpy1DObj& x2, const Numpy1DObj& y2,
 			const QRectF* clip, bool autoexpand)
 {
-  // if autoexpand, expand rectangle by line width
-  QRectF clipcopy(QPointF(-32767,-32767), QPointF(32767,32767));
-  if ( clip != 0 && autoexpand )
-    {
-      const qreal lw = painter.pen().widthF();
-      qreal x1, y1, x2, y2;
-      clip->getCoords(&x1, &y1, &x2, &y2);
-      clipcopy.setCoords(x1, y1, x2, y2);
-      clipcopy.adjust(-lw, -lw, lw, lw);
-    }
-
-  const int maxsize = min(x1.dim, x2.dim, y1.dim, y2.dim);
+  const Numpy1DObj* arrays[4] = { &x1, &y1, &x2, &y2 };
+  plotLineArraysToPainter(painter, arrays, 1, clip, autoexpand);
+}
 
-  QVector<QRectF> rects;
-  for(int i = 0; i < maxsize; ++i)
-    {
-      QPointF pt1(x1(i), y1(i));
-      QPointF pt2(x2(i), y2(i));
-      const QRectF rect(pt1, pt2);
+void plotLineSetsToPainter(QPainter& painter, const Tuple2Ptrs& sets,
+                           const QRectF* clip, bool autoexpand)
+{
+  checkArraySets(sets);
+  plotLineArraysToPainter(painter, sets.data.constData(),
+                          sets.data.size()/4, clip, autoexpand);
+}
 
-      if( clipcopy.intersects(rect) )
-	{
-	  rects << clipcopy.intersected(rect);
-	}
-    }
+void plotBoxesToPainter(QPainter& painter,
+			const Numpy1DObj& x1, const Numpy1DObj& y1,
+			const Numpy1DObj& x2, const Numpy1DObj& y2,
+			const QRectF* clip, bool autoexpand)
+{
+  const Numpy1DObj* arrays[4] = { &x1, &y1, &x2, &y2 };
+  plotBoxArraysToPainter(painter, arrays, 1, clip, autoexpand);
+}
 
-  if( ! rects.isEmpty() )
-    painter.drawRects(rects);
+void plotBoxSetsToPainter(QPainter& painter, const Tuple2Ptrs& sets,
+                          const QRectF* clip, bool autoexpand)
+{
+  checkArraySets(sets);
+  plotBoxArraysToPainter(painter, sets.data.constData(),
+                         sets.data.size()/4, clip, autoexpand);
 }
 
 void addCubicsToPainterPath(QPainterPath& path, const QPolygonF& poly)
@@ -316,9 +1197,86 @@ void addCubicsToPainterPath(QPainterPath& path, const QPolygonF& poly)
     }
 }
 
+namespace
+{
+  // rows of images processed by each task when threading
+  const int IMAGE_TASK_ROWS = 32;
+  // minimum number of pixels to use threads for
+  const int IMAGE_THREAD_MIN_PIXELS = 65536;
+  // minimum number of colour lookup table entries per colour band
+  const int IMAGE_LUT_PER_BAND = 64;
+  const int IMAGE_LUT_MIN = 4096;
+  const int IMAGE_LUT_MAX = 65536;
+
+  // interpolate color for val (between 0 and 1) from the bands of
+  // colors, or its discrete band if jumps is set
+  QRgb mapColor(const Numpy2DIntObj &colors, double val, bool jumps)
+  {
+    const int numcolors = colors.dims[0];
+    const int numbands = numcolors-1;
+    int b, g, r, a;
+
+    val = clipval(val, 0., 1.);
+
+    if( jumps )
+      {
+        // jumps between colours in discrete mode
+        // (ignores 1st color, which signals this mode)
+        const int band = clipval(int(val*(numcolors-1))+1, 1,
+                                 numcolors-1);
+
+        b = colors(0, band);
+        g = colors(1, band);
+        r = colors(2, band);
+        a = colors(3, band);
+      }
+    else
+      {
+        // do linear interpolation between bands
+        // make sure between 0 and 1
+
+        const int band = clipval(int(val*numbands), 0, numbands-1);
+        const double delta = val*numbands - band;
+
+        // ensure we don't read beyond where we should
+        const int band2 = std::min(band + 1, numbands);
+        const double delta1 = 1.-delta;
+
+        // we add 0.5 before truncating to round to nearest int
+        b = int(delta1*colors(0, band) +
+                delta *colors(0, band2) + 0.5);
+        g = int(delta1*colors(1, band) +
+                delta *colors(1, band2) + 0.5);
+        r = int(delta1*colors(2, band) +
+                delta *colors(2, band2) + 0.5);
+        a = int(delta1*colors(3, band) +
+                delta *colors(3, band2) + 0.5);
+      }
+
+    return qRgba(r, g, b, a);
+  }
+
+  // call func(y1, y2) for ranges of rows, in parallel for large images
+  template<class Func> void forImageRows(int width, int height, Func func)
+  {
+    const unsigned ntasks = (height+IMAGE_TASK_ROWS-1) / IMAGE_TASK_ROWS;
+    const unsigned nthreads =
+      qint64(width)*height >= IMAGE_THREAD_MIN_PIXELS ?
+      parallelNumThreads() : 1;
+
+    parallelFor(ntasks, nthreads, [&](unsigned task)
+                {
+                  const int y1 = task*IMAGE_TASK_ROWS;
+                  func(y1, std::min(y1+IMAGE_TASK_ROWS, height));
+                });
+  }
+}
+
 QImage numpyToQImage(const Numpy2DObj& imgdata, const Numpy2DIntObj &colors,
-		     bool forcetrans)
+		     bool forcetrans, bool exact)
 {
+  TRACE_SCOPE("qtloops.numpyToQImage");
+
   // make format use alpha transparency if required
   const int numcolors = colors.dims[0];
   if ( colors.dims[1] != 4 )
@@ -328,83 +1286,102 @@ QImage numpyToQImage(const Numpy2DObj& imgdata, const Numpy2DIntObj &colors,
   const int numbands = numcolors-1;
   const int xw = imgdata.dims[1];
   const int yw = imgdata.dims[0];
+  TRACE_COUNT("qtloops.image.pixelsmapped", (long long)(xw)*yw);
 
   // if the first value in the color is -1 then switch to jumping mode
   const bool jumps = colors(0,0) == -1;
 
+  // Unless exact or in jumping mode, colors are looked up in a table
+  // of values sampled finely enough that the difference from
+  // interpolating is invisible. The last entry is for non-finite
+  // values (transparent).
+  const bool uselut = !exact && !jumps;
+  const int nlut = clipval(numbands*IMAGE_LUT_PER_BAND,
+                           IMAGE_LUT_MIN, IMAGE_LUT_MAX);
+  std::vector<QRgb> lut;
+  if( uselut )
+    {
+      lut.resize(nlut+1);
+      for(int i=0; i<nlut; ++i)
+        lut[i] = mapColor(colors, double(i)/(nlut-1), false);
+      lut[nlut] = qRgba(0, 0, 0, 0);
+    }
+
   // make image
   QImage img(xw, yw, QImage::Format_ARGB32);
+  uchar* bits = img.bits();
+  const int bpl = img.bytesPerLine();
 
-  // does the image use alpha values?
-  bool hasalpha = false;
+  // does the image use alpha values? (set by each thread)
+  std::atomic<bool> hasalpha(false);
 
-  // iterate over input pixels
-  for(int y=0; y<yw; ++y)
+  forImageRows(xw, yw, [&](int y1, int y2)
     {
-      // direction of images is different for qt and numpy image
-      QRgb* scanline = reinterpret_cast<QRgb*>(img.scanLine(yw-y-1));
-      for(int x=0; x<xw; ++x)
-	{
-	  double val = imgdata(x, y);
-
-	  // output color
-	  int b, g, r, a;
+      std::vector<double> rowbuf;
+      std::vector<int> idxs;
+      bool rowalpha = false;
 
-	  if( ! isFinite(val) )
-	    {
-	      // transparent
-	      b = g = r = a = 0;
-	    }
-	  else
-	    {
-	      val = clipval(val, 0., 1.);
-
-	      if( jumps )
-		{
-		  // jumps between colours in discrete mode
-		  // (ignores 1st color, which signals this mode)
-		  const int band = clipval(int(val*(numcolors-1))+1, 1,
-					   numcolors-1);
-
-		  b = colors(0, band);
-		  g = colors(1, band);
-		  r = colors(2, band);
-		  a = colors(3, band);
-		}
-	      else
-		{
-		  // do linear interpolation between bands
-		  // make sure between 0 and 1
-
-		  const int band = clipval(int(val*numbands), 0, numbands-1);
-		  const double delta = val*numbands - band;
-
-		  // ensure we don't read beyond where we should
-		  const int band2 = std::min(band + 1, numbands);
-		  const double delta1 = 1.-delta;
-
-                  // we add 0.5 before truncating to round to nearest int
-		  b = int(delta1*colors(0, band) +
-			  delta *colors(0, band2) + 0.5);
-		  g = int(delta1*colors(1, band) +
-			  delta *colors(1, band2) + 0.5);
-		  r = int(delta1*colors(2, band) +
-			  delta *colors(2, band2) + 0.5);
-		  a = int(delta1*colors(3, band) +
-			  delta *colors(3, band2) + 0.5);
-	      
-		}
-	    }
-
-          if(a != 255)
-            hasalpha = true;
-
-	  *(scanline+x) = qRgba(r, g, b, a);
-	}
-    }
+      for(int y=y1; y<y2; ++y)
+        {
+          // direction of images is different for qt and numpy image
+          QRgb* scanline = reinterpret_cast<QRgb*>(bits + (yw-y-1)*bpl);
+
+          // get row as doubles
+          const double* row = imgdata.rowDoubles(y);
+          if( row == 0 )
+            {
+              rowbuf.resize(xw);
+              for(int x=0; x<xw; ++x)
+                rowbuf[x] = imgdata(x, y);
+              row = rowbuf.data();
+            }
+
+          if( uselut )
+            {
+              // branch-free so that the compiler can vectorize the
+              // index calculation
+              idxs.resize(xw);
+              int* idxp = idxs.data();
+              const double scale = nlut-1;
+              for(int x=0; x<xw; ++x)
+                {
+                  const double val = row[x];
+                  // false for infinite or NaN
+                  const bool finite = (val-val) == 0;
+                  const double cval = std::min(std::max(val, 0.), 1.);
+                  const int idx = int(cval*scale + 0.5);
+                  idxp[x] = finite ? idx : nlut;
+                }
+              for(int x=0; x<xw; ++x)
+                {
+                  const QRgb col = lut[idxp[x]];
+                  rowalpha |= qAlpha(col) != 255;
+                  scanline[x] = col;
+                }
+            }
+          else
+            {
+              for(int x=0; x<xw; ++x)
+                {
+                  const double val = row[x];
+                  QRgb col;
+                  if( ! isFinite(val) )
+                    // transparent
+                    col = qRgba(0, 0, 0, 0);
+                  else
+                    col = mapColor(colors, val, jumps);
+
+                  rowalpha |= qAlpha(col) != 255;
+                  scanline[x] = col;
+                }
+            }
+        }
 
+      if( rowalpha )
+        hasalpha = true;
+    });
 
-  if(!hasalpha)
+  if(!hasalpha && !forcetrans)
     {
       // return image without transparency for speed / space improvements
 #if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
@@ -424,22 +1401,139 @@ void applyImageTransparancy(QImage& img, const Numpy2DObj& data)
 {
   const int xw = std::min(data.dims[1], img.width());
   const int yw = std::min(data.dims[0], img.height());
-  
-  for(int y=0; y<yw; ++y)
+  if( xw <= 0 || yw <= 0 )
+    return;
+
+  uchar* bits = img.bits();
+  const int bpl = img.bytesPerLine();
+
+  forImageRows(xw, yw, [&](int y1, int y2)
     {
-      // direction of images is different for qt and numpy image
-      QRgb* scanline = reinterpret_cast<QRgb*>(img.scanLine(yw-y-1));
-      for(int x=0; x<xw; ++x)
-	{
-	  const double val = clipval(data(x, y), 0., 1.);
-	  const QRgb col = *(scanline+x);
+      std::vector<double> rowbuf;
 
-	  // update pixel alpha component
-	  QRgb newcol = qRgba( qRed(col), qGreen(col), qBlue(col),
-			       int(qAlpha(col)*val) );
-	  *(scanline+x) = newcol;
-	}
+      for(int y=y1; y<y2; ++y)
+        {
+          // direction of images is different for qt and numpy image
+          QRgb* scanline = reinterpret_cast<QRgb*>(bits + (yw-y-1)*bpl);
+
+          const double* row = data.rowDoubles(y);
+          if( row == 0 )
+            {
+              rowbuf.resize(xw);
+              for(int x=0; x<xw; ++x)
+                rowbuf[x] = data(x, y);
+              row = rowbuf.data();
+            }
+
+          for(int x=0; x<xw; ++x)
+            {
+              // non-finite values make the pixel transparent
+              const double v = row[x];
+              const double val = (v-v) == 0 ?
+                std::min(std::max(v, 0.), 1.) : 0.;
+              const QRgb col = scanline[x];
+
+              // update pixel alpha component
+              scanline[x] = (col & 0x00ffffff) |
+                (QRgb(int(qAlpha(col)*val)) << 24);
+            }
+        }
+    });
+}
+
+namespace
+{
+  // Edges of the image pixels along x or y, in output coordinates.
+  // Pixel i of the image covers bound(i) to bound(i+1), where x
+  // edges run left to right and y edges bottom to top (so reversed
+  // compared to the image rows).
+  struct ResampleBounds
+  {
+    ResampleBounds(const Numpy1DObj& _edge, bool _reversed, int imgsize)
+      : edge(_edge), reversed(_reversed),
+        num(std::min(imgsize, _edge.dim-1))
+    {
     }
+
+    double operator()(int i) const
+    {
+      return edge(reversed ? edge.dim-1-i : i);
+    }
+
+    const Numpy1DObj& edge;
+    bool reversed;
+    // number of pixels
+    int num;
+  };
+
+  // image pixel containing the centre of each output pixel from
+  // start to start+num
+  std::vector<int> nearestTable(const ResampleBounds& bound,
+                                int start, int num)
+  {
+    std::vector<int> tab(num);
+    int idx = 0;
+    for(int o=0; o<num; ++o)
+      {
+        const double p = o+start+0.5;
+        while( idx+1 < bound.num && bound(idx+1) <= p )
+          ++idx;
+        tab[o] = idx;
+      }
+    return tab;
+  }
+
+  // pixels to interpolate between and weight of the second (out of
+  // 256) for linear interpolation between image pixel centres
+  struct ResampleInterp
+  {
+    int i1, i2, w;
+  };
+
+  std::vector<ResampleInterp> interpTable(const ResampleBounds& bound,
+                                          int start, int num)
+  {
+    std::vector<ResampleInterp> tab(num);
+    const int last = bound.num-1;
+    int idx = 0;
+    double c1 = 0.5*(bound(0)+bound(1));
+    double c2 = last>0 ? 0.5*(bound(1)+bound(2)) : c1;
+    for(int o=0; o<num; ++o)
+      {
+        const double p = o+start+0.5;
+        while( idx < last && c2 <= p )
+          {
+            ++idx;
+            c1 = c2;
+            c2 = idx<last ? 0.5*(bound(idx+1)+bound(idx+2)) : c1;
+          }
+
+        ResampleInterp& t = tab[o];
+        if( p <= c1 || idx == last )
+          {
+            t.i1 = t.i2 = idx;
+            t.w = 0;
+          }
+        else
+          {
+            t.i1 = idx;
+            t.i2 = idx+1;
+            t.w = clipval(int((p-c1)/(c2-c1)*256+0.5), 0, 256);
+          }
+      }
+    return tab;
+  }
+
+  // interpolate each 8 bit channel of two colours (w out of 256)
+  inline QRgb lerpRgba(QRgb a, QRgb b, int w)
+  {
+    const unsigned w1 = 256-w;
+    const unsigned rb = (((a & 0xff00ff)*w1 + (b & 0xff00ff)*w) >> 8)
+      & 0xff00ff;
+    const unsigned ag = (((a>>8) & 0xff00ff)*w1 + ((b>>8) & 0xff00ff)*w)
+      & 0xff00ff00;
+    return rb | ag;
+  }
 }
 
 QImage resampleNonlinearImage(const QImage& img,
@@ -448,6 +1542,7 @@ QImage resampleNonlinearImage(const QImage& img,
                               const Numpy1DObj& xedge,
                               const Numpy1DObj& yedge)
 {
+  TRACE_SCOPE("qtloops.resampleNonlinearImage");
   putinorder(x0, x1);
   putinorder(y0, y1);
 
@@ -456,127 +1551,318 @@ QImage resampleNonlinearImage(const QImage& img,
 
   QImage outimg(xw, yw, img.format());
 
-  int iy=0;
-  for(int oy=0; oy<yw; ++oy)
+  const ResampleBounds xbound(xedge, false, img.width());
+  const ResampleBounds ybound(yedge, true, img.height());
+  if( xbound.num <= 0 || ybound.num <= 0 )
     {
-      while( yedge(yedge.dim-2-iy)<=oy+y0+0.5 && iy<yedge.dim-1 )
-        ++iy;
+      outimg.fill(0);
+      return outimg;
+    }
 
-      QRgb* oscanline = reinterpret_cast<QRgb*>(outimg.scanLine(oy));
-      const QRgb* iscanline = reinterpret_cast<const QRgb*>(img.scanLine(iy));
+  // input pixel for each output column and row
+  const std::vector<int> ixs(nearestTable(xbound, x0, xw));
+  const std::vector<int> iys(nearestTable(ybound, y0, yw));
 
-      int ix=0;
-      for(int ox=0; ox<xw; ++ox)
-        {
-          while( xedge(ix+1)<=ox+x0+0.5 && ix<xedge.dim-1 )
-            ++ix;
+  uchar* bits = outimg.bits();
+  const int bpl = outimg.bytesPerLine();
 
-          oscanline[ox] = iscanline[ix];
+  forImageRows(xw, yw, [&](int oy1, int oy2)
+    {
+      for(int oy=oy1; oy<oy2; ++oy)
+        {
+          QRgb* oscanline = reinterpret_cast<QRgb*>(bits + oy*bpl);
+          const QRgb* iscanline =
+            reinterpret_cast<const QRgb*>(img.constScanLine(iys[oy]));
+          for(int ox=0; ox<xw; ++ox)
+            oscanline[ox] = iscanline[ixs[ox]];
         }
-    }
+    });
 
   return outimg;
 }
 
-void plotImageAsRects(QPainter& painter, const QRectF& bounds, const QImage& img)
+QImage resampleNonlinearImageBilinear(const QImage& inimg,
+                                      int x0, int y0,
+                                      int x1, int y1,
+                                      const Numpy1DObj& xedge,
+                                      const Numpy1DObj& yedge)
 {
-  const int width=img.width();
-  const int height=img.height();
-  if(width<=0 || height<=0)
-    return;
+  putinorder(x0, x1);
+  putinorder(y0, y1);
 
-  const qreal dx = bounds.width() / width;
-  const qreal dy = bounds.height() / height;
-  const qreal x0 = bounds.left();
-  const qreal y0 = bounds.top();
+  const int xw = x1-x0;
+  const int yw = y1-y0;
 
-  const QRectF cliprect = painter.clipBoundingRect();
-  const bool clipped = ! cliprect.isEmpty();
+  // interpolate premultiplied colours, so transparent pixels do
+  // not tint their neighbours
+  const QImage img =
+    inimg.format() == QImage::Format_RGB32 ||
+    inimg.format() == QImage::Format_ARGB32_Premultiplied ?
+    inimg : inimg.convertToFormat(QImage::Format_ARGB32_Premultiplied);
 
-  painter.save();
-  for(int y=0; y<height; ++y)
-    for(int x=0; x<width; ++x)
-      {
-        QRectF r(x0+x*dx, y0+y*dy, dx, dy);
-        if(clipped)
-          r &= cliprect;
+  QImage outimg(xw, yw, img.format());
 
-        if(r.isValid())
+  const ResampleBounds xbound(xedge, false, img.width());
+  const ResampleBounds ybound(yedge, true, img.height());
+  if( xbound.num <= 0 || ybound.num <= 0 )
+    {
+      outimg.fill(0);
+      return outimg;
+    }
+
+  const std::vector<ResampleInterp> ixs(interpTable(xbound, x0, xw));
+  const std::vector<ResampleInterp> iys(interpTable(ybound, y0, yw));
+
+  uchar* bits = outimg.bits();
+  const int bpl = outimg.bytesPerLine();
+
+  forImageRows(xw, yw, [&](int oy1, int oy2)
+    {
+      for(int oy=oy1; oy<oy2; ++oy)
+        {
+          const ResampleInterp& ty = iys[oy];
+          QRgb* oscanline = reinterpret_cast<QRgb*>(bits + oy*bpl);
+          const QRgb* iscan1 =
+            reinterpret_cast<const QRgb*>(img.constScanLine(ty.i1));
+          const QRgb* iscan2 =
+            reinterpret_cast<const QRgb*>(img.constScanLine(ty.i2));
+          for(int ox=0; ox<xw; ++ox)
+            {
+              const ResampleInterp& tx = ixs[ox];
+              const QRgb top = lerpRgba(iscan1[tx.i1], iscan1[tx.i2], tx.w);
+              const QRgb bot = lerpRgba(iscan2[tx.i1], iscan2[tx.i2], tx.w);
+              oscanline[ox] = lerpRgba(top, bot, ty.w);
+            }
+        }
+    });
+
+  return outimg;
+}
+
+namespace
+{
+  // rectangle of image pixels x1<=x<x2, y1<=y<y2 of the same colour
+  struct ImageRun
+  {
+    int x1, x2, y1, y2;
+    QRgb rgb;
+  };
+
+  // Merge image pixels of the same colour into rectangles, calling
+  // func(run) for each. Pixels are joined into runs along each row,
+  // which are output in raster order. If joinrows is set, runs
+  // covering the same columns in consecutive rows are also joined,
+  // so they are no longer in raster order. Completely transparent
+  // pixels are skipped.
+  template<class Func> void mergeImageRuns(const QImage& img, bool joinrows,
+                                           Func func)
+  {
+    const int width = img.width();
+    const int height = img.height();
+
+    // runs continuing from the previous row, and in this row
+    std::vector<ImageRun> open, row;
+
+    for(int y=0; y<=height; ++y)
+      {
+        row.clear();
+        if(y < height)
           {
-            const QColor col(img.pixelColor(x, y));
-            const int alpha = col.alpha();
-            if(alpha == 0)
+            const QRgb* scan = reinterpret_cast<const QRgb*>(
+              img.constScanLine(y));
+            int x = 0;
+            while(x < width)
               {
-                // transparent
+                const QRgb rgb = scan[x];
+                int x2 = x+1;
+                while(x2 < width && scan[x2] == rgb)
+                  ++x2;
+                if(qAlpha(rgb) != 0)
+                  {
+                    const ImageRun run = {x, x2, y, y+1, rgb};
+                    row.push_back(run);
+                  }
+                x = x2;
               }
-            else if(alpha == 255)
-              {
-                // opaque, so draw line to avoid antialiasing gaps round
-                // boxes
-                painter.setPen(QPen(QBrush(col), 0.));
-                painter.setBrush(QBrush(col));
-                painter.drawRect(r);
-              }
-            else
+          }
+
+        if(!joinrows)
+          {
+            for(auto const& r : row)
+              func(r);
+            continue;
+          }
+
+        // both lists are in order of x, so extend matching runs
+        // from the previous row and output the rest
+        auto o = open.begin();
+        for(auto& r : row)
+          {
+            while(o != open.end() && o->x1 < r.x1)
+              func(*o++);
+            if(o != open.end() && o->x1 == r.x1 && o->x2 == r.x2 &&
+               o->rgb == r.rgb)
               {
-                painter.fillRect(r, col);
+                r.y1 = o->y1;
+                ++o;
               }
           }
+        while(o != open.end())
+          func(*o++);
+
+        std::swap(open, row);
+      }
+  }
+
+  // are any pixels of the (ARGB32) image opaque?
+  bool hasOpaquePixels(const QImage& img)
+  {
+    for(int y=0, height=img.height(); y<height; ++y)
+      {
+        const QRgb* scan = reinterpret_cast<const QRgb*>(img.constScanLine(y));
+        for(int x=0, width=img.width(); x<width; ++x)
+          if(qAlpha(scan[x]) == 255)
+            return true;
       }
-  painter.restore();
+    return false;
+  }
+
+  // Draws rectangles of colours. Opaque rectangles are drawn with an
+  // outline of their colour, which covers the edges of neighbouring
+  // rectangles, so they must be drawn in order. Rectangles added
+  // one after another with the same colour are put in one path. If
+  // batch is set (when there are no opaque rectangles), all the
+  // rectangles of each colour are put in one path, so that the
+  // painter (and vector output) gets one object per colour.
+  class ColorRectDrawer
+  {
+  public:
+    ColorRectDrawer(QPainter& _painter, bool _batch)
+      : painter(_painter), batch(_batch), pathrgb(0)
+    {
+      cliprect = painter.clipBoundingRect();
+      clipped = ! cliprect.isEmpty();
+      painter.save();
+    }
+
+    ~ColorRectDrawer()
+    {
+      painter.restore();
+    }
+
+    void add(QRectF r, QRgb rgb)
+    {
+      if(clipped)
+        r &= cliprect;
+      if(!r.isValid())
+        return;
+
+      if(batch)
+        paths[rgb].addRect(r);
+      else
+        {
+          if(rgb != pathrgb)
+            {
+              drawPath(pathrgb, path);
+              path = QPainterPath();
+              pathrgb = rgb;
+            }
+          path.addRect(r);
+        }
+    }
+
+    // draw remaining rectangles
+    void draw()
+    {
+      for(const auto& cp : paths)
+        drawPath(cp.first, cp.second);
+      paths.clear();
+      drawPath(pathrgb, path);
+      path = QPainterPath();
+    }
+
+  private:
+    void drawPath(QRgb rgb, const QPainterPath& p)
+    {
+      if(p.isEmpty())
+        return;
+      const QColor col(QColor::fromRgba(rgb));
+      if(col.alpha() == 255)
+        {
+          // opaque, so draw line to avoid antialiasing gaps round
+          // boxes
+          painter.setPen(QPen(QBrush(col), 0.));
+          painter.setBrush(QBrush(col));
+          painter.drawPath(p);
+        }
+      else
+        {
+          painter.fillPath(p, col);
+        }
+    }
+
+  private:
+    QPainter& painter;
+    bool batch;
+    QRectF cliprect;
+    bool clipped;
+    std::map<QRgb, QPainterPath> paths;
+    QPainterPath path;
+    QRgb pathrgb;
+  };
+}
+
+void plotImageAsRects(QPainter& painter, const QRectF& bounds, const QImage& inimg)
+{
+  const int width=inimg.width();
+  const int height=inimg.height();
+  if(width<=0 || height<=0)
+    return;
+
+  const qreal dx = bounds.width() / width;
+  const qreal dy = bounds.height() / height;
+  const qreal x0 = bounds.left();
+  const qreal y0 = bounds.top();
+
+  const QImage img = inimg.convertToFormat(QImage::Format_ARGB32);
+  const bool batch = !hasOpaquePixels(img);
+  ColorRectDrawer drawer(painter, batch);
+  mergeImageRuns(img, batch, [&](const ImageRun& run)
+    {
+      drawer.add(QRectF(x0+run.x1*dx, y0+run.y1*dy,
+                        (run.x2-run.x1)*dx, (run.y2-run.y1)*dy),
+                 run.rgb);
+    });
+  drawer.draw();
 }
 
 void plotNonlinearImageAsBoxes(QPainter& painter,
-                               const QImage& img,
+                               const QImage& inimg,
                                const Numpy1DObj& xedges,
                                const Numpy1DObj& yedges)
 {
-  const int width=img.width();
-  const int height=img.height();
+  const int width=inimg.width();
+  const int height=inimg.height();
 
   // safety
   if( xedges.dim != width+1 || yedges.dim != height+1 )
     throw "Number of edges did not match image size";
 
-  const QRectF cliprect = painter.clipBoundingRect();
-  const bool clipped = ! cliprect.isEmpty();
-
-  painter.save();
-  for(int y=0; y<height; ++y)
-    for(int x=0; x<width; ++x)
-      {
-        const qreal x0 = std::min(xedges(x), xedges(x+1));
-        const qreal x1 = std::max(xedges(x), xedges(x+1));
-        const qreal y0 = std::min(yedges(y), yedges(y+1));
-        const qreal y1 = std::max(yedges(y), yedges(y+1));
-
-        QRectF r(x0, y0, x1-x0, y1-y0);
-        if(clipped)
-          r &= cliprect;
-
-        if(r.isValid())
-          {
-            // note: axis coordinates are reversed wrt to image
-            const QColor col(img.pixelColor(x, height-1-y));
-
-            const int alpha = col.alpha();
-            if(alpha == 0)
-              {
-                // transparent
-              }
-            else if(alpha == 255)
-              {
-                // opaque, so draw line to avoid antialiasing gaps round
-                // boxes
-                painter.setPen(QPen(QBrush(col), 0.));
-                painter.setBrush(QBrush(col));
-                painter.drawRect(r);
-              }
-            else
-              {
-                painter.fillRect(r, col);
-              }
-          }
-      }
-  painter.restore();
+  const QImage img = inimg.convertToFormat(QImage::Format_ARGB32);
+  const bool batch = !hasOpaquePixels(img);
+  ColorRectDrawer drawer(painter, batch);
+  mergeImageRuns(img, batch, [&](const ImageRun& run)
+    {
+      // note: axis coordinates are reversed wrt to image
+      const int ey1 = height-run.y2;
+      const int ey2 = height-run.y1;
+
+      const qreal x0 = std::min(xedges(run.x1), xedges(run.x2));
+      const qreal x1 = std::max(xedges(run.x1), xedges(run.x2));
+      const qreal y0 = std::min(yedges(ey1), yedges(ey2));
+      const qreal y1 = std::max(yedges(ey1), yedges(ey2));
+
+      drawer.add(QRectF(x0, y0, x1-x0, y1-y0), run.rgb);
+    });
+  drawer.draw();
 }
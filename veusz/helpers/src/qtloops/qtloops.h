@@ -28,6 +28,9 @@
 #include <QPainterPath>
 #include <QRectF>
 #include <QImage>
+#include <QSizeF>
+
+class LineLabeller;
 
 class QtLoops {
 public:
@@ -42,6 +45,22 @@ void addNumpyToPolygonF(QPolygonF& poly,
 void addNumpyPolygonToPath(QPainterPath &path, const Tuple2Ptrs& d,
 			   const QRectF* clip = 0);
 
+// Lines or polygons stored together, as returned by Cntr.trace with
+// flat set, where line i has the points from offsets[i] to
+// offsets[i+1] of x and y. Non-finite points are skipped.
+// (both throw const char* if the offsets are invalid)
+
+// add lines to labeller, each with a label of size textsize
+void addNumpyLinesToLabeller(LineLabeller& labeller,
+                             const Numpy1DObj& x, const Numpy1DObj& y,
+                             const Numpy1DObj& offsets, QSizeF textsize);
+
+// add polygons to path, clipping them to clip if set
+void addNumpyPolygonsToPath(QPainterPath& path,
+                            const Numpy1DObj& x, const Numpy1DObj& y,
+                            const Numpy1DObj& offsets,
+                            const QRectF* clip = 0);
+
 // Scale path by scale given. Puts output in out.
 QPainterPath scalePath(const QPainterPath& path, qreal scale);
 
@@ -50,13 +69,28 @@ QPainterPath scalePath(const QPainterPath& path, qreal scale);
 // if scaling is not 0, is an array to scale the data points by
 // if colorimg is not 0, is a Nx1 image containing color points for path fills
 // clip is a clipping rectangle if set
+// many markers are drawn as cached sprites on raster devices, or merged
+// into paths where they do not overlap on other devices
+// if decimate is set, opaque markers drawn over pixels already covered
+// by markers are skipped
 void plotPathsToPainter(QPainter& painter, QPainterPath& path,
 			const Numpy1DObj& x, const Numpy1DObj& y,
 			const Numpy1DObj* scaling = 0,
 			const QRectF* clip = 0,
 			const QImage* colorimg = 0,
-			bool scaleline = false);
-
+			bool scaleline = false,
+			bool decimate = false);
+
+// bin points in bounds into a width*height image of color, with alpha
+// proportional to the log of the number of points in each pixel
+QImage pointDensityImage(const Numpy1DObj& x, const Numpy1DObj& y,
+                         const QRectF& bounds, int width, int height,
+                         const QColor& color);
+
+// draw lines (or boxes) between (x1, y1) and (x2, y2), clipped to
+// clip expanded by the pen width if autoexpand. The clip is not used
+// if autoexpand is unset (boxes are only limited to the range of
+// coordinates which can be drawn).
 void plotLinesToPainter(QPainter& painter,
 			const Numpy1DObj& x1, const Numpy1DObj& y1,
 			const Numpy1DObj& x2, const Numpy1DObj& y2,
@@ -67,11 +101,22 @@ void plotBoxesToPainter(QPainter& painter,
 			const Numpy1DObj& x2, const Numpy1DObj& y2,
 			const QRectF* clip = 0, bool autoexpand = true);
 
+// draw the lines (or boxes) given by several sets of arrays in one
+// call, where sets holds arrays in the order x1, y1, x2, y2 for each
+// set (throws const char* if the arrays are not in sets of four)
+void plotLineSetsToPainter(QPainter& painter, const Tuple2Ptrs& sets,
+                           const QRectF* clip = 0, bool autoexpand = true);
+void plotBoxSetsToPainter(QPainter& painter, const Tuple2Ptrs& sets,
+                          const QRectF* clip = 0, bool autoexpand = true);
+
 // add polygon to painter path as a cubic
 void addCubicsToPainterPath(QPainterPath& path, const QPolygonF& poly);
 
+// convert 2D data (0 to 1) to an image using the colors given (BGRA
+// rows). Colors are looked up in a table unless exact is set, in
+// which case they are interpolated for each pixel.
 QImage numpyToQImage(const Numpy2DObj& data, const Numpy2DIntObj &colors,
-		     bool forcetrans = false);
+		     bool forcetrans = false, bool exact = false);
 
 void applyImageTransparancy(QImage& img, const Numpy2DObj& data);
 
@@ -81,6 +126,14 @@ QImage resampleNonlinearImage(const QImage& img,
                               const Numpy1DObj& xedge,
                               const Numpy1DObj& yedge);
 
+// as resampleNonlinearImage, but interpolating linearly between the
+// centres of the image pixels
+QImage resampleNonlinearImageBilinear(const QImage& img,
+                                      int x0, int y0,
+                                      int x1, int y1,
+                                      const Numpy1DObj& xedge,
+                                      const Numpy1DObj& yedge);
+
 // plot image as a set of rectangles
 void plotImageAsRects(QPainter& painter, const QRectF& bounds, const QImage& img);
 
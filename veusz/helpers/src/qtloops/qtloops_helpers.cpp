@@ -45,6 +45,81 @@ void do_numpy_init_package()
   do_import();
 }
 
+namespace
+{
+  // get element type of array, returning false if not supported
+  bool arrayElemType(PyArrayObject* array, NumpyElemType& type)
+  {
+    if( !PyArray_ISNOTSWAPPED(array) || !PyArray_ISALIGNED(array) )
+      return false;
+
+    const int itemsize = PyArray_ITEMSIZE(array);
+    if( PyArray_ISFLOAT(array) )
+      {
+        if( itemsize == int(sizeof(double)) )
+          type = NUMPY_DOUBLE;
+        else if( itemsize == int(sizeof(float)) )
+          type = NUMPY_FLOAT;
+        else
+          return false;
+      }
+    else if( PyArray_ISSIGNED(array) )
+      {
+        switch(itemsize)
+          {
+          case 1: type = NUMPY_INT8; break;
+          case 2: type = NUMPY_INT16; break;
+          case 4: type = NUMPY_INT32; break;
+          case 8: type = NUMPY_INT64; break;
+          default: return false;
+          }
+      }
+    else if( PyArray_ISUNSIGNED(array) || PyArray_ISBOOL(array) )
+      {
+        switch(itemsize)
+          {
+          case 1: type = NUMPY_UINT8; break;
+          case 2: type = NUMPY_UINT16; break;
+          case 4: type = NUMPY_UINT32; break;
+          case 8: type = NUMPY_UINT64; break;
+          default: return false;
+          }
+      }
+    else
+      return false;
+
+    return true;
+  }
+
+  // Return array with ndim dimensions to read in place if possible,
+  // or converted to double otherwise. Returns a new reference or 0.
+  PyArrayObject* inPlaceArray(PyObject* obj, int ndim, NumpyElemType& type)
+  {
+    PyArrayObject* array = (PyArrayObject*)
+      PyArray_FromAny(obj, NULL, ndim, ndim, 0, NULL);
+    if( array == NULL )
+      {
+        PyErr_Clear();
+        return 0;
+      }
+    if( arrayElemType(array, type) )
+      return array;
+
+    // unsupported type, so convert
+    PyArrayObject* dblarray = (PyArrayObject*)
+      PyArray_FromAny((PyObject*)array, PyArray_DescrFromType(NPY_DOUBLE),
+                      ndim, ndim, NPY_ARRAY_CARRAY_RO, NULL);
+    Py_DECREF(array);
+    if( dblarray == NULL )
+      {
+        PyErr_Clear();
+        return 0;
+      }
+    type = NUMPY_DOUBLE;
+    return dblarray;
+  }
+}
+
 Tuple2Ptrs::Tuple2Ptrs(PyObject* tuple)
 {
   const size_t numitems = PyTuple_Size(tuple);
@@ -54,41 +129,34 @@ Tuple2Ptrs::Tuple2Ptrs(PyObject* tuple)
       // access python tuple item
       PyObject* obj = PyTuple_GetItem(tuple, i);
 
-      // convert to C array (stored in objdata)
-      PyArrayObject *array = (PyArrayObject*)
-	PyArray_ContiguousFromObject(obj, NPY_DOUBLE, 1, 1);
-      if( array == NULL )
-	{
-	  throw "Cannot covert parameter to 1D numpy array";
-	}
-      data.push_back( (double*)PyArray_DATA(array) );
-      dims.push_back( PyArray_DIMS(array)[0] );
-      _arrays.push_back( (PyObject*)array );
+      // accessor for item (which throws if not an array)
+      Numpy1DObj* array = new Numpy1DObj(obj);
+      data.push_back(array);
+      dims.push_back(array->dim);
     }
 }
 
 Tuple2Ptrs::~Tuple2Ptrs()
 {
   // delete array objects
-  for(int i=0; i < _arrays.size(); ++i)
+  for(int i=0; i < data.size(); ++i)
     {
-      Py_DECREF(_arrays[i]);
-      _arrays[i] = 0;
+      delete data[i];
       data[i] = 0;
     }
 }
 
 Numpy1DObj::Numpy1DObj(PyObject* array)
-  : data(0), _array(0)
+  : _array(0), bytes(0), stride(0), type(NUMPY_DOUBLE)
 {
-  PyArrayObject *arrayobj = (PyArrayObject*)
-    PyArray_ContiguousFromObject(array, NPY_DOUBLE, 1, 1);
+  PyArrayObject *arrayobj = inPlaceArray(array, 1, type);
   if( arrayobj == NULL )
     {
       throw "Cannot covert item to 1D numpy array";
     }
 
-  data = (double*)PyArray_DATA(arrayobj);
+  bytes = (const char*)PyArray_DATA(arrayobj);
+  stride = PyArray_STRIDES(arrayobj)[0];
   dim = PyArray_DIMS(arrayobj)[0];
   _array = (PyObject*)arrayobj;
 }
@@ -97,23 +165,24 @@ Numpy1DObj::~Numpy1DObj()
 {
   Py_XDECREF(_array);
   _array = 0;
-  data = 0;
+  bytes = 0;
 }
 
 Numpy2DObj::Numpy2DObj(PyObject* array)
-  : data(0), _array(0)
+  : _array(0), bytes(0), type(NUMPY_DOUBLE)
 {
-  PyArrayObject *arrayobj = (PyArrayObject*)
-    PyArray_ContiguousFromObject(array, NPY_DOUBLE, 2, 2);
+  PyArrayObject *arrayobj = inPlaceArray(array, 2, type);
 
   if( arrayobj == NULL )
     {
       throw "Cannot convert to 2D numpy array";
     }
 
-  data = (double*)PyArray_DATA(arrayobj);
+  bytes = (const char*)PyArray_DATA(arrayobj);
   dims[0] = PyArray_DIMS(arrayobj)[0];
   dims[1] = PyArray_DIMS(arrayobj)[1];
+  strides[0] = PyArray_STRIDES(arrayobj)[0];
+  strides[1] = PyArray_STRIDES(arrayobj)[1];
   _array = (PyObject*)arrayobj;
 }
 
@@ -121,7 +190,7 @@ Numpy2DObj::~Numpy2DObj()
 {
   Py_XDECREF(_array);
   _array = 0;
-  data = 0;
+  bytes = 0;
 }
 
 Numpy2DIntObj::Numpy2DIntObj(PyObject* array)
@@ -161,3 +230,18 @@ PyObject* doubleArrayToNumpy(const double* d, int len)
 
   return n;
 }
+
+PyObject* doubleArray2DToNumpy(const double* d, int rows, int cols)
+{
+  npy_intp dims[2];
+  dims[0] = rows;
+  dims[1] = cols;
+  PyObject* n = PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+
+  double* pydata = (double*)PyArray_DATA((PyArrayObject*)(n));
+  const size_t len = size_t(rows)*cols;
+  for(size_t i = 0; i < len; ++i)
+    pydata[i] = d[i];
+
+  return n;
+}
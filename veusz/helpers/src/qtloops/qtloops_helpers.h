@@ -23,69 +23,118 @@
 
 #include "Python.h"
 
+#include <cstddef>
 #include <QVector>
 
 #define DEBUG false
 
 void do_numpy_init_package();
 
-// class for converting tuples to objects which clean themselves up
-// throws const char* if conversion failed
-class Tuple2Ptrs
-{
-public:
-  Tuple2Ptrs(PyObject* tuple);
-  ~Tuple2Ptrs();
-
-  // data in tuple are stored here
-  QVector<const double*> data;
-  QVector<int> dims;
+// element types of numpy arrays which are read in place
+enum NumpyElemType
+  {
+    NUMPY_DOUBLE, NUMPY_FLOAT,
+    NUMPY_INT8, NUMPY_INT16, NUMPY_INT32, NUMPY_INT64,
+    NUMPY_UINT8, NUMPY_UINT16, NUMPY_UINT32, NUMPY_UINT64
+  };
 
-private:
-  // these are the python objects made by PyArray_AsCArray
-  QVector<PyObject*> _arrays;
-};
+// read element at p of type t as a double
+inline double numpyElemToDouble(const char* p, NumpyElemType t)
+{
+  switch(t)
+    {
+    case NUMPY_DOUBLE: return *reinterpret_cast<const double*>(p);
+    case NUMPY_FLOAT: return *reinterpret_cast<const float*>(p);
+    case NUMPY_INT8: return *reinterpret_cast<const signed char*>(p);
+    case NUMPY_INT16: return *reinterpret_cast<const short*>(p);
+    case NUMPY_INT32: return *reinterpret_cast<const int*>(p);
+    case NUMPY_INT64: return double(*reinterpret_cast<const long long*>(p));
+    case NUMPY_UINT8: return *reinterpret_cast<const unsigned char*>(p);
+    case NUMPY_UINT16: return *reinterpret_cast<const unsigned short*>(p);
+    case NUMPY_UINT32: return *reinterpret_cast<const unsigned*>(p);
+    case NUMPY_UINT64:
+      return double(*reinterpret_cast<const unsigned long long*>(p));
+    }
+  return 0;
+}
 
 // class for converting numpy array to an array
+//
+// Arrays of floating point or integer types in native byte order
+// are read in place, whatever their strides, so that mapped or
+// sliced arrays are not copied. Other inputs are converted to double.
 class Numpy1DObj
 {
  public:
   Numpy1DObj(PyObject* array);
   ~Numpy1DObj();
 
-  const double* data;
   int dim;
 
   inline double operator()(const int x) const
   {
     if( DEBUG && (x < 0 || x >= dim) )
 	throw "Invalid index in array";
-    return data[x];
+    return numpyElemToDouble(bytes + ptrdiff_t(x)*stride, type);
+  }
+
+  // pointer to data if it is a contiguous double array, else 0
+  const double* contiguousDoubles() const
+  {
+    return type == NUMPY_DOUBLE && stride == ptrdiff_t(sizeof(double)) ?
+      reinterpret_cast<const double*>(bytes) : 0;
   }
 
  private:
   PyObject* _array;
+  const char* bytes;
+  ptrdiff_t stride;
+  NumpyElemType type;
+};
+
+// class for converting tuples to objects which clean themselves up
+// throws const char* if conversion failed
+class Tuple2Ptrs
+{
+public:
+  Tuple2Ptrs(PyObject* tuple);
+  ~Tuple2Ptrs();
+
+  // data in tuple are stored here
+  QVector<const Numpy1DObj*> data;
+  QVector<int> dims;
 };
 
 // class for converting a 2D numpy array to an array
+// (read in place as for Numpy1DObj)
 class Numpy2DObj
 {
  public:
   Numpy2DObj(PyObject* array);
   ~Numpy2DObj();
 
-  const double* data;
   int dims[2];
 
   inline double operator()(const int x, const int y) const
   {
-    if( DEBUG && (x < 0 || x >= dims[0] || y < 0 || y >= dims[1]) )
+    if( DEBUG && (x < 0 || x >= dims[1] || y < 0 || y >= dims[0]) )
       throw "Invalid index in array";
-    return data[x+y*dims[1]];
+    return numpyElemToDouble(bytes + ptrdiff_t(y)*strides[0] +
+                             ptrdiff_t(x)*strides[1], type);
+  }
+
+  // pointer to row y if rows are contiguous doubles, else 0
+  const double* rowDoubles(const int y) const
+  {
+    return type == NUMPY_DOUBLE && strides[1] == ptrdiff_t(sizeof(double)) ?
+      reinterpret_cast<const double*>(bytes + ptrdiff_t(y)*strides[0]) : 0;
   }
 
  private:
   PyObject* _array;
+  const char* bytes;
+  ptrdiff_t strides[2];
+  NumpyElemType type;
 };
 
 // class for converting a 2D numpy array to an integer array
@@ -111,4 +160,7 @@ class Numpy2DIntObj
 
 PyObject* doubleArrayToNumpy(const double* d, int len);
 
+// make 2D array from row-major data
+PyObject* doubleArray2DToNumpy(const double* d, int rows, int cols);
+
 #endif
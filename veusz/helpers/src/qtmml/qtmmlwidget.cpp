@@ -50,6 +50,12 @@
 #include <QtWidgets/QDesktopWidget>
 #include <QtGui/QPainter>
 #include <QtGui/QPaintEvent>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSharedPointer>
+
+#include <list>
 
 #include "qtmmlwidget.h"
 
@@ -171,6 +177,9 @@ class MmlDocument : public Mml
 	void setBackgroundColor(const QColor &color)
 	    { m_background_color = color; }
 
+	const MmlNode *rootNode() const
+	    { return m_root_node; }
+
     private:
 	void _dump(const MmlNode *node, QString &indent) const;
 	bool insertChild(MmlNode *parent, MmlNode *new_node, QString *errorMsg);
@@ -6276,12 +6285,136 @@ static QFont interpretMathSize(QString value, QFont &fn, int em, int ex, bool *o
     All methods work the same as the corresponding methods in QtMmlWidget.
 */
 
+// Cache of laid out documents, shared by QtMmlDocument objects.
+//
+// Documents are kept by their text and the fonts and size used to
+// lay them out, so that documents with the same expressions only
+// parse and lay them out once. Documents in the cache are not changed,
+// except for the origin set when painting, so painting is serialized.
+// The least recently used documents are removed when the estimated
+// memory of the documents is above the limit.
+
+namespace {
+
+// estimated memory used by each node, including its attributes
+const int MML_NODE_BYTES = 256;
+
+class MmlDocumentCache
+{
+    public:
+	MmlDocumentCache()
+	    : m_total(0), m_limit(8*1024*1024) {}
+
+	static MmlDocumentCache &instance()
+	{
+	    static MmlDocumentCache cache;
+	    return cache;
+	}
+
+	QSharedPointer<MmlDocument> find(const QString &key);
+	void insert(const QString &key, QSharedPointer<MmlDocument> doc,
+		    int bytes);
+
+	int limit() const { return m_limit; }
+	void setLimit(int bytes);
+
+	// lock held while painting cached documents
+	QMutex &paintMutex() { return m_paint_mutex; }
+
+    private:
+	struct Entry
+	{
+	    QString key;
+	    QSharedPointer<MmlDocument> doc;
+	    int bytes;
+	};
+	typedef std::list<Entry> EntryList;
+
+	void evict();
+
+	// most recently used first
+	EntryList m_entries;
+	QHash<QString, EntryList::iterator> m_index;
+	qint64 m_total;
+	int m_limit;
+	QMutex m_mutex, m_paint_mutex;
+};
+
+QSharedPointer<MmlDocument> MmlDocumentCache::find(const QString &key)
+{
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, EntryList::iterator>::iterator i = m_index.find(key);
+    if (i == m_index.end())
+	return QSharedPointer<MmlDocument>();
+
+    m_entries.splice(m_entries.begin(), m_entries, i.value());
+    return m_entries.front().doc;
+}
+
+void MmlDocumentCache::insert(const QString &key,
+			      QSharedPointer<MmlDocument> doc, int bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_index.contains(key))
+	return;
+
+    Entry entry;
+    entry.key = key;
+    entry.doc = doc;
+    entry.bytes = bytes;
+    m_entries.push_front(entry);
+    m_index.insert(key, m_entries.begin());
+    m_total += bytes;
+    evict();
+}
+
+void MmlDocumentCache::setLimit(int bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_limit = bytes;
+    evict();
+}
+
+void MmlDocumentCache::evict()
+{
+    while (m_total > m_limit && !m_entries.empty()) {
+	const Entry &last = m_entries.back();
+	m_total -= last.bytes;
+	m_index.remove(last.key);
+	m_entries.pop_back();
+    }
+}
+
+// key for the cache from the text and the settings in doc
+QString mmlCacheKey(const QString &text, const MmlDocument &doc)
+{
+    QString key = QString::number(doc.baseFontPointSize());
+    for (int type = QtMmlWidget::NormalFont;
+	 type <= QtMmlWidget::DoublestruckFont; ++type) {
+	key += QChar(0);
+	key += doc.fontName(QtMmlWidget::MmlFont(type));
+    }
+    key += QChar(0);
+    key += text;
+    return key;
+}
+
+int countMmlNodes(const MmlNode *node)
+{
+    int count = 0;
+    for (; node != 0; node = node->nextSibling())
+	count += 1 + countMmlNodes(node->firstChild());
+    return count;
+}
+
+} // namespace
+
 /*!
   Constructs an empty MML document.
 */
 QtMmlDocument::QtMmlDocument()
+    : m_doc(new MmlDocument), m_has_content(false)
 {
-    m_doc = new MmlDocument;
 }
 
 /*!
@@ -6289,7 +6422,6 @@ QtMmlDocument::QtMmlDocument()
 */
 QtMmlDocument::~QtMmlDocument()
 {
-    delete m_doc;
 }
 
 /*!
@@ -6297,7 +6429,10 @@ QtMmlDocument::~QtMmlDocument()
 */
 void QtMmlDocument::clear()
 {
+    detach();
     m_doc->clear();
+    m_text.clear();
+    m_has_content = false;
 }
 
 /*!
@@ -6311,11 +6446,39 @@ void QtMmlDocument::clear()
 
     \a text should contain MathML 2.0 presentation markup elements enclosed
     in a <math> element.
+
+    Documents laid out with the same text, fonts and size are shared,
+    so the fonts and size should be set before the content where
+    possible.
 */
 bool QtMmlDocument::setContent(QString text, QString *errorMsg,
                                int *errorLine, int *errorColumn)
 {
-    return m_doc->setContent(text, errorMsg, errorLine, errorColumn);
+    m_text = text;
+    m_has_content = false;
+
+    const QString key = mmlCacheKey(text, *m_doc);
+    QSharedPointer<MmlDocument> cached = MmlDocumentCache::instance().find(key);
+    if (!cached.isNull()) {
+	m_doc = cached;
+	m_has_content = true;
+	return true;
+    }
+
+    // lay out a new document with the same settings
+    QSharedPointer<MmlDocument> doc(new MmlDocument);
+    copySettings(*m_doc, *doc);
+    if (!doc->setContent(text, errorMsg, errorLine, errorColumn)) {
+	m_doc = doc;
+	return false;
+    }
+
+    m_doc = doc;
+    m_has_content = true;
+    const int bytes = countMmlNodes(doc->rootNode()) * MML_NODE_BYTES +
+	int(key.size() * sizeof(QChar));
+    MmlDocumentCache::instance().insert(key, doc, bytes);
+    return true;
 }
 
 /*!
@@ -6323,6 +6486,7 @@ bool QtMmlDocument::setContent(QString text, QString *errorMsg,
 */
 void QtMmlDocument::paint(QPainter *p, const QPoint &pos) const
 {
+    QMutexLocker locker(&MmlDocumentCache::instance().paintMutex());
     m_doc->paint(p, pos);
 }
 
@@ -6351,8 +6515,11 @@ QString QtMmlDocument::fontName(QtMmlWidget::MmlFont type) const
 */
 void QtMmlDocument::setFontName(QtMmlWidget::MmlFont type, const QString &name)
 {
+    if (m_doc->fontName(type) == name)
+	return;
+    detach();
     m_doc->setFontName(type, name);
-    m_doc->layout();
+    relayout();
 }
 
 /*!
@@ -6374,6 +6541,55 @@ int QtMmlDocument::baseFontPointSize() const
 */
 void QtMmlDocument::setBaseFontPointSize(int size)
 {
+    if (m_doc->baseFontPointSize() == size)
+	return;
+    detach();
     m_doc->setBaseFontPointSize(size);
-    m_doc->layout();
+    relayout();
+}
+
+/*!
+    Returns the estimated memory in bytes which may be used by laid
+    out documents shared between QtMmlDocument objects.
+*/
+int QtMmlDocument::cacheLimit()
+{
+    return MmlDocumentCache::instance().limit();
+}
+
+/*!
+    Sets the estimated memory in bytes which may be used by laid out
+    documents shared between QtMmlDocument objects. Setting this to
+    0 disables sharing.
+*/
+void QtMmlDocument::setCacheLimit(int bytes)
+{
+    MmlDocumentCache::instance().setLimit(bytes);
+}
+
+// copy the fonts and size of one document to another
+void QtMmlDocument::copySettings(const MmlDocument &from, MmlDocument &to)
+{
+    for (int type = QtMmlWidget::NormalFont;
+	 type <= QtMmlWidget::DoublestruckFont; ++type) {
+	QtMmlWidget::MmlFont font = QtMmlWidget::MmlFont(type);
+	to.setFontName(font, from.fontName(font));
+    }
+    to.setBaseFontPointSize(from.baseFontPointSize());
+}
+
+// make a document with the same settings which can be changed, as
+// the current one may be shared (the content is lost)
+void QtMmlDocument::detach()
+{
+    QSharedPointer<MmlDocument> doc(new MmlDocument);
+    copySettings(*m_doc, *doc);
+    m_doc = doc;
+}
+
+// lay out the content again with the current settings
+void QtMmlDocument::relayout()
+{
+    if (m_has_content)
+	setContent(m_text);
 }
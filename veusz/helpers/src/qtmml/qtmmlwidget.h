@@ -49,6 +49,7 @@
 
 #include <QtWidgets/QFrame>
 #include <QtXml/QtXml>
+#include <QtCore/QSharedPointer>
 
 class MmlDocument;
 
@@ -117,8 +118,17 @@ public:
 
     int baseFontPointSize() const;
     void setBaseFontPointSize(int size);
+
+    static int cacheLimit();
+    static void setCacheLimit(int bytes);
 private:
-    MmlDocument *m_doc;
+    static void copySettings(const MmlDocument &from, MmlDocument &to);
+    void detach();
+    void relayout();
+
+    QSharedPointer<MmlDocument> m_doc;
+    QString m_text;
+    bool m_has_content;
 };
 
 #endif
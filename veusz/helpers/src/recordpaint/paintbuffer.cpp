@@ -0,0 +1,729 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <QPainter>
+#include <QPaintEngine>
+#include "paintbuffer.h"
+#include "tracing.h"
+
+namespace
+{
+  // size of header in words
+  const size_t HEADER_WORDS = sizeof(PaintBuffer::Command)/sizeof(quint64);
+
+  // no position in the buffer
+  const size_t NOPOS = size_t(-1);
+
+  // maximum number of items merged into one command, so that their
+  // bounds stay small enough for playing regions to skip them
+  const quint32 MERGE_MAX_ITEMS = 1024;
+
+  // number of cells along each side of the grid for playing regions
+  const int GRID_CELLS = 32;
+  // drawing commands covering more cells than this are not put in
+  // the grid, but always tested
+  const int GRID_MAX_CELLS = GRID_CELLS*GRID_CELLS/4;
+
+  template<class T> quint32 addToPool(QVector<T>& pool, const T& obj)
+  {
+    pool.append(obj);
+    return quint32(pool.size()-1);
+  }
+
+  template<class T> inline const T* payloadAs(const quint64* payload)
+  {
+    return reinterpret_cast<const T*>(payload);
+  }
+
+  // saved file format
+  const char FILE_MAGIC[8] = {'V','Z','R','E','C','P','N','T'};
+  const quint32 FILE_VERSION = 1;
+  const quint32 FILE_BYTEORDER = 0x01020304;
+  const QDataStream::Version FILE_STREAMVERSION = QDataStream::Qt_5_6;
+
+  struct FileHeader
+  {
+    char magic[8];
+    quint32 version;
+    quint32 byteorder;
+    quint32 qrealsize;
+    quint32 headersize;
+    PaintBuffer::DeviceInfo info;
+    // number of command words and drawing command bounds
+    quint64 numwords, numbounds;
+    // offsets of sections from start of file
+    quint64 wordsoffset, boundsoffset, poolsoffset;
+    // size of pools section in bytes
+    quint64 poolsbytes;
+  };
+
+  void writeAll(QIODevice& dev, const void* data, qint64 bytes)
+  {
+    if( bytes > 0 && dev.write(static_cast<const char*>(data), bytes) != bytes )
+      throw "Could not write recording file";
+  }
+
+  void readAll(QIODevice& dev, void* data, qint64 bytes)
+  {
+    if( bytes > 0 && dev.read(static_cast<char*>(data), bytes) != bytes )
+      throw "Recording file is truncated";
+  }
+
+  // minimum payload size of command in bytes
+  quint64 payloadBytes(const PaintBuffer::Command& cmd)
+  {
+    const quint64 n = cmd.count;
+    switch(cmd.op)
+      {
+      case PaintBuffer::OP_ELLIPSE: return sizeof(QRect);
+      case PaintBuffer::OP_ELLIPSEF: return sizeof(QRectF);
+      case PaintBuffer::OP_IMAGE: return sizeof(PaintBuffer::ImageItem);
+      case PaintBuffer::OP_LINES: return n*sizeof(QLine);
+      case PaintBuffer::OP_LINESF: return n*sizeof(QLineF);
+      case PaintBuffer::OP_PIXMAP: return sizeof(PaintBuffer::PixmapItem);
+      case PaintBuffer::OP_POINTS: case PaintBuffer::OP_POLYGON:
+        return n*sizeof(QPoint);
+      case PaintBuffer::OP_POINTSF: case PaintBuffer::OP_POLYGONF:
+        return n*sizeof(QPointF);
+      case PaintBuffer::OP_RECTS: return n*sizeof(QRect);
+      case PaintBuffer::OP_RECTSF: return n*sizeof(QRectF);
+      case PaintBuffer::OP_TEXT: return sizeof(QPointF);
+      case PaintBuffer::OP_TILEDPIXMAP:
+        return sizeof(PaintBuffer::TiledPixmapItem);
+      case PaintBuffer::OP_BRUSHORIGIN: return sizeof(QPointF);
+      case PaintBuffer::OP_TRANSFORM:
+        return sizeof(PaintBuffer::TransformItem);
+      default: return 0;
+      }
+  }
+}
+
+PaintBuffer::PaintBuffer()
+  : _lastpos(NOPOS), _lastmerged(false),
+    _mapfile(0), _mapped(0), _nmapped(0), _gridsize(0)
+{
+}
+
+PaintBuffer::~PaintBuffer()
+{
+  delete _mapfile;
+}
+
+void PaintBuffer::clear()
+{
+  delete _mapfile;
+  _mapfile = 0;
+  _mapped = 0;
+  _nmapped = 0;
+  _words.clear();
+  _lastpos = NOPOS;
+  _lastmerged = false;
+  _bounds.clear();
+  _grid.clear();
+  _griddraws.clear();
+  _gridsize = 0;
+  _paths.clear();
+  _images.clear();
+  _imageindex.clear();
+  _pixmaps.clear();
+  _pens.clear();
+  _brushes.clear();
+  _fonts.clear();
+  _regions.clear();
+  _texts.clear();
+}
+
+void PaintBuffer::addCommand(Op op, quint32 arg, quint32 count,
+                             const void* payload, size_t bytes)
+{
+  if( _mapfile != 0 )
+    unmapFile();
+
+  const size_t words = (bytes + sizeof(quint64) - 1) / sizeof(quint64);
+  const size_t pos = _words.size();
+  _words.resize(pos + HEADER_WORDS + words);
+  _lastpos = pos;
+  _lastmerged = false;
+
+  Command* cmd = reinterpret_cast<Command*>(&_words[pos]);
+  cmd->op = op;
+  cmd->arg = arg;
+  cmd->count = count;
+  cmd->words = quint32(words);
+
+  if(bytes > 0)
+    {
+      // zero any padding at the end
+      _words[pos + HEADER_WORDS + words - 1] = 0;
+      std::memcpy(&_words[pos + HEADER_WORDS], payload, bytes);
+    }
+}
+
+bool PaintBuffer::mergeItems(Op op, quint32 arg, const void* items,
+                             size_t itemsize, int count)
+{
+  if( _mapfile != 0 || _lastpos == NOPOS || count <= 0 )
+    return false;
+
+  Command* cmd = reinterpret_cast<Command*>(&_words[_lastpos]);
+  if( cmd->op != quint32(op) || cmd->arg != arg ||
+      cmd->count + quint32(count) > MERGE_MAX_ITEMS )
+    return false;
+
+  // the last command is at the end of the buffer, so its payload
+  // can be extended
+  const size_t bytes = itemsize*count;
+  const size_t pos = _words.size();
+  _words.resize(pos + bytes/sizeof(quint64));
+  std::memcpy(&_words[pos], items, bytes);
+
+  // resize may have moved the buffer
+  cmd = reinterpret_cast<Command*>(&_words[_lastpos]);
+  cmd->count += quint32(count);
+  cmd->words += quint32(bytes/sizeof(quint64));
+  _lastmerged = true;
+  return true;
+}
+
+quint32 PaintBuffer::addPath(const QPainterPath& path)
+{
+  return addToPool(_paths, path);
+}
+
+// the same image is often drawn many times (e.g. markers drawn as
+// sprites), so it is only added once
+quint32 PaintBuffer::addImage(const QImage& image)
+{
+  auto it = _imageindex.find(image.cacheKey());
+  if( it != _imageindex.end() )
+    return it->second;
+  const quint32 idx = addToPool(_images, image);
+  _imageindex.emplace(image.cacheKey(), idx);
+  return idx;
+}
+
+quint32 PaintBuffer::addPixmap(const QPixmap& pixmap)
+{
+  return addToPool(_pixmaps, pixmap);
+}
+
+quint32 PaintBuffer::addPen(const QPen& pen)
+{
+  return addToPool(_pens, pen);
+}
+
+quint32 PaintBuffer::addBrush(const QBrush& brush)
+{
+  return addToPool(_brushes, brush);
+}
+
+quint32 PaintBuffer::addFont(const QFont& font)
+{
+  return addToPool(_fonts, font);
+}
+
+quint32 PaintBuffer::addRegion(const QRegion& region)
+{
+  return addToPool(_regions, region);
+}
+
+quint32 PaintBuffer::addText(const QString& text)
+{
+  return addToPool(_texts, text);
+}
+
+void PaintBuffer::addBounds(const QRectF& bounds)
+{
+  // treat non-finite bounds as unknown
+  const qreal sum = bounds.left()+bounds.top()+bounds.width()+bounds.height();
+  const QRectF r( sum-sum == 0 ? bounds : unboundedRect() );
+
+  if( _lastmerged && !_bounds.empty() )
+    {
+      _bounds.back() = _bounds.back().united(r);
+      // the index no longer matches, even though the size is the same
+      _gridsize = 0;
+    }
+  else
+    _bounds.push_back(r);
+}
+
+void PaintBuffer::buildIndex() const
+{
+  _grid.clear();
+  _griddraws.clear();
+  _gridsize = _bounds.size();
+
+  // grid covers the extent of the bounded commands
+  const QRectF unbounded(unboundedRect());
+  _gridrect = QRectF();
+  for(auto const& b : _bounds)
+    if( b != unbounded )
+      _gridrect = _gridrect.isNull() ? b : _gridrect.united(b);
+  if( _gridrect.width() <= 0 || _gridrect.height() <= 0 )
+    {
+      for(int i=0; i<int(_bounds.size()); ++i)
+        _griddraws.push_back(i);
+      return;
+    }
+
+  _grid.resize(GRID_CELLS*GRID_CELLS);
+  const qreal sx = GRID_CELLS / _gridrect.width();
+  const qreal sy = GRID_CELLS / _gridrect.height();
+  auto cell = [](qreal v) { return std::min(std::max(int(v), 0), GRID_CELLS-1); };
+
+  for(int i=0; i<int(_bounds.size()); ++i)
+    {
+      const QRectF& b = _bounds[i];
+      const int cx1 = cell((b.left()-_gridrect.left())*sx);
+      const int cx2 = cell((b.right()-_gridrect.left())*sx);
+      const int cy1 = cell((b.top()-_gridrect.top())*sy);
+      const int cy2 = cell((b.bottom()-_gridrect.top())*sy);
+      if( (cx2-cx1+1)*(cy2-cy1+1) > GRID_MAX_CELLS )
+        _griddraws.push_back(i);
+      else
+        for(int cy=cy1; cy<=cy2; ++cy)
+          for(int cx=cx1; cx<=cx2; ++cx)
+            _grid[cy*GRID_CELLS+cx].push_back(i);
+    }
+}
+
+void PaintBuffer::indexRegions() const
+{
+  if( _gridsize != _bounds.size() )
+    buildIndex();
+}
+
+void PaintBuffer::play(QPainter& painter, const QTransform& origtransform,
+                       int dpiy) const
+{
+  TRACE_SCOPE("recordpaint.play");
+  TRACE_COUNT("recordpaint.drawn", _bounds.size());
+  playCommands(painter, origtransform, dpiy, 0, -1);
+}
+
+void PaintBuffer::play(QPainter& painter, const QTransform& origtransform,
+                       int dpiy, const QRectF& region) const
+{
+  TRACE_SCOPE("recordpaint.playRegion");
+  if( region.isEmpty() || _bounds.empty() )
+    return;
+  indexRegions();
+
+  // mark the drawing commands overlapping the region
+  std::vector<char> selected(_bounds.size(), 0);
+  int lastdraw = -1;
+  auto test = [&](int i)
+    {
+      if( !selected[i] && _bounds[i].intersects(region) )
+        {
+          selected[i] = 1;
+          lastdraw = std::max(lastdraw, i);
+        }
+    };
+
+  for(int i : _griddraws)
+    test(i);
+  if( !_grid.empty() && region.intersects(_gridrect) )
+    {
+      const qreal sx = GRID_CELLS / _gridrect.width();
+      const qreal sy = GRID_CELLS / _gridrect.height();
+      auto cell = [](qreal v) { return std::min(std::max(int(v), 0), GRID_CELLS-1); };
+      const int cx1 = cell((region.left()-_gridrect.left())*sx);
+      const int cx2 = cell((region.right()-_gridrect.left())*sx);
+      const int cy1 = cell((region.top()-_gridrect.top())*sy);
+      const int cy2 = cell((region.bottom()-_gridrect.top())*sy);
+      for(int cy=cy1; cy<=cy2; ++cy)
+        for(int cx=cx1; cx<=cx2; ++cx)
+          for(int i : _grid[cy*GRID_CELLS+cx])
+            test(i);
+    }
+
+  // nothing to draw
+  if( lastdraw < 0 )
+    return;
+  TRACE_COUNT("recordpaint.drawn",
+              std::count(selected.begin(), selected.end(), 1));
+
+  playCommands(painter, origtransform, dpiy, &selected, lastdraw);
+}
+
+void PaintBuffer::playCommands(QPainter& painter,
+                               const QTransform& origtransform,
+                               int dpiy, const std::vector<char>* selected,
+                               int lastdraw) const
+{
+  const quint64* p = words();
+  const quint64* const end = p + numWords();
+  int drawidx = -1;
+
+  while(p < end)
+    {
+      const Command& cmd = *reinterpret_cast<const Command*>(p);
+      const quint64* payload = p + HEADER_WORDS;
+      const int count = int(cmd.count);
+      p = payload + cmd.words;
+
+      if( isDrawOp(cmd.op) )
+        {
+          ++drawidx;
+          if( selected != 0 )
+            {
+              if( drawidx > lastdraw )
+                break;
+              if( !(*selected)[drawidx] )
+                continue;
+            }
+        }
+
+      switch(cmd.op)
+        {
+        case OP_ELLIPSE:
+          painter.drawEllipse(*payloadAs<QRect>(payload));
+          break;
+        case OP_ELLIPSEF:
+          painter.drawEllipse(*payloadAs<QRectF>(payload));
+          break;
+        case OP_IMAGE:
+          {
+            const ImageItem& it = *payloadAs<ImageItem>(payload);
+            painter.drawImage(it.rect, _images[cmd.arg], it.sr,
+                              Qt::ImageConversionFlags(it.flags));
+          }
+          break;
+        case OP_LINES:
+          painter.drawLines(payloadAs<QLine>(payload), count);
+          break;
+        case OP_LINESF:
+          painter.drawLines(payloadAs<QLineF>(payload), count);
+          break;
+        case OP_PATH:
+          painter.drawPath(_paths[cmd.arg]);
+          break;
+        case OP_PIXMAP:
+          {
+            const PixmapItem& it = *payloadAs<PixmapItem>(payload);
+            painter.drawPixmap(it.rect, _pixmaps[cmd.arg], it.sr);
+          }
+          break;
+        case OP_POINTS:
+          painter.drawPoints(payloadAs<QPoint>(payload), count);
+          break;
+        case OP_POINTSF:
+          painter.drawPoints(payloadAs<QPointF>(payload), count);
+          break;
+        case OP_POLYGON:
+        case OP_POLYGONF:
+          {
+            const bool isf = cmd.op == OP_POLYGONF;
+            const QPointF* ptsf = payloadAs<QPointF>(payload);
+            const QPoint* pts = payloadAs<QPoint>(payload);
+            switch(QPaintEngine::PolygonDrawMode(cmd.arg))
+              {
+              case QPaintEngine::OddEvenMode:
+                if(isf) painter.drawPolygon(ptsf, count, Qt::OddEvenFill);
+                else painter.drawPolygon(pts, count, Qt::OddEvenFill);
+                break;
+              case QPaintEngine::WindingMode:
+                if(isf) painter.drawPolygon(ptsf, count, Qt::WindingFill);
+                else painter.drawPolygon(pts, count, Qt::WindingFill);
+                break;
+              case QPaintEngine::ConvexMode:
+                if(isf) painter.drawConvexPolygon(ptsf, count);
+                else painter.drawConvexPolygon(pts, count);
+                break;
+              case QPaintEngine::PolylineMode:
+                if(isf) painter.drawPolyline(ptsf, count);
+                else painter.drawPolyline(pts, count);
+                break;
+              }
+          }
+          break;
+        case OP_RECTS:
+          painter.drawRects(payloadAs<QRect>(payload), count);
+          break;
+        case OP_RECTSF:
+          painter.drawRects(payloadAs<QRectF>(payload), count);
+          break;
+        case OP_TEXT:
+          painter.drawText(*payloadAs<QPointF>(payload), _texts[cmd.arg]);
+          break;
+        case OP_TILEDPIXMAP:
+          {
+            const TiledPixmapItem& it = *payloadAs<TiledPixmapItem>(payload);
+            painter.drawTiledPixmap(it.rect, _pixmaps[cmd.arg], it.pt);
+          }
+          break;
+
+        case OP_PEN:
+          painter.setPen(_pens[cmd.arg]);
+          break;
+        case OP_BRUSH:
+          painter.setBrush(_brushes[cmd.arg]);
+          break;
+        case OP_BRUSHORIGIN:
+          painter.setBrushOrigin(*payloadAs<QPointF>(payload));
+          break;
+        case OP_FONT:
+          {
+            QFont tempfont(_fonts[cmd.arg]);
+            if( tempfont.pointSizeF() > 0. )
+              {
+                // scale font sizes in points using dpi ratio
+                const int thisdpi = painter.device()->logicalDpiY();
+                const double scale = tempfont.pointSizeF() / thisdpi * dpiy;
+                tempfont.setPointSizeF(scale);
+              }
+            painter.setFont(tempfont);
+          }
+          break;
+        case OP_BACKGROUND:
+          painter.setBackground(_brushes[cmd.arg]);
+          break;
+        case OP_BACKGROUNDMODE:
+          painter.setBackgroundMode(Qt::BGMode(cmd.arg));
+          break;
+        case OP_TRANSFORM:
+          painter.setWorldTransform(origtransform);
+          painter.setWorldTransform(
+            payloadAs<TransformItem>(payload)->transform(), true);
+          break;
+        case OP_CLIPREGION:
+          painter.setClipRegion(_regions[cmd.arg],
+                                Qt::ClipOperation(cmd.count));
+          break;
+        case OP_CLIPPATH:
+          painter.setClipPath(_paths[cmd.arg],
+                              Qt::ClipOperation(cmd.count));
+          break;
+        case OP_HINTS:
+          painter.setRenderHints(QPainter::RenderHints(int(cmd.arg)));
+          break;
+        case OP_COMPOSITION:
+          painter.setCompositionMode(QPainter::CompositionMode(cmd.arg));
+          break;
+        case OP_CLIPENABLED:
+          painter.setClipping(cmd.arg != 0);
+          break;
+        }
+    }
+}
+
+void PaintBuffer::unmapFile()
+{
+  _words.assign(_mapped, _mapped+_nmapped);
+  delete _mapfile;
+  _mapfile = 0;
+  _mapped = 0;
+  _nmapped = 0;
+}
+
+void PaintBuffer::saveFile(const QString& filename,
+                           const DeviceInfo& info) const
+{
+  // write pools first, to find their size
+  QByteArray pools;
+  {
+    QDataStream ds(&pools, QIODevice::WriteOnly);
+    ds.setVersion(FILE_STREAMVERSION);
+    ds << _paths << _images << _pixmaps << _pens << _brushes
+       << _fonts << _regions << _texts;
+  }
+
+  FileHeader hdr;
+  std::memset(&hdr, 0, sizeof(hdr));
+  std::memcpy(hdr.magic, FILE_MAGIC, sizeof(hdr.magic));
+  hdr.version = FILE_VERSION;
+  hdr.byteorder = FILE_BYTEORDER;
+  hdr.qrealsize = sizeof(qreal);
+  hdr.headersize = sizeof(FileHeader);
+  hdr.info = info;
+  hdr.numwords = numWords();
+  hdr.numbounds = _bounds.size();
+  hdr.wordsoffset = sizeof(FileHeader);
+  hdr.boundsoffset = hdr.wordsoffset + hdr.numwords*sizeof(quint64);
+  hdr.poolsoffset = hdr.boundsoffset + hdr.numbounds*4*sizeof(double);
+  hdr.poolsbytes = quint64(pools.size());
+
+  std::vector<double> bounds;
+  bounds.reserve(_bounds.size()*4);
+  for(auto const& b : _bounds)
+    {
+      bounds.push_back(b.left()); bounds.push_back(b.top());
+      bounds.push_back(b.width()); bounds.push_back(b.height());
+    }
+
+  // QSaveFile writes to a temporary file and renames it over the
+  // file on commit, so that readers never see a partly written file
+  QSaveFile file(filename);
+  if( !file.open(QIODevice::WriteOnly) )
+    throw "Could not open recording file for writing";
+  try
+    {
+      writeAll(file, &hdr, sizeof(hdr));
+      writeAll(file, words(), hdr.numwords*sizeof(quint64));
+      writeAll(file, bounds.data(), bounds.size()*sizeof(double));
+      writeAll(file, pools.constData(), pools.size());
+    }
+  catch( const char* )
+    {
+      file.cancelWriting();
+      throw;
+    }
+  if( !file.commit() )
+    throw "Could not write recording file";
+}
+
+void PaintBuffer::loadFile(const QString& filename, DeviceInfo& info)
+{
+  clear();
+
+  QFile* file = new QFile(filename);
+  try
+    {
+      if( !file->open(QIODevice::ReadOnly) )
+        throw "Could not open recording file";
+
+      FileHeader hdr;
+      readAll(*file, &hdr, sizeof(hdr));
+      if( std::memcmp(hdr.magic, FILE_MAGIC, sizeof(hdr.magic)) != 0 )
+        throw "Not a recording file";
+      if( hdr.version != FILE_VERSION )
+        throw "Unsupported recording file version";
+      if( hdr.byteorder != FILE_BYTEORDER || hdr.qrealsize != sizeof(qreal) ||
+          hdr.headersize != sizeof(FileHeader) )
+        throw "Recording file was written on an incompatible system";
+
+      // check sections lie inside file (the counts are checked first
+      // to avoid overflows)
+      const quint64 size = quint64(file->size());
+      if( hdr.numwords > size/sizeof(quint64) ||
+          hdr.numbounds > size/(4*sizeof(double)) ||
+          hdr.poolsbytes > size ||
+          hdr.wordsoffset % sizeof(quint64) != 0 ||
+          hdr.wordsoffset > size ||
+          hdr.wordsoffset + hdr.numwords*sizeof(quint64) > size ||
+          hdr.boundsoffset > size ||
+          hdr.boundsoffset + hdr.numbounds*4*sizeof(double) > size ||
+          hdr.poolsoffset > size ||
+          hdr.poolsoffset + hdr.poolsbytes > size )
+        throw "Recording file is corrupt";
+
+      // bounds
+      std::vector<double> bounds(hdr.numbounds*4);
+      if( !file->seek(qint64(hdr.boundsoffset)) )
+        throw "Recording file is truncated";
+      readAll(*file, bounds.data(), bounds.size()*sizeof(double));
+      _bounds.reserve(hdr.numbounds);
+      for(size_t i=0; i<hdr.numbounds; ++i)
+        _bounds.push_back(QRectF(bounds[i*4], bounds[i*4+1],
+                                 bounds[i*4+2], bounds[i*4+3]));
+
+      // pools
+      if( !file->seek(qint64(hdr.poolsoffset)) )
+        throw "Recording file is truncated";
+      const QByteArray pools(file->read(qint64(hdr.poolsbytes)));
+      if( quint64(pools.size()) != hdr.poolsbytes )
+        throw "Recording file is truncated";
+      {
+        QDataStream ds(pools);
+        ds.setVersion(FILE_STREAMVERSION);
+        ds >> _paths >> _images >> _pixmaps >> _pens >> _brushes
+           >> _fonts >> _regions >> _texts;
+        if( ds.status() != QDataStream::Ok )
+          throw "Recording file is corrupt";
+      }
+
+      // map the commands if possible, otherwise read them
+      const qint64 wordbytes = qint64(hdr.numwords*sizeof(quint64));
+      uchar* mapped = wordbytes > 0 ?
+        file->map(qint64(hdr.wordsoffset), wordbytes) : 0;
+      if( mapped != 0 )
+        {
+          _mapfile = file;
+          _mapped = reinterpret_cast<const quint64*>(mapped);
+          _nmapped = hdr.numwords;
+          file = 0;
+        }
+      else
+        {
+          _words.resize(hdr.numwords);
+          if( !file->seek(qint64(hdr.wordsoffset)) )
+            throw "Recording file is truncated";
+          readAll(*file, _words.data(), wordbytes);
+        }
+
+      checkCommands();
+      info = hdr.info;
+    }
+  catch( const char* )
+    {
+      delete file;
+      clear();
+      throw;
+    }
+
+  delete file;
+}
+
+void PaintBuffer::checkCommands() const
+{
+  const quint64* p = words();
+  const quint64* const end = p + numWords();
+  size_t numdraws = 0;
+
+  while(p < end)
+    {
+      if( quint64(end-p) < HEADER_WORDS )
+        throw "Recording file is corrupt";
+      const Command& cmd = *reinterpret_cast<const Command*>(p);
+      p += HEADER_WORDS;
+      if( quint64(end-p) < cmd.words ||
+          cmd.op > OP_CLIPENABLED ||
+          payloadBytes(cmd) > quint64(cmd.words)*sizeof(quint64) )
+        throw "Recording file is corrupt";
+      p += cmd.words;
+
+      int poolsize = -1;
+      switch(cmd.op)
+        {
+        case OP_IMAGE: poolsize = _images.size(); break;
+        case OP_PATH: case OP_CLIPPATH: poolsize = _paths.size(); break;
+        case OP_PIXMAP: case OP_TILEDPIXMAP: poolsize = _pixmaps.size(); break;
+        case OP_TEXT: poolsize = _texts.size(); break;
+        case OP_PEN: poolsize = _pens.size(); break;
+        case OP_BRUSH: case OP_BACKGROUND: poolsize = _brushes.size(); break;
+        case OP_FONT: poolsize = _fonts.size(); break;
+        case OP_CLIPREGION: poolsize = _regions.size(); break;
+        default: break;
+        }
+      if( poolsize >= 0 && cmd.arg >= quint32(poolsize) )
+        throw "Recording file is corrupt";
+
+      if( isDrawOp(cmd.op) )
+        ++numdraws;
+    }
+
+  if( numdraws != _bounds.size() )
+    throw "Recording file is corrupt";
+}
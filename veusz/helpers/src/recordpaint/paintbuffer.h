@@ -0,0 +1,285 @@
+// -*- mode: C++; -*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef PAINTBUFFER_H
+#define PAINTBUFFER_H
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <QBrush>
+#include <QFont>
+#include <QImage>
+#include <QPainterPath>
+#include <QPen>
+#include <QPixmap>
+#include <QRectF>
+#include <QRegion>
+#include <QString>
+#include <QTransform>
+#include <QVector>
+
+class QPainter;
+class QFile;
+
+// Recorded painting commands, stored in a contiguous buffer of
+// 64 bit words. Each command is a header giving the operation,
+// followed by its payload of plain data (points, lines, rectangles
+// or small structures) stored inline. Objects with their own storage
+// (paths, images, pens, fonts, etc.) are kept in pools, and are
+// referred to by their index in the pool.
+//
+// Buffers can be saved to a binary file. This is a header (see
+// FileHeader in paintbuffer.cpp), followed by the command words, the
+// bounds of the drawing commands, and the pools written by
+// QDataStream. The command words are 8 byte aligned in the file, so
+// can be memory mapped and played directly. The format is tied to the
+// byte order and size of qreal of the machine which wrote it, and has
+// a version number which should be increased if Op or the payloads
+// are changed.
+class PaintBuffer
+{
+public:
+  enum Op
+    {
+      // drawing
+      OP_ELLIPSE, OP_ELLIPSEF, OP_IMAGE, OP_LINES, OP_LINESF, OP_PATH,
+      OP_PIXMAP, OP_POINTS, OP_POINTSF, OP_POLYGON, OP_POLYGONF,
+      OP_RECTS, OP_RECTSF, OP_TEXT, OP_TILEDPIXMAP,
+
+      // changes of state
+      OP_PEN, OP_BRUSH, OP_BRUSHORIGIN, OP_FONT, OP_BACKGROUND,
+      OP_BACKGROUNDMODE, OP_TRANSFORM, OP_CLIPREGION, OP_CLIPPATH,
+      OP_HINTS, OP_COMPOSITION, OP_CLIPENABLED
+    };
+
+  // header of each command
+  struct Command
+  {
+    quint32 op;
+    // small argument (mode, flags or pool index)
+    quint32 arg;
+    // number of items in payload, or a second argument
+    quint32 count;
+    // size of payload in words
+    quint32 words;
+  };
+
+  // payloads of commands which are not simple arrays
+  struct ImageItem
+  {
+    QRectF rect, sr;
+    quint32 flags;
+  };
+  struct PixmapItem
+  {
+    QRectF rect, sr;
+  };
+  struct TiledPixmapItem
+  {
+    QRectF rect;
+    QPointF pt;
+  };
+  struct TransformItem
+  {
+    TransformItem(const QTransform& t)
+    : m11(t.m11()), m12(t.m12()), m13(t.m13()),
+      m21(t.m21()), m22(t.m22()), m23(t.m23()),
+      m31(t.m31()), m32(t.m32()), m33(t.m33())
+    {
+    }
+    QTransform transform() const
+    {
+      return QTransform(m11, m12, m13, m21, m22, m23, m31, m32, m33);
+    }
+    qreal m11, m12, m13, m21, m22, m23, m31, m32, m33;
+  };
+
+  // properties of the recording device, kept in saved files
+  struct DeviceInfo
+  {
+    qint32 width, height, dpix, dpiy;
+    qint32 drawitemcount, reserved;
+  };
+
+  PaintBuffer();
+  ~PaintBuffer();
+
+  void clear();
+
+  // add a command with an array of count items of plain data
+  // If merge is set and the last command added has the same op and
+  // arg, the items are appended to it instead (the caller should
+  // only do this if drawing them together looks the same)
+  template<class T> void addItems(Op op, quint32 arg,
+                                  const T* items, int count,
+                                  bool merge=false)
+  {
+    static_assert(sizeof(T) % sizeof(quint64) == 0,
+                  "items must fill whole words to be merged");
+    if( !(merge && mergeItems(op, arg, items, sizeof(T), count)) )
+      addCommand(op, arg, quint32(count), items, sizeof(T)*count);
+  }
+
+  // add a command with a single item of plain data (or none)
+  template<class T> void addItem(Op op, quint32 arg, const T& item)
+  {
+    addCommand(op, arg, 1, &item, sizeof(T));
+  }
+  void addOp(Op op, quint32 arg, quint32 count=0)
+  {
+    addCommand(op, arg, count, 0, 0);
+  }
+
+  // add objects to pools, returning their index
+  quint32 addPath(const QPainterPath& path);
+  quint32 addImage(const QImage& image);
+  quint32 addPixmap(const QPixmap& pixmap);
+  quint32 addPen(const QPen& pen);
+  quint32 addBrush(const QBrush& brush);
+  quint32 addFont(const QFont& font);
+  quint32 addRegion(const QRegion& region);
+  quint32 addText(const QString& text);
+
+  // is this a drawing operation (rather than a change of state)?
+  static bool isDrawOp(quint32 op) { return op <= OP_TILEDPIXMAP; }
+
+  // set the bounds of the last drawing command added, in device
+  // coordinates (which should be called for every drawing command)
+  // If the items were merged into the previous command, its bounds
+  // are extended instead.
+  void addBounds(const QRectF& bounds);
+
+  // bounds to use if the extent of a drawing command is unknown
+  static QRectF unboundedRect()
+  {
+    return QRectF(-1e30, -1e30, 2e30, 2e30);
+  }
+
+  // play back commands to painter
+  // origtransform is the transform of the painter before playing
+  // dpiy is the vertical resolution of the recording device
+  void play(QPainter& painter, const QTransform& origtransform,
+            int dpiy) const;
+
+  // play back only the drawing commands which overlap region (in
+  // device coordinates), with all the changes of state before them
+  void play(QPainter& painter, const QTransform& origtransform,
+            int dpiy, const QRectF& region) const;
+
+  // make the index used for playing regions, if out of date
+  // (this should be done before playing regions in several threads)
+  void indexRegions() const;
+
+  // are there pixmaps, which should not be used outside the main thread?
+  bool hasPixmaps() const { return !_pixmaps.isEmpty(); }
+
+  // is there text, which may not be drawn safely in other threads?
+  bool hasTexts() const { return !_texts.isEmpty(); }
+
+  // memory used by the command buffer in bytes
+  size_t bufferBytes() const { return numWords()*sizeof(quint64); }
+
+  // save commands to a file, with the device info
+  // (throws const char* on failure)
+  void saveFile(const QString& filename, const DeviceInfo& info) const;
+
+  // replace the commands with those in a file saved by saveFile,
+  // returning the device info in info (throws const char* on failure)
+  // The command buffer is mapped from the file where possible.
+  void loadFile(const QString& filename, DeviceInfo& info);
+
+private:
+  // no copying, as commands may be mapped from a file
+  PaintBuffer(const PaintBuffer&);
+  PaintBuffer& operator=(const PaintBuffer&);
+
+  void addCommand(Op op, quint32 arg, quint32 count,
+                  const void* payload, size_t bytes);
+
+  // append items to the last command if it has the same op and arg,
+  // returning whether this was done
+  bool mergeItems(Op op, quint32 arg, const void* items,
+                  size_t itemsize, int count);
+
+  // the command words, either in _words or mapped from a file
+  const quint64* words() const
+  {
+    return _mapfile!=0 ? _mapped : _words.data();
+  }
+  size_t numWords() const
+  {
+    return _mapfile!=0 ? _nmapped : _words.size();
+  }
+
+  // copy any mapped commands into _words, so more can be added
+  void unmapFile();
+
+  // check loaded commands are consistent with the pools, so they
+  // can be played safely (throws const char* if not)
+  void checkCommands() const;
+
+  // play commands, drawing those with selected set to 1, if given,
+  // up to drawing command lastdraw
+  void playCommands(QPainter& painter, const QTransform& origtransform,
+                    int dpiy, const std::vector<char>* selected,
+                    int lastdraw) const;
+
+  // make the grid of drawing commands for playing regions
+  void buildIndex() const;
+
+private:
+  std::vector<quint64> _words;
+
+  // position in _words of the last command added (or npos), and
+  // whether items were merged into it by the last addItems
+  size_t _lastpos;
+  bool _lastmerged;
+
+  // commands mapped from a file, if _mapfile is set
+  QFile* _mapfile;
+  const quint64* _mapped;
+  size_t _nmapped;
+
+  // bounds of each drawing command
+  std::vector<QRectF> _bounds;
+
+  // grid of the drawing commands overlapping each cell, covering
+  // _gridrect, and the commands too large to put in the grid
+  // (made when a region is first played)
+  mutable std::vector< std::vector<int> > _grid;
+  mutable std::vector<int> _griddraws;
+  mutable QRectF _gridrect;
+  mutable size_t _gridsize;
+
+  QVector<QPainterPath> _paths;
+  QVector<QImage> _images;
+  // index in _images of images added, by their cache key
+  std::unordered_map<qint64, quint32> _imageindex;
+  QVector<QPixmap> _pixmaps;
+  QVector<QPen> _pens;
+  QVector<QBrush> _brushes;
+  QVector<QFont> _fonts;
+  QVector<QRegion> _regions;
+  QVector<QString> _texts;
+};
+
+#endif
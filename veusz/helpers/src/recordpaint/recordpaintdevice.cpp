@@ -16,8 +16,13 @@
 //    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 /////////////////////////////////////////////////////////////////////////////
 
-#include <QtAlgorithms>
+#include <algorithm>
 #include <limits>
+#include <QFontDatabase>
+#include <QPainter>
+
+#include "parallel.h"
+#include "tracing.h"
 #include "recordpaintdevice.h"
 #include "recordpaintengine.h"
 
@@ -33,7 +38,6 @@ RecordPaintDevice::RecordPaintDevice(int width, int height,
 RecordPaintDevice::~RecordPaintDevice()
 {
   delete _engine;
-  qDeleteAll(_elements);
 }
 
 QPaintEngine* RecordPaintDevice::paintEngine() const
@@ -72,9 +76,115 @@ int RecordPaintDevice::metric(QPaintDevice::PaintDeviceMetric metric) const
 
 void RecordPaintDevice::play(QPainter& painter)
 {
-  QTransform origtransform(painter.worldTransform());
-  foreach(PaintElement* el, _elements)
+  const QTransform origtransform(painter.worldTransform());
+  _buffer.play(painter, origtransform, _dpiy);
+}
+
+void RecordPaintDevice::play(QPainter& painter, const QRectF& region)
+{
+  const QTransform origtransform(painter.worldTransform());
+  _buffer.play(painter, origtransform, _dpiy, region);
+}
+
+void RecordPaintDevice::playTiled(QImage& image, int renderhints,
+                                  int tilesize, unsigned nthreads)
+{
+  if( image.isNull() )
+    return;
+  if( image.depth() != 32 )
+    throw "Image must have 32 bits per pixel";
+  TRACE_SCOPE("recordpaint.playTiled");
+  tilesize = std::max(tilesize, 16);
+
+  // take the pointer outside the threads, as bits() may detach
+  uchar* const bits = image.bits();
+  const int bpl = image.bytesPerLine();
+  const QImage::Format format = image.format();
+  const int width = image.width();
+  const int height = image.height();
+  const int dpmx = image.dotsPerMeterX();
+  const int dpmy = image.dotsPerMeterY();
+
+  const int ntilesx = (width+tilesize-1) / tilesize;
+  const int ntilesy = (height+tilesize-1) / tilesize;
+
+  // QPixmap is not safe to use outside the main thread, and neither
+  // is text on some platforms
+  if( _buffer.hasPixmaps() ||
+      (_buffer.hasTexts() && !QFontDatabase::supportsThreadedFontRendering()) )
+    nthreads = 1;
+  nthreads = std::min(parallelNumThreads(nthreads),
+                      unsigned(ntilesx*ntilesy));
+
+  // tiles only help if they are drawn in parallel
+  if( nthreads <= 1 )
+    {
+      QPainter painter(&image);
+      painter.setRenderHints(QPainter::RenderHints(renderhints));
+      play(painter);
+      painter.end();
+      return;
+    }
+
+  // the index is made lazily, so make it before starting threads
+  _buffer.indexRegions();
+  TRACE_COUNT("recordpaint.tiles", ntilesx*ntilesy);
+
+  parallelFor(unsigned(ntilesx*ntilesy), nthreads,
+              [&](unsigned task)
+    {
+      const int x0 = int(task % ntilesx) * tilesize;
+      const int y0 = int(task / ntilesx) * tilesize;
+      const int tw = std::min(tilesize, width-x0);
+      const int th = std::min(tilesize, height-y0);
+
+      // tile shares the pixels of the image, so drawing is clipped at
+      // its edges and tiles do not overlap
+      QImage tile(bits + size_t(y0)*bpl + size_t(x0)*4, tw, th, bpl, format);
+      tile.setDotsPerMeterX(dpmx);
+      tile.setDotsPerMeterY(dpmy);
+
+      QPainter painter(&tile);
+      painter.setRenderHints(QPainter::RenderHints(renderhints));
+      painter.translate(-x0, -y0);
+      play(painter, QRectF(x0, y0, tw, th));
+      painter.end();
+    });
+}
+
+void RecordPaintDevice::saveFile(const QString& filename) const
+{
+  PaintBuffer::DeviceInfo info;
+  info.width = _width;
+  info.height = _height;
+  info.dpix = _dpix;
+  info.dpiy = _dpiy;
+  info.drawitemcount = drawItemCount();
+  info.reserved = 0;
+  _buffer.saveFile(filename, info);
+}
+
+RecordPaintDevice* RecordPaintDevice::loadFile(const QString& filename)
+{
+  // the size is not known until the file is loaded
+  RecordPaintDevice* dev = new RecordPaintDevice(1, 1, 1, 1);
+  try
+    {
+      PaintBuffer::DeviceInfo info;
+      dev->_buffer.loadFile(filename, info);
+      if( info.width <= 0 || info.height <= 0 ||
+          info.dpix <= 0 || info.dpiy <= 0 )
+        throw "Recording file is corrupt";
+      dev->_width = info.width;
+      dev->_height = info.height;
+      dev->_dpix = info.dpix;
+      dev->_dpiy = info.dpiy;
+      dev->_engine->setDrawItemCount(info.drawitemcount);
+    }
+  catch( const char* )
     {
-      el->paint(painter, origtransform);
+      delete dev;
+      throw;
     }
+  return dev;
 }
@@ -19,9 +19,10 @@
 #ifndef RECORD_PAINT_DEVICE__H
 #define RECORD_PAINT_DEVICE__H
 
+#include <QImage>
 #include <QPaintDevice>
-#include <QVector>
-#include "paintelement.h"
+#include <QString>
+#include "paintbuffer.h"
 #include "recordpaintengine.h"
 
 class RecordPaintDevice : public QPaintDevice
@@ -31,27 +32,42 @@ public:
   ~RecordPaintDevice();
   QPaintEngine* paintEngine() const;
 
-  // play back all 
+  // play back all
   void play(QPainter& painter);
 
+  // play back only the items overlapping region, which is in the
+  // coordinates of this device
+  void play(QPainter& painter, const QRectF& region);
+
+  // play back onto image, whose pixels are the coordinates of this
+  // device, splitting it into square tiles of tilesize pixels which
+  // are drawn by up to nthreads threads (0 for one per core). It is
+  // drawn without tiles if only one thread can be used, as when it
+  // holds pixmaps, or text which the platform cannot draw in other
+  // threads
+  // renderhints are the QPainter::RenderHints to use
+  // image must have 32 bits per pixel (throws const char* if not)
+  void playTiled(QImage& image, int renderhints,
+                 int tilesize=512, unsigned nthreads=0);
+
   int metric(QPaintDevice::PaintDeviceMetric metric) const;
 
   int drawItemCount() const { return _engine->drawItemCount(); }
 
+  // save the recording to a file (throws const char* on failure)
+  void saveFile(const QString& filename) const;
+
+  // make a new device from a file written by saveFile
+  // (throws const char* on failure)
+  static RecordPaintDevice* loadFile(const QString& filename);
+
 public:
   friend class RecordPaintEngine;
 
-private:
-  // add an element to the list of maintained elements
-  void addElement(PaintElement* el)
-  {
-    _elements.push_back(el);
-  }
-
 private:
   int _width, _height, _dpix, _dpiy;
   RecordPaintEngine* _engine;
-  QVector<PaintElement*> _elements;
+  PaintBuffer _buffer;
 };
 
 #endif
@@ -16,466 +16,157 @@
 //    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 /////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <QPainter>
+#include <QFontMetricsF>
 #include <QImage>
 #include <QRectF>
 #include <QLineF>
 #include <QVector>
 #include <QPaintEngine>
 
-#include "paintelement.h"
+#include "paintbuffer.h"
 #include "recordpaintengine.h"
 #include "recordpaintdevice.h"
 
-namespace {
-
-  //////////////////////////////////////////////////////////////
-  // Drawing Elements
-  // these are defined for each type of painting 
-  // the QPaintEngine does
-
-  // draw an ellipse (QRect and QRectF)
-  template <class T>
-  class ellipseElement : public PaintElement {
-  public:
-    ellipseElement(const T &rect) : _ellipse(rect) {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.drawEllipse(_ellipse);
-    }
-
-  private:
-    T _ellipse;
-  };
-  typedef ellipseElement<QRect> EllipseElement;
-  typedef ellipseElement<QRectF> EllipseFElement;
-
-  // draw QImage
-  class ImageElement : public PaintElement {
-  public:
-    ImageElement(const QRectF& rect, const QImage& image,
-		 const QRectF& sr, Qt::ImageConversionFlags flags)
-      : _image(image), _rect(rect), _sr(sr), _flags(flags)
-    {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.drawImage(_rect, _image, _sr, _flags);
-    }
-
-  private:
-    QImage _image;
-    QRectF _rect, _sr;
-    Qt::ImageConversionFlags _flags;
-  };
-
-  // draw lines
-  // this is for painting QLine and QLineF
-  template <class T>
-  class lineElement : public PaintElement {
-  public:
-    lineElement(const T *lines, int linecount)
-    {
-      for(int i = 0; i < linecount; i++)
-	_lines << lines[i];
-    }
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.drawLines(_lines);
-    }
-
-  private:
-    QVector<T> _lines;
-  };
-  // specific Line and LineF variants
-  typedef lineElement<QLine> LineElement;
-  typedef lineElement<QLineF> LineFElement;
-
-  // draw QPainterPath
-  class PathElement : public PaintElement {
-  public:
-    PathElement(const QPainterPath& path)
-      : _path(path) {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.drawPath(_path);
-    }
-
-  private:
-    QPainterPath _path;
-  };
-
-  // draw Pixmap
-  class PixmapElement : public PaintElement {
-  public:
-    PixmapElement(const QRectF& r, const QPixmap& pm,
-		  const QRectF& sr) :
-      _r(r), _pm(pm), _sr(sr) {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.drawPixmap(_r, _pm, _sr);
-    }
-
-  private:
-    QRectF _r;
-    QPixmap _pm;
-    QRectF _sr;
-  };
-
-  // draw points (QPoint and QPointF)
-  template <class T, class V>
-  class pointElement : public PaintElement {
-  public:
-    pointElement(const T* points, int pointcount)
-    {
-      for(int i=0; i<pointcount; ++i)
-	_pts << points[i];
-    }
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.drawPoints(_pts);
-    }
-
-  private:
-    V _pts;
-  };
-  typedef pointElement<QPoint, QPolygon> PointElement;
-  typedef pointElement<QPointF, QPolygonF> PointFElement;
-
-  // for QPolygon and QPolygonF
-  template <class T, class V>
-  class polyElement: public PaintElement {
-  public:
-    polyElement(const T* points, int pointcount,
-		QPaintEngine::PolygonDrawMode mode)
-      : _mode(mode)
-    {
-      for(int i=0; i<pointcount; ++i)
-	_pts << points[i];
-    }
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      switch(_mode)
-	{
-	case QPaintEngine::OddEvenMode:
-	  painter.drawPolygon(_pts, Qt::OddEvenFill);
-	  break;
-	case QPaintEngine::WindingMode:
-	  painter.drawPolygon(_pts, Qt::WindingFill);
-	  break;
-	case QPaintEngine::ConvexMode:
-	  painter.drawConvexPolygon(_pts);
-	  break;
-	case QPaintEngine::PolylineMode:
-	  painter.drawPolyline(_pts);
-	  break;
-	}
-    }
-
-  private:
-    QPaintEngine::PolygonDrawMode _mode;
-    V _pts;
-  };
-  typedef polyElement<QPoint,QPolygon> PolygonElement;
-  typedef polyElement<QPointF,QPolygonF> PolygonFElement;
-
-  // for QRect and QRectF
-  template <class T>
-  class rectElement : public PaintElement {
-  public:
-    rectElement(const T* rects, int rectcount)
-    {
-      for(int i=0; i<rectcount; i++)
-	_rects << rects[i];
-    }
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.drawRects(_rects);
-    }
-
-  private:
-    QVector<T> _rects;
-  };
-  typedef rectElement<QRect> RectElement;
-  typedef rectElement<QRectF> RectFElement;
-
-  // draw Text
-  class TextElement : public PaintElement {
-  public:
-    TextElement(const QPointF& pt, const QTextItem& txt)
-      : _pt(pt), _text(txt.text())
-    {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.drawText(_pt, _text);
-    }
-
-  private:
-    QPointF _pt;
-    QString _text;
-  };
-
-  class TiledPixmapElement : public PaintElement {
-  public:
-    TiledPixmapElement(const QRectF& rect, const QPixmap& pixmap,
-		       const QPointF& pt)
-      : _rect(rect), _pixmap(pixmap), _pt(pt)
-    {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.drawTiledPixmap(_rect, _pixmap, _pt);
-    }
-
-  private:
-    QRectF _rect;
-    QPixmap _pixmap;
-    QPointF _pt;
-  };
-
-  ///////////////////////////////////////////////////////////////////
-  // State paint elements
-
-  // these define and change the state of the painter
-
-  class BackgroundBrushElement : public PaintElement {
-  public:
-    BackgroundBrushElement(const QBrush& brush)
-      : _brush(brush)
-    {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.setBackground(_brush);
-    }
-
-  private:
-    QBrush _brush;
-  };
-
-  class BackgroundModeElement : public PaintElement {
-  public:
-    BackgroundModeElement(Qt::BGMode mode)
-      : _mode(mode)
-    {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.setBackgroundMode(_mode);
-    }
-
-  private:
-    Qt::BGMode _mode;
-  };
-
-  class BrushElement : public PaintElement {
-  public:
-    BrushElement(const QBrush& brush)
-      : _brush(brush)
-    {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.setBrush(_brush);
-    }
-
-  private:
-    QBrush _brush;
-  };
-
-  class BrushOriginElement : public PaintElement {
-  public:
-    BrushOriginElement(const QPointF& origin)
-      : _origin(origin)
-    {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.setBrushOrigin(_origin);
-    }
-
-  private:
-    QPointF _origin;
-  };
-
-  class ClipRegionElement : public PaintElement {
-  public:
-    ClipRegionElement(Qt::ClipOperation op,
-		      const QRegion& region)
-      : _op(op), _region(region)
-    {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.setClipRegion(_region, _op);
-    }
-
-  private:
-    Qt::ClipOperation _op;
-    QRegion _region;
-  };
-
-  class ClipPathElement : public PaintElement {
-  public:
-    ClipPathElement(Qt::ClipOperation op,
-		    const QPainterPath& region)
-      : _op(op), _region(region)
-    {}
-
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.setClipPath(_region, _op);
-    }
+///////////////////////////////////////////////////////////////////
+// Paint engine follows
 
-  private:
-    Qt::ClipOperation _op;
-    QPainterPath _region;
-  };
+RecordPaintEngine::RecordPaintEngine()
+  : QPaintEngine(QPaintEngine::AllFeatures),
+    _drawitemcount(0),
+    _pdev(0),
+    _backgroundmode(0), _hints(0), _composition(0), _clipenabled(0),
+    _recorded(0)
+{
+}
 
-  class CompositionElement : public PaintElement {
-  public:
-    CompositionElement(QPainter::CompositionMode mode)
-      : _mode(mode)
-    {}
+bool RecordPaintEngine::begin(QPaintDevice* pdev)
+{
+  // old style C cast - probably should use dynamic_cast
+  _pdev = (RecordPaintDevice*)(pdev);
 
-    void paint(QPainter& painter, const QTransform&)
-    {
-      painter.setCompositionMode(_mode);
-    }
+  // record the whole state again for a new painter
+  _recorded = 0;
 
-  private:
-    QPainter::CompositionMode _mode;
-  };
+  // signal started ok
+  return 1;
+}
 
-  class FontElement : public PaintElement {
-  public:
-    FontElement(const QFont& font, int dpi)
-      : _dpi(dpi), _font(font)
-    {}
+void RecordPaintEngine::addBounds(const QRectF& rect, bool stroked)
+{
+  QRectF r(rect.normalized());
 
-    void paint(QPainter& painter, const QTransform&)
+  // width of line outside the shape in logical coordinates, allowing
+  // for mitred joins
+  const bool pen = stroked && _pen.style() != Qt::NoPen;
+  if( pen && !_pen.isCosmetic() )
     {
-      QFont tempfont(_font);
-      if( tempfont.pointSizeF() > 0. )
-	{
-	  // scale font sizes in points using dpi ratio
-	  int thisdpi = painter.device()->logicalDpiY();
-	  double scale = tempfont.pointSizeF() / thisdpi * _dpi;
-	  tempfont.setPointSizeF(scale);
-	}
-
-      painter.setFont(tempfont);
+      qreal ext = 0.5*std::max(_pen.widthF(), qreal(1));
+      if( _pen.joinStyle() == Qt::MiterJoin ||
+          _pen.joinStyle() == Qt::SvgMiterJoin )
+        ext *= std::max(_pen.miterLimit(), qreal(1));
+      r.adjust(-ext, -ext, ext, ext);
     }
 
-  private:
-    int _dpi;
-    QFont _font;
-  };
-
-  class TransformElement : public PaintElement {
-  public:
-    TransformElement(const QTransform& t)
-      : _t(t)
-    {}
+  r = _transform.mapRect(r);
 
-    void paint(QPainter& painter, const QTransform& origtransform)
-    {
-      painter.setWorldTransform(origtransform);
-      painter.setWorldTransform(_t, true);
-    }
+  // extra pixel for antialiasing, and cosmetic pens are in device units
+  qreal ext = 1;
+  if( pen && _pen.isCosmetic() )
+    ext += 0.5*std::max(_pen.widthF(), qreal(1));
+  r.adjust(-ext, -ext, ext, ext);
 
-  private:
-    QTransform _t;
-  };
-
-  class ClipEnabledElement : public PaintElement {
-  public:
-    ClipEnabledElement(bool enabled)
-      : _enabled(enabled)
-    {}
+  _pdev->_buffer.addBounds(r);
+}
 
-    void paint(QPainter& painter, const QTransform&)
+template<class T> void RecordPaintEngine::addPointBounds(const T* points,
+                                                        int count,
+                                                        bool stroked)
+{
+  if( count <= 0 )
     {
-      painter.setClipping(_enabled);
+      _pdev->_buffer.addBounds(QRectF());
+      return;
     }
-
-  private:
-    bool _enabled;
-  };
-
-  class PenElement : public PaintElement {
-  public:
-    PenElement(const QPen& pen)
-      : _pen(pen)
-    {}
-
-    void paint(QPainter& painter, const QTransform&)
+  qreal minx = points[0].x(), maxx = minx;
+  qreal miny = points[0].y(), maxy = miny;
+  for(int i=1; i<count; ++i)
     {
-      painter.setPen(_pen);
+      minx = std::min(minx, qreal(points[i].x()));
+      maxx = std::max(maxx, qreal(points[i].x()));
+      miny = std::min(miny, qreal(points[i].y()));
+      maxy = std::max(maxy, qreal(points[i].y()));
     }
+  addBounds(QRectF(minx, miny, maxx-minx, maxy-miny), stroked);
+}
 
-  private:
-    QPen _pen;
-  };
-
-  class HintsElement : public PaintElement {
-  public:
-    HintsElement(QPainter::RenderHints hints)
-      : _hints(hints)
-    {}
-
-    void paint(QPainter& painter, const QTransform&)
+template<class T> void RecordPaintEngine::addLineBounds(const T* lines,
+                                                       int count)
+{
+  QRectF r;
+  for(int i=0; i<count; ++i)
     {
-      painter.setRenderHints(_hints);
+      const QRectF lr = QRectF(lines[i].p1(), lines[i].p2()).normalized();
+      r = i==0 ? lr : r.united(lr);
     }
-
-  private:
-    QPainter::RenderHints _hints;
-  };
-
-
-  // end anonymous block
+  addBounds(r, true);
 }
 
-///////////////////////////////////////////////////////////////////
-// Paint engine follows
-
-RecordPaintEngine::RecordPaintEngine()
-  : QPaintEngine(QPaintEngine::AllFeatures),
-    _drawitemcount(0),
-    _pdev(0)
+template<class T> void RecordPaintEngine::addRectBounds(const T* rects,
+                                                       int count)
 {
+  QRectF r;
+  for(int i=0; i<count; ++i)
+    r = i==0 ? QRectF(rects[i]) : r.united(QRectF(rects[i]));
+  addBounds(r, true);
 }
 
-bool RecordPaintEngine::begin(QPaintDevice* pdev)
+bool RecordPaintEngine::canMerge(bool filled) const
 {
-  // old style C cast - probably should use dynamic_cast
-  _pdev = (RecordPaintDevice*)(pdev);
+  // overlaps of merged primitives are only drawn once, so this is
+  // only the same if they are opaque
+  if( _composition != QPainter::CompositionMode_SourceOver )
+    return false;
+  if( _pen.style() != Qt::NoPen &&
+      !(_pen.style() == Qt::SolidLine && _pen.brush().isOpaque()) )
+    return false;
+  if( filled && _brush.style() != Qt::NoBrush && !_brush.isOpaque() )
+    return false;
+  // the outlines of filled primitives are drawn over the fill of
+  // earlier ones, so they must be the same color
+  if( filled && _pen.style() != Qt::NoPen && _brush.style() != Qt::NoBrush &&
+      !(_pen.brush().style() == Qt::SolidPattern &&
+        _brush.style() == Qt::SolidPattern &&
+        _pen.color().rgba() == _brush.color().rgba()) )
+    return false;
+  return true;
+}
 
-  // signal started ok
-  return 1;
+template<class T> bool RecordPaintEngine::stateChanged(
+  QPaintEngine::DirtyFlag flag, T& current, const T& value)
+{
+  if( (_recorded & flag) && current == value )
+    return false;
+  _recorded |= flag;
+  current = value;
+  return true;
 }
 
-// for each type of drawing command we add a new element
-// to the list maintained by the device
+// for each type of drawing command we add a new command to the
+// buffer maintained by the device, with its bounds
 
 void RecordPaintEngine::drawEllipse(const QRectF& rect)
 {
-  _pdev->addElement( new EllipseFElement(rect) );
+  _pdev->_buffer.addItem(PaintBuffer::OP_ELLIPSEF, 0, rect);
+  addBounds(rect, true);
   _drawitemcount++;
 }
 
 void RecordPaintEngine::drawEllipse(const QRect& rect)
 {
-  _pdev->addElement( new EllipseElement(rect) );
+  _pdev->_buffer.addItem(PaintBuffer::OP_ELLIPSE, 0, rect);
+  addBounds(rect, true);
   _drawitemcount++;
 }
 
@@ -484,85 +175,119 @@ void RecordPaintEngine::drawImage(const QRectF& rectangle,
 				  const QRectF& sr,
 				  Qt::ImageConversionFlags flags)
 {
-  _pdev->addElement( new ImageElement(rectangle, image, sr, flags) );
+  PaintBuffer& buf = _pdev->_buffer;
+  const PaintBuffer::ImageItem item = {rectangle, sr, quint32(flags)};
+  buf.addItem(PaintBuffer::OP_IMAGE, buf.addImage(image), item);
+  addBounds(rectangle, false);
   _drawitemcount++;
 }
 
 void RecordPaintEngine::drawLines(const QLineF* lines, int lineCount)
 {
-  _pdev->addElement( new LineFElement(lines, lineCount) );
+  _pdev->_buffer.addItems(PaintBuffer::OP_LINESF, 0, lines, lineCount,
+                          canMerge(false));
+  addLineBounds(lines, lineCount);
   _drawitemcount += lineCount;
 }
 
 void RecordPaintEngine::drawLines(const QLine* lines, int lineCount)
 {
-  _pdev->addElement( new LineElement(lines, lineCount) );
+  _pdev->_buffer.addItems(PaintBuffer::OP_LINES, 0, lines, lineCount,
+                          canMerge(false));
+  addLineBounds(lines, lineCount);
   _drawitemcount += lineCount;
 }
 
 void RecordPaintEngine::drawPath(const QPainterPath& path)
 {
-  _pdev->addElement( new PathElement(path) );
+  PaintBuffer& buf = _pdev->_buffer;
+  buf.addOp(PaintBuffer::OP_PATH, buf.addPath(path));
+  addBounds(path.controlPointRect(), true);
   _drawitemcount++;
 }
 
 void RecordPaintEngine::drawPixmap(const QRectF& r,
 				   const QPixmap& pm, const QRectF& sr)
 {
-  _pdev->addElement( new PixmapElement(r, pm, sr) );
+  PaintBuffer& buf = _pdev->_buffer;
+  const PaintBuffer::PixmapItem item = {r, sr};
+  buf.addItem(PaintBuffer::OP_PIXMAP, buf.addPixmap(pm), item);
+  addBounds(r, false);
   _drawitemcount++;
 }
 
 void RecordPaintEngine::drawPoints(const QPointF* points, int pointCount)
 {
-  _pdev->addElement( new PointFElement(points, pointCount) );
+  _pdev->_buffer.addItems(PaintBuffer::OP_POINTSF, 0, points, pointCount,
+                          canMerge(false));
+  addPointBounds(points, pointCount, true);
   _drawitemcount += pointCount;
 }
 
 void RecordPaintEngine::drawPoints(const QPoint* points, int pointCount)
 {
-  _pdev->addElement( new PointElement(points, pointCount) );
+  _pdev->_buffer.addItems(PaintBuffer::OP_POINTS, 0, points, pointCount,
+                          canMerge(false));
+  addPointBounds(points, pointCount, true);
   _drawitemcount += pointCount;
 }
 
 void RecordPaintEngine::drawPolygon(const QPointF* points, int pointCount,
 				    QPaintEngine::PolygonDrawMode mode)
 {
-  _pdev->addElement( new PolygonFElement(points, pointCount, mode) );
+  _pdev->_buffer.addItems(PaintBuffer::OP_POLYGONF, quint32(mode),
+                          points, pointCount);
+  addPointBounds(points, pointCount, true);
   _drawitemcount += pointCount;
 }
 
 void RecordPaintEngine::drawPolygon(const QPoint* points, int pointCount,
 				    QPaintEngine::PolygonDrawMode mode)
 {
-  _pdev->addElement( new PolygonElement(points, pointCount, mode) );
+  _pdev->_buffer.addItems(PaintBuffer::OP_POLYGON, quint32(mode),
+                          points, pointCount);
+  addPointBounds(points, pointCount, true);
   _drawitemcount += pointCount;
 }
 
 void RecordPaintEngine::drawRects(const QRectF* rects, int rectCount)
 {
-  _pdev->addElement( new RectFElement( rects, rectCount ) );
+  _pdev->_buffer.addItems(PaintBuffer::OP_RECTSF, 0, rects, rectCount,
+                          canMerge(true));
+  addRectBounds(rects, rectCount);
   _drawitemcount += rectCount;
 }
 
 void RecordPaintEngine::drawRects(const QRect* rects, int rectCount)
 {
-  _pdev->addElement( new RectElement( rects, rectCount ) );
+  _pdev->_buffer.addItems(PaintBuffer::OP_RECTS, 0, rects, rectCount,
+                          canMerge(true));
+  addRectBounds(rects, rectCount);
   _drawitemcount += rectCount;
 }
 
 void RecordPaintEngine::drawTextItem(const QPointF& p,
 				     const QTextItem& textItem)
 {
-  _pdev->addElement( new TextElement(p, textItem) );
-  _drawitemcount += textItem.text().length();
+  PaintBuffer& buf = _pdev->_buffer;
+  const QString text(textItem.text());
+  buf.addItem(PaintBuffer::OP_TEXT, buf.addText(text), p);
+  // pad by the line height to allow for italics and large glyphs
+  const QFontMetricsF fm(_font, _pdev);
+  const qreal pad = fm.height();
+  addBounds(fm.boundingRect(text).translated(p).
+            adjusted(-pad, -pad, pad, pad), false);
+  _drawitemcount += text.length();
 }
 
 void RecordPaintEngine::drawTiledPixmap(const QRectF& rect,
 					      const QPixmap& pixmap,
 					      const QPointF& p)
 {
-  _pdev->addElement( new TiledPixmapElement(rect, pixmap, p) );
+  PaintBuffer& buf = _pdev->_buffer;
+  const PaintBuffer::TiledPixmapItem item = {rect, p};
+  buf.addItem(PaintBuffer::OP_TILEDPIXMAP, buf.addPixmap(pixmap), item);
+  addBounds(rect, false);
   _drawitemcount += 1;
 }
 
@@ -580,33 +305,56 @@ QPaintEngine::Type RecordPaintEngine::type () const
 
 void RecordPaintEngine::updateState(const QPaintEngineState& state)
 {
-  // we add a new element for each change of state
+  // we add a new command for each change of state, unless it is
+  // the same as the last value recorded
   // these are replayed later
+  PaintBuffer& buf = _pdev->_buffer;
   const int flags = state.state();
-  if( flags & QPaintEngine::DirtyPen )
-    _pdev->addElement( new PenElement( state.pen() ) );
-  if( flags & QPaintEngine::DirtyBrush )
-    _pdev->addElement( new BrushElement( state.brush() ) );
-  if( flags & QPaintEngine::DirtyBrushOrigin )
-    _pdev->addElement( new BrushOriginElement( state.brushOrigin() ) );
-  if( flags & QPaintEngine::DirtyFont )
-    _pdev->addElement( new FontElement( state.font(), _pdev->_dpiy ) );
-  if( flags & QPaintEngine::DirtyBackground )
-    _pdev->addElement( new BackgroundBrushElement( state.backgroundBrush() ) );
-  if( flags & QPaintEngine::DirtyBackgroundMode )
-    _pdev->addElement( new BackgroundModeElement( state.backgroundMode() ) );
-  if( flags & QPaintEngine::DirtyTransform )
-    _pdev->addElement( new TransformElement( state.transform() ) );
+  if( (flags & QPaintEngine::DirtyPen) &&
+      stateChanged(QPaintEngine::DirtyPen, _pen, state.pen()) )
+    buf.addOp( PaintBuffer::OP_PEN, buf.addPen(_pen) );
+  if( (flags & QPaintEngine::DirtyBrush) &&
+      stateChanged(QPaintEngine::DirtyBrush, _brush, state.brush()) )
+    buf.addOp( PaintBuffer::OP_BRUSH, buf.addBrush(_brush) );
+  if( (flags & QPaintEngine::DirtyBrushOrigin) &&
+      stateChanged(QPaintEngine::DirtyBrushOrigin, _brushorigin,
+                   state.brushOrigin()) )
+    buf.addItem( PaintBuffer::OP_BRUSHORIGIN, 0, _brushorigin );
+  if( (flags & QPaintEngine::DirtyFont) &&
+      stateChanged(QPaintEngine::DirtyFont, _font, state.font()) )
+    buf.addOp( PaintBuffer::OP_FONT, buf.addFont(_font) );
+  if( (flags & QPaintEngine::DirtyBackground) &&
+      stateChanged(QPaintEngine::DirtyBackground, _background,
+                   state.backgroundBrush()) )
+    buf.addOp( PaintBuffer::OP_BACKGROUND, buf.addBrush(_background) );
+  if( (flags & QPaintEngine::DirtyBackgroundMode) &&
+      stateChanged(QPaintEngine::DirtyBackgroundMode, _backgroundmode,
+                   int(state.backgroundMode())) )
+    buf.addOp( PaintBuffer::OP_BACKGROUNDMODE, quint32(_backgroundmode) );
+  if( (flags & QPaintEngine::DirtyTransform) &&
+      stateChanged(QPaintEngine::DirtyTransform, _transform,
+                   state.transform()) )
+    buf.addItem( PaintBuffer::OP_TRANSFORM, 0,
+                 PaintBuffer::TransformItem(_transform) );
+  // clipping is cumulative, so is always recorded
   if( flags & QPaintEngine::DirtyClipRegion )
-    _pdev->addElement( new ClipRegionElement( state.clipOperation(),
-					      state.clipRegion() ) );
+    buf.addOp( PaintBuffer::OP_CLIPREGION,
+               buf.addRegion(state.clipRegion()),
+               quint32(state.clipOperation()) );
   if( flags & QPaintEngine::DirtyClipPath )
-    _pdev->addElement( new ClipPathElement( state.clipOperation(),
-					    state.clipPath() ) );
-  if( flags & QPaintEngine::DirtyHints )
-    _pdev->addElement( new HintsElement( state.renderHints() ) );
-  if( flags & QPaintEngine::DirtyCompositionMode )
-    _pdev->addElement( new CompositionElement( state.compositionMode() ) );
-  if( flags & QPaintEngine::DirtyClipEnabled )
-    _pdev->addElement( new ClipEnabledElement( state.isClipEnabled() ) );
+    buf.addOp( PaintBuffer::OP_CLIPPATH,
+               buf.addPath(state.clipPath()),
+               quint32(state.clipOperation()) );
+  if( (flags & QPaintEngine::DirtyHints) &&
+      stateChanged(QPaintEngine::DirtyHints, _hints,
+                   int(state.renderHints())) )
+    buf.addOp( PaintBuffer::OP_HINTS, quint32(_hints) );
+  if( (flags & QPaintEngine::DirtyCompositionMode) &&
+      stateChanged(QPaintEngine::DirtyCompositionMode, _composition,
+                   int(state.compositionMode())) )
+    buf.addOp( PaintBuffer::OP_COMPOSITION, quint32(_composition) );
+  if( (flags & QPaintEngine::DirtyClipEnabled) &&
+      stateChanged(QPaintEngine::DirtyClipEnabled, _clipenabled,
+                   state.isClipEnabled() ? 1 : 0) )
+    buf.addOp( PaintBuffer::OP_CLIPENABLED, quint32(_clipenabled) );
 }
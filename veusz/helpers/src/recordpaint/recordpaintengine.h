@@ -29,6 +29,11 @@
 #include <QRectF>
 #include <QRect>
 #include <QPixmap>
+#include <QPen>
+#include <QBrush>
+#include <QPointF>
+#include <QFont>
+#include <QTransform>
 
 class RecordPaintDevice;
 
@@ -66,10 +71,39 @@ public:
   
   // return an estimate of number of items drawn
   int drawItemCount() const { return _drawitemcount; }
+  void setDrawItemCount(int count) { _drawitemcount = count; }
+
+private:
+  // add the device bounds of the command just added, given the
+  // bounds in logical coordinates and whether it is outlined by the pen
+  void addBounds(const QRectF& rect, bool stroked);
+  template<class T> void addPointBounds(const T* points, int count,
+                                        bool stroked);
+  template<class T> void addLineBounds(const T* lines, int count);
+  template<class T> void addRectBounds(const T* rects, int count);
+
+  // can primitives be merged into the previous command, drawing the
+  // same? (needs opaque solid pen, and brush if filled)
+  bool canMerge(bool filled) const;
+
+  // has state changed from the last value recorded? updates current
+  template<class T> bool stateChanged(QPaintEngine::DirtyFlag flag,
+                                      T& current, const T& value);
 
 private:
   int _drawitemcount;
   RecordPaintDevice* _pdev;
+
+  // current state, for computing bounds and dropping changes
+  // which do nothing
+  QPen _pen;
+  QFont _font;
+  QTransform _transform;
+  QBrush _brush, _background;
+  QPointF _brushorigin;
+  int _backgroundmode, _hints, _composition, _clipenabled;
+  // DirtyFlags of state which has been recorded
+  int _recorded;
 };
 
 #endif
@@ -0,0 +1,275 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+// Benchmark of the 3D rendering pipeline, using synthetic scenes
+// rendered to a QImage in each of the rendering modes. The time spent
+// in each stage and the number of fragments are taken from
+// Scene::lastRenderStats().
+
+/*
+  This is built by "python3 setup.py build_bench", into build/bench
+  (it is not installed).
+
+  Usage: threedbench [repeats] [threads] [size]
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtGui/QPainterPath>
+
+#include "camera.h"
+#include "mmaths.h"
+#include "objects.h"
+#include "properties.h"
+#include "scene.h"
+
+namespace
+{
+  typedef std::mt19937 RandomGen;
+
+  double uniform(RandomGen& gen, double a, double b)
+  {
+    return std::uniform_real_distribution<double>(a, b)(gen);
+  }
+
+  // triangles with random vertices, which intersect each other
+  ObjectContainer* makeTriangles(RandomGen& gen, unsigned n)
+  {
+    ObjectContainer* cont = new ObjectContainer;
+    for(unsigned i=0; i<n; ++i)
+      {
+        Vec3 c(uniform(gen, -0.5, 0.5), uniform(gen, -0.5, 0.5),
+               uniform(gen, -0.5, 0.5));
+        Vec3 pts[3];
+        for(unsigned p=0; p<3; ++p)
+          pts[p] = c + Vec3(uniform(gen, -0.1, 0.1),
+                            uniform(gen, -0.1, 0.1),
+                            uniform(gen, -0.1, 0.1));
+        SurfaceProp* prop = new SurfaceProp(uniform(gen, 0, 1),
+                                            uniform(gen, 0, 1),
+                                            uniform(gen, 0, 1), 0.5,
+                                            i%4 == 0 ? 0.5 : 0);
+        cont->addObject(new Triangle(pts[0], pts[1], pts[2], prop));
+      }
+    return cont;
+  }
+
+  // surface on a n*n grid, with grid lines
+  ObjectContainer* makeMesh(unsigned n)
+  {
+    ValVector pos1, pos2, heights;
+    for(unsigned i=0; i<n; ++i)
+      {
+        pos1.push_back(-0.5 + i/double(n-1));
+        pos2.push_back(-0.5 + i/double(n-1));
+      }
+    for(unsigned i1=0; i1<n; ++i1)
+      for(unsigned i2=0; i2<n; ++i2)
+        heights.push_back(0.4*std::sin(pos1[i1]*10)*std::cos(pos2[i2]*7));
+
+    ObjectContainer* cont = new ObjectContainer;
+    cont->addObject(new Mesh(pos1, pos2, heights, Mesh::Z_DIRN,
+                             new LineProp(0, 0, 0, 0, 0, 0.5),
+                             new SurfaceProp(0.3, 0.5, 0.9)));
+    return cont;
+  }
+
+  // a cloud of circular markers
+  ObjectContainer* makePoints(RandomGen& gen, unsigned n)
+  {
+    ValVector x, y, z;
+    std::normal_distribution<double> norm(0, 0.15);
+    for(unsigned i=0; i<n; ++i)
+      {
+        x.push_back(norm(gen));
+        y.push_back(norm(gen));
+        z.push_back(norm(gen));
+      }
+    QPainterPath path;
+    path.addEllipse(QRectF(-2, -2, 4, 4));
+
+    ObjectContainer* cont = new ObjectContainer;
+    cont->addObject(new Points(x, y, z, path,
+                               new LineProp(0, 0, 0, 0, 0, 0.5),
+                               new SurfaceProp(0.9, 0.2, 0.2)));
+    return cont;
+  }
+
+  // cuboids overlapping each other, partly transparent
+  ObjectContainer* makeCuboids(RandomGen& gen, unsigned n)
+  {
+    ValVector xmin, xmax, ymin, ymax, zmin, zmax;
+    for(unsigned i=0; i<n; ++i)
+      {
+        double x = uniform(gen, -0.5, 0.4);
+        double y = uniform(gen, -0.5, 0.4);
+        double z = uniform(gen, -0.5, 0.4);
+        xmin.push_back(x); xmax.push_back(x+uniform(gen, 0.02, 0.1));
+        ymin.push_back(y); ymax.push_back(y+uniform(gen, 0.02, 0.1));
+        zmin.push_back(z); zmax.push_back(z+uniform(gen, 0.02, 0.1));
+      }
+
+    ObjectContainer* cont = new ObjectContainer;
+    cont->addObject(new MultiCuboid(xmin, xmax, ymin, ymax, zmin, zmax,
+                                    new LineProp(0, 0, 0, 0, 0, 0.5),
+                                    new SurfaceProp(0.2, 0.8, 0.2, 0.5,
+                                                    0.3)));
+    return cont;
+  }
+
+  struct Timings
+  {
+    Timings()
+      : total(0), nfragments(0), nsplit(0), ndrawn(0)
+    {
+    }
+
+    Scene::RenderStats stage;
+    double total;
+    unsigned nfragments, nsplit, ndrawn;
+  };
+
+  // render the scene repeats times, returning the mean timings
+  Timings benchScene(ObjectContainer* root, Scene::RenderMode mode,
+                     unsigned repeats, unsigned nthreads, int size)
+  {
+    Camera cam;
+    cam.setPointing(Vec3(0, 0, -2.5), Vec3(0, 0, 0), Vec3(0, -1, 0));
+    cam.setPerspective(90, 1, 100);
+
+    Scene scene(mode);
+    scene.setNumThreads(nthreads);
+    scene.addLight(Vec3(2, -2, -2), QColor(255, 255, 255), 0.8);
+
+    QImage img(size, size, QImage::Format_ARGB32_Premultiplied);
+
+    Timings t;
+    for(unsigned r=0; r<repeats; ++r)
+      {
+        img.fill(Qt::white);
+        QPainter painter(&img);
+        painter.setRenderHint(QPainter::Antialiasing);
+
+        auto start = std::chrono::steady_clock::now();
+        scene.render(root, &painter, cam, 0, 0, size, size, -1);
+        painter.end();
+        t.total += std::chrono::duration<double>
+          (std::chrono::steady_clock::now()-start).count();
+
+        const Scene::RenderStats& s = scene.lastRenderStats();
+        t.stage.fragments += s.fragments;
+        t.stage.lighting += s.lighting;
+        t.stage.splitting += s.splitting;
+        t.stage.ordering += s.ordering;
+        t.stage.projection += s.projection;
+        t.stage.raster += s.raster;
+        t.stage.drawing += s.drawing;
+        t.nfragments = s.nfragments;
+        t.nsplit = s.nsplit;
+        t.ndrawn = s.ndrawn;
+      }
+
+    const double f = 1e3/repeats;
+    t.total *= f;
+    t.stage.fragments *= f;
+    t.stage.lighting *= f;
+    t.stage.splitting *= f;
+    t.stage.ordering *= f;
+    t.stage.projection *= f;
+    t.stage.raster *= f;
+    t.stage.drawing *= f;
+    return t;
+  }
+
+  void printTimings(const char* scenename, const char* modename,
+                    const Timings& t)
+  {
+    std::printf("%-10s %-9s %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %9.1f"
+                " %9u %9u %9u\n",
+                scenename, modename,
+                t.stage.fragments, t.stage.lighting, t.stage.splitting,
+                t.stage.ordering, t.stage.projection, t.stage.raster,
+                t.stage.drawing, t.total,
+                t.nfragments, t.nsplit, t.ndrawn);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  // needed for drawing text and paths to a QImage
+  QGuiApplication app(argc, argv);
+
+  const unsigned repeats = argc > 1 ? std::atoi(argv[1]) : 5;
+  const unsigned nthreads = argc > 2 ? std::atoi(argv[2]) : 0;
+  const int size = argc > 3 ? std::atoi(argv[3]) : 800;
+
+  RandomGen gen(42);
+
+  struct SceneDef
+  {
+    const char* name;
+    ObjectContainer* root;
+  };
+  SceneDef scenes[] = {
+    {"triangles", makeTriangles(gen, 2000)},
+    {"mesh", makeMesh(200)},
+    {"points", makePoints(gen, 20000)},
+    {"cuboids", makeCuboids(gen, 500)},
+  };
+
+  struct ModeDef
+  {
+    const char* name;
+    Scene::RenderMode mode;
+  };
+  const ModeDef modes[] = {
+    {"painters", Scene::RENDER_PAINTERS},
+    {"bsp", Scene::RENDER_BSP},
+    {"zbuffer", Scene::RENDER_ZBUFFER},
+  };
+
+  std::printf("# %u repeats, %u threads (0 is all cores), %dx%d pixels\n",
+              repeats, nthreads, size, size);
+  std::printf("# mean times in ms\n");
+  std::printf("%-10s %-9s %8s %8s %8s %8s %8s %8s %8s %9s %9s %9s %9s\n",
+              "scene", "mode", "frags", "light", "split", "order", "proj",
+              "raster", "draw", "total", "nfrags", "nsplit", "ndrawn");
+
+  for(auto& sc : scenes)
+    {
+      // same orientation as the default in scene3d.py
+      sc.root->objM = rotate3M4(0, 35/180.*M_PI, 0);
+      sc.root->setNumThreads(0);
+
+      for(auto const& m : modes)
+        printTimings(sc.name, m.name,
+                     benchScene(sc.root, m.mode, repeats, nthreads, size));
+
+      delete sc.root;
+    }
+
+  return 0;
+}
@@ -4,11 +4,52 @@
 #include <limits>
 #include "fragment.h"
 #include "bsp.h"
+#include "parallel.h"
 
 #define EPS 1e-6
 
+// minimum number of fragments to consider building in parallel
+#define BSP_PARALLEL_MIN_FRAGS 8192
+// don't split nodes smaller than this to make more parallel subtrees
+#define BSP_PARALLEL_MIN_SUBTREE 512
+// number of subtrees to aim for per thread
+#define BSP_PARALLEL_SUBTREES_PER_THREAD 4
+
 namespace
 {
+  // Access to fragments by index. Fragments made by splitting are
+  // appended to extra and numbered from extrastart. When building on
+  // one thread, base and extra are the same vector. When building in
+  // parallel, each thread appends to its own vector so that base is
+  // never resized while other threads use it.
+  struct FragStore
+  {
+    FragStore(FragmentVector& _base, FragmentVector& _extra,
+              unsigned _extrastart)
+      : base(_base), extra(_extra), extrastart(_extrastart)
+    {}
+
+    Fragment& operator[](unsigned i)
+    {
+      return i<extrastart ? base[i] : extra[i-extrastart];
+    }
+    const Fragment& operator[](unsigned i) const
+    {
+      return i<extrastart ? base[i] : extra[i-extrastart];
+    }
+
+    // add fragment, returning its index
+    unsigned add(const Fragment& f)
+    {
+      extra.push_back(f);
+      return extrastart+extra.size()-1;
+    }
+
+    FragmentVector& base;
+    FragmentVector& extra;
+    unsigned extrastart;
+  };
+
   // 2d triangle area squared (only considering X/Y)
   inline double triAreaSqd2D(const Vec3* pts)
   {
@@ -21,7 +62,7 @@ namespace
   // Find set of three points to define a plane (pts).
   // Needs to find points which are not the same return true if ok
   bool findPlane(const IdxVector& idxs, unsigned startidx,
-                 const FragmentVector& frags, Vec3* pts)
+                 const FragStore& frags, Vec3* pts)
   {
     double maxtriarea2 = -1;
     unsigned besttri = EMPTY_BSP_IDX;
@@ -99,7 +140,7 @@ namespace
 
   // is path in front, on or behind plane?
   void handlePath(const Vec3& norm, const Vec3& plane0,
-                  FragmentVector& v, unsigned fidx,
+                  FragStore& v, unsigned fidx,
                   IdxVector& idxsame, IdxVector& idxfront, IdxVector& idxback)
   {
     int sign = dotsign(dot(norm, v[fidx].points[0]-plane0));
@@ -113,7 +154,7 @@ namespace
 
   // is line in front, on or behind plane
   void handleLine(const Vec3& norm, const Vec3& plane0,
-                  FragmentVector& fragvec, unsigned fidx,
+                  FragStore& fragvec, unsigned fidx,
                   IdxVector& idxsame, IdxVector& idxfront, IdxVector& idxback)
   {
     Fragment& f = fragvec[fidx];
@@ -145,14 +186,13 @@ namespace
 
         // write copy with -ve part
         fcpy.points[sign0 < 0 ? 1 : 0] = newpt;
-        idxback.push_back(fragvec.size());
-        fragvec.push_back(fcpy);
+        idxback.push_back(fragvec.add(fcpy));
       }
   }
 
   // is triangle in front, behind or on plane?
   void handleTriangle(const Vec3& norm, const Vec3& plane0,
-                      FragmentVector& fragvec, unsigned fidx,
+                      FragStore& fragvec, unsigned fidx,
                       IdxVector& idxsame, IdxVector& idxfront, IdxVector& idxback)
   {
     Fragment& f = fragvec[fidx];
@@ -195,8 +235,7 @@ namespace
 
         // then make a copy for the other side
         fcpy.points[(idx0+1)%3] = newpt;
-        (dots[(idx0+2)%3]>0 ? idxfront : idxback).push_back(fragvec.size());
-        fragvec.push_back(fcpy);
+        (dots[(idx0+2)%3]>0 ? idxfront : idxback).push_back(fragvec.add(fcpy));
       }
     else
       {
@@ -226,23 +265,12 @@ namespace
         // then add the other two on the other side
         fcpy1.points[diffidx] = newpt_p1;
         fcpy1.points[(diffidx+2)%3] = newpt_p2;
-        (dots[diffidx] < 0 ? idxfront : idxback).push_back(fragvec.size());
-        fragvec.push_back(fcpy1);
+        (dots[diffidx] < 0 ? idxfront : idxback).push_back(fragvec.add(fcpy1));
         fcpy2.points[diffidx] = newpt_p2;
-        (dots[diffidx] < 0 ? idxfront : idxback).push_back(fragvec.size());
-        fragvec.push_back(fcpy2);
+        (dots[diffidx] < 0 ? idxfront : idxback).push_back(fragvec.add(fcpy2));
       }
   }
 
-  struct BSPStackItem
-  {
-    BSPStackItem(unsigned _bspidx, unsigned _nidxs)
-      : bspidx(_bspidx), nidxs(_nidxs)
-    {}
-    unsigned bspidx; // BSPRecord we are working on here
-    unsigned nidxs;  // Number of fragment indices in to_process
-  };
-
   // get Z component of fragment, nudging points and lines forward
   // Z decreases away from viewer
   double fragZ(const Fragment& f)
@@ -273,186 +301,489 @@ namespace
     const FragmentVector& v;
   };
 
+  // Choose a plane from the fragments in idxs (from startidx) and
+  // split them by it. Fragments on the plane are added to the node in
+  // frag_idxs and the others are sorted into idxfront and
+  // idxback. If there is no plane, all are added to the node.
+  void processNode(FragStore& fragvec, const Vec3& viewdirn,
+                   const IdxVector& idxs, unsigned startidx,
+                   BSPRecord& rec, IdxVector& frag_idxs,
+                   IdxVector& idxfront, IdxVector& idxback)
+  {
+    rec.minfragidxidx = frag_idxs.size(); // where the items get added
+
+    const unsigned endidx = idxs.size();
+    Vec3 planepts[3];
+
+    // if more than item to process then choose a plane, then split
+    if( endidx-startidx > 1 &&
+        findPlane(idxs, startidx, fragvec, planepts) )
+      {
+        // norm of plane (making sure it points to observer)
+        Vec3 norm = cross(planepts[1]-planepts[0], planepts[2]-planepts[0]);
+        if(dot(norm, viewdirn) < 0)
+          norm = -norm;
+        // approximately normalise
+        norm *= 1./(std::abs(norm(0))+std::abs(norm(1))+std::abs(norm(2)));
+        rec.planenorm = norm;
+        rec.planedot = dot(norm, planepts[0]);
+
+        for(unsigned i=startidx; i<endidx; ++i)
+          {
+            unsigned fidx = idxs[i];
+            switch(fragvec[fidx].type)
+              {
+                case Fragment::FR_PATH:
+                handlePath(norm, planepts[0], fragvec, fidx,
+                           frag_idxs, idxfront, idxback);
+                break;
+              case Fragment::FR_LINESEG:
+                handleLine(norm, planepts[0], fragvec, fidx,
+                           frag_idxs, idxfront, idxback);
+                break;
+              case Fragment::FR_TRIANGLE:
+                handleTriangle(norm, planepts[0], fragvec, fidx,
+                               frag_idxs, idxfront, idxback);
+                break;
+              default:
+                break;
+              }
+          }
+
+        // number added to this node
+        rec.nfrags = frag_idxs.size()-rec.minfragidxidx;
+
+        if(rec.nfrags == 0)
+          {
+            // if everything is on one side, this is a leaf with no
+            // plane dividing its fragments
+            if(idxfront.empty() != idxback.empty())
+              {
+                rec.planenorm = Vec3();
+                rec.planedot = 0;
+              }
+
+            if(idxfront.empty() && !idxback.empty())
+              {
+                frag_idxs.insert(frag_idxs.end(), idxback.begin(), idxback.end());
+                rec.nfrags = idxback.size();
+                idxback.resize(0);
+              }
+            else if(idxback.empty() && !idxfront.empty())
+              {
+                frag_idxs.insert(frag_idxs.end(), idxfront.begin(), idxfront.end());
+                rec.nfrags = idxfront.size();
+                idxfront.resize(0);
+              }
+          }
+      }
+    else
+      {
+        // single item to process or plane couldn't be found
+        frag_idxs.insert(frag_idxs.end(), idxs.begin()+startidx, idxs.end());
+        rec.nfrags = endidx-startidx;
+      }
+  }
+
+  // This is a non-recursive BSP building routine. Fragment indices
+  // to examine are built up on the to_process vector. A stack of
+  // BuildItem items is used to keep track which BSP record the
+  // fragment indices belong to. The tree is built below record
+  // rootidx of bsp_recs, which should exist. bufs is scratch space.
+  void buildTree(FragStore& fragvec, const Vec3& viewdirn,
+                 IdxVector& to_process,
+                 std::vector<BSPRecord>& bsp_recs, IdxVector& frag_idxs,
+                 BSPWorkspace::BuildBuffers& bufs,
+                 unsigned rootidx=0)
+  {
+    // these are where indices for the front and back side of the plane
+    IdxVector& idxback = bufs.idxback;
+    IdxVector& idxfront = bufs.idxfront;
+    idxback.resize(0);
+    idxfront.resize(0);
+    idxback.reserve(to_process.size());
+    idxfront.reserve(to_process.size());
+    to_process.reserve(to_process.size()*2);
+
+    // stack of items to process
+    std::vector<BSPWorkspace::BuildItem>& stack = bufs.stack;
+    stack.clear();
+    stack.reserve(128);
+    stack.push_back( BSPWorkspace::BuildItem(rootidx, to_process.size()) );
+
+    while( !stack.empty() )
+      {
+        if(bufs.cancel != 0 && bufs.cancel->load(std::memory_order_relaxed))
+          break;
+
+        BSPWorkspace::BuildItem stackitem(stack.back());
+        stack.pop_back();
+
+        // this is the bsp record with which the items are associated
+        const unsigned to_process_size = to_process.size();
+        processNode(fragvec, viewdirn,
+                    to_process, to_process_size-stackitem.nidxs,
+                    bsp_recs[stackitem.bspidx], frag_idxs,
+                    idxfront, idxback);
+
+        // remove items to process
+        to_process.resize(to_process_size-stackitem.nidxs);
+
+        // push_back invalidates records, so we don't keep them
+        if(!idxfront.empty())
+          {
+            unsigned newbspidx = bsp_recs.size();
+            bsp_recs[stackitem.bspidx].frontidx = newbspidx;
+            bsp_recs.push_back(BSPRecord());
+            stack.push_back( BSPWorkspace::BuildItem(newbspidx, idxfront.size()) );
+            to_process.insert(to_process.end(), idxfront.begin(), idxfront.end());
+            idxfront.resize(0);
+          }
+
+        if(!idxback.empty())
+          {
+            unsigned newbspidx = bsp_recs.size();
+            bsp_recs[stackitem.bspidx].backidx = newbspidx;
+            // add the record to be processed
+            bsp_recs.push_back(BSPRecord());
+            // new set of items to process
+            stack.push_back( BSPWorkspace::BuildItem(newbspidx, idxback.size()) );
+            // and add onto to process list
+            to_process.insert(to_process.end(), idxback.begin(), idxback.end());
+            idxback.resize(0);
+          }
+
+      } // while !stack.empty()
+  }
+
+  // fragments waiting to be added below a node by insertFragments
+  struct InsertItem
+  {
+    unsigned bspidx;
+    IdxVector idxs;
+  };
+
 }
 
-// This is a non-recursive BSP building routines. Fragment indices to
-// examine are built up on the to_process vector. A stack of
-// BSPStackItem items is used to keep track which BSP record the
-// fragment indices belong to.
+BSPBuilder::BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn,
+                       unsigned nthreads, BSPWorkspace* ws)
+{
+  build(fragvec, viewdirn, nthreads, ws);
+}
 
-BSPBuilder::BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn)
+void BSPBuilder::build(FragmentVector& fragvec, Vec3 viewdirn,
+                       unsigned nthreads, BSPWorkspace* ws)
 {
+  BSPWorkspace localws;
+  BSPWorkspace& w = ws!=0 ? *ws : localws;
+  w.bufs.cancel = w.cancel;
+
   // initial record
+  bsp_recs.resize(0);
+  frag_idxs.resize(0);
   bsp_recs.reserve(fragvec.size());
   bsp_recs.push_back(BSPRecord());
 
   // add every non-empty fragment onto a list of fragments to process
-  IdxVector to_process;
-  to_process.reserve(fragvec.size()*2);
+  IdxVector& to_process = w.to_process;
+  to_process.resize(0);
+  to_process.reserve(fragvec.size());
   for(unsigned i=0, s=fragvec.size(); i<s; ++i)
     {
       if(fragvec[i].type != Fragment::FR_NONE)
         to_process.push_back(i);
     }
 
-  // these are where indices for the front and back side of the plane
-  IdxVector idxback;
-  IdxVector idxfront;
-  idxback.reserve(fragvec.size());
-  idxfront.reserve(fragvec.size());
-  Vec3 planepts[3];
+  if(nthreads > 1 && to_process.size() >= BSP_PARALLEL_MIN_FRAGS)
+    buildParallel(fragvec, viewdirn, nthreads, w);
+  else
+    {
+      FragStore store(fragvec, fragvec, 0);
+      buildTree(store, viewdirn, to_process, bsp_recs, frag_idxs, w.bufs);
+    }
+}
 
-  // stack of items to process
-  std::vector<BSPStackItem> stack;
-  stack.reserve(128);
-  stack.push_back( BSPStackItem(0, to_process.size()) );
+// Each node only ever touches its own fragments, so the front and
+// back subtrees of a node are independent. We split the largest
+// nodes on this thread until there are enough subtrees, build the
+// subtrees in parallel, then append their records, fragment indices
+// and split fragments in the order the subtrees were created. The
+// tree is identical to the single-threaded one, except for the
+// numbering of the records and split fragments.
+
+void BSPBuilder::buildParallel(FragmentVector& fragvec, const Vec3& viewdirn,
+                               unsigned nthreads, BSPWorkspace& ws)
+{
+  IdxVector& idxback = ws.bufs.idxback;
+  IdxVector& idxfront = ws.bufs.idxfront;
+  idxback.resize(0);
+  idxfront.resize(0);
+  FragStore serialstore(fragvec, fragvec, 0);
+
+  // the first npending subtrees are nodes waiting to be split, in
+  // the order they were created
+  std::vector<BSPWorkspace::Subtree>& subtrees = ws.subtrees;
+  if(subtrees.empty())
+    subtrees.resize(1);
+  unsigned npending = 1;
+  subtrees[0].bspidx = 0;
+  subtrees[0].idxs.swap(ws.to_process);
+
+  const unsigned maxsubtrees = nthreads*BSP_PARALLEL_SUBTREES_PER_THREAD;
+  while(npending > 0 && npending < maxsubtrees)
+    {
+      // split the largest pending node (the first if equal)
+      unsigned largest = 0;
+      for(unsigned i=1; i<npending; ++i)
+        if(subtrees[i].idxs.size() > subtrees[largest].idxs.size())
+          largest = i;
+      if(subtrees[largest].idxs.size() < BSP_PARALLEL_MIN_SUBTREE)
+        break;
+
+      // remove the node from the pending nodes, keeping the others in
+      // order (its buffer is moved to the end for reuse)
+      std::rotate(subtrees.begin()+largest, subtrees.begin()+largest+1,
+                  subtrees.begin()+npending);
+      --npending;
+      const unsigned nodebspidx = subtrees[npending].bspidx;
+      IdxVector& nodeidxs = ws.to_process;
+      nodeidxs.swap(subtrees[npending].idxs);
+
+      processNode(serialstore, viewdirn, nodeidxs, 0,
+                  bsp_recs[nodebspidx], frag_idxs, idxfront, idxback);
+
+      for(unsigned side=0; side<2; ++side)
+        {
+          IdxVector& sideidxs = side==0 ? idxfront : idxback;
+          if(sideidxs.empty())
+            continue;
+
+          (side==0 ? bsp_recs[nodebspidx].frontidx :
+           bsp_recs[nodebspidx].backidx) = bsp_recs.size();
+          if(subtrees.size() <= npending)
+            subtrees.resize(npending+1);
+          subtrees[npending].bspidx = bsp_recs.size();
+          subtrees[npending].idxs.swap(sideidxs);
+          sideidxs.resize(0);
+          ++npending;
+          bsp_recs.push_back(BSPRecord());
+        }
+    }
+
+  // start the biggest subtrees first to balance the threads
+  IdxVector& order = ws.order;
+  order.resize(npending);
+  for(unsigned i=0; i<npending; ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+                   [&subtrees](unsigned a, unsigned b)
+                   {
+                     return subtrees[a].idxs.size() > subtrees[b].idxs.size();
+                   });
+
+  // fragments at or above this index are split within a subtree
+  const unsigned extrastart = fragvec.size();
+
+  parallelFor(npending, nthreads,
+              [&](unsigned t)
+              {
+                BSPWorkspace::Subtree& sub = subtrees[order[t]];
+                sub.recs.resize(0);
+                sub.frag_idxs.resize(0);
+                sub.newfrags.resize(0);
+                sub.recs.push_back(BSPRecord());
+                sub.bufs.cancel = ws.cancel;
+                FragStore store(fragvec, sub.newfrags, extrastart);
+                buildTree(store, viewdirn, sub.idxs,
+                          sub.recs, sub.frag_idxs, sub.bufs);
+              });
+
+  // work out where each subtree goes, in creation order
+  unsigned nfrag = fragvec.size();
+  unsigned nrec = bsp_recs.size();
+  unsigned nidx = frag_idxs.size();
+  for(unsigned i=0; i<npending; ++i)
+    {
+      BSPWorkspace::Subtree& sub = subtrees[i];
+      sub.fragstart = nfrag;
+      sub.recstart = nrec;
+      sub.idxstart = nidx;
+      nfrag += sub.newfrags.size();
+      nrec += sub.recs.size()-1;
+      nidx += sub.frag_idxs.size();
+    }
+  fragvec.resize(nfrag);
+  bsp_recs.resize(nrec);
+  frag_idxs.resize(nidx);
+
+  // then copy them into place, renumbering them
+  parallelFor(npending, nthreads,
+              [&](unsigned i)
+              {
+                const BSPWorkspace::Subtree& sub = subtrees[i];
+
+                std::copy(sub.newfrags.begin(), sub.newfrags.end(),
+                          fragvec.begin()+sub.fragstart);
+
+                const unsigned fragoffset = sub.fragstart-extrastart;
+                for(unsigned j=0, nj=sub.frag_idxs.size(); j<nj; ++j)
+                  {
+                    const unsigned idx = sub.frag_idxs[j];
+                    frag_idxs[sub.idxstart+j] =
+                      idx >= extrastart ? idx+fragoffset : idx;
+                  }
+
+                // local record 0 is the pending node, others are appended
+                const unsigned recoffset = sub.recstart-1;
+                for(unsigned r=0, nr=sub.recs.size(); r<nr; ++r)
+                  {
+                    BSPRecord rec(sub.recs[r]);
+                    rec.minfragidxidx += sub.idxstart;
+                    if(rec.frontidx != EMPTY_BSP_IDX)
+                      rec.frontidx += recoffset;
+                    if(rec.backidx != EMPTY_BSP_IDX)
+                      rec.backidx += recoffset;
+                    bsp_recs[r==0 ? sub.bspidx : recoffset+r] = rec;
+                  }
+              });
+}
+
+// Fragments are pushed down the tree, being split by the plane of
+// each node they reach. Fragments on a plane are treated as being in
+// front, as the node's own fragments are stored contiguously. If
+// there is no child on that side, a new subtree is built. If a leaf
+// without a plane is reached, it is rebuilt including its old
+// fragments (leaving the old indices unused in frag_idxs).
+
+void BSPBuilder::insertFragments(FragmentVector& fragvec,
+                                 const IdxVector& idxs, Vec3 viewdirn,
+                                 BSPWorkspace* ws)
+{
+  if(idxs.empty())
+    return;
+
+  BSPWorkspace localws;
+  BSPWorkspace& w = ws!=0 ? *ws : localws;
+  w.bufs.cancel = w.cancel;
+  if(bsp_recs.empty())
+    bsp_recs.push_back(BSPRecord());
+
+  FragStore store(fragvec, fragvec, 0);
+  IdxVector idxsame, idxfront, idxback, to_process;
+
+  std::vector<InsertItem> stack(1);
+  stack[0].bspidx = 0;
+  stack[0].idxs = idxs;
 
   while( !stack.empty() )
     {
-      BSPStackItem stackitem(stack.back());
+      InsertItem item;
+      std::swap(item, stack.back());
       stack.pop_back();
 
-      // this is the bsp record with which the items are associated
-      BSPRecord& rec = bsp_recs[stackitem.bspidx];
-      rec.minfragidxidx = frag_idxs.size(); // where the items get added
+      const BSPRecord rec(bsp_recs[item.bspidx]);
+      if(rec.planenorm.rad2() == 0)
+        {
+          to_process.assign(frag_idxs.begin()+rec.minfragidxidx,
+                            frag_idxs.begin()+(rec.minfragidxidx+rec.nfrags));
+          to_process.insert(to_process.end(),
+                            item.idxs.begin(), item.idxs.end());
+          bsp_recs[item.bspidx] = BSPRecord();
+          buildTree(store, viewdirn, to_process, bsp_recs, frag_idxs,
+                    w.bufs, item.bspidx);
+          continue;
+        }
 
-      // if more than item to process then choose a plane, then split
-      if( stackitem.nidxs > 1 &&
-          findPlane(to_process, to_process.size()-stackitem.nidxs,
-                    fragvec, planepts) )
+      const Vec3 norm(rec.planenorm);
+      const Vec3 plane0(norm*(rec.planedot/norm.rad2()));
+      for(unsigned fidx : item.idxs)
         {
-          // norm of plane (making sure it points to observer)
-          Vec3 norm = cross(planepts[1]-planepts[0], planepts[2]-planepts[0]);
-          if(dot(norm, viewdirn) < 0)
-            norm = -norm;
-          // approximately normalise
-          norm *= 1./(std::abs(norm(0))+std::abs(norm(1))+std::abs(norm(2)));
-
-          unsigned to_process_size = to_process.size();
-          for(unsigned i=to_process_size-stackitem.nidxs; i<to_process_size; ++i)
+          switch(fragvec[fidx].type)
             {
-              unsigned fidx = to_process[i];
-              switch(fragvec[fidx].type)
-                {
-                  case Fragment::FR_PATH:
-                  handlePath(norm, planepts[0], fragvec, fidx,
-                             frag_idxs, idxfront, idxback);
-                  break;
-                case Fragment::FR_LINESEG:
-                  handleLine(norm, planepts[0], fragvec, fidx,
-                             frag_idxs, idxfront, idxback);
-                  break;
-                case Fragment::FR_TRIANGLE:
-                  handleTriangle(norm, planepts[0], fragvec, fidx,
-                                 frag_idxs, idxfront, idxback);
-                  break;
-                default:
-                  break;
-                }
+            case Fragment::FR_PATH:
+              handlePath(norm, plane0, store, fidx,
+                         idxfront, idxfront, idxback);
+              break;
+            case Fragment::FR_LINESEG:
+              handleLine(norm, plane0, store, fidx,
+                         idxfront, idxfront, idxback);
+              break;
+            case Fragment::FR_TRIANGLE:
+              handleTriangle(norm, plane0, store, fidx,
+                             idxfront, idxfront, idxback);
+              break;
+            default:
+              break;
             }
+        }
 
-          // number added to this node
-          rec.nfrags = frag_idxs.size()-rec.minfragidxidx;
-          // remove items to process
-          to_process.resize(to_process_size-stackitem.nidxs);
-
-          if(rec.nfrags == 0)
-            {
-              if(idxfront.empty() && !idxback.empty())
-                {
-                  frag_idxs.insert(frag_idxs.end(), idxback.begin(), idxback.end());
-                  rec.nfrags = idxback.size();
-                  idxback.resize(0);
-                }
-              else if(idxback.empty() && !idxfront.empty())
-                {
-                  frag_idxs.insert(frag_idxs.end(), idxfront.begin(), idxfront.end());
-                  rec.nfrags = idxfront.size();
-                  idxfront.resize(0);
-                }
-            }
+      for(unsigned side=0; side<2; ++side)
+        {
+          IdxVector& sideidxs = side==0 ? idxfront : idxback;
+          if(sideidxs.empty())
+            continue;
 
-          // push_back invalidates rec, so we don't use it below
-          if(!idxfront.empty())
+          unsigned childidx = side==0 ? rec.frontidx : rec.backidx;
+          if(childidx != EMPTY_BSP_IDX)
             {
-              unsigned newbspidx = bsp_recs.size();
-              bsp_recs[stackitem.bspidx].frontidx = newbspidx;
-              bsp_recs.push_back(BSPRecord());
-              stack.push_back( BSPStackItem(newbspidx, idxfront.size()) );
-              to_process.insert(to_process.end(), idxfront.begin(), idxfront.end());
-              idxfront.resize(0);
+              stack.push_back(InsertItem());
+              stack.back().bspidx = childidx;
+              stack.back().idxs.swap(sideidxs);
             }
-
-          if(!idxback.empty())
+          else
             {
-              unsigned newbspidx = bsp_recs.size();
-              bsp_recs[stackitem.bspidx].backidx = newbspidx;
-              // add the record to be processed
+              childidx = bsp_recs.size();
+              (side==0 ? bsp_recs[item.bspidx].frontidx :
+               bsp_recs[item.bspidx].backidx) = childidx;
               bsp_recs.push_back(BSPRecord());
-              // new set of items to process
-              stack.push_back( BSPStackItem(newbspidx, idxback.size()) );
-              // and add onto to process list
-              to_process.insert(to_process.end(), idxback.begin(), idxback.end());
-              idxback.resize(0);
+              buildTree(store, viewdirn, sideidxs, bsp_recs, frag_idxs,
+                        w.bufs, childidx);
             }
+          sideidxs.resize(0);
         }
-      else
-        {
-          // single item to process or plane couldn't be found
-          frag_idxs.insert(frag_idxs.end(),
-                           to_process.end()-stackitem.nidxs,
-                           to_process.end());
-          to_process.resize(to_process.size()-stackitem.nidxs);
-          rec.nfrags = stackitem.nidxs;
-        }
-
-    } // while !stack.empty()
+    }
 }
 
-namespace
-{
-  // Similar stack item to keep track of the tree navigation while
-  // "drawing" the tree
-  struct WalkStackItem
-  {
-    WalkStackItem(unsigned _idx, unsigned _stage)
-      : bsp_idx(_idx), stage(_stage)
-    {}
-
-    unsigned bsp_idx;
-    unsigned stage;
-  };
-};
-
 // This is a non-recursive function to walk the tree. We keep a
 // "stack" to do the walking. Because we have to walk the back before
 // the current items and then the front, we have two types of stack
-// items: WALK_START and WALK_RECS
+// items: stage 0 (start) and stage 1 (the node's records). If an eye
+// position is given, the side of each plane furthest from the eye is
+// walked first.
 
-IdxVector BSPBuilder::getFragmentIdxs(const FragmentVector& fragvec) const
+void BSPBuilder::walkTree(const FragmentVector& fragvec, const Vec3* eye,
+                          IdxVector& retn, BSPWorkspace& ws) const
 {
-  IdxVector retn;
+  retn.resize(0);
+  if(bsp_recs.empty())
+    return;
 
-  std::vector<WalkStackItem> stack;
+  std::vector<BSPWorkspace::WalkItem>& stack = ws.walkstack;
+  stack.clear();
   stack.reserve(128);
-  stack.push_back(WalkStackItem(0, 0));
+  stack.push_back(BSPWorkspace::WalkItem(0, 0));
 
-  IdxVector temp;
+  IdxVector& temp = ws.walktemp;
 
   while( !stack.empty() )
     {
-      WalkStackItem stackitem(stack.back());
+      BSPWorkspace::WalkItem stackitem(stack.back());
       stack.pop_back();
 
-      const BSPRecord &rec = bsp_recs[stackitem.bsp_idx];
+      const BSPRecord &rec = bsp_recs[stackitem.bspidx];
 
       if(stackitem.stage == 0)
         {
-          if(rec.frontidx != EMPTY_BSP_IDX)
-            stack.push_back( WalkStackItem(rec.frontidx, 0) );
-          stack.push_back( WalkStackItem(stackitem.bsp_idx, 1) );
-          if(rec.backidx != EMPTY_BSP_IDX)
-            stack.push_back( WalkStackItem(rec.backidx, 0) );
+          const bool eyefront = eye==0 ||
+            dot(rec.planenorm, *eye) >= rec.planedot;
+          const unsigned firstidx = eyefront ? rec.backidx : rec.frontidx;
+          const unsigned lastidx = eyefront ? rec.frontidx : rec.backidx;
+
+          if(lastidx != EMPTY_BSP_IDX)
+            stack.push_back( BSPWorkspace::WalkItem(lastidx, 0) );
+          stack.push_back( BSPWorkspace::WalkItem(stackitem.bspidx, 1) );
+          if(firstidx != EMPTY_BSP_IDX)
+            stack.push_back( BSPWorkspace::WalkItem(firstidx, 0) );
         }
       else
         {
@@ -473,10 +804,40 @@ IdxVector BSPBuilder::getFragmentIdxs(const FragmentVector& fragvec) const
             }
         }
     }
+}
+
+IdxVector BSPBuilder::getFragmentIdxs(const FragmentVector& fragvec) const
+{
+  IdxVector retn;
+  BSPWorkspace ws;
+  walkTree(fragvec, 0, retn, ws);
+  return retn;
+}
 
+IdxVector BSPBuilder::getFragmentIdxs(const FragmentVector& fragvec,
+                                      const Vec3& eye) const
+{
+  IdxVector retn;
+  BSPWorkspace ws;
+  walkTree(fragvec, &eye, retn, ws);
   return retn;
 }
 
+void BSPBuilder::getFragmentIdxs(const FragmentVector& fragvec,
+                                 IdxVector& idxs, BSPWorkspace* ws) const
+{
+  BSPWorkspace localws;
+  walkTree(fragvec, 0, idxs, ws!=0 ? *ws : localws);
+}
+
+void BSPBuilder::getFragmentIdxs(const FragmentVector& fragvec,
+                                 const Vec3& eye, IdxVector& idxs,
+                                 BSPWorkspace* ws) const
+{
+  BSPWorkspace localws;
+  walkTree(fragvec, &eye, idxs, ws!=0 ? *ws : localws);
+}
+
 #if 0
 #include <iostream>
 int main()
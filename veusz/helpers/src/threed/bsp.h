@@ -21,6 +21,7 @@
 #ifndef BSP_H
 #define BSP_H
 
+#include <atomic>
 #include <vector>
 #include "fragment.h"
 
@@ -32,7 +33,8 @@ struct BSPRecord
 {
   BSPRecord()
     : minfragidxidx(0), nfrags(0),
-      frontidx(EMPTY_BSP_IDX), backidx(EMPTY_BSP_IDX)
+      frontidx(EMPTY_BSP_IDX), backidx(EMPTY_BSP_IDX),
+      planedot(0)
   {
   }
 
@@ -41,6 +43,73 @@ struct BSPRecord
   unsigned minfragidxidx, nfrags;
   // indices in bsp_recs to the BSPRecord items in front and behind
   unsigned frontidx, backidx;
+  // plane splitting the node (dot(planenorm, x) == planedot), with
+  // planenorm pointing to the front. planenorm is zero if the node
+  // was not split.
+  Vec3 planenorm;
+  double planedot;
+};
+
+// Buffers used while building and walking BSP trees. Giving the same
+// workspace to repeated builds and walks reuses their memory.
+struct BSPWorkspace
+{
+  // stack item while building: the BSPRecord being worked on and
+  // the number of its fragment indices at the end of to_process
+  struct BuildItem
+  {
+    BuildItem(unsigned _bspidx, unsigned _nidxs)
+      : bspidx(_bspidx), nidxs(_nidxs)
+    {}
+    unsigned bspidx;
+    unsigned nidxs;
+  };
+
+  // stack item while walking: stage 0 walks the children, 1 the node
+  struct WalkItem
+  {
+    WalkItem(unsigned _bspidx, unsigned _stage)
+      : bspidx(_bspidx), stage(_stage)
+    {}
+    unsigned bspidx;
+    unsigned stage;
+  };
+
+  // scratch space for building a (sub)tree on one thread
+  struct BuildBuffers
+  {
+    BuildBuffers() : cancel(0) {}
+    IdxVector idxfront, idxback;
+    std::vector<BuildItem> stack;
+    const std::atomic<bool>* cancel;
+  };
+
+  // subtree built by a thread below record bspidx from the fragment
+  // indices idxs, with record and fragment indices local to the
+  // subtree (its root is record 0), and where they are placed in
+  // the tree afterwards
+  struct Subtree
+  {
+    unsigned bspidx;
+    IdxVector idxs;
+    std::vector<BSPRecord> recs;
+    IdxVector frag_idxs;
+    FragmentVector newfrags;
+    BuildBuffers bufs;
+    unsigned fragstart, recstart, idxstart;
+  };
+
+  BSPWorkspace() : cancel(0) {}
+
+  IdxVector to_process;
+  BuildBuffers bufs;
+  std::vector<Subtree> subtrees;
+  IdxVector order;
+  IdxVector walktemp;
+  std::vector<WalkItem> walkstack;
+
+  // if this is set, building stops early, leaving an incomplete tree
+  const std::atomic<bool>* cancel;
 };
 
 // This class defines a specialised Binary Space Paritioning (BSP)
@@ -50,22 +119,64 @@ struct BSPRecord
 // used to create a robust back->front ordering for a particular
 // viewing direction. To avoid lots of dynamic memory allocation and
 // to reduce overheads, the nodes in the BSP tree are stored in a
-// vector.
+// vector. The tree can also be walked for other eye positions, if
+// the fragments are kept.
+//
+// If nthreads > 1 and there are enough fragments, the top of the
+// tree is split on a single thread until there are enough independent
+// subtrees, which are then built in parallel and merged in a fixed
+// order. The drawing order is the same as the single-threaded build.
+//
+// The optional BSPWorkspace arguments give buffers to reuse. If a
+// builder is rebuilt with build(), its own vectors are also reused.
 
 class BSPBuilder
 {
 public:
+  // empty tree
+  BSPBuilder() {}
+
   // construct the BSP tree from the fragments given and a particular
   // viewing direction
-  BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn);
+  BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn, unsigned nthreads=1,
+             BSPWorkspace* ws=0);
+
+  // replace the tree with one for the fragments given
+  void build(FragmentVector& fragvec, Vec3 viewdirn, unsigned nthreads=1,
+             BSPWorkspace* ws=0);
+
+  // add fragments given by idxs to the tree, splitting them (and
+  // appending to fragvec) as necessary
+  void insertFragments(FragmentVector& fragvec, const IdxVector& idxs,
+                       Vec3 viewdirn, BSPWorkspace* ws=0);
 
   // return a vector of fragment indexes in drawing order
   IdxVector getFragmentIdxs(const FragmentVector& fragvec) const;
 
+  // return fragment indexes in drawing order for an eye at the
+  // position given (in the coordinates the tree was built in).
+  // fragvec is used to sort fragments within a node by depth, so
+  // can be a copy of the fragments transformed to viewing
+  // coordinates.
+  IdxVector getFragmentIdxs(const FragmentVector& fragvec,
+                            const Vec3& eye) const;
+
+  // versions of the above which place the indexes in idxs
+  void getFragmentIdxs(const FragmentVector& fragvec, IdxVector& idxs,
+                       BSPWorkspace* ws=0) const;
+  void getFragmentIdxs(const FragmentVector& fragvec, const Vec3& eye,
+                       IdxVector& idxs, BSPWorkspace* ws=0) const;
+
   // the nodes in the tree
   std::vector<BSPRecord> bsp_recs;
   // vector of indices to the fragments vector
   IdxVector frag_idxs;
+
+private:
+  void buildParallel(FragmentVector& fragvec, const Vec3& viewdirn,
+                     unsigned nthreads, BSPWorkspace& ws);
+  void walkTree(const FragmentVector& fragvec, const Vec3* eye,
+                IdxVector& retn, BSPWorkspace& ws) const;
 };
 
 
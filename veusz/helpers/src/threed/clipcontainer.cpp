@@ -16,129 +16,182 @@
 //    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 /////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <utility>
+#include <vector>
 #include "clipcontainer.h"
 
 #define EPS 1e-8
 
+// maximum number of vertices of a triangle clipped by the six planes
+// (each plane adds at most one to a convex polygon), with room to spare
+#define MAX_CLIP_VERTICES 16
+
 namespace
 {
 
-  // clip line by plane
-  void clipLine(Fragment& f, const Vec3& onplane, const Vec3& normal)
+  // The six faces of the clipping box, as a point on each plane and
+  // its normal. Dotting (point - onplane) with the normal gives >= 0
+  // if the point is inside.
+  struct ClipPlanes
+  {
+    Vec3 onplane[6];
+    Vec3 normal[6];
+
+    double dist(unsigned p, const Vec3& pt) const
+    {
+      return dot(pt-onplane[p], normal[p]);
+    }
+  };
+
+  // where the edge from good point a to bad point b crosses the plane
+  // (always found in this direction, so triangles sharing an edge are
+  // cut at the same point)
+  inline Vec3 intercept(const Vec3& a, double da, const Vec3& b, double db)
   {
-    double dot0 = dot(f.points[0]-onplane, normal);
-    bool bad0 = dot0 < -EPS;
-    double dot1 = dot(f.points[1]-onplane, normal);
-    bool bad1 = dot1 < -EPS;
-
-    if(!bad0 && !bad1)
-      // both points on good side of plane
-      ;
-    else if(bad0 && bad1)
-      // both line points on bad side of plane
+    return a + (b-a)*(da/(da-db));
+  }
+
+  // clip line by all the planes
+  void clipLine(Fragment& f, const ClipPlanes& planes)
+  {
+    const Vec3 p0 = f.points[0];
+    const Vec3 linevec = f.points[1]-p0;
+
+    // clip the range of the line parameter, 0 to 1
+    double t0 = 0, t1 = 1;
+    for(unsigned p=0; p<6; ++p)
+      {
+        const double dot0 = planes.dist(p, f.points[0]);
+        const double dot1 = planes.dist(p, f.points[1]);
+        const bool bad0 = dot0 < -EPS;
+        const bool bad1 = dot1 < -EPS;
+        if(bad0 && bad1)
+          {
+            f.type = Fragment::FR_NONE;
+            return;
+          }
+        else if(bad0)
+          t0 = std::max(t0, dot0 / (dot0-dot1));
+        else if(bad1)
+          t1 = std::min(t1, dot0 / (dot0-dot1));
+      }
+
+    if(t0 > t1)
       f.type = Fragment::FR_NONE;
     else
       {
-        // clip line to plane (bad1 or bad2, not both)
-        Vec3 linevec = f.points[1]-f.points[0];
-        double d = -dot0 / dot(linevec, normal);
-        f.points[bad0 ? 0 : 1] = f.points[0] + linevec*d;
+        if(t0 > 0)
+          f.points[0] = p0 + linevec*t0;
+        if(t1 < 1)
+          f.points[1] = p0 + linevec*t1;
       }
   }
 
-  // clip triangle by plane
-  void clipTriangle(FragmentVector& v, unsigned idx,
-                    const Vec3& onplane, const Vec3& normal)
+  // clip triangle by all the planes, replacing it by the first of the
+  // triangles covering the clipped polygon, and adding the others
+  // to extra
+  void clipTriangle(Fragment& f, const ClipPlanes& planes,
+                    FragmentVector& extra)
   {
-    Fragment& f = v[idx];
-    double dotv[3];
-    unsigned bad[3];
-    for(unsigned i=0; i<3; ++i)
+    // which planes have points outside (other planes can't cut the
+    // polygon, as its points are between those of the triangle)
+    unsigned cutplanes = 0;
+    for(unsigned p=0; p<6; ++p)
       {
-        dotv[i] = dot(f.points[i]-onplane, normal);
-        bad[i] = dotv[i] < -EPS;
+        unsigned nbad = 0;
+        for(unsigned i=0; i<3; ++i)
+          nbad += planes.dist(p, f.points[i]) < -EPS;
+        if(nbad == 3)
+          {
+            f.type = Fragment::FR_NONE;
+            return;
+          }
+        if(nbad > 0)
+          cutplanes |= 1<<p;
       }
-    unsigned badsum = bad[0]+bad[1]+bad[2];
+    if(cutplanes == 0)
+      return;
 
-    switch(badsum)
+    // clip polygon by each plane in turn
+    Vec3 bufs[2][MAX_CLIP_VERTICES];
+    double dists[MAX_CLIP_VERTICES];
+    Vec3* poly = bufs[0];
+    Vec3* out = bufs[1];
+    unsigned npoly = 3;
+    for(unsigned i=0; i<3; ++i)
+      poly[i] = f.points[i];
+
+    for(unsigned p=0; p<6; ++p)
       {
-      case 0:
-        // all points ok
-        break;
-      case 1:
-        // two points are good, one is bad
-        {
-          unsigned badidx = bad[0] ? 0 : bad[1] ? 1 : 2;
-
-          // calculate where vectors from good to bad points
-          // intercept plane
-          Vec3 good1 = f.points[(badidx+1)%3];
-          Vec3 linevec1 = good1 - f.points[badidx];
-          double d1 = -dotv[badidx] / dot(linevec1, normal);
-          Vec3 icept1 = f.points[badidx] + linevec1*d1;
-
-          Vec3 good2 = f.points[(badidx+2)%3];
-          Vec3 linevec2 = good2 - f.points[badidx];
-          double d2 = -dotv[badidx] / dot(linevec2, normal);
-          Vec3 icept2 = f.points[badidx] + linevec2*d2;
-
-          // break into two triangles from good points to intercepts
-          // note: the push back invalidates the original, so we have
-          // to make a copy
-          f.points[0] = good2;
-          f.points[1] = icept2;
-          f.points[2] = good1;
-          Fragment fcpy(f);
-          fcpy.points[0] = good1;
-          fcpy.points[1] = icept1;
-          fcpy.points[2] = icept2;
-          v.push_back(fcpy);
-        }
-        break;
-      case 2:
-        // one point is ok, the other two are bad
-        {
-          unsigned goodidx = !bad[0] ? 0 : !bad[1] ? 1 : 2;
+        if(!(cutplanes & (1<<p)))
+          continue;
 
-          // work out where vectors from ok point intercept with plane
-          Vec3 linevec1 = f.points[(goodidx+1)%3] - f.points[goodidx];
-          double d1 = -dotv[goodidx] / dot(linevec1, normal);
-          f.points[(goodidx+1)%3] = f.points[goodidx] + linevec1*d1;
+        for(unsigned i=0; i<npoly; ++i)
+          dists[i] = planes.dist(p, poly[i]);
 
-          Vec3 linevec2 = f.points[(goodidx+2)%3] - f.points[goodidx];
-          double d2 = -dotv[goodidx] / dot(linevec2, normal);
-          f.points[(goodidx+2)%3] = f.points[goodidx] + linevec2*d2;
-        }
-        break;
-      case 3:
-        // all points are bad
-        f.type = Fragment::FR_NONE;
-        break;
+        unsigned nout = 0;
+        for(unsigned i=0; i<npoly && nout+2<=MAX_CLIP_VERTICES; ++i)
+          {
+            const unsigned j = (i+1)%npoly;
+            const bool goodi = dists[i] >= -EPS;
+            const bool goodj = dists[j] >= -EPS;
+            if(goodi)
+              out[nout++] = poly[i];
+            if(goodi && !goodj)
+              out[nout++] = intercept(poly[i], dists[i], poly[j], dists[j]);
+            else if(!goodi && goodj)
+              out[nout++] = intercept(poly[j], dists[j], poly[i], dists[i]);
+          }
+
+        std::swap(poly, out);
+        npoly = nout;
+        if(npoly < 3)
+          {
+            f.type = Fragment::FR_NONE;
+            return;
+          }
+      }
+
+    // split polygon into a fan of triangles, keeping the winding
+    f.points[0] = poly[0];
+    f.points[1] = poly[1];
+    f.points[2] = poly[2];
+    for(unsigned i=2; i+1<npoly; ++i)
+      {
+        extra.push_back(f);
+        Fragment& fextra = extra.back();
+        fextra.points[1] = poly[i];
+        fextra.points[2] = poly[i+1];
       }
   }
 
-  // clip all fragments to the plane given
-  void clipFragments(FragmentVector& v, unsigned start,
-                     const Vec3& onplane, const Vec3& normal)
+  // clip fragments from start to end in v by all the planes, in one
+  // pass, adding any extra triangles to extra
+  void clipFragments(FragmentVector& v, unsigned start, unsigned end,
+                     const ClipPlanes& planes, FragmentVector& extra)
   {
-    unsigned nfrags = v.size();
-    for(unsigned i=start; i<nfrags; ++i)
+    for(unsigned i=start; i<end; ++i)
       {
         Fragment& f = v[i];
         switch(f.type)
           {
           case Fragment::FR_PATH:
-            // point on wrong side of plane
-            if(dot(f.points[0]-onplane, normal) < -EPS)
-              f.type = Fragment::FR_NONE;
+            // point on wrong side of a plane
+            for(unsigned p=0; p<6; ++p)
+              if(planes.dist(p, f.points[0]) < -EPS)
+                {
+                  f.type = Fragment::FR_NONE;
+                  break;
+                }
             break;
 
           case Fragment::FR_LINESEG:
-            clipLine(f, onplane, normal);
+            clipLine(f, planes);
             break;
 
           case Fragment::FR_TRIANGLE:
-            clipTriangle(v, i, onplane, normal);
+            clipTriangle(f, planes, extra);
             break;
 
           default:
@@ -152,10 +205,28 @@ namespace
 
 void ClipContainer::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
 {
-  // get fragments for children (and range in vector)
-  const unsigned fragstart = v.size();
-  for(unsigned i=0, s=objects.size(); i<s; ++i)
-    objects[i]->getFragments(perspM, outerM, v);
+  // get fragments for children, keeping the ranges in the vector of
+  // those which need clipping
+  std::vector< std::pair<unsigned, unsigned> > cliprange;
+  for(auto object : objects)
+    {
+      Vec3 omin, omax;
+      const bool known = object->getBounds(omin, omax);
+      if(known && boxOutOfBounds(omin, omax))
+        continue;
+
+      const unsigned start = v.size();
+      object->getFragments(perspM, outerM, v);
+      if(known && boxInBounds(omin, omax))
+        continue;
+
+      if(!cliprange.empty() && cliprange.back().second == start)
+        cliprange.back().second = v.size();
+      else
+        cliprange.push_back(std::make_pair(start, unsigned(v.size())));
+    }
+  if(cliprange.empty())
+    return;
 
   // these are the points defining the clipping cube
   Vec3 pts[8];
@@ -174,10 +245,48 @@ void ClipContainer::getFragments(const Mat4& perspM, const Mat4& outerM, Fragmen
 
   // clip with plane point and normal
   // dotting points with plane with these will give all >= 0 if in cube
-  clipFragments(v, fragstart, pts[0], cross(pts[2]-pts[0], pts[1]-pts[0]));
-  clipFragments(v, fragstart, pts[0], cross(pts[1]-pts[0], pts[4]-pts[0]));
-  clipFragments(v, fragstart, pts[0], cross(pts[4]-pts[0], pts[2]-pts[0]));
-  clipFragments(v, fragstart, pts[7], cross(pts[5]-pts[7], pts[3]-pts[7]));
-  clipFragments(v, fragstart, pts[7], cross(pts[3]-pts[7], pts[6]-pts[7]));
-  clipFragments(v, fragstart, pts[7], cross(pts[6]-pts[7], pts[5]-pts[7]));
+  ClipPlanes planes;
+  const unsigned planepts[6][3] = {
+    {0,2,1}, {0,1,4}, {0,4,2}, {7,5,3}, {7,3,6}, {7,6,5} };
+  for(unsigned p=0; p<6; ++p)
+    {
+      const Vec3& o = pts[planepts[p][0]];
+      planes.onplane[p] = o;
+      planes.normal[p] = cross(pts[planepts[p][1]]-o, pts[planepts[p][2]]-o);
+    }
+
+  // triangles split by the planes are added at the end
+  FragmentVector extra;
+  for(auto const& range : cliprange)
+    clipFragments(v, range.first, range.second, planes, extra);
+  v.insert(v.end(), extra.begin(), extra.end());
+}
+
+bool ClipContainer::getBounds(Vec3& bmin, Vec3& bmax) const
+{
+  bmin = minpt;
+  bmax = maxpt;
+
+  // children are drawn in the coordinates of this container
+  Vec3 cmin, cmax;
+  bool first = true;
+  for(auto object : objects)
+    {
+      Vec3 omin, omax;
+      if(!object->getBounds(omin, omax))
+        return true;
+      for(unsigned i=0; i<3; ++i)
+        {
+          cmin(i) = first ? omin(i) : std::min(cmin(i), omin(i));
+          cmax(i) = first ? omax(i) : std::max(cmax(i), omax(i));
+        }
+      first = false;
+    }
+  if(!first)
+    for(unsigned i=0; i<3; ++i)
+      {
+        bmin(i) = std::max(bmin(i), cmin(i));
+        bmax(i) = std::min(bmax(i), cmax(i));
+      }
+  return true;
 }
@@ -33,14 +33,43 @@ public:
   {
   }
 
+  // Children entirely inside the box are not clipped and those
+  // entirely outside are skipped, if their bounds are known. The
+  // fragments of the others are clipped by the faces of the box.
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
+  // the box, shrunk to the bounds of the children if known
+  bool getBounds(Vec3& bmin, Vec3& bmax) const;
+
+  // children are clipped together, so can't be selected individually
+  void getSelectedFragments(const Mat4& perspM, const Mat4& outerM,
+                            FragmentVector& v, bool viewdep)
+  {
+    Object::getSelectedFragments(perspM, outerM, v, viewdep);
+  }
+
   bool pointInBounds(Vec3 pt) const
   {
     return (pt(0) >= minpt(0) && pt(1) >= minpt(1) && pt(2) >= minpt(2) &&
             pt(0) <= maxpt(0) && pt(1) <= maxpt(1) && pt(2) <= maxpt(2));
   }
 
+  // is the box from bmin to bmax entirely inside this box?
+  bool boxInBounds(const Vec3& bmin, const Vec3& bmax) const
+  {
+    return pointInBounds(bmin) && pointInBounds(bmax);
+  }
+
+  // is the box from bmin to bmax (which may be empty) entirely
+  // outside this box?
+  bool boxOutOfBounds(const Vec3& bmin, const Vec3& bmax) const
+  {
+    for(unsigned i=0; i<3; ++i)
+      if(!(bmin(i) <= bmax(i)) || bmax(i) < minpt(i) || bmin(i) > maxpt(i))
+        return true;
+    return false;
+  }
+
  public:
   Vec3 minpt, maxpt;
 };
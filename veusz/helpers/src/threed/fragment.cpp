@@ -16,6 +16,9 @@
 //    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 /////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include "fragment.h"
 
 FragmentParameters::~FragmentParameters()
@@ -27,3 +30,100 @@ void FragmentPathParameters::callback(QPainter* painter,
                                       int index, double scale, double linescale)
 {
 }
+
+namespace
+{
+  // Project n points (x,y,z) with the matrix m, writing the result
+  // to (ox,oy,oz). There are no branches or dependencies between
+  // iterations, so compilers vectorise this with the baseline SIMD
+  // instructions (SSE2 or NEON). This is done in single precision,
+  // which is plenty for positions on the screen and depth ordering,
+  // and has twice as many values in each register.
+  void projectPoints(const Mat4f& m, unsigned n,
+                     const float* __restrict x, const float* __restrict y,
+                     const float* __restrict z,
+                     float* __restrict ox, float* __restrict oy,
+                     float* __restrict oz)
+  {
+    const float m00=m(0,0), m01=m(0,1), m02=m(0,2), m03=m(0,3);
+    const float m10=m(1,0), m11=m(1,1), m12=m(1,2), m13=m(1,3);
+    const float m20=m(2,0), m21=m(2,1), m22=m(2,2), m23=m(2,3);
+    const float m30=m(3,0), m31=m(3,1), m32=m(3,2), m33=m(3,3);
+
+    for(unsigned i=0; i<n; ++i)
+      {
+        const float px=x[i], py=y[i], pz=z[i];
+        const float inv = 1/(m30*px + m31*py + m32*pz + m33);
+        ox[i] = (m00*px + m01*py + m02*pz + m03)*inv;
+        oy[i] = (m10*px + m11*py + m12*pz + m13)*inv;
+        oz[i] = (m20*px + m21*py + m22*pz + m23)*inv;
+      }
+  }
+}
+
+void FragmentProjections::project(const Mat4& projM,
+                                  const FragmentVector& frags)
+{
+  const unsigned n = frags.size();
+  types.resize(n);
+  nvisible.resize(n);
+  for(unsigned p=0; p<3; ++p)
+    {
+      x[p].resize(n);
+      y[p].resize(n);
+      z[p].resize(n);
+    }
+
+  for(unsigned i=0; i<n; ++i)
+    {
+      types[i] = frags[i].type;
+      nvisible[i] = frags[i].nPointsVisible();
+    }
+
+  // gather the points for each slot, then project them
+  const Mat4f projMf(projM);
+  FloatVector tx(n), ty(n), tz(n);
+  for(unsigned p=0; p<3; ++p)
+    {
+      for(unsigned i=0; i<n; ++i)
+        {
+          const Vec3& pt = frags[i].points[p];
+          tx[i] = float(pt(0));
+          ty[i] = float(pt(1));
+          tz[i] = float(pt(2));
+        }
+      projectPoints(projMf, n, tx.data(), ty.data(), tz.data(),
+                    x[p].data(), y[p].data(), z[p].data());
+    }
+}
+
+void FragmentProjections::xyRange(double& minx, double& miny,
+                                  double& maxx, double& maxy) const
+{
+  const double inf = std::numeric_limits<double>::infinity();
+  minx = miny = inf;
+  maxx = maxy = -inf;
+
+  const unsigned n = size();
+  for(unsigned p=0; p<3; ++p)
+    {
+      const float* px = x[p].data();
+      const float* py = y[p].data();
+      const unsigned char* nv = nvisible.data();
+      double mnx=inf, mny=inf, mxx=-inf, mxy=-inf;
+      for(unsigned i=0; i<n; ++i)
+        {
+          const double vx = px[i], vy = py[i];
+          // x-x is NaN if x is not finite
+          const bool ok = p<nv[i] && (vx-vx)==0 && (vy-vy)==0;
+          mnx = std::min(mnx, ok ? vx : inf);
+          mxx = std::max(mxx, ok ? vx : -inf);
+          mny = std::min(mny, ok ? vy : inf);
+          mxy = std::max(mxy, ok ? vy : -inf);
+        }
+      minx = std::min(minx, mnx);
+      maxx = std::max(maxx, mxx);
+      miny = std::min(miny, mny);
+      maxy = std::max(maxy, mxy);
+    }
+}
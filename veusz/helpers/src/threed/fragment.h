@@ -59,12 +59,9 @@ struct Fragment
 {
   enum FragmentType {FR_NONE, FR_TRIANGLE, FR_LINESEG, FR_PATH};
 
-  // 3D points
+  // 3D points (projected points are in FragmentProjections)
   Vec3 points[3];
 
-  // projected points associated with fragment
-  Vec3 proj[3];
-
   // pointer to object, to avoid self-comparison.
   Object* object;
   // optional pointer to a parameters object
@@ -86,6 +83,9 @@ struct Fragment
   // passed to path plotting or as index to color bar
   unsigned index;
 
+  // index of original fragment, if split (used by retained scenes)
+  unsigned srcidx;
+
   // type of fragment
   FragmentType type;
 
@@ -102,6 +102,7 @@ struct Fragment
       calccolor(0),
       splitcount(0),
       index(0),
+      srcidx(0),
       type(FR_NONE),
       usecalccolor(0)
   {
@@ -132,78 +133,97 @@ struct Fragment
       }
   }
 
-  double minDepth() const
+  // is fragment visible based on transparency?
+  bool isVisible() const
   {
-    switch(type)
+    bool vis=false;
+    if((type==FR_TRIANGLE || type==FR_PATH) && surfaceprop!=0)
       {
-      case FR_TRIANGLE:
-	return std::min(proj[0](2), std::min(proj[1](2), proj[2](2)));
-      case FR_LINESEG:
-	return std::min(proj[0](2), proj[1](2)) - LINE_DELTA_DEPTH;
-      case FR_PATH:
-	return proj[0](2) - 2*LINE_DELTA_DEPTH;
-      default:
-	return std::numeric_limits<double>::infinity();
+        if(surfaceprop->color(index).alpha() > 0)
+          vis = true;
       }
+
+    if((type==FR_LINESEG || type==FR_PATH) && lineprop!=0)
+      {
+        if(lineprop->color(index).alpha() > 0)
+          vis = true;
+      }
+    return vis;
   }
-  double maxDepth() const
+
+};
+
+typedef std::vector<Fragment> FragmentVector;
+
+// Projected coordinates of fragments, stored as a structure of arrays
+// so that they can be computed and scanned in bulk. Point p of
+// fragment i is at index i of x[p], y[p] and z[p] (z being depth).
+// These are single precision, as they are only used for drawing and
+// ordering by depth.
+// types and nvisible hold the type and number of visible points of
+// each fragment.
+struct FragmentProjections
+{
+  // project points of fragments (all three, used or not)
+  void project(const Mat4& projM, const FragmentVector& frags);
+
+  unsigned size() const { return types.size(); }
+
+  Vec3 proj(unsigned i, unsigned p) const
   {
-    switch(type)
+    return Vec3(x[p][i], y[p][i], z[p][i]);
+  }
+
+  double minDepth(unsigned i) const
+  {
+    switch(types[i])
       {
-      case FR_TRIANGLE:
-	return std::max(proj[0](2), std::max(proj[1](2), proj[2](2)));
-      case FR_LINESEG:
-	return std::max(proj[0](2), proj[1](2)) - LINE_DELTA_DEPTH;
-      case FR_PATH:
-	return proj[0](2) - 2*LINE_DELTA_DEPTH;
+      case Fragment::FR_TRIANGLE:
+	return std::min(z[0][i], std::min(z[1][i], z[2][i]));
+      case Fragment::FR_LINESEG:
+	return std::min(z[0][i], z[1][i]) - LINE_DELTA_DEPTH;
+      case Fragment::FR_PATH:
+	return z[0][i] - 2*LINE_DELTA_DEPTH;
       default:
 	return std::numeric_limits<double>::infinity();
       }
   }
-  double meanDepth() const
+  double maxDepth(unsigned i) const
   {
-    switch(type)
+    switch(types[i])
       {
-      case FR_TRIANGLE:
-	return (proj[0](2) + proj[1](2) + proj[2](2))*(1/3.f);
-      case FR_LINESEG:
-	return (proj[0](2) + proj[1](2))*0.5f - LINE_DELTA_DEPTH;
-      case FR_PATH:
-	return proj[0](2) - 2*LINE_DELTA_DEPTH;
+      case Fragment::FR_TRIANGLE:
+	return std::max(z[0][i], std::max(z[1][i], z[2][i]));
+      case Fragment::FR_LINESEG:
+	return std::max(z[0][i], z[1][i]) - LINE_DELTA_DEPTH;
+      case Fragment::FR_PATH:
+	return z[0][i] - 2*LINE_DELTA_DEPTH;
       default:
 	return std::numeric_limits<double>::infinity();
       }
   }
-
-  // recalculate projected coordinates
-  void updateProjCoords(const Mat4& projM)
+  double meanDepth(unsigned i) const
   {
-    unsigned n=nPointsTotal();
-    for(unsigned i=0; i<n; ++i)
-      proj[i] = calcProjVec(projM, points[i]);
-  }
-
-  // is fragment visible based on transparency?
-  bool isVisible() const
-  {
-    bool vis=false;
-    if((type==FR_TRIANGLE || type==FR_PATH) && surfaceprop!=0)
-      {
-        if(surfaceprop->color(index).alpha() > 0)
-          vis = true;
-      }
-
-    if((type==FR_LINESEG || type==FR_PATH) && lineprop!=0)
+    switch(types[i])
       {
-        if(lineprop->color(index).alpha() > 0)
-          vis = true;
+      case Fragment::FR_TRIANGLE:
+	return (z[0][i] + z[1][i] + z[2][i])*(1/3.f);
+      case Fragment::FR_LINESEG:
+	return (z[0][i] + z[1][i])*0.5f - LINE_DELTA_DEPTH;
+      case Fragment::FR_PATH:
+	return z[0][i] - 2*LINE_DELTA_DEPTH;
+      default:
+	return std::numeric_limits<double>::infinity();
       }
-    return vis;
   }
 
-};
+  // range of visible projected x and y, ignoring non-finite values
+  // (returns infinities if there are no points)
+  void xyRange(double& minx, double& miny, double& maxx, double& maxy) const;
 
-typedef std::vector<Fragment> FragmentVector;
+  std::vector<unsigned char> types, nvisible;
+  FloatVector x[3], y[3], z[3];
+};
 
 
 #endif
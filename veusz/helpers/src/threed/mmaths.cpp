@@ -66,3 +66,28 @@ Mat4 translationM4(Vec3 vec)
 
   return m;
 }
+
+Mat4 invertAffineM4(const Mat4& m)
+{
+  // inverse of the 3x3 part, using cofactors
+  Mat3 a(false);
+  for(unsigned y=0; y<3; ++y)
+    for(unsigned x=0; x<3; ++x)
+      a(y,x) = m(y,x);
+  const double invdet = 1/det(a);
+
+  Mat4 r;
+  for(unsigned y=0; y<3; ++y)
+    for(unsigned x=0; x<3; ++x)
+      {
+        const unsigned x1=(y+1)%3, x2=(y+2)%3, y1=(x+1)%3, y2=(x+2)%3;
+        r(y,x) = (a(y1,x1)*a(y2,x2) - a(y1,x2)*a(y2,x1)) * invdet;
+      }
+
+  // translation is -inv(a)*t
+  for(unsigned y=0; y<3; ++y)
+    r(y,3) = -(r(y,0)*m(0,3) + r(y,1)*m(1,3) + r(y,2)*m(2,3));
+  r(3,3) = 1;
+
+  return r;
+}
@@ -26,148 +26,170 @@
 
 #define PI 3.14159265358979323846
 
+// The vector and matrix types are templates on the scalar type.
+// Vec3, Mat4, etc. are the double versions, used for geometry (such
+// as splitting by the BSP tree) where precision matters. Vec3f,
+// Mat4f, etc. are float versions for bulk data where it does not
+// (projected points and lighting), which halves the memory used and
+// fits twice as many values in vector registers. Explicit
+// constructors convert between them.
+
 //////////////////////////////////////////////////////////////////////////////
 // 4-vector
-struct Vec4
+template<class T> struct Vec4T
 {
-  Vec4()
+  Vec4T()
   {
     v[0] = v[1] = v[2] = v[3] = 0;
   }
-  Vec4(double a, double b, double c, double d=1)
+  Vec4T(T a, T b, T c, T d=1)
   {
     v[0] = a; v[1] = b; v[2] = c; v[3] = d;
   }
+  template<class U> explicit Vec4T(const Vec4T<U>& o)
+  {
+    v[0] = T(o(0)); v[1] = T(o(1)); v[2] = T(o(2)); v[3] = T(o(3));
+  }
 
-  inline double& operator()(unsigned i) { return v[i]; }
-  inline double operator()(unsigned i) const { return v[i]; }
+  inline T& operator()(unsigned i) { return v[i]; }
+  inline T operator()(unsigned i) const { return v[i]; }
 
-  inline void operator*=(double f)
+  inline void operator*=(T f)
   {
     v[0] *= f; v[1] *= f; v[2] *= f; v[3] *= f;
   }
-  inline Vec4 operator+(const Vec4& o) const
+  inline Vec4T operator+(const Vec4T& o) const
   {
-    return Vec4(v[0]+o.v[0], v[1]+o.v[1], v[2]+o.v[2], v[3]+o.v[3]);
+    return Vec4T(v[0]+o.v[0], v[1]+o.v[1], v[2]+o.v[2], v[3]+o.v[3]);
   }
-  inline Vec4 operator-(const Vec4& o) const
+  inline Vec4T operator-(const Vec4T& o) const
   {
-    return Vec4(v[0]-o.v[0], v[1]-o.v[1], v[2]-o.v[2], v[3]-o.v[3]);
+    return Vec4T(v[0]-o.v[0], v[1]-o.v[1], v[2]-o.v[2], v[3]-o.v[3]);
   }
-  inline Vec4 operator*(double f) const
+  inline Vec4T operator*(T f) const
   {
-    return Vec4(v[0]*f, v[1]*f, v[2]*f, v[3]*f);
+    return Vec4T(v[0]*f, v[1]*f, v[2]*f, v[3]*f);
   }
-  Vec4& operator+=(const Vec4& o)
+  Vec4T& operator+=(const Vec4T& o)
   {
     v[0]+=o.v[0]; v[1]+=o.v[1]; v[2]+=o.v[2]; v[3]+=o.v[3]; return *this;
   }
-  Vec4& operator-=(const Vec4& o)
+  Vec4T& operator-=(const Vec4T& o)
   {
     v[0]-=o.v[0]; v[1]-=o.v[1]; v[2]-=o.v[2]; v[3]-=o.v[3]; return *this;
   }
-  inline bool operator==(const Vec4& o) const
+  inline bool operator==(const Vec4T& o) const
   {
     return v[0]==o.v[0] && v[1]==o.v[1] && v[2]==o.v[2] && v[3]==o.v[3];
   }
-  inline bool operator!=(const Vec4& o) const
+  inline bool operator!=(const Vec4T& o) const
   {
     return !(operator==(o));
   }
 
   // radius
-  inline double rad2() const
+  inline T rad2() const
   {
     return v[0]*v[0]+v[1]*v[1]+v[2]*v[2]+v[3]*v[3];
   }
-  inline double rad() const { return std::sqrt(rad2()); }
+  inline T rad() const { return std::sqrt(rad2()); }
 
   inline void normalise() { operator*=(1/rad()); }
 
   inline bool isfinite() const { return std::isfinite(v[0]+v[1]+v[2]+v[3]); }
 
 private:
-  double v[4];
+  T v[4];
 };
 
+typedef Vec4T<double> Vec4;
+typedef Vec4T<float> Vec4f;
+
 //////////////////////////////////////////////////////////////////////////////
 // 3-vector
 
-struct Vec3
+template<class T> struct Vec3T
 {
-  Vec3()
+  Vec3T()
   {
     v[0] = v[1] = v[2] = 0;
   }
-  Vec3(double a, double b, double c)
+  Vec3T(T a, T b, T c)
   {
     v[0] = a; v[1] = b; v[2] = c;
   }
+  template<class U> explicit Vec3T(const Vec3T<U>& o)
+  {
+    v[0] = T(o(0)); v[1] = T(o(1)); v[2] = T(o(2));
+  }
 
-  inline double& operator()(unsigned i) { return v[i]; }
-  inline double operator()(unsigned i) const { return v[i]; }
+  inline T& operator()(unsigned i) { return v[i]; }
+  inline T operator()(unsigned i) const { return v[i]; }
 
-  inline void operator*=(double f)
+  inline void operator*=(T f)
   {
     v[0] *= f; v[1] *= f; v[2] *= f;
   }
-  inline Vec3 operator+(const Vec3& o) const
+  inline Vec3T operator+(const Vec3T& o) const
   {
-    return Vec3(v[0]+o.v[0], v[1]+o.v[1], v[2]+o.v[2]);
+    return Vec3T(v[0]+o.v[0], v[1]+o.v[1], v[2]+o.v[2]);
   }
-  inline Vec3 operator-() const
+  inline Vec3T operator-() const
   {
-    return Vec3(-v[0], -v[1], -v[2]);
+    return Vec3T(-v[0], -v[1], -v[2]);
   }
-  inline Vec3 operator-(const Vec3& o) const
+  inline Vec3T operator-(const Vec3T& o) const
   {
-    return Vec3(v[0]-o.v[0], v[1]-o.v[1], v[2]-o.v[2]);
+    return Vec3T(v[0]-o.v[0], v[1]-o.v[1], v[2]-o.v[2]);
   }
-  inline Vec3 operator*(double f) const
+  inline Vec3T operator*(T f) const
   {
-    return Vec3(v[0]*f, v[1]*f, v[2]*f);
+    return Vec3T(v[0]*f, v[1]*f, v[2]*f);
   }
-  Vec3& operator+=(const Vec3& o)
+  Vec3T& operator+=(const Vec3T& o)
   {
     v[0]+=o.v[0]; v[1]+=o.v[1]; v[2]+=o.v[2]; return *this;
   }
-  Vec3& operator-=(const Vec3& o)
+  Vec3T& operator-=(const Vec3T& o)
   {
     v[0]-=o.v[0]; v[1]-=o.v[1]; v[2]-=o.v[2]; return *this;
   }
 
-  inline bool operator==(const Vec3& o) const
+  inline bool operator==(const Vec3T& o) const
   {
     return v[0]==o.v[0] && v[1]==o.v[1] && v[2]==o.v[2];
   }
-  inline bool operator!=(const Vec3& o) const
+  inline bool operator!=(const Vec3T& o) const
   {
     return !(operator==(o));
   }
 
   // radius
-  inline double rad2() const
+  inline T rad2() const
   {
     return v[0]*v[0]+v[1]*v[1]+v[2]*v[2];
   }
-  inline double rad() const { return std::sqrt(rad2()); }
+  inline T rad() const { return std::sqrt(rad2()); }
 
   inline void normalise() { operator*=(1/rad()); }
 
   inline bool isfinite() const { return std::isfinite(v[0]+v[1]+v[2]); }
 
 private:
-  double v[3];
+  T v[3];
 };
 
-inline Vec3 cross(const Vec3& a, const Vec3& b)
+typedef Vec3T<double> Vec3;
+typedef Vec3T<float> Vec3f;
+
+template<class T> inline Vec3T<T> cross(const Vec3T<T>& a, const Vec3T<T>& b)
 {
-  return Vec3(a(1)*b(2)-a(2)*b(1),
-	      a(2)*b(0)-a(0)*b(2),
-	      a(0)*b(1)-a(1)*b(0));
+  return Vec3T<T>(a(1)*b(2)-a(2)*b(1),
+                  a(2)*b(0)-a(0)*b(2),
+                  a(0)*b(1)-a(1)*b(0));
 }
 
-inline double dot(const Vec3& a, const Vec3& b)
+template<class T> inline T dot(const Vec3T<T>& a, const Vec3T<T>& b)
 {
   return a(0)*b(0)+a(1)*b(1)+a(2)*b(2);
 }
@@ -175,23 +197,29 @@ inline double dot(const Vec3& a, const Vec3& b)
 //////////////////////////////////////////////////////////////////////////////
 // 4x4 matrix
 
-struct Mat4
+template<class T> struct Mat4T
 {
-  Mat4(bool zero=true)
+  Mat4T(bool zero=true)
   {
     if(zero)
       for(unsigned y=0; y<4; ++y)
 	for(unsigned x=0; x<4; ++x)
 	  m[y][x] = 0;
   }
+  template<class U> explicit Mat4T(const Mat4T<U>& o)
+  {
+    for(unsigned y=0; y<4; ++y)
+      for(unsigned x=0; x<4; ++x)
+        m[y][x] = T(o(y,x));
+  }
 
-  inline double& operator()(unsigned y, unsigned x) { return m[y][x]; }
-  inline double operator()(unsigned y, unsigned x) const { return m[y][x]; }
+  inline T& operator()(unsigned y, unsigned x) { return m[y][x]; }
+  inline T operator()(unsigned y, unsigned x) const { return m[y][x]; }
 
   // matrix multiply
-  inline Mat4 operator*(const Mat4& o) const
+  inline Mat4T operator*(const Mat4T& o) const
   {
-    Mat4 ret(false);
+    Mat4T ret(false);
     for(unsigned y=0; y<4; ++y)
       for(unsigned x=0; x<4; ++x)
 	ret.m[y][x] = m[y][0]*o.m[0][x] + m[y][1]*o.m[1][x] +
@@ -199,18 +227,18 @@ struct Mat4
     return ret;
   }
 
-  inline Vec4 operator*(const Vec4& v) const
+  inline Vec4T<T> operator*(const Vec4T<T>& v) const
   {
-    return Vec4(v(0)*m[0][0]+v(1)*m[0][1]+v(2)*m[0][2]+v(3)*m[0][3],
+    return Vec4T<T>(v(0)*m[0][0]+v(1)*m[0][1]+v(2)*m[0][2]+v(3)*m[0][3],
 		v(0)*m[1][0]+v(1)*m[1][1]+v(2)*m[1][2]+v(3)*m[1][3],
 		v(0)*m[2][0]+v(1)*m[2][1]+v(2)*m[2][2]+v(3)*m[2][3],
 		v(0)*m[3][0]+v(1)*m[3][1]+v(2)*m[3][2]+v(3)*m[3][3]);
   }
 
 
-  inline Mat4 transpose() const
+  inline Mat4T transpose() const
   {
-    Mat4 r(false);
+    Mat4T r(false);
     for(unsigned y=0; y<4; ++y)
       for(unsigned x=0; y<x; ++x)
 	r.m[y][x] = m[x][y];
@@ -218,16 +246,19 @@ struct Mat4
   }
 
 private:
-  double m[4][4];
+  T m[4][4];
 };
 
+typedef Mat4T<double> Mat4;
+typedef Mat4T<float> Mat4f;
+
 // multiply matrix by vector
-inline Vec4 operator*(const Vec4& v, const Mat4& m)
+template<class T> inline Vec4T<T> operator*(const Vec4T<T>& v, const Mat4T<T>& m)
 {
-  return Vec4(v(0)*m(0,0)+v(1)*m(1,0)+v(2)*m(2,0)+v(3)*m(3,0),
-	      v(0)*m(0,1)+v(1)*m(1,1)+v(2)*m(2,1)+v(3)*m(3,1),
-	      v(0)*m(0,2)+v(1)*m(1,2)+v(2)*m(2,2)+v(3)*m(3,2),
-	      v(0)*m(0,3)+v(1)*m(1,3)+v(2)*m(2,3)+v(3)*m(3,3));
+  return Vec4T<T>(v(0)*m(0,0)+v(1)*m(1,0)+v(2)*m(2,0)+v(3)*m(3,0),
+                  v(0)*m(0,1)+v(1)*m(1,1)+v(2)*m(2,1)+v(3)*m(3,1),
+                  v(0)*m(0,2)+v(1)*m(1,2)+v(2)*m(2,2)+v(3)*m(3,2),
+                  v(0)*m(0,3)+v(1)*m(1,3)+v(2)*m(2,3)+v(3)*m(3,3));
 }
 
 // identity matrix
@@ -247,6 +278,10 @@ Mat4 rotateM4(double angle, Vec3 vec);
 // create a translation matrix
 Mat4 translationM4(Vec3 vec);
 
+// invert a matrix made of rotations, scalings and translations
+// (the bottom row is 0,0,0,1)
+Mat4 invertAffineM4(const Mat4& m);
+
 // create a scaling matrix
 inline Mat4 scaleM4(Vec3 s)
 {
@@ -281,43 +316,49 @@ inline Mat4 rotate3M4(double ax, double ay, double az)
 ///////////////////////////////////////////////////////////////////////
 // 3-Matrix
 
-struct Mat3
+template<class T> struct Mat3T
 {
-  Mat3(bool zero=true)
+  Mat3T(bool zero=true)
   {
     if(zero)
       for(unsigned y=0; y<3; ++y)
 	for(unsigned x=0; x<3; ++x)
 	  m[y][x] = 0;
   }
+  template<class U> explicit Mat3T(const Mat3T<U>& o)
+  {
+    for(unsigned y=0; y<3; ++y)
+      for(unsigned x=0; x<3; ++x)
+        m[y][x] = T(o(y,x));
+  }
 
-  Mat3(double a, double b, double c,
-       double d, double e, double f,
-       double g, double h, double i)
+  Mat3T(T a, T b, T c,
+       T d, T e, T f,
+       T g, T h, T i)
     : m{{a,b,c},{d,e,f},{g,h,i}}
   {}
 
-  inline double& operator()(unsigned y, unsigned x) { return m[y][x]; }
-  inline double operator()(unsigned y, unsigned x) const { return m[y][x]; }
+  inline T& operator()(unsigned y, unsigned x) { return m[y][x]; }
+  inline T operator()(unsigned y, unsigned x) const { return m[y][x]; }
 
-  inline Mat3 operator*(const Mat3& o) const
+  inline Mat3T operator*(const Mat3T& o) const
   {
-    Mat3 ret(false);
+    Mat3T ret(false);
     for(unsigned y=0; y<3; ++y)
       for(unsigned x=0; x<3; ++x)
 	ret.m[y][x] = m[y][0]*o.m[0][x] + m[y][1]*o.m[1][x] +
 	  m[y][2]*o.m[2][x];
     return ret;
   }
-  inline Vec3 operator*(const Vec3& v) const
+  inline Vec3T<T> operator*(const Vec3T<T>& v) const
   {
-    return Vec3(v(0)*m[0][0]+v(1)*m[0][1]+v(2)*m[0][2],
+    return Vec3T<T>(v(0)*m[0][0]+v(1)*m[0][1]+v(2)*m[0][2],
 		v(0)*m[1][0]+v(1)*m[1][1]+v(2)*m[1][2],
 		v(0)*m[2][0]+v(1)*m[2][1]+v(2)*m[2][2]);
   }
-  inline Mat3 transpose() const
+  inline Mat3T transpose() const
   {
-    Mat3 r(false);
+    Mat3T r(false);
     for(unsigned y=0; y<4; ++y)
       for(unsigned x=0; y<x; ++x)
 	r.m[y][x] = m[x][y];
@@ -325,14 +366,17 @@ struct Mat3
   }
 
 private:
-  double m[3][3];
+  T m[3][3];
 };
 
-inline Vec3 operator*(const Vec3& v, const Mat3& m)
+typedef Mat3T<double> Mat3;
+typedef Mat3T<float> Mat3f;
+
+template<class T> inline Vec3T<T> operator*(const Vec3T<T>& v, const Mat3T<T>& m)
 {
-  return Vec3(v(0)*m(0,0)+v(1)*m(1,0)+v(2)*m(2,0),
-	      v(0)*m(0,1)+v(1)*m(1,1)+v(2)*m(2,1),
-	      v(0)*m(0,2)+v(1)*m(1,2)+v(2)*m(2,2));
+  return Vec3T<T>(v(0)*m(0,0)+v(1)*m(1,0)+v(2)*m(2,0),
+                  v(0)*m(0,1)+v(1)*m(1,1)+v(2)*m(2,1),
+                  v(0)*m(0,2)+v(1)*m(1,2)+v(2)*m(2,2));
 }
 
 // identity matrix
@@ -364,7 +408,7 @@ inline Mat3 translateM3(double dx, double dy)
 }
 
 // determinant
-inline double det(const Mat3& m)
+template<class T> inline T det(const Mat3T<T>& m)
 {
   return
     m(0,0)*m(1,1)*m(2,2) - m(2,0)*m(1,1)*m(0,2) +
@@ -375,78 +419,85 @@ inline double det(const Mat3& m)
 //////////////////////////////////////////////////////////////////////////////
 // Two item vector
 
-struct Vec2
+template<class T> struct Vec2T
 {
-  Vec2()
+  Vec2T()
   {
     v[0] = v[1] = 0;
   }
-  Vec2(double a, double b)
+  Vec2T(T a, T b)
   {
     v[0] = a; v[1] = b;
   }
+  template<class U> explicit Vec2T(const Vec2T<U>& o)
+  {
+    v[0] = T(o(0)); v[1] = T(o(1));
+  }
 
-  inline double& operator()(unsigned i) { return v[i]; }
-  inline double operator()(unsigned i) const { return v[i]; }
+  inline T& operator()(unsigned i) { return v[i]; }
+  inline T operator()(unsigned i) const { return v[i]; }
 
-  inline void operator*=(double f)
+  inline void operator*=(T f)
   {
     v[0] *= f; v[1] *= f;
   }
-  inline Vec2 operator+(const Vec2& o) const
+  inline Vec2T operator+(const Vec2T& o) const
   {
-    return Vec2(v[0]+o.v[0], v[1]+o.v[1]);
+    return Vec2T(v[0]+o.v[0], v[1]+o.v[1]);
   }
-  inline Vec2 operator-() const
+  inline Vec2T operator-() const
   {
-    return Vec2(-v[0], -v[1]);
+    return Vec2T(-v[0], -v[1]);
   }
-  inline Vec2 operator-(const Vec2& o) const
+  inline Vec2T operator-(const Vec2T& o) const
   {
-    return Vec2(v[0]-o.v[0], v[1]-o.v[1]);
+    return Vec2T(v[0]-o.v[0], v[1]-o.v[1]);
   }
-  inline Vec2 operator*(double f) const
+  inline Vec2T operator*(T f) const
   {
-    return Vec2(v[0]*f, v[1]*f);
+    return Vec2T(v[0]*f, v[1]*f);
   }
-  Vec2& operator+=(const Vec2& o)
+  Vec2T& operator+=(const Vec2T& o)
   {
     v[0]+=o.v[0]; v[1]+=o.v[1]; return *this;
   }
-  Vec2& operator-=(const Vec2& o)
+  Vec2T& operator-=(const Vec2T& o)
   {
     v[0]-=o.v[0]; v[1]-=o.v[1]; return *this;
   }
-  inline bool operator==(const Vec2& o) const
+  inline bool operator==(const Vec2T& o) const
   {
     return v[0]==o.v[0] && v[1]==o.v[1];
   }
-  inline bool operator!=(const Vec2& o) const
+  inline bool operator!=(const Vec2T& o) const
   {
     return !(operator==(o));
   }
 
   // radius
-  inline double rad2() const
+  inline T rad2() const
   {
     return v[0]*v[0]+v[1]*v[1];
   }
-  inline double rad() const { return std::sqrt(rad2()); }
+  inline T rad() const { return std::sqrt(rad2()); }
 
   inline void normalise() { operator*=(1/rad()); }
 
   inline bool isfinite() const { return std::isfinite(v[0]+v[1]); }
 
 private:
-  double v[2];
+  T v[2];
 };
 
-inline double cross(const Vec2& a, const Vec2& b)
+typedef Vec2T<double> Vec2;
+typedef Vec2T<float> Vec2f;
+
+template<class T> inline T cross(const Vec2T<T>& a, const Vec2T<T>& b)
 {
   return a(0)*b(1)-a(1)*b(0);
 }
 
-inline double dot(const Vec2& a, const Vec2& b)
+template<class T> inline T dot(const Vec2T<T>& a, const Vec2T<T>& b)
 {
   return a(0)*b(0)+a(1)*b(1);
 }
@@ -454,52 +505,52 @@ inline double dot(const Vec2& a, const Vec2& b)
 //////////////////////////////////////////////////////////////////////////////
 // Helper functions
 
-inline Vec3 vec4to3(const Vec4& v)
+template<class T> inline Vec3T<T> vec4to3(const Vec4T<T>& v)
 {
-  double inv = 1/v(3);
-  return Vec3(v(0)*inv, v(1)*inv, v(2)*inv);
+  T inv = 1/v(3);
+  return Vec3T<T>(v(0)*inv, v(1)*inv, v(2)*inv);
 }
 
-inline Vec4 vec3to4(const Vec3& v)
+template<class T> inline Vec4T<T> vec3to4(const Vec3T<T>& v)
 {
-  return Vec4(v(0), v(1), v(2), 1);
+  return Vec4T<T>(v(0), v(1), v(2), 1);
 }
 
-inline Vec2 vec3to2(const Vec3& v)
+template<class T> inline Vec2T<T> vec3to2(const Vec3T<T>& v)
 {
-  return Vec2(v(0), v(1));
+  return Vec2T<T>(v(0), v(1));
 }
 
 // do projection, getting x,y coordinate and depth
-inline Vec3 calcProjVec(const Mat4& projM, const Vec4& v)
+template<class T> inline Vec3T<T> calcProjVec(const Mat4T<T>& projM, const Vec4T<T>& v)
 {
-  Vec4 nv(projM*v);
-  double inv = 1/nv(3);
-  return Vec3(nv(0)*inv, nv(1)*inv, nv(2)*inv);
+  Vec4T<T> nv(projM*v);
+  T inv = 1/nv(3);
+  return Vec3T<T>(nv(0)*inv, nv(1)*inv, nv(2)*inv);
 }
 
-inline Vec3 calcProjVec(const Mat4& projM, const Vec3& v)
+template<class T> inline Vec3T<T> calcProjVec(const Mat4T<T>& projM, const Vec3T<T>& v)
 {
-  Vec4 nv(projM*vec3to4(v));
-  double inv = 1/nv(3);
-  return Vec3(nv(0)*inv, nv(1)*inv, nv(2)*inv);
+  Vec4T<T> nv(projM*vec3to4(v));
+  T inv = 1/nv(3);
+  return Vec3T<T>(nv(0)*inv, nv(1)*inv, nv(2)*inv);
 }
 
 // convert projected coordinates to screen coordinates using screen matrix
 // makes (x,y,depth) -> screen coordinates
-inline Vec2 projVecToScreen(const Mat3& screenM, const Vec3& vec)
+template<class T> inline Vec2T<T> projVecToScreen(const Mat3T<T>& screenM, const Vec3T<T>& vec)
 {
-  Vec3 mult(screenM*Vec3(vec(0), vec(1), 1));
-  double inv = 1/mult(2);
-  return Vec2(mult(0)*inv, mult(1)*inv);
+  Vec3T<T> mult(screenM*Vec3T<T>(vec(0), vec(1), 1));
+  T inv = 1/mult(2);
+  return Vec2T<T>(mult(0)*inv, mult(1)*inv);
 }
 
 // do 2d lines overlap?
-inline bool line2DOverlap(Vec2 A1, Vec2 A2, Vec2 B1, Vec2 B2)
+template<class T> inline bool line2DOverlap(Vec2T<T> A1, Vec2T<T> A2, Vec2T<T> B1, Vec2T<T> B2)
 {
-  double d = cross(A2-A1, B2-B1);
-  double u = cross(B2-B1, A1-B1);
-  double v = cross(A2-A1, A1-B1);
+  T d = cross(A2-A1, B2-B1);
+  T u = cross(B2-B1, A1-B1);
+  T v = cross(A2-A1, A1-B1);
 
   if(d>=0)
     return 0<=u && u<=d && 0<=v && v<=d;
@@ -508,9 +559,9 @@ inline bool line2DOverlap(Vec2 A1, Vec2 A2, Vec2 B1, Vec2 B2)
 }
 
 // drop dimension of vector
-inline Vec2 dropDim(const Vec3 v)
+template<class T> inline Vec2T<T> dropDim(const Vec3T<T> v)
 {
-  return Vec2(v(0), v(1));
+  return Vec2T<T>(v(0), v(1));
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -520,6 +571,7 @@ typedef std::vector<Vec2> Vec2Vector;
 typedef std::vector<Vec3> Vec3Vector;
 typedef std::vector<Vec4> Vec4Vector;
 typedef std::vector<double> ValVector;
+typedef std::vector<float> FloatVector;
 
 //////////////////////////////////////////////////////////////////////////////
 
@@ -22,6 +22,159 @@
 #include <limits>
 #include "objects.h"
 #include "twod.h"
+#include "parallel.h"
+
+// minimum number of fragment-generating items (e.g. grid cells) for
+// each parallel task
+#define PARALLEL_FRAGMENT_ITEMS 4096
+
+namespace
+{
+  // Append fragments for items 0 to n-1 to v, where func(start, end,
+  // vec) appends the fragments for items start to end-1 to vec. With
+  // more than one thread, ranges of at least minitems are generated
+  // into separate vectors, concatenated in order, so the result is
+  // the same as func(0, n, v).
+  template<class Func> void parallelFragments(unsigned n, unsigned nthreads,
+                                              unsigned minitems,
+                                              FragmentVector& v, Func func)
+  {
+    nthreads = parallelNumThreads(nthreads);
+    const unsigned nchunks = std::min(nthreads*4, n/std::max(minitems, 1u));
+    if(nthreads <= 1 || nchunks <= 1 || parallelInTask())
+      {
+        func(0, n, v);
+        return;
+      }
+
+    std::vector<FragmentVector> chunkfrags(nchunks);
+    parallelFor(nchunks, nthreads, [&](unsigned c)
+      {
+        const unsigned start = (unsigned long long)(c)*n/nchunks;
+        const unsigned end = (unsigned long long)(c+1)*n/nchunks;
+        func(start, end, chunkfrags[c]);
+      });
+
+    size_t total = v.size();
+    for(auto& frags : chunkfrags)
+      total += frags.size();
+    v.reserve(total);
+    for(auto& frags : chunkfrags)
+      v.insert(v.end(), frags.begin(), frags.end());
+  }
+
+  // number of lines along each direction of a grid used to estimate
+  // the projected size of its cells
+#define LOD_SAMPLE_LINES 9
+
+  // Choose strides s1 and s2 through a grid of n1 by n2 points, so
+  // that the cells of the decimated grid are no larger than 1/res of
+  // the projected size of the grid. pt(i1, i2) gives the position of
+  // a grid point (which may be non-finite). The largest projected
+  // cell is measured along a few lines in each direction.
+  template<class PtFn> void lodStrides(const Mat4& perspM, const Mat4& outerM,
+                                       unsigned n1, unsigned n2, double res,
+                                       PtFn pt, unsigned& s1, unsigned& s2)
+  {
+    s1 = s2 = 1;
+    if(!(res > 0) || n1 < 2 || n2 < 2)
+      return;
+
+    const double inf = std::numeric_limits<double>::infinity();
+    double minx = inf, miny = inf, maxx = -inf, maxy = -inf;
+    double maxstep[2] = {0, 0};
+
+    for(unsigned dirn=0; dirn<2; ++dirn)
+      {
+        const unsigned nalong = dirn==0 ? n1 : n2;
+        const unsigned nlines = dirn==0 ? n2 : n1;
+        const unsigned nsample = std::min(nlines, unsigned(LOD_SAMPLE_LINES));
+        for(unsigned l=0; l<nsample; ++l)
+          {
+            const unsigned li = nsample==1 ? 0 :
+              (unsigned long long)(l)*(nlines-1)/(nsample-1);
+            Vec3 last;
+            bool lastok = false;
+            for(unsigned j=0; j<nalong; ++j)
+              {
+                const Vec3 p(calcProjVec(perspM, outerM*
+                                         (dirn==0 ? pt(j, li) : pt(li, j))));
+                const bool ok = p.isfinite();
+                if(ok)
+                  {
+                    minx = std::min(minx, p(0)); maxx = std::max(maxx, p(0));
+                    miny = std::min(miny, p(1)); maxy = std::max(maxy, p(1));
+                    if(lastok)
+                      {
+                        const double dx = p(0)-last(0), dy = p(1)-last(1);
+                        maxstep[dirn] = std::max(maxstep[dirn],
+                                                 std::sqrt(dx*dx+dy*dy));
+                      }
+                  }
+                last = p;
+                lastok = ok;
+              }
+          }
+      }
+
+    const double target = std::max(maxx-minx, maxy-miny) / res;
+    if(!(target > 0) || !std::isfinite(target))
+      return;
+    if(maxstep[0] > 0)
+      s1 = unsigned(std::max(std::min(target/maxstep[0], double(n1-1)), 1.));
+    if(maxstep[1] > 0)
+      s2 = unsigned(std::max(std::min(target/maxstep[1], double(n2-1)), 1.));
+  }
+
+  // indices 0, s, 2*s... up to and including n-1
+  void strideIndices(unsigned n, unsigned s, std::vector<unsigned>& idxs)
+  {
+    idxs.clear();
+    for(unsigned i=0; i<n; i+=s)
+      idxs.push_back(i);
+    if(n>0 && idxs.back() != n-1)
+      idxs.push_back(n-1);
+  }
+
+  // make the bounds empty, so that any finite point extends them
+  void emptyBounds(Vec3& minpt, Vec3& maxpt)
+  {
+    const double inf = std::numeric_limits<double>::infinity();
+    minpt = Vec3(inf, inf, inf);
+    maxpt = Vec3(-inf, -inf, -inf);
+  }
+
+  // extend the bounds to include pt, if it is finite
+  inline void extendBounds(Vec3& minpt, Vec3& maxpt, const Vec3& pt)
+  {
+    if(pt.isfinite())
+      for(unsigned i=0; i<3; ++i)
+        {
+          minpt(i) = std::min(minpt(i), pt(i));
+          maxpt(i) = std::max(maxpt(i), pt(i));
+        }
+  }
+
+  // extend the bounds along axis to include the finite values in vals
+  void extendBoundsAxis(Vec3& minpt, Vec3& maxpt, unsigned axis,
+                        const ValVector& vals)
+  {
+    for(double val : vals)
+      if(std::isfinite(val))
+        {
+          minpt(axis) = std::min(minpt(axis), val);
+          maxpt(axis) = std::max(maxpt(axis), val);
+        }
+  }
+
+  // bounds of the points in pts
+  void pointBounds(const Vec3Vector& pts, Vec3& minpt, Vec3& maxpt)
+  {
+    emptyBounds(minpt, maxpt);
+    for(auto const& pt : pts)
+      extendBounds(minpt, maxpt, pt);
+  }
+}
 
 Object::~Object()
 {
@@ -31,11 +184,40 @@ void Object::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector
 {
 }
 
+bool Object::isViewDependent() const
+{
+  return false;
+}
+
+void Object::getSelectedFragments(const Mat4& perspM, const Mat4& outerM,
+                                  FragmentVector& v, bool viewdep)
+{
+  if(isViewDependent() == viewdep)
+    getFragments(perspM, outerM, v);
+}
+
 void Object::assignWidgetId(unsigned long long id)
 {
   widgetid = id;
 }
 
+void Object::setNumThreads(unsigned n)
+{
+}
+
+void Object::setResolution(double res)
+{
+}
+
+void Object::setLODViewM(const Mat4& m)
+{
+}
+
+bool Object::getBounds(Vec3& minpt, Vec3& maxpt) const
+{
+  return false;
+}
+
 // Triangle
 ///////////
 
@@ -52,6 +234,14 @@ void Triangle::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVect
   v.push_back(f);
 }
 
+bool Triangle::getBounds(Vec3& minpt, Vec3& maxpt) const
+{
+  emptyBounds(minpt, maxpt);
+  for(unsigned i=0; i<3; ++i)
+    extendBounds(minpt, maxpt, points[i]);
+  return true;
+}
+
 // PolyLine
 ///////////
 
@@ -83,6 +273,12 @@ void PolyLine::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVect
     }
 }
 
+bool PolyLine::getBounds(Vec3& minpt, Vec3& maxpt) const
+{
+  pointBounds(points, minpt, maxpt);
+  return true;
+}
+
 // LineSegments
 ///////////////
 
@@ -131,6 +327,12 @@ void LineSegments::getFragments(const Mat4& perspM, const Mat4& outerM, Fragment
     }
 }
 
+bool LineSegments::getBounds(Vec3& minpt, Vec3& maxpt) const
+{
+  pointBounds(points, minpt, maxpt);
+  return true;
+}
+
 // Mesh
 ///////
 
@@ -149,10 +351,106 @@ void Mesh::getVecIdxs(unsigned &vidx_h, unsigned &vidx_1, unsigned &vidx_2) cons
     }
 }
 
+bool Mesh::getBounds(Vec3& minpt, Vec3& maxpt) const
+{
+  unsigned vidx_h, vidx_1, vidx_2;
+  getVecIdxs(vidx_h, vidx_1, vidx_2);
+
+  emptyBounds(minpt, maxpt);
+  extendBoundsAxis(minpt, maxpt, vidx_h, heights);
+  extendBoundsAxis(minpt, maxpt, vidx_1, pos1);
+  extendBoundsAxis(minpt, maxpt, vidx_2, pos2);
+  return true;
+}
+
 void Mesh::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
 {
-  getLineFragments(perspM, outerM, v);
-  getSurfaceFragments(perspM, outerM, v);
+  unsigned s1, s2;
+  getStrides(perspM, outerM, s1, s2);
+  if(s1 == 1 && s2 == 1)
+    {
+      getLineFragments(perspM, outerM, v);
+      getSurfaceFragments(perspM, outerM, v);
+    }
+  else
+    getDecimatedFragments(perspM, outerM, s1, s2, v);
+}
+
+void Mesh::getStrides(const Mat4& perspM, const Mat4& outerM,
+                      unsigned& s1, unsigned& s2) const
+{
+  const unsigned n1 = pos1.size();
+  const unsigned n2 = pos2.size();
+  if(heights.size() != n1*n2)
+    {
+      s1 = s2 = 1;
+      return;
+    }
+
+  unsigned vidx_h, vidx_1, vidx_2;
+  getVecIdxs(vidx_h, vidx_1, vidx_2);
+
+  lodStrides(perspM, lodviewM*outerM, n1, n2, resolution,
+             [&](unsigned i1, unsigned i2)
+             {
+               Vec4 p(0,0,0,1);
+               p(vidx_h) = heights[i1*n2+i2];
+               p(vidx_1) = pos1[i1];
+               p(vidx_2) = pos2[i2];
+               return p;
+             },
+             s1, s2);
+}
+
+// Make a mesh from every s1 and s2 grid points, then renumber its
+// fragments to match the full mesh, so that colors are looked up
+// from the right points.
+void Mesh::getDecimatedFragments(const Mat4& perspM, const Mat4& outerM,
+                                 unsigned s1, unsigned s2, FragmentVector& v)
+{
+  const unsigned n1 = pos1.size();
+  const unsigned n2 = pos2.size();
+
+  std::vector<unsigned> idx1, idx2;
+  strideIndices(n1, s1, idx1);
+  strideIndices(n2, s2, idx2);
+  const unsigned n1r = idx1.size();
+  const unsigned n2r = idx2.size();
+
+  ValVector rpos1, rpos2, rheights;
+  for(unsigned i1 : idx1)
+    rpos1.push_back(pos1[i1]);
+  for(unsigned i2 : idx2)
+    rpos2.push_back(pos2[i2]);
+  rheights.reserve(n1r*n2r);
+  for(unsigned i1 : idx1)
+    for(unsigned i2 : idx2)
+      rheights.push_back(heights[i1*n2+i2]);
+
+  Mesh reduced(rpos1, rpos2, rheights, dirn, lineprop.ptr(), surfaceprop.ptr(),
+               hidehorzline, hidevertline);
+  reduced.nthreads = nthreads;
+
+  const unsigned start = v.size();
+  reduced.getLineFragments(perspM, outerM, v);
+  reduced.getSurfaceFragments(perspM, outerM, v);
+
+  // line points are numbered along pos1 for each pos2, then along
+  // pos2 for each pos1 (see getLineFragments)
+  const unsigned nhorz = hidehorzline ? 0 : n1r*n2r;
+  for(unsigned i=start, s=v.size(); i<s; ++i)
+    {
+      Fragment& f = v[i];
+      f.object = this;
+      const unsigned idx = f.index;
+      if(f.type == Fragment::FR_TRIANGLE)
+        f.index = idx1[idx/(n2r-1)]*(n2-1) + idx2[idx%(n2r-1)];
+      else if(idx < nhorz)
+        f.index = idx2[idx/n1r]*n1 + idx1[idx%n1r];
+      else
+        f.index = (hidehorzline ? 0 : n1*n2) +
+          idx1[(idx-nhorz)/n2r]*n2 + idx2[(idx-nhorz)%n2r];
+    }
 }
 
 void Mesh::getLineFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
@@ -205,9 +503,23 @@ void Mesh::getLineFragments(const Mat4& perspM, const Mat4& outerM, FragmentVect
 
 void Mesh::getSurfaceFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
 {
-  if(surfaceprop.ptr() == 0)
+  if(surfaceprop.ptr() == 0 || pos1.size() < 2)
     return;
 
+  const unsigned n1 = pos1.size();
+  const unsigned n2 = pos2.size();
+  parallelFragments(n1-1, nthreads,
+                    PARALLEL_FRAGMENT_ITEMS/std::max(n2, 1u), v,
+                    [&](unsigned i1start, unsigned i1end, FragmentVector& rowv)
+                    {
+                      getSurfaceRowFragments(outerM, i1start, i1end, rowv);
+                    });
+}
+
+void Mesh::getSurfaceRowFragments(const Mat4& outerM,
+                                  unsigned i1start, unsigned i1end,
+                                  FragmentVector& v)
+{
   unsigned vidx_h, vidx_1, vidx_2;
   getVecIdxs(vidx_h, vidx_1, vidx_2);
 
@@ -223,15 +535,16 @@ void Mesh::getSurfaceFragments(const Mat4& perspM, const Mat4& outerM, FragmentV
   static const unsigned tidxs[2][2][3] = {
     {{0,1,2},{3,1,2}}, {{1,0,3},{2,0,3}} };
 
-  const unsigned n1 = pos1.size();
   const unsigned n2 = pos2.size();
 
   Vec4 p[4];
   Vec3 pproj[4];
   p[0](3) = p[1](3) = p[2](3) = p[3](3) = 1;
-  for(unsigned i1=0; (i1+1)<n1; ++i1)
+  for(unsigned i1=i1start; i1<i1end; ++i1)
     for(unsigned i2=0; (i2+1)<n2; ++i2)
       {
+        fs.index = i1*(n2-1)+i2;
+
         // update coordinates of corners of square and project
         for(unsigned i=0; i<4; ++i)
           {
@@ -253,8 +566,6 @@ void Mesh::getSurfaceFragments(const Mat4& perspM, const Mat4& outerM, FragmentV
                 v.push_back(fs);
               }
           }
-
-        ++fs.index;
       }
 }
 
@@ -286,39 +597,149 @@ namespace
 
   // keep track of which lines are drawn in the grid, so they aren't
   // drawn again. We have a grid point for each edge, and a line
-  // index (0-3)
+  // index (0-3). Only rows from base to base+n1-1 are tracked.
 #define MAXLINEIDX 4
   struct LineCellTracker
   {
-    LineCellTracker(unsigned _n1, unsigned _n2)
-      : n1(_n1), n2(_n2), data(n1*n2*MAXLINEIDX, 0)
+    LineCellTracker(unsigned _base, unsigned _n1, unsigned _n2)
+      : base(_base), n1(_n1), n2(_n2), data(n1*n2*MAXLINEIDX, 0)
     {
     }
 
     void setLine(unsigned i1, unsigned i2, unsigned lineidx)
     {
-      data[(i1*n2+i2)*MAXLINEIDX+lineidx] = 1;
+      data[((i1-base)*n2+i2)*MAXLINEIDX+lineidx] = 1;
     }
 
     bool isLineSet(unsigned i1, unsigned i2, unsigned lineidx) const
     {
-      return data[(i1*n2+i2)*MAXLINEIDX+lineidx];
+      return data[((i1-base)*n2+i2)*MAXLINEIDX+lineidx];
     }
 
-    unsigned n1, n2;
+    unsigned base, n1, n2;
     std::vector<char> data;
   };
 };
 
 void DataMesh::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
 {
-  // check indices
+  unsigned s1, s2;
+  getStrides(perspM, outerM, s1, s2);
+  if(s1 == 1 && s2 == 1)
+    makeFragments(perspM, outerM, v);
+  else
+    makeDecimatedFragments(perspM, outerM, s1, s2, v);
+}
+
+bool DataMesh::validIndices() const
+{
   bool found[3] = {0, 0, 0};
-  unsigned idxs[3] = {idxval, idxedge1, idxedge2};
+  const unsigned idxs[3] = {idxval, idxedge1, idxedge2};
   for(unsigned i=0; i<3; ++i)
     if(idxs[i]<=2)
       found[idxs[i]]=1;
-  if(!found[0] || !found[1] || !found[2])
+  return found[0] && found[1] && found[2];
+}
+
+bool DataMesh::getBounds(Vec3& minpt, Vec3& maxpt) const
+{
+  if(!validIndices())
+    return false;
+
+  // the points of the surface in the value direction are averages
+  // of the values, so are within their range
+  emptyBounds(minpt, maxpt);
+  extendBoundsAxis(minpt, maxpt, idxval, vals);
+  extendBoundsAxis(minpt, maxpt, idxedge1, edges1);
+  extendBoundsAxis(minpt, maxpt, idxedge2, edges2);
+  return true;
+}
+
+void DataMesh::getStrides(const Mat4& perspM, const Mat4& outerM,
+                          unsigned& s1, unsigned& s2) const
+{
+  const int n1=int(edges1.size())-1;
+  const int n2=int(edges2.size())-1;
+  if(!validIndices() || n1<1 || n2<1 || n1*n2 != int(vals.size()))
+    {
+      s1 = s2 = 1;
+      return;
+    }
+
+  // strides through the edges, with heights from neighbouring cells
+  lodStrides(perspM, lodviewM*outerM, n1+1, n2+1, resolution,
+             [&](unsigned i1, unsigned i2)
+             {
+               Vec4 p(0,0,0,1);
+               p(idxval) = vals[std::min(int(i1), n1-1)*n2 +
+                                std::min(int(i2), n2-1)];
+               p(idxedge1) = edges1[i1];
+               p(idxedge2) = edges2[i2];
+               return p;
+             },
+             s1, s2);
+}
+
+// Make a mesh where each cell is a block of s1 by s2 cells, taking
+// the value of the cell nearest the centre of the block (or the
+// first with a finite value). Fragments are renumbered to the cells
+// used, so that colors are looked up correctly.
+void DataMesh::makeDecimatedFragments(const Mat4& perspM, const Mat4& outerM,
+                                      unsigned s1, unsigned s2,
+                                      FragmentVector& v)
+{
+  const unsigned n2 = edges2.size()-1;
+
+  std::vector<unsigned> eidx1, eidx2;
+  strideIndices(edges1.size(), s1, eidx1);
+  strideIndices(edges2.size(), s2, eidx2);
+  const unsigned n1r = eidx1.size()-1;
+  const unsigned n2r = eidx2.size()-1;
+
+  ValVector redges1, redges2, rvals;
+  for(unsigned i1 : eidx1)
+    redges1.push_back(edges1[i1]);
+  for(unsigned i2 : eidx2)
+    redges2.push_back(edges2[i2]);
+
+  std::vector<unsigned> cellidxs;
+  cellidxs.reserve(n1r*n2r);
+  rvals.reserve(n1r*n2r);
+  for(unsigned b1=0; b1<n1r; ++b1)
+    for(unsigned b2=0; b2<n2r; ++b2)
+      {
+        const unsigned start1 = eidx1[b1], end1 = eidx1[b1+1];
+        const unsigned start2 = eidx2[b2], end2 = eidx2[b2+1];
+        unsigned cell = ((start1+end1-1)/2)*n2 + (start2+end2-1)/2;
+        for(unsigned i1=start1; i1<end1 && !std::isfinite(vals[cell]); ++i1)
+          for(unsigned i2=start2; i2<end2; ++i2)
+            if(std::isfinite(vals[i1*n2+i2]))
+              {
+                cell = i1*n2+i2;
+                break;
+              }
+        cellidxs.push_back(cell);
+        rvals.push_back(vals[cell]);
+      }
+
+  DataMesh reduced(redges1, redges2, rvals, idxval, idxedge1, idxedge2,
+                   highres, lineprop.ptr(), surfaceprop.ptr(),
+                   hidehorzline, hidevertline);
+  reduced.nthreads = nthreads;
+
+  const unsigned start = v.size();
+  reduced.makeFragments(perspM, outerM, v);
+  for(unsigned i=start, s=v.size(); i<s; ++i)
+    {
+      v[i].object = this;
+      v[i].index = cellidxs[v[i].index];
+    }
+}
+
+void DataMesh::makeFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
+{
+  // check indices
+  if(!validIndices())
     {
       std::fprintf(stderr, "DataMesh: invalid indices\n");
       return;
@@ -335,6 +756,21 @@ void DataMesh::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVect
   if( lineprop.ptr()==0 && surfaceprop.ptr()==0 )
     return;
 
+  const int n1=int(edges1.size())-1;
+  const int n2=int(edges2.size())-1;
+  parallelFragments(std::max(n1, 0), nthreads,
+                    PARALLEL_FRAGMENT_ITEMS/std::max(n2, 1), v,
+                    [&](unsigned i1start, unsigned i1end, FragmentVector& rowv)
+                    {
+                      makeRowFragments(outerM, i1start, i1end, rowv);
+                    });
+}
+
+void DataMesh::makeRowFragments(const Mat4& outerM, int i1start, int i1end,
+                                FragmentVector& v)
+{
+  const unsigned idxs[3] = {idxval, idxedge1, idxedge2};
+
   // used to draw the grid and surface
   Fragment ft;
   ft.type = Fragment::FR_TRIANGLE;
@@ -389,15 +825,26 @@ void DataMesh::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVect
     corners[i](3) = 1;
   Vec3 corners3[9];  // 3d version of above
 
+  const int n1=int(edges1.size())-1;
+  const int n2=int(edges2.size())-1;
+
   // don't draw lines twice by keeping track if which edges of which
   // cells have been drawn already
-  LineCellTracker linetracker(edges1.size(), edges2.size());
+  const int base = std::max(i1start-1, 0);
+  LineCellTracker linetracker(base, i1end+1-base, edges2.size());
 
-  const int n1=int(edges1.size())-1;
-  const int n2=int(edges2.size())-1;
+  // lines of the previous row, which is done by another range
+  if(fl.lineprop!=0 && i1start>0)
+    for(int i2=0; i2<n2; ++i2)
+      if( std::isfinite(vals[(i1start-1)*n2+i2]) )
+        for(unsigned i=0; i<nlines; ++i)
+          if( !(hidehorzline && linedirn[i]==0) &&
+              !(hidevertline && linedirn[i]==1) )
+            linetracker.setLine(i1start-1+linecells[i][0], i2+linecells[i][1],
+                                linecells[i][2]);
 
   // loop over 2d array
-  for(int i1=0; i1<n1; ++i1)
+  for(int i1=i1start; i1<i1end; ++i1)
     for(int i2=0; i2<n2; ++i2)
       {
         // skip bad data values
@@ -506,6 +953,23 @@ void DataMesh::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVect
 //////////////
 
 void MultiCuboid::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
+{
+  makeFragments(perspM, outerM, v);
+}
+
+bool MultiCuboid::getBounds(Vec3& minpt, Vec3& maxpt) const
+{
+  emptyBounds(minpt, maxpt);
+  extendBoundsAxis(minpt, maxpt, 0, xmin);
+  extendBoundsAxis(minpt, maxpt, 0, xmax);
+  extendBoundsAxis(minpt, maxpt, 1, ymin);
+  extendBoundsAxis(minpt, maxpt, 1, ymax);
+  extendBoundsAxis(minpt, maxpt, 2, zmin);
+  extendBoundsAxis(minpt, maxpt, 2, zmax);
+  return true;
+}
+
+void MultiCuboid::makeFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
 {
   // nothing to draw
   if( lineprop.ptr()==0 && surfaceprop.ptr()==0 )
@@ -556,6 +1020,13 @@ void MultiCuboid::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentV
     {{1,1,0}, {1,1,1}}
   };
 
+  // does outerM reverse the winding of triangles?
+  Mat3 linM(false);
+  for(unsigned i=0; i<3; ++i)
+    for(unsigned j=0; j<3; ++j)
+      linM(i,j) = outerM(i,j);
+  const bool reflect = det(linM) < 0;
+
   /// maximum size of array
   const int sizex = std::min(xmin.size(), xmax.size());
   const int sizey = std::min(ymin.size(), ymax.size());
@@ -576,13 +1047,31 @@ void MultiCuboid::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentV
           for(int tri=0; tri<12; ++tri)
             {
               // points for triangle
+              Vec3 objpts[3];
               for(int pt=0; pt<3; ++pt)
                 {
-                  ft.points[pt] = vec4to3(outerM*
-                                          Vec4(x[triidx[tri][pt][0]],
-                                               y[triidx[tri][pt][1]],
-                                               z[triidx[tri][pt][2]]));
+                  objpts[pt] = Vec3(x[triidx[tri][pt][0]],
+                                    y[triidx[tri][pt][1]],
+                                    z[triidx[tri][pt][2]]);
+                  ft.points[pt] = vec4to3(outerM*vec3to4(objpts[pt]));
                 }
+
+              // Wind the triangle to face out of its side of the
+              // cuboid, for back face culling. The side is the axis
+              // along which its points share the same end, so the two
+              // sides of a flat cuboid face opposite ways.
+              int axis = 0;
+              while(axis < 2 && !(triidx[tri][0][axis] == triidx[tri][1][axis] &&
+                                  triidx[tri][0][axis] == triidx[tri][2][axis]))
+                ++axis;
+              const double* lims = axis==0 ? x : axis==1 ? y : z;
+              const int end = triidx[tri][0][axis];
+              const double outwards = (end==1) == (lims[0] <= lims[1]) ? 1 : -1;
+              const double norm = cross(objpts[1]-objpts[0],
+                                        objpts[2]-objpts[0])(axis);
+              if((norm*outwards < 0) != reflect)
+                std::swap(ft.points[1], ft.points[2]);
+
               if(ft.isVisible())
                 v.push_back(ft);
             }
@@ -647,6 +1136,15 @@ void Points::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector
     }
 }
 
+bool Points::getBounds(Vec3& minpt, Vec3& maxpt) const
+{
+  emptyBounds(minpt, maxpt);
+  const unsigned size = std::min(x.size(), std::min(y.size(), z.size()));
+  for(unsigned i=0; i<size; ++i)
+    extendBounds(minpt, maxpt, Vec3(x[i], y[i], z[i]));
+  return true;
+}
+
 
 // Text
 ///////
@@ -692,6 +1190,21 @@ void Text::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector&
     }
 }
 
+bool Text::getBounds(Vec3& minpt, Vec3& maxpt) const
+{
+  emptyBounds(minpt, maxpt);
+  const unsigned numitems = std::min(pos1.size(), pos2.size()) / 3;
+  for(unsigned i=0; i<numitems; ++i)
+    {
+      const unsigned base = i*3;
+      extendBounds(minpt, maxpt,
+                   Vec3(pos1[base], pos1[base+1], pos1[base+2]));
+      extendBounds(minpt, maxpt,
+                   Vec3(pos2[base], pos2[base+1], pos2[base+2]));
+    }
+  return true;
+}
+
 void Text::draw(QPainter* painter,
                 QPointF pt1, QPointF pt2, QPointF pt3,
                 unsigned index, double scale, double linescale)
@@ -724,9 +1237,57 @@ ObjectContainer::~ObjectContainer()
 void ObjectContainer::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
 {
   const Mat4 totM(outerM*objM);
-  const unsigned s=objects.size();
-  for(unsigned i=0; i<s; ++i)
-    objects[i]->getFragments(perspM, totM, v);
+  parallelFragments(objects.size(), nthreads, 1, v,
+                    [&](unsigned start, unsigned end, FragmentVector& objv)
+                    {
+                      for(unsigned i=start; i<end; ++i)
+                        objects[i]->getFragments(perspM, totM, objv);
+                    });
+}
+
+bool ObjectContainer::getBounds(Vec3& minpt, Vec3& maxpt) const
+{
+  emptyBounds(minpt, maxpt);
+  for(auto object : objects)
+    {
+      Vec3 omin, omax;
+      if(!object->getBounds(omin, omax))
+        return false;
+      if(!(omin(0)<=omax(0) && omin(1)<=omax(1) && omin(2)<=omax(2)))
+        continue;
+
+      // add the corners of the box of the child, transformed to the
+      // coordinates of this container
+      for(unsigned c=0; c<8; ++c)
+        {
+          const Vec3 corner(c&1 ? omax(0) : omin(0),
+                            c&2 ? omax(1) : omin(1),
+                            c&4 ? omax(2) : omin(2));
+          extendBounds(minpt, maxpt, vec4to3(objM*vec3to4(corner)));
+        }
+    }
+  return true;
+}
+
+bool ObjectContainer::isViewDependent() const
+{
+  for(auto object : objects)
+    if(object->isViewDependent())
+      return true;
+  return false;
+}
+
+void ObjectContainer::getSelectedFragments(const Mat4& perspM, const Mat4& outerM,
+                                           FragmentVector& v, bool viewdep)
+{
+  const Mat4 totM(outerM*objM);
+  parallelFragments(objects.size(), nthreads, 1, v,
+                    [&](unsigned start, unsigned end, FragmentVector& objv)
+                    {
+                      for(unsigned i=start; i<end; ++i)
+                        objects[i]->getSelectedFragments(perspM, totM, objv,
+                                                         viewdep);
+                    });
 }
 
 void ObjectContainer::assignWidgetId(unsigned long long id)
@@ -735,6 +1296,25 @@ void ObjectContainer::assignWidgetId(unsigned long long id)
     object->assignWidgetId(id);
 }
 
+void ObjectContainer::setNumThreads(unsigned n)
+{
+  nthreads = n;
+  for(auto object : objects)
+    object->setNumThreads(n);
+}
+
+void ObjectContainer::setResolution(double res)
+{
+  for(auto object : objects)
+    object->setResolution(res);
+}
+
+void ObjectContainer::setLODViewM(const Mat4& m)
+{
+  for(auto object : objects)
+    object->setLODViewM(m);
+}
+
 // FacingContainer
 
 void FacingContainer::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
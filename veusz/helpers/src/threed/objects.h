@@ -33,17 +33,57 @@
 class Object
 {
  public:
-  Object() : widgetid(0) {}
+  // How the Scene may discard fragments of the object before
+  // ordering them. CULL_OFFSCREEN removes triangles and lines outside
+  // the view when the scale is fixed. CULL_BACKFACES removes opaque
+  // triangles facing away from the viewer, for closed objects whose
+  // triangles are wound so that cross(b-a, c-a) points outwards.
+  enum CullMode { CULL_NONE=0, CULL_OFFSCREEN=1, CULL_BACKFACES=2 };
+
+  Object() : widgetid(0), cull(CULL_OFFSCREEN) {}
 
   virtual ~Object();
 
   virtual void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
+  // do the fragments depend on the viewing direction, other than by
+  // being transformed (e.g. only drawn if facing the viewer)?
+  virtual bool isViewDependent() const;
+
+  // only get fragments of objects where isViewDependent() is viewdep
+  virtual void getSelectedFragments(const Mat4& perspM, const Mat4& outerM,
+                                    FragmentVector& v, bool viewdep);
+
   // recursive set id of child objects
   virtual void assignWidgetId(unsigned long long id);
 
+  // number of threads to use when getting fragments, for objects
+  // which support it (0 is number of cores), including children
+  virtual void setNumThreads(unsigned n);
+
+  // for objects which support it, including children, the maximum
+  // number of grid cells to draw across the projected size of the
+  // object (0 for full detail)
+  virtual void setResolution(double res);
+
+  // for objects using a resolution, including children, the matrix
+  // taking the coordinates given by outerM in getFragments to viewing
+  // coordinates, used to measure the projected size of the object
+  // when the fragments are not wanted in viewing coordinates
+  virtual void setLODViewM(const Mat4& m);
+
+  // set minpt and maxpt to the bounding box of the points of the
+  // object, in the coordinates transformed by outerM in getFragments,
+  // returning false if it is not known. Non-finite points are
+  // ignored, so the box may be empty (minpt greater than maxpt).
+  virtual bool getBounds(Vec3& minpt, Vec3& maxpt) const;
+
+ public:
   // id of widget which generated object
   unsigned long long widgetid;
+
+  // combination of CullMode values
+  unsigned cull;
 };
 
 class Triangle : public Object
@@ -61,6 +101,7 @@ class Triangle : public Object
   }
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  bool getBounds(Vec3& minpt, Vec3& maxpt) const;
 
  public:
   Vec3 points[3];
@@ -90,6 +131,7 @@ public:
   void addPoints(const ValVector& x, const ValVector& y, const ValVector& z);
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  bool getBounds(Vec3& minpt, Vec3& maxpt) const;
 
 public:
   Vec3Vector points;
@@ -106,6 +148,7 @@ public:
                const LineProp* prop);
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  bool getBounds(Vec3& minpt, Vec3& maxpt) const;
 
 public:
   Vec3Vector points;
@@ -129,20 +172,40 @@ public:
        Direction _dirn,
        const LineProp* lprop=0, const SurfaceProp* sprop=0,
        bool _hidehorzline=0, bool _hidevertline=0)
-    : pos1(_pos1), pos2(_pos2), heights(_heights),
+    : nthreads(1), resolution(0), lodviewM(identityM4()),
+      pos1(_pos1), pos2(_pos2), heights(_heights),
       dirn(_dirn), lineprop(lprop), surfaceprop(sprop),
       hidehorzline(_hidehorzline), hidevertline(_hidevertline)
   {
   }
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  bool getBounds(Vec3& minpt, Vec3& maxpt) const;
+  void setNumThreads(unsigned n) { nthreads = n; }
+  void setResolution(double res) { resolution = res; }
+  void setLODViewM(const Mat4& m) { lodviewM = m; }
 
 private:
+  // strides to step through grid for the resolution
+  void getStrides(const Mat4& perspM, const Mat4& outerM,
+                  unsigned& s1, unsigned& s2) const;
+  // get fragments for grid points every s1 and s2 points
+  void getDecimatedFragments(const Mat4& perspM, const Mat4& outerM,
+                             unsigned s1, unsigned s2, FragmentVector& v);
+
   void getSurfaceFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  // surface for rows i1start to i1end-1
+  void getSurfaceRowFragments(const Mat4& outerM,
+                              unsigned i1start, unsigned i1end,
+                              FragmentVector& v);
   void getLineFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
   void getVecIdxs(unsigned &vidx_h, unsigned &vidx_1, unsigned &vidx_2) const;
 
+  unsigned nthreads;
+  double resolution;
+  Mat4 lodviewM;
+
 public:
   ValVector pos1, pos2, heights;
   Direction dirn;
@@ -164,7 +227,8 @@ public:
            bool _highres,
            const LineProp* lprop=0, const SurfaceProp* sprop=0,
            bool _hidehorzline=0, bool _hidevertline=0)
-    : edges1(_edges1), edges2(_edges2), vals(_vals),
+    : nthreads(1), resolution(0), lodviewM(identityM4()),
+      edges1(_edges1), edges2(_edges2), vals(_vals),
       idxval(_idxval), idxedge1(_idxedge1), idxedge2(_idxedge2),
       highres(_highres),
       lineprop(lprop), surfaceprop(sprop),
@@ -173,6 +237,28 @@ public:
   }
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  bool getBounds(Vec3& minpt, Vec3& maxpt) const;
+  void setNumThreads(unsigned n) { nthreads = n; }
+  void setResolution(double res) { resolution = res; }
+  void setLODViewM(const Mat4& m) { lodviewM = m; }
+
+private:
+  bool validIndices() const;
+  // strides to step through cells for the resolution
+  void getStrides(const Mat4& perspM, const Mat4& outerM,
+                  unsigned& s1, unsigned& s2) const;
+  // get fragments for blocks of s1 by s2 cells
+  void makeDecimatedFragments(const Mat4& perspM, const Mat4& outerM,
+                              unsigned s1, unsigned s2, FragmentVector& v);
+
+  void makeFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  // fragments for rows i1start to i1end-1
+  void makeRowFragments(const Mat4& outerM, int i1start, int i1end,
+                        FragmentVector& v);
+
+  unsigned nthreads;
+  double resolution;
+  Mat4 lodviewM;
 
 public:
   ValVector edges1, edges2, vals;
@@ -197,9 +283,16 @@ public:
       zmin(_zmin), zmax(_zmax),
       lineprop(lprop), surfaceprop(sprop)
   {
+    // the cuboids are closed and their triangles face outwards
+    cull = CULL_OFFSCREEN | CULL_BACKFACES;
   }
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  bool getBounds(Vec3& minpt, Vec3& maxpt) const;
+
+private:
+  void makeFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+
 
 public:
   ValVector xmin, xmax, ymin, ymax, zmin, zmax;
@@ -226,6 +319,7 @@ public:
   void setSizes(const ValVector& _sizes) { sizes = _sizes; }
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  bool getBounds(Vec3& minpt, Vec3& maxpt) const;
 
 private:
   FragmentPathParameters fragparams;
@@ -247,6 +341,7 @@ public:
   Text(const ValVector& _pos1, const ValVector& _pos2);
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  bool getBounds(Vec3& minpt, Vec3& maxpt) const;
 
   virtual void draw(QPainter* painter,
                     QPointF pt1, QPointF pt2, QPointF pt3,
@@ -277,6 +372,7 @@ public:
   {}
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  bool isViewDependent() const { return true; }
 };
 
 // container of objects with transformation matrix of children
@@ -286,11 +382,18 @@ class ObjectContainer : public Object
 {
  public:
   ObjectContainer()
-    : objM(identityM4())
+    : nthreads(1), objM(identityM4())
     {}
 
   ~ObjectContainer();
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  bool getBounds(Vec3& minpt, Vec3& maxpt) const;
+
+  // view dependent if any child is, but children are selected
+  // individually
+  bool isViewDependent() const;
+  void getSelectedFragments(const Mat4& perspM, const Mat4& outerM,
+                            FragmentVector& v, bool viewdep);
 
   void addObject(Object* obj)
   {
@@ -300,6 +403,14 @@ class ObjectContainer : public Object
   // recursive set id of child objects
   void assignWidgetId(unsigned long long id);
 
+  // children are also processed in parallel if n is not 1
+  void setNumThreads(unsigned n);
+  void setResolution(double res);
+  void setLODViewM(const Mat4& m);
+
+ private:
+  unsigned nthreads;
+
  public:
   Mat4 objM;
   std::vector<Object*> objects;
@@ -317,6 +428,14 @@ public:
   }
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
+  // contents are selected together
+  bool isViewDependent() const { return true; }
+  void getSelectedFragments(const Mat4& perspM, const Mat4& outerM,
+                            FragmentVector& v, bool viewdep)
+  {
+    Object::getSelectedFragments(perspM, outerM, v, viewdep);
+  }
+
 public:
   Vec3 norm;
 };
@@ -343,6 +462,7 @@ public:
                          double axangle);
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  bool isViewDependent() const { return true; }
 
 private:
   Vec3 box1, box2;
@@ -0,0 +1,164 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include <cmath>
+#include <functional>
+#include "pathsprites.h"
+
+PathSpriteCache::PathSpriteCache(QPainter* painter)
+{
+  const QTransform t = painter->combinedTransform();
+  devscale = t.m11();
+  dx = t.dx();
+  dy = t.dy();
+  usable = t.type() <= QTransform::TxScale && t.m22() == devscale &&
+    devscale > 0 && std::isfinite(devscale) &&
+    std::isfinite(dx) && std::isfinite(dy);
+  antialias = painter->testRenderHint(QPainter::Antialiasing);
+}
+
+size_t PathSpriteCache::KeyHash::operator()(const Key& k) const
+{
+  size_t h = std::hash<const void*>()(k.path);
+  auto combine = [&h](size_t v)
+    {
+      h ^= v + 0x9e3779b9 + (h<<6) + (h>>2);
+    };
+  combine(std::hash<int>()(k.scalestep));
+  combine(std::hash<unsigned>()(k.penrgba));
+  combine(std::hash<unsigned>()(k.brushrgba));
+  combine(std::hash<int>()(k.penstyle*2 + int(k.scaleline)));
+  combine(std::hash<int>()(k.brushstyle));
+  combine(std::hash<double>()(k.penwidth));
+  combine(std::hash<int>()((k.pencap*8 + k.penjoin)*2 + int(k.pencosmetic)));
+  combine(std::hash<double>()(k.penmiter));
+  return h;
+}
+
+bool PathSpriteCache::makeSprite(const Key& key, const QPen& pen,
+                                 const QBrush& brush, Sprite& sprite) const
+{
+  const double scale = std::exp(double(key.scalestep)/PATHSPRITES_SCALE_STEPS);
+
+  // bounds in device pixels, including the pen and antialiasing
+  // (miter joins and square caps stick out further than half the
+  // pen width, and cosmetic pens are in device pixels)
+  double penw = pen.style()==Qt::NoPen ? 0 : pen.widthF();
+  if(!pen.isCosmetic())
+    penw *= devscale * (key.scaleline ? scale : 1);
+  double extent = 0.5;
+  if(pen.joinStyle()==Qt::MiterJoin || pen.joinStyle()==Qt::SvgMiterJoin)
+    extent = std::max(extent, 0.5*pen.miterLimit());
+  if(pen.capStyle()==Qt::SquareCap)
+    extent = std::max(extent, std::sqrt(0.5));
+  const double margin = std::max(penw*extent, 0.5) + 1;
+  const QRectF bounds = key.path->boundingRect();
+  const double left = std::floor(bounds.left()*scale*devscale - margin);
+  const double top = std::floor(bounds.top()*scale*devscale - margin);
+  const double right = std::ceil(bounds.right()*scale*devscale + margin);
+  const double bottom = std::ceil(bounds.bottom()*scale*devscale + margin);
+  if(!(right-left <= PATHSPRITES_MAX_SIZE &&
+       bottom-top <= PATHSPRITES_MAX_SIZE))
+    return false;
+
+  sprite.image = QImage(int(right-left), int(bottom-top),
+                        QImage::Format_ARGB32_Premultiplied);
+  sprite.image.fill(0);
+  sprite.offset = QPointF(left, top);
+
+  // drawn in the same way as Scene::drawPath
+  QPainter painter(&sprite.image);
+  painter.setRenderHint(QPainter::Antialiasing, antialias);
+  painter.translate(-left, -top);
+  painter.scale(devscale, devscale);
+  painter.setPen(pen);
+  painter.setBrush(brush);
+  if(key.scaleline)
+    {
+      painter.scale(scale, scale);
+      painter.drawPath(*key.path);
+    }
+  else
+    {
+      QPainterPath path(*key.path);
+      for(int i=0, n=path.elementCount(); i<n; ++i)
+        {
+          const QPainterPath::Element el = path.elementAt(i);
+          path.setElementPositionAt(i, el.x*scale, el.y*scale);
+        }
+      painter.drawPath(path);
+    }
+  painter.end();
+
+  return true;
+}
+
+bool PathSpriteCache::draw(QPainter* painter, const QPainterPath* path,
+                           double scale, bool scaleline, QPointF pt,
+                           const QPen& pen, const QBrush& brush)
+{
+  // gradients and patterns depend on the position, and custom
+  // dashes are rare
+  if(!usable || !(scale > 0) || !std::isfinite(scale) ||
+     pen.style() == Qt::CustomDashLine ||
+     (brush.style() != Qt::NoBrush && brush.style() != Qt::SolidPattern))
+    return false;
+
+  Key key;
+  key.path = path;
+  key.scalestep = int(std::lround(std::log(scale)*PATHSPRITES_SCALE_STEPS));
+  key.scaleline = scaleline;
+  key.penstyle = pen.style();
+  key.penrgba = pen.style()==Qt::NoPen ? 0 : pen.color().rgba();
+  key.penwidth = pen.style()==Qt::NoPen ? 0 : pen.widthF();
+  key.pencap = pen.style()==Qt::NoPen ? 0 : int(pen.capStyle());
+  key.penjoin = pen.style()==Qt::NoPen ? 0 : int(pen.joinStyle());
+  key.penmiter = pen.style()==Qt::NoPen ? 0 : pen.miterLimit();
+  key.pencosmetic = pen.style()!=Qt::NoPen && pen.isCosmetic();
+  key.brushstyle = brush.style();
+  key.brushrgba = brush.style()==Qt::NoBrush ? 0 : brush.color().rgba();
+
+  auto it = sprites.find(key);
+  if(it == sprites.end())
+    {
+      if(sprites.size() >= PATHSPRITES_MAX_NUM)
+        return false;
+      // sprites which are too large are kept with no image, so they
+      // are not tried again
+      Sprite sprite;
+      if(!makeSprite(key, pen, brush, sprite))
+        sprite.image = QImage();
+      it = sprites.emplace(key, sprite).first;
+    }
+
+  const Sprite& sprite = it->second;
+  if(sprite.image.isNull())
+    return false;
+
+  // put the origin of the path on the nearest device pixel, as it
+  // is in the sprite
+  const double devx = std::round(pt.x()*devscale + dx) + sprite.offset.x();
+  const double devy = std::round(pt.y()*devscale + dy) + sprite.offset.y();
+  painter->drawImage(QRectF((devx-dx)/devscale, (devy-dy)/devscale,
+                            sprite.image.width()/devscale,
+                            sprite.image.height()/devscale),
+                     sprite.image);
+  return true;
+}
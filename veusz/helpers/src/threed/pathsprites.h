@@ -0,0 +1,113 @@
+// -*-c++-*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef PATHSPRITES_H
+#define PATHSPRITES_H
+
+#include <unordered_map>
+#include <QtCore/QPointF>
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtGui/QPainterPath>
+#include <QtGui/QPen>
+#include <QtGui/QBrush>
+
+// maximum width or height of a sprite in device pixels
+#define PATHSPRITES_MAX_SIZE 64
+// maximum number of sprites to keep
+#define PATHSPRITES_MAX_NUM 4096
+// scales of sprites are rounded to this number of steps per factor
+// of e (about 1.5% per step)
+#define PATHSPRITES_SCALE_STEPS 64
+
+// Drawing many copies of the same marker path (such as the points
+// of a 3D scatter plot) is slow when each is drawn as a path. This
+// class draws each as an image of the path (a sprite), made when a
+// path is first drawn with a given size, pen and brush. Sizes are
+// rounded slightly so that sprites can be shared.
+//
+// Sprites are only used if the painter only scales and translates,
+// and are made at the resolution of the painter. As they are placed
+// on the nearest pixel, they are not exactly the same as drawing the
+// path, so should only be used for interactive drawing. Paths are
+// identified by their address, so a cache should only be kept while
+// the paths are unchanged (e.g. while drawing a scene).
+
+class PathSpriteCache
+{
+public:
+  // painter should be set up for drawing before calling
+  PathSpriteCache(QPainter* painter);
+
+  // Draw path scaled by scale with its origin at pt. The pen width
+  // is also scaled if scaleline is set. Returns false if a sprite
+  // could not be used, when the path should be drawn normally.
+  bool draw(QPainter* painter, const QPainterPath* path,
+            double scale, bool scaleline, QPointF pt,
+            const QPen& pen, const QBrush& brush);
+
+private:
+  struct Key
+  {
+    const QPainterPath* path;
+    int scalestep;
+    bool scaleline;
+    QRgb penrgba, brushrgba;
+    int penstyle, brushstyle;
+    double penwidth;
+    int pencap, penjoin;
+    double penmiter;
+    bool pencosmetic;
+
+    bool operator==(const Key& o) const
+    {
+      return path==o.path && scalestep==o.scalestep &&
+        scaleline==o.scaleline && penrgba==o.penrgba &&
+        brushrgba==o.brushrgba && penstyle==o.penstyle &&
+        brushstyle==o.brushstyle && penwidth==o.penwidth &&
+        pencap==o.pencap && penjoin==o.penjoin && penmiter==o.penmiter &&
+        pencosmetic==o.pencosmetic;
+    }
+  };
+  struct KeyHash
+  {
+    size_t operator()(const Key& k) const;
+  };
+
+  struct Sprite
+  {
+    QImage image;
+    // top left of image relative to origin of path, in device pixels
+    QPointF offset;
+  };
+
+  // make sprite, returning false if too large to be a sprite
+  bool makeSprite(const Key& key, const QPen& pen, const QBrush& brush,
+                  Sprite& sprite) const;
+
+private:
+  bool usable;
+  bool antialias;
+  // device pixels per painter unit, and device position of origin
+  double devscale, dx, dy;
+  std::unordered_map<Key, Sprite, KeyHash> sprites;
+};
+
+#endif
@@ -0,0 +1,75 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include "renderjob.h"
+
+SceneRenderJob::SceneRenderJob(Scene* _scene, Object* _root,
+                               const Camera& _cam,
+                               double _x1, double _y1,
+                               double _x2, double _y2, double _scale)
+  : scene(_scene), root(_root), cam(_cam),
+    x1(_x1), y1(_y1), x2(_x2), y2(_y2), scale(_scale), preptime(0),
+    cancelflag(false), finished(false), ready(false)
+{
+  scene->setCancelFlag(&cancelflag);
+  thread = std::thread(&SceneRenderJob::run, this);
+}
+
+SceneRenderJob::~SceneRenderJob()
+{
+  cancel();
+  wait();
+}
+
+void SceneRenderJob::run()
+{
+  const auto start = std::chrono::steady_clock::now();
+  bool ok = false;
+  try
+    {
+      ok = scene->prepare(root, cam, x1, y1, x2, y2, scale);
+    }
+  catch(...)
+    {
+      // exceptions cannot leave the thread, so nothing is drawn
+      ok = false;
+    }
+  preptime = std::chrono::duration<double>
+    (std::chrono::steady_clock::now()-start).count();
+  ready.store(ok && !isCancelled(), std::memory_order_release);
+  finished.store(true, std::memory_order_release);
+}
+
+void SceneRenderJob::wait()
+{
+  if(thread.joinable())
+    {
+      thread.join();
+      scene->setCancelFlag(0);
+    }
+}
+
+bool SceneRenderJob::draw(QPainter* painter)
+{
+  if(!isReady())
+    return false;
+  wait();
+  scene->drawPrepared(painter);
+  return true;
+}
@@ -0,0 +1,85 @@
+// -*-c++-*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef RENDERJOB_H
+#define RENDERJOB_H
+
+#include <atomic>
+#include <thread>
+#include <QtGui/QPainter>
+
+#include "scene.h"
+
+// Prepare a scene for drawing in a background thread, so that the
+// caller is not held up while the fragments are made and ordered.
+// The job works like a future: its result is drawn with draw() once
+// isReady(), and it can be cancelled, which stops the scene building
+// its BSP tree as soon as it can.
+//
+// The scene and root are used by the thread until isFinished(), so
+// they should not be used or deleted by anything else until then
+// (the destructor cancels the job and waits for the thread).
+
+class SceneRenderJob
+{
+public:
+  // start preparing scene with the arguments given to Scene::render
+  SceneRenderJob(Scene* scene, Object* root, const Camera& cam,
+                 double x1, double y1, double x2, double y2, double scale);
+  ~SceneRenderJob();
+
+  // ask the thread to stop
+  void cancel() { cancelflag.store(true); }
+  bool isCancelled() const { return cancelflag.load(); }
+
+  // has the thread stopped (with the scene prepared or cancelled)?
+  bool isFinished() const { return finished.load(std::memory_order_acquire); }
+  // is the scene prepared and ready to draw?
+  bool isReady() const { return ready.load(std::memory_order_acquire); }
+
+  // wait for the thread to stop
+  void wait();
+
+  // time taken to prepare the scene in seconds, once finished
+  double prepareTime() const { return preptime; }
+
+  // draw the prepared scene to painter, if ready, returning whether
+  // it was drawn (this can be repeated)
+  bool draw(QPainter* painter);
+
+private:
+  // no copying, as the thread refers to the job
+  SceneRenderJob(const SceneRenderJob&);
+  SceneRenderJob& operator=(const SceneRenderJob&);
+
+  void run();
+
+private:
+  Scene* scene;
+  Object* root;
+  Camera cam;
+  double x1, y1, x2, y2, scale;
+  double preptime;
+
+  std::atomic<bool> cancelflag, finished, ready;
+  std::thread thread;
+};
+
+#endif
@@ -17,46 +17,46 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <cmath>
+#include <chrono>
 #include <limits>
+#include <unordered_map>
+#include <QtCore/QLineF>
 #include <QtCore/QPointF>
+#include <QtCore/QVector>
+#include <QtGui/QPainterPath>
 #include <QtGui/QPolygonF>
 #include <QtGui/QPen>
 #include <QtGui/QBrush>
 #include <QtGui/QColor>
-#include <QtGui/QPixmap>
+#include <QtCore/QRect>
 #include <QtGui/QImage>
 #include <QtGui/QPainter>
 
 #include "scene.h"
 #include "fragment.h"
 #include "bsp.h"
+#include "clipcontainer.h"
+#include "zbuffer.h"
+#include "parallel.h"
+#include "tracing.h"
+
+// maximum width or height of z-buffer image in pixels
+#define ZBUFFER_MAX_SIZE 8192
+// number of samples along each axis per pixel when antialiasing
+#define ZBUFFER_ANTIALIAS_SAMPLES 2
+// fraction of the depth range that lines are moved towards the viewer
+// to be drawn over triangles (paths are moved twice as much)
+#define ZBUFFER_LINE_BIAS 1e-3
 
 namespace
 {
   // Make scaling matrix to move points to correct output range
-  Mat3 makeScreenM(const FragmentVector& frags,
+  Mat3 makeScreenM(const FragmentProjections& projs,
 		   double x1, double y1, double x2, double y2)
   {
     // get range of projected points in x and y
     double minx, miny, maxx, maxy;
-    minx = miny = std::numeric_limits<double>::infinity();
-    maxx = maxy = -std::numeric_limits<double>::infinity();
-
-    for(auto const& f : frags)
-      {
-	for(unsigned p=0, np=f.nPointsVisible(); p<np; ++p)
-	  {
-	    double x = f.proj[p](0);
-	    double y = f.proj[p](1);
-	    if(std::isfinite(x) && std::isfinite(y))
-	      {
-		minx = std::min(minx, x);
-		maxx = std::max(maxx, x);
-		miny = std::min(miny, y);
-		maxy = std::max(maxy, y);
-	      }
-	  }
-      }
+    projs.xyRange(minx, miny, maxx, maxy);
 
     // catch bad values or empty arrays
     if(maxx == minx || !std::isfinite(minx) || !std::isfinite(maxx))
@@ -91,38 +91,285 @@ namespace
     return std::min(std::max(val, minval), maxval);
   }
 
-  unsigned init_fragments_size = 512;
+  // buffers are kept if their capacity is less than SCENE_BUFFER_SLACK
+  // times the recent peak size (or SCENE_BUFFER_MIN items)
+#define SCENE_BUFFER_MIN 4096
+#define SCENE_BUFFER_SLACK 4
+
+  // fragments lit by each thread at a time, and number of triangles
+  // lit together within them
+#define SCENE_LIGHT_TASK 16384
+#define SCENE_LIGHT_BLOCK 256
+
+  // maximum number of cells along each side of the grid of triangles
+  // used to find lines to break up in the painter's algorithm
+#define SCENE_SPLIT_GRID 64
+
+  // adds the time while the object exists to a total (in seconds)
+  class StageTimer
+  {
+  public:
+    StageTimer(double& _total)
+      : total(_total), start(std::chrono::steady_clock::now())
+    {
+    }
+    ~StageTimer()
+    {
+      total += std::chrono::duration<double>
+        (std::chrono::steady_clock::now()-start).count();
+    }
+
+  private:
+    double& total;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  // time a stage of rendering, adding to its total in stats, and
+  // to the trace stat of the stage if tracing is compiled in
+#define SCENE_STAGE(stage)                              \
+  StageTimer timer(stats.stage);                        \
+  TRACE_SCOPE("threed." #stage)
+
+  template<class T> void trimBuffer(std::vector<T>& v, size_t peak)
+  {
+    const size_t keep = std::max(peak, size_t(SCENE_BUFFER_MIN));
+    if(v.capacity() > SCENE_BUFFER_SLACK*keep)
+      {
+        std::vector<T> smaller;
+        smaller.reserve(std::max(keep, v.size()));
+        smaller.assign(v.begin(), v.end());
+        v.swap(smaller);
+      }
+  }
+
+  // pens and brushes of solid colours, kept by RGBA so that drawing
+  // many fragments of a few colours does not make new ones for each
+  class ColorCache
+  {
+  public:
+    const QBrush& brush(QRgb rgba)
+    {
+      auto it = brushes.find(rgba);
+      if(it == brushes.end())
+        it = brushes.emplace(rgba, QBrush(QColor::fromRgba(rgba))).first;
+      return it->second;
+    }
+    const QPen& pen(QRgb rgba)
+    {
+      auto it = pens.find(rgba);
+      if(it == pens.end())
+        it = pens.emplace(rgba, QPen(QColor::fromRgba(rgba))).first;
+      return it->second;
+    }
+
+  private:
+    std::unordered_map<QRgb, QBrush> brushes;
+    std::unordered_map<QRgb, QPen> pens;
+  };
+
+  // Colour of a triangle which can be drawn in a batch with others of
+  // the same colour, or 0 if it should be drawn by itself. Only
+  // opaque triangles are batched, as overlapping translucent ones
+  // would look different drawn together.
+  QRgb batchTriangleRGBA(const Fragment& frag)
+  {
+    const SurfaceProp* p = frag.surfaceprop;
+    if(frag.type != Fragment::FR_TRIANGLE || p == 0 || p->hide || p->trans != 0)
+      return 0;
+    const QRgb rgba = frag.usecalccolor ? frag.calccolor :
+      p->color(frag.index).rgba();
+    return qAlpha(rgba) == 255 ? rgba : 0;
+  }
+
+  // the same for line segments (batches should also share lineprop)
+  QRgb batchLineRGBA(const Fragment& frag)
+  {
+    const LineProp* p = frag.lineprop;
+    if(frag.type != Fragment::FR_LINESEG || p == 0 || p->hide)
+      return 0;
+    const QRgb rgba = frag.usecalccolor ? frag.calccolor :
+      p->color(frag.index).rgba();
+    return qAlpha(rgba) == 255 ? rgba : 0;
+  }
 
   // This is a bit of a hack to avoid problems with the painter's
-  // algorithm. This idea is to just break up lines with a length over
-  // the maximum into pieces smaller than maxlen.
-  void breakLongLines(FragmentVector& fragments, double maxlen)
+  // algorithm. The idea is to break up a line with a length over the
+  // maximum into pieces smaller than maxlen, so that its pieces are
+  // sorted separately. Returns whether the line was split.
+  bool breakLongLine(FragmentVector& fragments, unsigned ifrag, double maxlen)
+  {
+    Fragment& f=fragments[ifrag];
+    const double len2 = (f.points[1]-f.points[0]).rad2();
+    if(!(len2 > maxlen*maxlen))
+      return false;
+
+    const int nbits = int(std::sqrt(len2)/maxlen)+1;
+    const Vec3 delta = (f.points[1]-f.points[0])*(1./nbits);
+
+    // set original to be first segment
+    f.points[1] = f.points[0]+delta;
+
+    // add nbits-1 copies for next segments
+    Fragment tempf(f);
+    for(int ic=1; ic<nbits; ++ic)
+      {
+        tempf.points[0] = tempf.points[1];
+        tempf.points[1] += delta;
+        fragments.push_back(tempf);
+      }
+    return true;
+  }
+
+  // projected bounding box and depth range of a fragment
+  struct ProjBounds
+  {
+    ProjBounds(const FragmentProjections& projs, unsigned i)
+      : minz(projs.minDepth(i)), maxz(projs.maxDepth(i))
+    {
+      minx = maxx = projs.x[0][i];
+      miny = maxy = projs.y[0][i];
+      for(unsigned p=1, np=projs.nvisible[i]; p<np; ++p)
+        {
+          minx = std::min(minx, double(projs.x[p][i]));
+          maxx = std::max(maxx, double(projs.x[p][i]));
+          miny = std::min(miny, double(projs.y[p][i]));
+          maxy = std::max(maxy, double(projs.y[p][i]));
+        }
+    }
+    bool isFinite() const
+    {
+      return std::isfinite(minx) && std::isfinite(maxx) &&
+        std::isfinite(miny) && std::isfinite(maxy) &&
+        std::isfinite(minz) && std::isfinite(maxz);
+    }
+    // do the boxes overlap in x and y, with depth ranges overlapping
+    // (where sorting by depth may put them in the wrong order)?
+    bool conflicts(const ProjBounds& o) const
+    {
+      return minx <= o.maxx && o.minx <= maxx &&
+        miny <= o.maxy && o.miny <= maxy &&
+        minz < o.maxz && o.minz < maxz;
+    }
+
+    double minx, maxx, miny, maxy, minz, maxz;
+  };
+
+  // Break up lines longer than maxlen (in 3D), which conflict with
+  // triangles in the painter's algorithm, as breakLongLine. Others
+  // are sorted correctly whole. Triangles are put in a grid of cells
+  // covering their projected bounding boxes, so each line is only
+  // compared with the triangles near it. Lines with non-finite
+  // projections are always broken. Returns whether any were.
+  bool breakConflictingLines(FragmentVector& fragments,
+                             const FragmentProjections& projs,
+                             double maxlen)
   {
-    const double maxlen2 = maxlen*maxlen;
-    const int size = fragments.size();
-    for(int ifrag=0; ifrag<size; ++ifrag)
+    std::vector<unsigned> lines, tris;
+    std::vector<ProjBounds> tribounds;
+    double minx=std::numeric_limits<double>::infinity(), miny=minx;
+    double maxx=-minx, maxy=-minx;
+    const unsigned nfrags = fragments.size();
+    for(unsigned i=0; i<nfrags; ++i)
       {
-        Fragment& f=fragments[ifrag];
+        const Fragment& f = fragments[i];
         if(f.type == Fragment::FR_LINESEG)
           {
-            const double len2 = (f.points[1]-f.points[0]).rad2();
-            if(len2 > maxlen2)
+            if((f.points[1]-f.points[0]).rad2() > maxlen*maxlen)
+              lines.push_back(i);
+          }
+        else if(f.type == Fragment::FR_TRIANGLE)
+          {
+            const ProjBounds b(projs, i);
+            if(b.isFinite())
               {
-                const int nbits = int(std::sqrt(len2/maxlen2))+1;
-                const Vec3 delta = (f.points[1]-f.points[0])*(1./nbits);
+                tris.push_back(i);
+                tribounds.push_back(b);
+                minx = std::min(minx, b.minx);
+                maxx = std::max(maxx, b.maxx);
+                miny = std::min(miny, b.miny);
+                maxy = std::max(maxy, b.maxy);
+              }
+          }
+      }
+    if(lines.empty())
+      return false;
+
+    // roughly a triangle for each cell, up to a maximum
+    const int ncells = tris.empty() ? 1 :
+      clip(int(std::sqrt(double(tris.size()))), 1, SCENE_SPLIT_GRID);
+    const double cellw = (maxx-minx)/ncells, cellh = (maxy-miny)/ncells;
+    auto cellx = [&](double x)
+      {
+        return cellw > 0 ? clip(int((x-minx)/cellw), 0, ncells-1) : 0;
+      };
+    auto celly = [&](double y)
+      {
+        return cellh > 0 ? clip(int((y-miny)/cellh), 0, ncells-1) : 0;
+      };
 
-                // set original to be first segment
-                f.points[1] = f.points[0]+delta;
+    std::vector< std::vector<unsigned> > grid(ncells*ncells);
+    for(unsigned t=0, nt=tris.size(); t<nt; ++t)
+      {
+        const ProjBounds& b = tribounds[t];
+        for(int cy=celly(b.miny), ey=celly(b.maxy); cy<=ey; ++cy)
+          for(int cx=cellx(b.minx), ex=cellx(b.maxx); cx<=ex; ++cx)
+            grid[cy*ncells+cx].push_back(t);
+      }
 
-                // add nbits-1 copies for next segments
-                Fragment tempf(f);
-                for(int ic=1; ic<nbits; ++ic)
-                  {
-                    tempf.points[0] = tempf.points[1];
-                    tempf.points[1] += delta;
-                    fragments.push_back(tempf);
-                  }
-              }
+    // which line each triangle was last compared with, so triangles
+    // in several cells are only compared once
+    std::vector<unsigned> lastline(tris.size(), unsigned(-1));
+
+    bool broken = false;
+    for(unsigned li=0, nl=lines.size(); li<nl; ++li)
+      {
+        const ProjBounds lb(projs, lines[li]);
+        bool conflict = !lb.isFinite();
+        if(!conflict && !tris.empty() &&
+           lb.maxx >= minx && lb.minx <= maxx &&
+           lb.maxy >= miny && lb.miny <= maxy)
+          {
+            for(int cy=celly(lb.miny), ey=celly(lb.maxy);
+                cy<=ey && !conflict; ++cy)
+              for(int cx=cellx(lb.minx), ex=cellx(lb.maxx);
+                  cx<=ex && !conflict; ++cx)
+                for(auto t : grid[cy*ncells+cx])
+                  if(lastline[t] != li)
+                    {
+                      lastline[t] = li;
+                      if(lb.conflicts(tribounds[t]))
+                        {
+                          conflict = true;
+                          break;
+                        }
+                    }
+          }
+        if(conflict)
+          broken |= breakLongLine(fragments, lines[li], maxlen);
+      }
+    return broken;
+  }
+
+  // This is a hack to force lines to be rendered in front of
+  // triangles and paths to be rendered in front of lines, moving
+  // them towards the viewer (the fragments should be in viewing
+  // coordinates). Suggestions to fix this are welcome.
+  void nudgeLinesForward(FragmentVector& frags)
+  {
+    for(auto& f : frags)
+      {
+        switch(f.type)
+          {
+          case Fragment::FR_LINESEG:
+            f.points[0](2) += LINE_DELTA_DEPTH;
+            f.points[1](2) += LINE_DELTA_DEPTH;
+            break;
+          case Fragment::FR_PATH:
+            f.points[0](2) += 2*LINE_DELTA_DEPTH;
+            f.points[1](2) += 2*LINE_DELTA_DEPTH;
+            break;
+          default:
+            break;
           }
       }
   }
@@ -186,7 +433,8 @@ QPen Scene::surfaceProp2QPen(const Fragment& frag) const
 
 void Scene::drawPath(QPainter* painter, const Fragment& frag,
                      QPointF pt1, QPointF pt2, QPointF pt3,
-                     double linescale, double distscale)
+                     double linescale, double distscale,
+                     PathSpriteCache* sprites)
 {
   FragmentPathParameters* pars =
     static_cast<FragmentPathParameters*>(frag.params);
@@ -203,6 +451,11 @@ void Scene::drawPath(QPainter* painter, const Fragment& frag,
       return;
     }
 
+  if(sprites != 0 &&
+     sprites->draw(painter, pars->path, scale, pars->scaleline, pt1,
+                   painter->pen(), painter->brush()))
+    return;
+
   if(pars->scaleline)
     {
       painter->save();
@@ -227,9 +480,17 @@ void Scene::drawPath(QPainter* painter, const Fragment& frag,
     }
 }
 
+// Runs of consecutive opaque triangles of the same colour are drawn
+// as a single path, and runs of opaque lines with the same pen by a
+// single drawLines. The triangles are made anticlockwise, so that
+// with the winding fill rule overlapping triangles are filled as if
+// drawn separately. Other fragments are drawn one by one.
+
 void Scene::doDrawing(QPainter* painter, const Mat3& screenM, double linescale,
-                      const Camera& cam, Scene::DrawCallback* callback)
+                      const Camera& cam)
 {
+  SCENE_STAGE(drawing);
+
   // draw fragments
   LineProp const* lline = 0;
   SurfaceProp const* lsurf = 0;
@@ -243,19 +504,89 @@ void Scene::doDrawing(QPainter* painter, const Mat3& screenM, double linescale,
   painter->setPen(no_pen);
   painter->setBrush(no_brush);
 
+  ColorCache colors;
+  PathSpriteCache sprites(painter);
   QPointF projpts[3];
+  QVector<QLineF> batchlines;
 
-  for(unsigned i=0, s=draworder.size(); i<s; ++i)
+  // convert projected points of fragment at draworder[i] to screen
+  auto toScreen = [&](unsigned i, const Fragment& frag)
     {
-      const Fragment& frag(fragments[draworder[i]]);
-
-      // convert projected points to screen
       for(unsigned pi=0, s=frag.nPointsTotal(); pi<s; ++pi)
         {
-          Vec2 p = projVecToScreen(screenM, frag.proj[pi]);
+          Vec2 p = projVecToScreen(screenM, projs.proj(draworder[i], pi));
           projpts[pi].setX(p(0));
           projpts[pi].setY(p(1));
         }
+    };
+
+  for(unsigned i=0, s=draworder.size(); i<s; )
+    {
+      const Fragment& frag(fragments[draworder[i]]);
+
+      // look for a run of fragments which can be drawn together
+      unsigned runend = i+1;
+      const QRgb trirgba = batchTriangleRGBA(frag);
+      const QRgb linergba = trirgba != 0 ? 0 : batchLineRGBA(frag);
+      if(trirgba != 0)
+        {
+          while(runend < s &&
+                batchTriangleRGBA(fragments[draworder[runend]]) == trirgba)
+            ++runend;
+        }
+      else if(linergba != 0)
+        {
+          while(runend < s &&
+                fragments[draworder[runend]].lineprop == frag.lineprop &&
+                batchLineRGBA(fragments[draworder[runend]]) == linergba)
+            ++runend;
+        }
+
+      if(runend-i > 1)
+        {
+          if(trirgba != 0)
+            {
+              QPainterPath path;
+              path.setFillRule(Qt::WindingFill);
+              for(unsigned j=i; j<runend; ++j)
+                {
+                  toScreen(j, fragments[draworder[j]]);
+                  const double cross =
+                    (projpts[1].x()-projpts[0].x())*(projpts[2].y()-projpts[0].y()) -
+                    (projpts[1].y()-projpts[0].y())*(projpts[2].x()-projpts[0].x());
+                  if(cross < 0)
+                    std::swap(projpts[1], projpts[2]);
+                  path.moveTo(projpts[0]);
+                  path.lineTo(projpts[1]);
+                  path.lineTo(projpts[2]);
+                  path.closeSubpath();
+                }
+              painter->setBrush(colors.brush(trirgba));
+              painter->setPen(colors.pen(trirgba));
+              painter->drawPath(path);
+            }
+          else
+            {
+              batchlines.resize(0);
+              for(unsigned j=i; j<runend; ++j)
+                {
+                  toScreen(j, fragments[draworder[j]]);
+                  batchlines.append(QLineF(projpts[0], projpts[1]));
+                }
+              painter->setBrush(no_brush);
+              painter->setPen(lineProp2QPen(frag, linescale));
+              painter->drawLines(batchlines);
+            }
+
+          // the pen and brush do not belong to a particular property
+          lline = 0;
+          lsurf = 0;
+          ltype = Fragment::FR_NONE;
+          i = runend;
+          continue;
+        }
+
+      toScreen(i, frag);
 
       switch(frag.type)
 	{
@@ -268,13 +599,14 @@ void Scene::doDrawing(QPainter* painter, const Mat3& screenM, double linescale,
                                           frag.usecalccolor)))
                 {
                   lsurf = frag.surfaceprop;
-                  painter->setBrush(surfaceProp2QBrush(frag));
+                  const QRgb rgba = surfaceProp2QColor(frag).rgba();
+                  painter->setBrush(colors.brush(rgba));
 
                   // use a pen if the surface is not transparent, to
                   // fill up the gaps between triangles when there is
                   // anti-aliasing
                   if(frag.surfaceprop->trans == 0)
-                    painter->setPen(surfaceProp2QPen(frag));
+                    painter->setPen(colors.pen(rgba));
                   else
                     painter->setPen(no_pen);
                 }
@@ -322,7 +654,8 @@ void Scene::doDrawing(QPainter* painter, const Mat3& screenM, double linescale,
               const double distinvratio = dist0 / frag.points[0].rad();
 
               drawPath(painter, frag, projpts[0], projpts[1], projpts[2],
-                       linescale, distinvratio);
+                       linescale, distinvratio,
+                       pathsprites ? &sprites : 0);
             }
 	  break;
 
@@ -330,62 +663,87 @@ void Scene::doDrawing(QPainter* painter, const Mat3& screenM, double linescale,
 	  break;
 	}
 
-      if(callback != 0)
-        callback->drawnFragment(frag);
-
       ltype = frag.type;
+      ++i;
     }
 }
 
-void Scene::calcLightingTriangle(Fragment& frag)
+// Triangles are lit in blocks. Their centres, normals, colours and
+// reflectivities are gathered into arrays, then each light is added
+// to the whole block in a loop without branches, which the compiler
+// can vectorize. The arithmetic is done in the same order as for a
+// single triangle, so the colours do not depend on the blocking.
+// Lights are added in single precision, so twice as many triangles
+// fit in each vector register, but the normals are found and
+// normalised in double precision first, as those of tiny triangles
+// would underflow.
+
+void Scene::calcLightingTriangles(const unsigned* idxs, unsigned n)
 {
-  // Calculate triangle norm. Make sure norm points towards
-  // the viewer @ (0,0,0)
-  Vec3 tripos = (frag.points[0] + frag.points[1] +
-                 frag.points[2]) * (1./3.);
-  Vec3 norm = cross(frag.points[1] - frag.points[0],
-                    frag.points[2] - frag.points[0]);
-  if(dot(tripos, norm)<0)
-    norm = -norm;
-  norm.normalise();
-
-  // get color of surface
-  const SurfaceProp* prop = frag.surfaceprop;
-  if(prop->refl==0.)
-    return;
-
-  double r, g, b, a;
-  if(prop->hasRGBs())
+  float cx[SCENE_LIGHT_BLOCK], cy[SCENE_LIGHT_BLOCK], cz[SCENE_LIGHT_BLOCK];
+  float nx[SCENE_LIGHT_BLOCK], ny[SCENE_LIGHT_BLOCK], nz[SCENE_LIGHT_BLOCK];
+  float cr[SCENE_LIGHT_BLOCK], cg[SCENE_LIGHT_BLOCK], cb[SCENE_LIGHT_BLOCK];
+  float ca[SCENE_LIGHT_BLOCK], refl[SCENE_LIGHT_BLOCK];
+
+  // gather positions, norms (pointing towards the viewer at the
+  // origin) and colours
+  for(unsigned k=0; k<n; ++k)
     {
-      QRgb rgb = prop->
-        rgbs[std::min(frag.index, unsigned(prop->rgbs.size())-1)];
-      r=qRed(rgb)*(1./255.); g=qGreen(rgb)*(1./255.);
-      b=qBlue(rgb)*(1./255.); a=qAlpha(rgb)*(1./255.);
-    }
-  else
-    {
-      r=prop->r; g=prop->g; b=prop->b; a=1-prop->trans;
+      const Fragment& frag = fragments[idxs[k]];
+      const Vec3 tripos = (frag.points[0] + frag.points[1] +
+                           frag.points[2]) * (1./3.);
+      Vec3 norm = cross(frag.points[1] - frag.points[0],
+                        frag.points[2] - frag.points[0]);
+      if(dot(tripos, norm) < 0)
+        norm = -norm;
+      norm.normalise();
+      const Vec3f tripf(tripos), normf(norm);
+      cx[k] = tripf(0); cy[k] = tripf(1); cz[k] = tripf(2);
+      nx[k] = normf(0); ny[k] = normf(1); nz[k] = normf(2);
+
+      const SurfaceProp* prop = frag.surfaceprop;
+      refl[k] = prop->refl;
+      if(prop->hasRGBs())
+        {
+          QRgb rgb = prop->
+            rgbs[std::min(frag.index, unsigned(prop->rgbs.size())-1)];
+          cr[k]=qRed(rgb)*(1.f/255.f); cg[k]=qGreen(rgb)*(1.f/255.f);
+          cb[k]=qBlue(rgb)*(1.f/255.f); ca[k]=qAlpha(rgb)*(1.f/255.f);
+        }
+      else
+        {
+          cr[k]=prop->r; cg[k]=prop->g; cb[k]=prop->b; ca[k]=1-prop->trans;
+        }
     }
 
   // add lighting contributions
   for(auto const& light : lights)
     {
-      // Now dot vector from light source to triangle with norm
-      Vec3 light2tri = tripos-light.posn;
-      light2tri.normalise();
-
-      // add new lighting index
-      double dotprod = std::max(0., dot(light2tri, norm));
-
-      double delta = prop->refl * dotprod;
-      r += delta*light.r; g += delta*light.g; b += delta*light.b;
+      const Vec3f lposn(light.posn);
+      const float lx = lposn(0), ly = lposn(1), lz = lposn(2);
+      const float lr = light.r, lg = light.g, lb = light.b;
+      for(unsigned k=0; k<n; ++k)
+        {
+          // dot vector from light source to triangle with norm
+          float dx = cx[k]-lx, dy = cy[k]-ly, dz = cz[k]-lz;
+          const float inv = 1/std::sqrt(dx*dx+dy*dy+dz*dz);
+          dx *= inv; dy *= inv; dz *= inv;
+          const float dotprod = std::max(0.f, dx*nx[k]+dy*ny[k]+dz*nz[k]);
+
+          const float delta = refl[k] * dotprod;
+          cr[k] += delta*lr; cg[k] += delta*lg; cb[k] += delta*lb;
+        }
     }
 
-  frag.calccolor = qRgba( clip(int(r*255), 0, 255),
-                          clip(int(g*255), 0, 255),
-                          clip(int(b*255), 0, 255),
-                          clip(int(a*255), 0, 255) );
-  frag.usecalccolor = 1;
+  for(unsigned k=0; k<n; ++k)
+    {
+      Fragment& frag = fragments[idxs[k]];
+      frag.calccolor = qRgba( clip(int(cr[k]*255), 0, 255),
+                              clip(int(cg[k]*255), 0, 255),
+                              clip(int(cb[k]*255), 0, 255),
+                              clip(int(ca[k]*255), 0, 255) );
+      frag.usecalccolor = 1;
+    }
 }
 
 void Scene::calcLightingLine(Fragment& frag)
@@ -435,40 +793,169 @@ void Scene::calcLighting()
   if(lights.empty())
     return;
 
-  for(auto &frag : fragments)
+  SCENE_STAGE(lighting);
+
+  // fragments are lit in ranges on several threads
+  const unsigned nfrags = fragments.size();
+  const unsigned ntasks = (nfrags+SCENE_LIGHT_TASK-1) / SCENE_LIGHT_TASK;
+  parallelFor(ntasks, parallelNumThreads(nthreads),
+              [&](unsigned task)
+              {
+                const unsigned end =
+                  std::min(nfrags, (task+1)*SCENE_LIGHT_TASK);
+                unsigned idxs[SCENE_LIGHT_BLOCK];
+                unsigned n = 0;
+                for(unsigned i=task*SCENE_LIGHT_TASK; i<end; ++i)
+                  {
+                    Fragment& frag = fragments[i];
+                    switch(frag.type)
+                      {
+                      case Fragment::FR_TRIANGLE:
+                        if(frag.surfaceprop != 0 &&
+                           frag.surfaceprop->refl != 0.)
+                          {
+                            idxs[n++] = i;
+                            if(n == SCENE_LIGHT_BLOCK)
+                              {
+                                calcLightingTriangles(idxs, n);
+                                n = 0;
+                              }
+                          }
+                        break;
+                      case Fragment::FR_LINESEG:
+                        if(frag.lineprop != 0)
+                          calcLightingLine(frag);
+                        break;
+                      default:
+                        break;
+                      }
+                  }
+                calcLightingTriangles(idxs, n);
+              });
+}
+
+void Scene::projectFragments(const Camera& cam)
+{
+  // convert 3d to 2d coordinates using the Camera
+  SCENE_STAGE(projection);
+  projs.project(cam.perspM, fragments);
+}
+
+void Scene::setCullView(const Camera& cam,
+                        double x1, double y1, double x2, double y2,
+                        double scale)
+{
+  cullperspM = cam.perspM;
+  if(scale > 0)
     {
-      switch(frag.type)
+      // see makeScreenMFixed
+      const double scaling =
+        std::abs(0.5*std::min(x2-x1, y2-y1)*scale);
+      cullmargscale = scaling > 0 ? 1/scaling : 0;
+      cullhalfx = 0.5*std::abs(x2-x1)*cullmargscale;
+      cullhalfy = 0.5*std::abs(y2-y1)*cullmargscale;
+    }
+  else
+    cullhalfx = cullhalfy = cullmargscale = 0;
+}
+
+// Fragments are checked in homogeneous (clip) coordinates, where the
+// view is a set of half spaces. A fragment is off screen if all its
+// points are outside the same one, including being behind the
+// viewer. Paths are never culled, as they extend an unknown distance
+// from their points. Back facing triangles are only culled if opaque,
+// as otherwise they can be seen through the front.
+
+bool Scene::isCulled(const Fragment& frag, bool backfaces) const
+{
+  if(frag.object == 0 || frag.object->cull == Object::CULL_NONE)
+    return false;
+
+  const unsigned cull = frag.object->cull;
+  double margin;
+  switch(frag.type)
+    {
+    case Fragment::FR_TRIANGLE:
+      if(backfaces && (cull & Object::CULL_BACKFACES) &&
+         frag.surfaceprop != 0 && !frag.surfaceprop->hide &&
+         frag.surfaceprop->trans == 0 &&
+         qAlpha(frag.surfaceprop->color(frag.index).rgba()) == 255)
         {
-        case Fragment::FR_TRIANGLE:
-          if(frag.surfaceprop != 0)
-            calcLightingTriangle(frag);
-          break;
-        case Fragment::FR_LINESEG:
-          if(frag.lineprop != 0)
-            calcLightingLine(frag);
-          break;
-        default:
-          break;
+          // the viewer is at the origin
+          const Vec3 norm = cross(frag.points[1]-frag.points[0],
+                                  frag.points[2]-frag.points[0]);
+          if(dot(norm, frag.points[0]) >= 0)
+            return true;
         }
+      // allow for the pen drawn around triangles
+      margin = preplinescale;
+      break;
+    case Fragment::FR_LINESEG:
+      margin = frag.lineprop != 0 ? frag.lineprop->width*preplinescale : 0;
+      break;
+    default:
+      return false;
+    }
+
+  if(!(cull & Object::CULL_OFFSCREEN) || cullhalfx <= 0)
+    return false;
+
+  const double hx = cullhalfx + margin*cullmargscale;
+  const double hy = cullhalfy + margin*cullmargscale;
+  unsigned outside = ~0u;
+  for(unsigned p=0, np=frag.nPointsVisible(); p<np; ++p)
+    {
+      const Vec4 c(cullperspM*vec3to4(frag.points[p]));
+      outside &=
+        unsigned(c(0) > hx*c(3)) | (unsigned(c(0) < -hx*c(3)) << 1) |
+        (unsigned(c(1) > hy*c(3)) << 2) | (unsigned(c(1) < -hy*c(3)) << 3) |
+        (unsigned(c(3) <= 0) << 4);
     }
+  return outside != 0;
 }
 
-void Scene::projectFragments(const Camera& cam)
+void Scene::cullFragments(FragmentVector& frags, bool backfaces)
 {
-  // convert 3d to 2d coordinates using the Camera
-  for(auto& f : fragments)
-    for(unsigned pi=0, np=f.nPointsTotal(); pi<np; ++pi)
-      f.proj[pi] = calcProjVec(cam.perspM, f.points[pi]);
+  SCENE_STAGE(culling);
+  unsigned ct = 0;
+  for(unsigned i=0, s=frags.size(); i<s; ++i)
+    if(!isCulled(frags[i], backfaces))
+      {
+        if(ct != i)
+          frags[ct] = frags[i];
+        ++ct;
+      }
+  stats.nculled += frags.size() - ct;
+  frags.resize(ct);
+}
+
+void Scene::cullDrawOrder(bool backfaces)
+{
+  SCENE_STAGE(culling);
+  unsigned ct = 0;
+  for(auto idx : draworder)
+    if(!isCulled(fragments[idx], backfaces))
+      draworder[ct++] = idx;
+  stats.nculled += draworder.size() - ct;
+  draworder.resize(ct);
 }
 
 void Scene::renderPainters(const Camera& cam)
 {
   calcLighting();
-
-  breakLongLines(fragments, 0.25);
   projectFragments(cam);
 
+  // the pieces of any lines broken up need projecting
+  bool broken;
+  {
+    SCENE_STAGE(splitting);
+    broken = breakConflictingLines(fragments, projs, 0.25);
+  }
+  if(broken)
+    projectFragments(cam);
+
   // simple painter's algorithm
+  SCENE_STAGE(ordering);
   draworder.reserve(fragments.size());
   for(unsigned i=0; i<fragments.size(); ++i)
     draworder.push_back(i);
@@ -476,7 +963,7 @@ void Scene::renderPainters(const Camera& cam)
   std::sort(draworder.begin(), draworder.end(),
             [this](unsigned i, unsigned j)
             {
-              return fragments[i].maxDepth() > fragments[j].maxDepth();
+              return projs.maxDepth(i) > projs.maxDepth(j);
             }
             );
 }
@@ -487,31 +974,316 @@ void Scene::renderBSP(const Camera& cam)
 
   //std::cout << "\nFragment size 1 " << fragments.size() << '\n';
 
-  // This is a hack to force lines to be rendered in front of
-  // triangles and paths to be rendered in front of lines. Suggestions
-  // to fix this are welcome.
-  for(auto& f : fragments)
+  nudgeLinesForward(fragments);
+
+  {
+    SCENE_STAGE(ordering);
+    bsp.build(fragments, Vec3(0,0,1), parallelNumThreads(nthreads), &bspws);
+    if(cancelled())
+      return;
+    bsp.getFragmentIdxs(fragments, draworder, &bspws);
+  }
+
+  //std::cout << "BSP recs size " << bsp.bsp_recs.size() << '\n';
+  //std::cout << "Fragment size 2 " << fragments.size() << '\n';
+
+  projectFragments(cam);
+}
+
+void Scene::renderZBuffer(const Camera& cam)
+{
+  calcLighting();
+  projectFragments(cam);
+
+  // triangles and lines are rasterised, but paths are drawn from back
+  // to front afterwards
+  SCENE_STAGE(ordering);
+  for(unsigned i=0; i<fragments.size(); ++i)
+    if(fragments[i].type == Fragment::FR_PATH)
+      draworder.push_back(i);
+
+  std::sort(draworder.begin(), draworder.end(),
+            [this](unsigned i, unsigned j)
+            {
+              return projs.maxDepth(i) > projs.maxDepth(j);
+            }
+            );
+}
+
+void Scene::drawZBuffer(QPainter* painter, const Mat3& screenM,
+                        double linescale,
+                        double x1, double y1, double x2, double y2)
+{
+  const QRectF rect(QPointF(std::min(x1, x2), std::min(y1, y2)),
+                    QPointF(std::max(x1, x2), std::max(y1, y2)));
+  if(!(rect.width() > 0 && rect.height() > 0))
+    return;
+
+  SCENE_STAGE(raster);
+
+  // rasterise at the resolution of the output device
+  double devscale =
+    std::sqrt(std::abs(painter->combinedTransform().determinant()));
+  if(!(devscale > 0) || !std::isfinite(devscale))
+    devscale = 1;
+  devscale = std::min(devscale, ZBUFFER_MAX_SIZE /
+                      std::max(rect.width(), rect.height()));
+  const int pixw = std::max(int(std::ceil(rect.width()*devscale)), 1);
+  const int pixh = std::max(int(std::ceil(rect.height()*devscale)), 1);
+  const double sx = pixw / rect.width();
+  const double sy = pixh / rect.height();
+
+  ZBuffer zbuf(pixw, pixh,
+               painter->testRenderHint(QPainter::Antialiasing) ?
+               ZBUFFER_ANTIALIAS_SAMPLES : 1);
+
+  // pixels relative to the rectangle
+  Mat3 pixM = identityM3();
+  pixM(0,0) = sx;
+  pixM(1,1) = sy;
+  pixM = pixM * translateM3(-rect.left(), -rect.top()) * screenM;
+
+  double mindepth, linebias;
+  zbufferDepths(mindepth, linebias);
+  fillZBuffer(zbuf, pixM, 0.5*(sx+sy), linescale, mindepth, linebias);
+
+  zbuf.render(parallelNumThreads(nthreads));
+  painter->drawImage(rect, zbuf.image());
+
+  // keep paths whose anchor is not hidden
+  unsigned ct = 0;
+  for(auto idx : draworder)
+    {
+      const Vec2 pt = projVecToScreen(pixM, projs.proj(idx, 0));
+      if(zbuf.visible(pt(0), pt(1), projs.z[0][idx]-mindepth-2*linebias))
+        draworder[ct++] = idx;
+    }
+  draworder.resize(ct);
+}
+
+void Scene::zbufferDepths(double& mindepth, double& linebias) const
+{
+  // depths are kept relative to the nearest point for precision
+  mindepth = std::numeric_limits<double>::infinity();
+  double maxdepth = -mindepth;
+  for(unsigned i=0, s=fragments.size(); i<s; ++i)
     {
-      switch(f.type)
+      const double d1 = projs.minDepth(i);
+      const double d2 = projs.maxDepth(i);
+      if(std::isfinite(d1) && std::isfinite(d2))
         {
-        case Fragment::FR_LINESEG:
-          f.points[0](2) += LINE_DELTA_DEPTH;
-          f.points[1](2) += LINE_DELTA_DEPTH;
+          mindepth = std::min(mindepth, d1);
+          maxdepth = std::max(maxdepth, d2);
+        }
+    }
+  if(!std::isfinite(mindepth))
+    mindepth = 0;
+  linebias = maxdepth>mindepth ? (maxdepth-mindepth)*ZBUFFER_LINE_BIAS : 0;
+}
+
+void Scene::fillZBuffer(ZBuffer& zbuf, const Mat3& pixM, double pixscale,
+                        double linescale,
+                        double mindepth, double linebias) const
+{
+  // pixel coordinates of point
+  auto topix = [&](unsigned idx, unsigned p, double bias)
+    {
+      const Vec3 proj = projs.proj(idx, p);
+      const Vec2 pix = projVecToScreen(pixM, proj);
+      return Vec3(pix(0), pix(1), proj(2)-mindepth-bias);
+    };
+
+  for(unsigned i=0, s=fragments.size(); i<s; ++i)
+    {
+      const Fragment& frag(fragments[i]);
+      switch(frag.type)
+        {
+        case Fragment::FR_TRIANGLE:
+          if(frag.surfaceprop != 0 && !frag.surfaceprop->hide)
+            zbuf.addTriangle(topix(i, 0, 0), topix(i, 1, 0), topix(i, 2, 0),
+                             surfaceProp2QColor(frag).rgba(), i);
           break;
-        case Fragment::FR_PATH:
-          f.points[0](2) += 2*LINE_DELTA_DEPTH;
-          f.points[1](2) += 2*LINE_DELTA_DEPTH;
+
+        case Fragment::FR_LINESEG:
+          if(frag.lineprop != 0 && !frag.lineprop->hide)
+            {
+              const QPen pen(lineProp2QPen(frag, linescale));
+              if(pen.style() != Qt::NoPen)
+                zbuf.addLine(topix(i, 0, linebias), topix(i, 1, linebias),
+                             pen.widthF()*pixscale, pen.color().rgba(),
+                             pen.style()==Qt::SolidLine ?
+                             QVector<qreal>() : pen.dashPattern(), i);
+            }
           break;
+
         default:
           break;
         }
     }
+}
 
-  BSPBuilder bsp(fragments, Vec3(0,0,1));
-  draworder = bsp.getFragmentIdxs(fragments);
+void Scene::setRetained(bool r)
+{
+  retain = r;
+  if(!r)
+    {
+      retainsrc.clear();
+      retainids.clear();
+      retainfrags.clear();
+      retainbsp = BSPBuilder();
+    }
+}
 
-  //std::cout << "BSP recs size " << bsp.bsp_recs.size() << '\n';
-  //std::cout << "Fragment size 2 " << fragments.size() << '\n';
+// are the fragments the same as those the retained tree was built from?
+bool Scene::retainedMatches(const FragmentVector& srcfrags) const
+{
+  if(srcfrags.size() != retainsrc.size())
+    return false;
+
+  for(unsigned i=0, s=srcfrags.size(); i<s; ++i)
+    {
+      const Fragment& a = srcfrags[i];
+      const Fragment& b = retainsrc[i];
+      if(a.type != b.type ||
+         (a.object != 0 ? a.object->widgetid : 0) != retainids[i])
+        return false;
+      for(unsigned p=0, np=a.nPointsTotal(); p<np; ++p)
+        if(a.points[p] != b.points[p])
+          return false;
+    }
+  return true;
+}
+
+// The fragments of view independent objects are made in the
+// coordinates of the children of the root, so they don't change if
+// the root is rotated or the camera moves. If they are unchanged, the
+// old tree of their triangles is reused, only taking the properties
+// (which may have been recreated) from the new fragments. Lines and
+// paths are moved towards the viewer as in renderBSP, which depends
+// on the view, so they are added to a copy of the tree on each
+// render, along with the fragments of view dependent objects. The
+// tree is walked using the position of the eye in the root
+// coordinates.
+
+void Scene::renderBSPRetained(ObjectContainer* root, const Camera& cam)
+{
+  const Mat4 toviewM(cam.viewM*root->objM);
+  const Mat4 fromviewM(invertAffineM4(toviewM));
+  // the viewer is at the origin
+  const Vec3 eye(vec4to3(fromviewM*Vec4(0,0,0,1)));
+
+  FragmentVector& srcfrags = newsrcfrags;
+  srcfrags.resize(0);
+  srcfrags.reserve(retainsrc.size());
+  // the fragments are in the root coordinates, but the detail
+  // drawn depends on their size in the view
+  const Mat4 identM(identityM4());
+  {
+    SCENE_STAGE(fragments);
+    for(auto object : root->objects)
+      {
+        object->setLODViewM(toviewM);
+        object->getSelectedFragments(cam.perspM, identM, srcfrags, false);
+        object->setLODViewM(identM);
+      }
+  }
+
+  if(!retainedMatches(srcfrags))
+    {
+      SCENE_STAGE(ordering);
+      retainids.resize(srcfrags.size());
+      for(unsigned i=0, s=srcfrags.size(); i<s; ++i)
+        retainids[i] = srcfrags[i].object != 0 ?
+          srcfrags[i].object->widgetid : 0;
+
+      retainfrags.resize(0);
+      for(unsigned i=0, s=srcfrags.size(); i<s; ++i)
+        if(srcfrags[i].type == Fragment::FR_TRIANGLE)
+          {
+            retainfrags.push_back(srcfrags[i]);
+            retainfrags.back().srcidx = i;
+          }
+      retainbsp.build(retainfrags, eye, parallelNumThreads(nthreads), &bspws);
+      if(cancelled())
+        {
+          // the tree is incomplete, so should not be reused
+          retainsrc.clear();
+          retainids.clear();
+          return;
+        }
+    }
+  retainsrc.swap(srcfrags);
+
+  // split fragments, with properties from the new fragments
+  fragments.reserve(retainfrags.size());
+  for(auto const& rf : retainfrags)
+    {
+      Fragment f(retainsrc[rf.srcidx]);
+      for(unsigned p=0; p<3; ++p)
+        f.points[p] = rf.points[p];
+      f.srcidx = rf.srcidx;
+      fragments.push_back(f);
+    }
+
+  // the lines and paths of the view independent objects, and the
+  // fragments of view dependent objects, in viewing coordinates
+  dynfrags.resize(0);
+  for(auto const& f : retainsrc)
+    if(f.type == Fragment::FR_LINESEG || f.type == Fragment::FR_PATH)
+      {
+        dynfrags.push_back(f);
+        Fragment& df = dynfrags.back();
+        for(unsigned p=0, np=df.nPointsTotal(); p<np; ++p)
+          df.points[p] = vec4to3(toviewM*vec3to4(df.points[p]));
+      }
+  const unsigned nlines = dynfrags.size();
+  {
+    SCENE_STAGE(fragments);
+    for(auto object : root->objects)
+      object->getSelectedFragments(cam.perspM, toviewM, dynfrags, true);
+  }
+  stats.nfragments = retainsrc.size() + (dynfrags.size()-nlines);
+  cullFragments(dynfrags, true);
+  nudgeLinesForward(dynfrags);
+
+  // add them to the tree, in the root coordinates
+  const BSPBuilder* treebsp = &retainbsp;
+  if(!dynfrags.empty())
+    {
+      dynidxs.resize(0);
+      dynidxs.reserve(dynfrags.size());
+      for(auto& f : dynfrags)
+        {
+          for(unsigned p=0, np=f.nPointsTotal(); p<np; ++p)
+            f.points[p] = vec4to3(fromviewM*vec3to4(f.points[p]));
+          dynidxs.push_back(fragments.size());
+          fragments.push_back(f);
+        }
+
+      SCENE_STAGE(ordering);
+      dynbsp = retainbsp;
+      dynbsp.insertFragments(fragments, dynidxs, eye, &bspws);
+      treebsp = &dynbsp;
+    }
+  if(cancelled())
+    return;
+
+  // everything now goes into viewing coordinates
+  for(auto& f : fragments)
+    for(unsigned p=0, np=f.nPointsTotal(); p<np; ++p)
+      f.points[p] = vec4to3(toviewM*vec3to4(f.points[p]));
+
+  calcLighting();
+
+  {
+    SCENE_STAGE(ordering);
+    treebsp->getFragmentIdxs(fragments, eye, draworder, &bspws);
+  }
+
+  // The tree does not depend on the view, so its fragments can only
+  // be culled from the drawing. Split triangles may not keep their
+  // winding, so back faces are not culled.
+  cullDrawOrder(false);
 
   projectFragments(cam);
 }
@@ -521,103 +1293,271 @@ void Scene::render(Object* root,
                    double x1, double y1, double x2, double y2,
                    double scale)
 {
-  render_internal(root, painter, cam, x1, y1, x2, y2, scale);
+  if(prepare(root, cam, x1, y1, x2, y2, scale))
+    drawPrepared(painter);
 }
 
-Scene::DrawCallback::~DrawCallback()
+void Scene::setCancelFlag(const std::atomic<bool>* flag)
 {
+  cancelflag = flag;
+  bspws.cancel = flag;
 }
 
-unsigned long long Scene::idPixel(Object* root,
-                                  QPainter* painter,
-                                  const Camera& cam,
-                                  double x1, double y1, double x2, double y2,
-                                  double scale,
-                                  double scaling, int x, int y)
+void Scene::pickFragments(ZBuffer& zbuf, Object* root, QPainter* painter,
+                          const Camera& cam,
+                          double x1, double y1, double x2, double y2,
+                          double scale,
+                          double scaling, const QRect& pixrect)
 {
-  constexpr int box = 3;
+  fragments.resize(0);
+  draworder.resize(0);
+  stats = RenderStats();
 
-  // class to keep a small pixmap of the image and keep looking for
-  // changes
-  class IdDrawCallback : public Scene::DrawCallback
-  {
-  public:
-    IdDrawCallback()
-      : lastwidgetid(0),
-        pixrender(2*box+1,2*box+1)
-    {
-      pixrender.fill(QColor(254,254,254));
-      lastimage = pixrender.toImage();
-    }
+  // picking does not need drawing order or lighting
+  root->getFragments(cam.perspM, cam.viewM, fragments);
+  projectFragments(cam);
+
+  screenM = scale<=0 ?
+    makeScreenM(projs, x1, y1, x2, y2) :
+    makeScreenMFixed(x1, y1, x2, y2, scale);
+  const double linescale = std::max(std::abs(x2-x1), std::abs(y2-y1)) *
+    (1./1000);
+
+  // pixels are screen coordinates scaled, relative to the rectangle
+  const Mat3 pixM = translateM3(-pixrect.left(), -pixrect.top()) *
+    scaleM3(scaling) * screenM;
 
-    void drawnFragment(const Fragment& frag)
+  double mindepth, linebias;
+  zbufferDepths(mindepth, linebias);
+  fillZBuffer(zbuf, pixM, scaling, linescale, mindepth, linebias);
+  zbuf.renderIds(parallelNumThreads(nthreads));
+
+  // Paths are drawn individually to find the pixels they cover. For
+  // speed, paths without callbacks are skipped if they are outside
+  // the rectangle.
+  const double dist0 = vec4to3(cam.viewM*Vec4(0,0,0)).rad();
+  const QRectF pixrectf(0, 0, pixrect.width(), pixrect.height());
+  QImage img(pixrect.width(), pixrect.height(),
+             QImage::Format_ARGB32_Premultiplied);
+  QPointF projpts[3];
+
+  for(unsigned i=0, s=fragments.size(); i<s; ++i)
     {
-      // has the image changed since the last time?
-      QImage image = pixrender.toImage();
+      const Fragment& frag(fragments[i]);
+      if(frag.type != Fragment::FR_PATH)
+        continue;
 
-      // Should only be a relatively small number of
-      // comparisons. Alternatively, it could use a checksum.
-      if(image != lastimage)
+      for(unsigned pi=0; pi<3; ++pi)
         {
-          if(frag.object != 0)
-            lastwidgetid = frag.object->widgetid;
-          lastimage = image;
+          Vec2 p = projVecToScreen(screenM, projs.proj(i, pi));
+          projpts[pi].setX(p(0));
+          projpts[pi].setY(p(1));
+        }
+      const double distinvratio = dist0 / frag.points[0].rad();
+
+      const FragmentPathParameters* pars =
+        static_cast<const FragmentPathParameters*>(frag.params);
+      if(!pars->runcallback)
+        {
+          double pathscale = frag.pathsize*linescale;
+          if(pars->scalepersp)
+            pathscale *= distinvratio;
+          double margin = frag.lineprop==0 ? 0 :
+            frag.lineprop->width*linescale*(pars->scaleline ? pathscale : 1);
+          margin += 1/scaling;
+
+          const QRectF bounds = pars->path->boundingRect();
+          const QRectF devbounds
+            ((projpts[0].x() + bounds.left()*pathscale - margin)*scaling -
+             pixrect.left(),
+             (projpts[0].y() + bounds.top()*pathscale - margin)*scaling -
+             pixrect.top(),
+             (bounds.width()*pathscale + 2*margin)*scaling,
+             (bounds.height()*pathscale + 2*margin)*scaling);
+          if(!devbounds.intersects(pixrectf))
+            continue;
+        }
+
+      img.fill(0);
+      painter->begin(&img);
+      painter->scale(scaling, scaling);
+      painter->setWindow(pixrect);
+      painter->setPen(lineProp2QPen(frag, linescale));
+      painter->setBrush(surfaceProp2QBrush(frag));
+      drawPath(painter, frag, projpts[0], projpts[1], projpts[2],
+               linescale, distinvratio);
+      painter->end();
+
+      const double depth = projs.z[0][i] - mindepth - 2*linebias;
+      for(int y=0; y<img.height(); ++y)
+        {
+          const QRgb* row = reinterpret_cast<const QRgb*>(img.constScanLine(y));
+          for(int x=0; x<img.width(); ++x)
+            if(qAlpha(row[x]) != 0)
+              zbuf.plotId(x, y, depth, i);
         }
     }
+}
 
-    unsigned long long lastwidgetid;
-    QPixmap pixrender;
-    QImage lastimage;
-  };
+unsigned long long Scene::idPixel(Object* root,
+                                  QPainter* painter,
+                                  const Camera& cam,
+                                  double x1, double y1, double x2, double y2,
+                                  double scale,
+                                  double scaling, int x, int y)
+{
+  // look in a small box around the pixel
+  constexpr int box = 3;
+  const QRect pixrect(x-box, y-box, 2*box+1, 2*box+1);
 
-  IdDrawCallback callback;
+  ZBuffer zbuf(pixrect.width(), pixrect.height());
+  pickFragments(zbuf, root, painter, cam, x1, y1, x2, y2, scale,
+                scaling, pixrect);
 
-  painter->begin(&callback.pixrender);
-  painter->scale(scaling, scaling);
-  painter->setWindow(x-box, y-box, box*2+1, box*2+1);
-  render_internal(root, painter, cam, x1, y1, x2, y2, scale, &callback);
-  painter->end();
+  // take the fragment drawn nearest the centre
+  unsigned fragidx = ZBUFFER_NO_ID;
+  int bestdist2 = std::numeric_limits<int>::max();
+  for(int py=0; py<pixrect.height(); ++py)
+    for(int px=0; px<pixrect.width(); ++px)
+      {
+        const int dist2 = (px-box)*(px-box) + (py-box)*(py-box);
+        const unsigned idx = zbuf.id(px, py);
+        if(idx != ZBUFFER_NO_ID && dist2 < bestdist2)
+          {
+            fragidx = idx;
+            bestdist2 = dist2;
+          }
+      }
 
-  return callback.lastwidgetid;
+  if(fragidx == ZBUFFER_NO_ID || fragments[fragidx].object == 0)
+    return 0;
+  return fragments[fragidx].object->widgetid;
 }
 
-void Scene::render_internal(Object* root,
-                            QPainter* painter, const Camera& cam,
-                            double x1, double y1, double x2, double y2,
-                            double scale,
-                            Scene::DrawCallback* callback)
+bool Scene::prepare(Object* root, const Camera& cam,
+                    double x1, double y1, double x2, double y2,
+                    double scale)
 {
-  fragments.reserve(init_fragments_size);
+  TRACE_SCOPE("threed.prepare");
+  prepared = false;
   fragments.resize(0);
   draworder.resize(0);
+  stats = RenderStats();
+  preplinescale = std::max(std::abs(x2-x1), std::abs(y2-y1)) * (1./1000);
+  setCullView(cam, x1, y1, x2, y2, scale);
+
+  // the retained tree is kept in the coordinates of the root's
+  // children, so the root should only transform them
+  ObjectContainer* rootcont = dynamic_cast<ObjectContainer*>(root);
+  if(mode == RENDER_BSP && retain && rootcont != 0 &&
+     dynamic_cast<FacingContainer*>(root) == 0 &&
+     dynamic_cast<ClipContainer*>(root) == 0)
+    {
+      renderBSPRetained(rootcont, cam);
+    }
+  else
+    {
+      // get fragments for whole scene
+      {
+        SCENE_STAGE(fragments);
+        root->getFragments(cam.perspM, cam.viewM, fragments);
+      }
+      stats.nfragments = fragments.size();
+      cullFragments(fragments, true);
 
-  // get fragments for whole scene
-  root->getFragments(cam.perspM, cam.viewM, fragments);
+      if(!cancelled())
+        switch(mode)
+          {
+          case RENDER_BSP:
+            renderBSP(cam);
+            break;
+          case RENDER_PAINTERS:
+            renderPainters(cam);
+            break;
+          case RENDER_ZBUFFER:
+            renderZBuffer(cam);
+            break;
+          default:
+            break;
+          }
+    }
 
-  switch(mode)
+  if(cancelled())
     {
-    case RENDER_BSP:
-      renderBSP(cam);
-      break;
-    case RENDER_PAINTERS:
-      renderPainters(cam);
-      break;
-    default:
-      break;
+      fragments.resize(0);
+      draworder.resize(0);
+      return false;
     }
 
   // how to transform projected points to screen (screenM is member)
   screenM = scale<=0 ?
-    makeScreenM(fragments, x1, y1, x2, y2) :
+    makeScreenM(projs, x1, y1, x2, y2) :
     makeScreenMFixed(x1, y1, x2, y2, scale);
 
-  double linescale = std::max(std::abs(x2-x1), std::abs(y2-y1)) * (1./1000);
+  stats.nsplit = fragments.size();
+  TRACE_COUNT("threed.nfragments", stats.nfragments);
+  TRACE_COUNT("threed.nculled", stats.nculled);
+  TRACE_COUNT("threed.nsplit", stats.nsplit);
+
+  prepcam = cam;
+  prepx1 = x1; prepy1 = y1; prepx2 = x2; prepy2 = y2;
+  prepared = true;
+  return true;
+}
+
+void Scene::drawPrepared(QPainter* painter)
+{
+  if(!prepared)
+    return;
+  TRACE_SCOPE("threed.drawPrepared");
+
+  // rasterise triangles and lines, leaving the paths to draw
+  if(mode == RENDER_ZBUFFER)
+    drawZBuffer(painter, screenM, preplinescale,
+                prepx1, prepy1, prepx2, prepy2);
+  stats.ndrawn = draworder.size();
+  TRACE_COUNT("threed.ndrawn", stats.ndrawn);
 
   // finally draw items
-  doDrawing(painter, screenM, linescale, cam, callback);
+  doDrawing(painter, screenM, preplinescale, prepcam);
+
+  trimBuffers();
+}
+
+void Scene::trimBuffers()
+{
+  fragspeak = std::max(fragments.size(), fragspeak-fragspeak/4);
 
-  // don't decrease size of fragments unnecessarily, unless it is large
-  init_fragments_size = fragments.size();
-  if(init_fragments_size > 65536)
-    init_fragments_size /= 2;
+  trimBuffer(fragments, fragspeak);
+  trimBuffer(draworder, fragspeak);
+  trimBuffer(projs.types, fragspeak);
+  trimBuffer(projs.nvisible, fragspeak);
+  for(unsigned p=0; p<3; ++p)
+    {
+      trimBuffer(projs.x[p], fragspeak);
+      trimBuffer(projs.y[p], fragspeak);
+      trimBuffer(projs.z[p], fragspeak);
+    }
+
+  trimBuffer(bsp.bsp_recs, fragspeak);
+  trimBuffer(bsp.frag_idxs, fragspeak);
+  trimBuffer(dynbsp.bsp_recs, fragspeak);
+  trimBuffer(dynbsp.frag_idxs, fragspeak);
+  trimBuffer(newsrcfrags, fragspeak);
+  trimBuffer(dynfrags, fragspeak);
+  trimBuffer(dynidxs, fragspeak);
+
+  trimBuffer(bspws.to_process, fragspeak);
+  trimBuffer(bspws.bufs.idxfront, fragspeak);
+  trimBuffer(bspws.bufs.idxback, fragspeak);
+  trimBuffer(bspws.walktemp, fragspeak);
+  for(auto& sub : bspws.subtrees)
+    {
+      trimBuffer(sub.idxs, fragspeak);
+      trimBuffer(sub.recs, fragspeak);
+      trimBuffer(sub.frag_idxs, fragspeak);
+      trimBuffer(sub.newfrags, fragspeak);
+      trimBuffer(sub.bufs.idxfront, fragspeak);
+      trimBuffer(sub.bufs.idxback, fragspeak);
+    }
 }
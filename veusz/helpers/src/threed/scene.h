@@ -21,16 +21,37 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <atomic>
 #include <vector>
 #include <QtGui/QPainter>
 #include "mmaths.h"
 #include "objects.h"
 #include "camera.h"
+#include "bsp.h"
+#include "zbuffer.h"
+#include "pathsprites.h"
 
 class Scene
 {
 public:
-  enum RenderMode {RENDER_PAINTERS, RENDER_BSP};
+  enum RenderMode {RENDER_PAINTERS, RENDER_BSP, RENDER_ZBUFFER};
+
+  // Time in seconds spent in each stage of a render, and the number
+  // of fragments made by the objects, culled, after splitting and
+  // drawn with the painter.
+  struct RenderStats
+  {
+    RenderStats()
+      : fragments(0), culling(0), lighting(0), splitting(0), ordering(0),
+        projection(0), raster(0), drawing(0),
+        nfragments(0), nculled(0), nsplit(0), ndrawn(0)
+    {
+    }
+
+    double fragments, culling, lighting, splitting, ordering, projection,
+      raster, drawing;
+    unsigned nfragments, nculled, nsplit, ndrawn;
+  };
 
 private:
   // internal light color and position
@@ -40,24 +61,36 @@ private:
     double r, g, b;
   };
 
-  // if passed to drawing routine, this is called after drawing each
-  // fragment
-  class DrawCallback
-  {
-  public:
-    DrawCallback() {};
-    virtual void drawnFragment(const Fragment& frag) = 0;
-    virtual ~DrawCallback();
-  };
-
 public:
   Scene(RenderMode _mode)
-    : mode(_mode)
+    : mode(_mode), nthreads(0), pathsprites(false),
+      cancelflag(0), prepared(false),
+      preplinescale(0), cullhalfx(0), cullhalfy(0), cullmargscale(0),
+      retain(false), fragspeak(0)
   {
   }
 
   // add a light to a list
   void addLight(Vec3 posn, QColor col, double intensity);
+  // remove any lights
+  void clearLights() { lights.clear(); }
+
+  // Keep the BSP tree between renders in RENDER_BSP mode, reusing it
+  // if the view independent objects produce the same fragments. This
+  // is for interactively rendering the same scene repeatedly from
+  // different views, as the fragments are compared on each render.
+  void setRetained(bool r);
+
+  // number of threads to use when rendering (0 is number of cores)
+  void setNumThreads(unsigned n) { nthreads = n; }
+
+  // draw markers (paths without callbacks) as images of their paths,
+  // which is much faster for many markers, but is not exact, so
+  // should only be used for interactive drawing
+  void setPathSprites(bool s) { pathsprites = s; }
+
+  // statistics of the last call to render() or pickFragments()
+  const RenderStats& lastRenderStats() const { return stats; }
 
   // render scene to painter in coordinate range given
   // (if scale<=0 then automatic scaling)
@@ -65,6 +98,18 @@ public:
               QPainter* painter, const Camera& cam,
               double x1, double y1, double x2, double y2, double scale);
 
+  // Rendering in two steps: prepare() makes the fragments and their
+  // drawing order, which does not need the painter (so can be done
+  // in another thread), then drawPrepared() draws them. prepare()
+  // returns false if it was cancelled, leaving nothing to draw.
+  bool prepare(Object* root, const Camera& cam,
+               double x1, double y1, double x2, double y2, double scale);
+  void drawPrepared(QPainter* painter);
+
+  // if the flag given is set (by another thread), prepare() stops as
+  // soon as it can (0 for no flag)
+  void setCancelFlag(const std::atomic<bool>* flag);
+
   // find widget id of pixel painted by drawing scene at (x, y)
   unsigned long long idPixel(Object* root, QPainter* painter, const Camera& cam,
                              double x1, double y1, double x2, double y2, double scale,
@@ -77,29 +122,70 @@ public:
 private:
   // calculate lighting norms for triangles
   void calcLighting();
-  void calcLightingTriangle(Fragment& frag);
+  // light the triangles with the indices given (at most
+  // SCENE_LIGHT_BLOCK of them)
+  void calcLightingTriangles(const unsigned* idxs, unsigned n);
   void calcLightingLine(Fragment& frag);
 
   // compute projected coordinates
   void projectFragments(const Camera& cam);
 
+  // remove fragments (in viewing coordinates) which are off the
+  // screen or back facing, as allowed by the cull modes of their
+  // objects (backfaces can be unset to only cull off screen ones)
+  void cullFragments(FragmentVector& frags, bool backfaces);
+  // the same for the fragments given by draworder
+  void cullDrawOrder(bool backfaces);
+  bool isCulled(const Fragment& frag, bool backfaces) const;
+  // set up culling for the view given to prepare()
+  void setCullView(const Camera& cam,
+                   double x1, double y1, double x2, double y2, double scale);
+
   void doDrawing(QPainter* painter, const Mat3& screenM, double linescale,
-                 const Camera& cam, DrawCallback* callback=0);
+                 const Camera& cam);
 
+  // (sprites is used to draw paths without callbacks, if not 0)
   void drawPath(QPainter* painter, const Fragment& frag,
                 QPointF pt1, QPointF pt2, QPointF pt3,
-                double linescale, double distscale);
+                double linescale, double distscale,
+                PathSpriteCache* sprites=0);
 
   // different rendering modes
   void renderPainters(const Camera& cam);
   void renderBSP(const Camera& cam);
-
-  // render scene to painter in coordinate range given
-  // (if scale<=0 then automatic scaling)
-  void render_internal(Object* root,
-                       QPainter* painter, const Camera& cam,
-                       double x1, double y1, double x2, double y2, double scale,
-                       DrawCallback* callback=0);
+  void renderBSPRetained(ObjectContainer* root, const Camera& cam);
+  void renderZBuffer(const Camera& cam);
+
+  // rasterise triangles and lines to an image drawn over x1,y1,x2,y2,
+  // leaving the visible paths in draworder
+  void drawZBuffer(QPainter* painter, const Mat3& screenM, double linescale,
+                   double x1, double y1, double x2, double y2);
+
+  // depth origin and line offset used for z-buffer depths
+  void zbufferDepths(double& mindepth, double& linebias) const;
+
+  // add triangles and lines to zbuf with ids of their fragment
+  // indices. pixM converts projected points to pixels, and pixscale
+  // is the number of pixels per unit screen distance.
+  void fillZBuffer(ZBuffer& zbuf, const Mat3& pixM, double pixscale,
+                   double linescale, double mindepth, double linebias) const;
+
+  // make zbuf (covering pixrect) contain the fragment indices which
+  // are drawn in each pixel
+  void pickFragments(ZBuffer& zbuf, Object* root, QPainter* painter,
+                     const Camera& cam,
+                     double x1, double y1, double x2, double y2, double scale,
+                     double scaling, const QRect& pixrect);
+  bool retainedMatches(const FragmentVector& srcfrags) const;
+
+  // release memory in buffers much larger than recently needed
+  void trimBuffers();
+
+  // has preparing been cancelled?
+  bool cancelled() const
+  {
+    return cancelflag != 0 && cancelflag->load(std::memory_order_relaxed);
+  }
 
   // create pens/brushes
   QPen lineProp2QPen(const Fragment& frag, double linescale) const;
@@ -109,9 +195,44 @@ private:
 
 private:
   RenderMode mode;
+  unsigned nthreads;
+  bool pathsprites;
   FragmentVector fragments;
+  FragmentProjections projs;
   std::vector<unsigned> draworder;
   std::vector<Light> lights;
+  RenderStats stats;
+
+  const std::atomic<bool>* cancelflag;
+  // camera and screen range given to the last prepare(), if it
+  // finished
+  bool prepared;
+  Camera prepcam;
+  double prepx1, prepy1, prepx2, prepy2, preplinescale;
+
+  // culling parameters for the current prepare(): the camera
+  // projection, half the size of the view in projected coordinates
+  // (zero if there is automatic scaling, so nothing is off screen)
+  // and the number of projected units per screen unit, for margins
+  Mat4 cullperspM;
+  double cullhalfx, cullhalfy, cullmargscale;
+
+  // retained BSP tree: fragments from the view independent objects
+  // and their widget ids, the same after splitting, and the tree
+  bool retain;
+  FragmentVector retainsrc;
+  std::vector<unsigned long long> retainids;
+  FragmentVector retainfrags;
+  BSPBuilder retainbsp;
+
+  // Buffers kept between renders, so that rendering a scene of the
+  // same size again does not allocate memory. fragspeak is a decaying
+  // peak number of fragments, used to decide when to release memory.
+  BSPBuilder bsp, dynbsp;
+  BSPWorkspace bspws;
+  FragmentVector newsrcfrags, dynfrags;
+  IdxVector dynidxs;
+  size_t fragspeak;
 };
 
 #endif
@@ -0,0 +1,440 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "zbuffer.h"
+#include "parallel.h"
+
+// number of output rows in each band rendered by a thread
+#define ZBUFFER_BAND_ROWS 16
+
+namespace
+{
+  // blend premultiplied src over dst
+  inline QRgb blendOver(QRgb src, QRgb dst)
+  {
+    const unsigned ia = 255 - qAlpha(src);
+    return qRgba(qRed(src) + (qRed(dst)*ia+127)/255,
+                 qGreen(src) + (qGreen(dst)*ia+127)/255,
+                 qBlue(src) + (qBlue(dst)*ia+127)/255,
+                 qAlpha(src) + (qAlpha(dst)*ia+127)/255);
+  }
+
+  // range of sample centres (i+0.5) between minv and maxv, clipped to
+  // 0..n-1 (returns i1<i0 if empty)
+  inline void sampleRange(double minv, double maxv, int n, int& i0, int& i1)
+  {
+    minv = std::max(minv-0.5, -1.);
+    maxv = std::min(maxv-0.5, double(n));
+    i0 = std::max(int(std::ceil(minv)), 0);
+    i1 = std::min(int(std::floor(maxv)), n-1);
+  }
+
+  // should samples exactly on an edge be drawn? Only one of the two
+  // triangles sharing an edge gets them, so transparent triangles do
+  // not blend twice.
+  inline bool edgeOwns(double dx, double dy)
+  {
+    return dy<0 || (dy==0 && dx>0);
+  }
+
+  // buffers for a band of sample rows, holding either colors or the
+  // ids of the nearest primitives
+  struct Band
+  {
+    Band(int _width, int _y0, int _y1, bool _idmode)
+      : width(_width), y0(_y0), y1(_y1), idmode(_idmode),
+        depths(size_t(width)*(y1-y0), std::numeric_limits<float>::infinity()),
+        cols(idmode ? 0 : size_t(width)*(y1-y0), 0),
+        ids(idmode ? size_t(width)*(y1-y0) : 0, ZBUFFER_NO_ID)
+    {
+    }
+
+    void plot(int x, int y, double z)
+    {
+      const size_t idx = size_t(y-y0)*width + x;
+      if(z < depths[idx])
+        {
+          if(idmode)
+            {
+              depths[idx] = float(z);
+              ids[idx] = primid;
+            }
+          else if(opaque)
+            {
+              depths[idx] = float(z);
+              cols[idx] = col;
+            }
+          else
+            cols[idx] = blendOver(col, cols[idx]);
+        }
+    }
+
+    void draw(const ZBuffer::Prim& p)
+    {
+      col = p.col;
+      opaque = qAlpha(p.col) == 255;
+      primid = p.id;
+      if(p.type == ZBuffer::Prim::TRIANGLE)
+        drawTriangle(p);
+      else
+        drawLine(p);
+    }
+
+    void drawTriangle(const ZBuffer::Prim& p);
+    void drawLine(const ZBuffer::Prim& p);
+
+    int width, y0, y1;
+    bool idmode;
+    std::vector<float> depths;
+    std::vector<QRgb> cols;
+    std::vector<unsigned> ids;
+
+    // primitive being drawn
+    QRgb col;
+    bool opaque;
+    unsigned primid;
+  };
+
+  void Band::drawTriangle(const ZBuffer::Prim& p)
+  {
+    double x[3] = {p.x[0], p.x[1], p.x[2]};
+    double y[3] = {p.y[0], p.y[1], p.y[2]};
+    double z[3] = {p.z[0], p.z[1], p.z[2]};
+
+    double area = (x[1]-x[0])*(y[2]-y[0]) - (x[2]-x[0])*(y[1]-y[0]);
+    if(area == 0)
+      return;
+    if(area < 0)
+      {
+        // make winding consistent
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        area = -area;
+      }
+    const double invarea = 1/area;
+    // edges opposite each point
+    const double edx[3] = {x[2]-x[1], x[0]-x[2], x[1]-x[0]};
+    const double edy[3] = {y[2]-y[1], y[0]-y[2], y[1]-y[0]};
+    const double eox[3] = {x[1], x[2], x[0]};
+    const double eoy[3] = {y[1], y[2], y[0]};
+    const bool own[3] = {edgeOwns(edx[0], edy[0]), edgeOwns(edx[1], edy[1]),
+                         edgeOwns(edx[2], edy[2])};
+
+    int ix0, ix1, iy0, iy1;
+    sampleRange(std::min(x[0], std::min(x[1], x[2])),
+                std::max(x[0], std::max(x[1], x[2])), width, ix0, ix1);
+    sampleRange(std::min(y[0], std::min(y[1], y[2])),
+                std::max(y[0], std::max(y[1], y[2])), y1, iy0, iy1);
+    iy0 = std::max(iy0, y0);
+
+    for(int iy=iy0; iy<=iy1; ++iy)
+      {
+        const double py = iy+0.5;
+        bool inspan = false;
+        for(int ix=ix0; ix<=ix1; ++ix)
+          {
+            const double px = ix+0.5;
+            double w[3];
+            bool inside = true;
+            for(unsigned e=0; e<3; ++e)
+              {
+                w[e] = edx[e]*(py-eoy[e]) - edy[e]*(px-eox[e]);
+                if(w[e] < 0 || (w[e] == 0 && !own[e]))
+                  inside = false;
+              }
+            if(inside)
+              {
+                inspan = true;
+                const double pz = (w[0]*z[0] + w[1]*z[1] + w[2]*z[2])*invarea;
+                plot(ix, iy, pz);
+              }
+            else if(inspan)
+              // triangles are convex, so the rest of the row is outside
+              break;
+          }
+      }
+  }
+
+  void Band::drawLine(const ZBuffer::Prim& p)
+  {
+    double dx = p.x[1]-p.x[0];
+    double dy = p.y[1]-p.y[0];
+    const double len = std::sqrt(dx*dx+dy*dy);
+    if(len > 0)
+      {
+        dx /= len; dy /= len;
+      }
+    else
+      {
+        dx = 1; dy = 0;
+      }
+    const double hw = 0.5*p.width;
+
+    // total dash pattern length
+    double period = 0;
+    for(auto d : p.dashes)
+      period += d;
+
+    // lines have square caps, so extend bounds by width
+    int ix0, ix1, iy0, iy1;
+    sampleRange(std::min(p.x[0], p.x[1])-p.width,
+                std::max(p.x[0], p.x[1])+p.width, width, ix0, ix1);
+    sampleRange(std::min(p.y[0], p.y[1])-p.width,
+                std::max(p.y[0], p.y[1])+p.width, y1, iy0, iy1);
+    iy0 = std::max(iy0, y0);
+
+    for(int iy=iy0; iy<=iy1; ++iy)
+      {
+        const double ry = iy+0.5-p.y[0];
+        for(int ix=ix0; ix<=ix1; ++ix)
+          {
+            const double rx = ix+0.5-p.x[0];
+
+            // distance along and perpendicular to line
+            const double t = rx*dx + ry*dy;
+            const double s = std::abs(ry*dx - rx*dy);
+            if(t < -hw || t > len+hw || s > hw)
+              continue;
+
+            if(period > 0)
+              {
+                // odd entries are gaps
+                double pos = std::fmod(t+hw, period);
+                unsigned di = 0;
+                while(di+1 < p.dashes.size() && pos >= p.dashes[di])
+                  pos -= p.dashes[di++];
+                if(di % 2 == 1)
+                  continue;
+              }
+
+            const double frac = len>0 ? std::min(std::max(t/len, 0.), 1.) : 0;
+            plot(ix, iy, p.z[0] + frac*(p.z[1]-p.z[0]));
+          }
+      }
+  }
+
+} // namespace
+
+ZBuffer::ZBuffer(int _width, int _height, int supersample)
+  : width(std::max(_width, 1)), height(std::max(_height, 1)),
+    ss(std::max(supersample, 1)), idmode(false),
+    depths(size_t(width)*height, std::numeric_limits<float>::infinity())
+{
+}
+
+void ZBuffer::addPrim(Prim& prim)
+{
+  const unsigned npts = prim.type==Prim::TRIANGLE ? 3 : 2;
+  double miny = std::numeric_limits<double>::infinity();
+  double maxy = -miny;
+  double minx = miny, maxx = maxy;
+  for(unsigned i=0; i<npts; ++i)
+    {
+      if(!std::isfinite(prim.x[i]) || !std::isfinite(prim.y[i]) ||
+         !std::isfinite(prim.z[i]))
+        return;
+      prim.x[i] *= ss;
+      prim.y[i] *= ss;
+      minx = std::min(minx, prim.x[i]); maxx = std::max(maxx, prim.x[i]);
+      miny = std::min(miny, prim.y[i]); maxy = std::max(maxy, prim.y[i]);
+    }
+  const double extra = prim.type==Prim::LINE ? prim.width : 0;
+
+  // skip anything off the image
+  if(maxx+extra < 0 || minx-extra > width*ss ||
+     maxy+extra < 0 || miny-extra > height*ss)
+    return;
+
+  prim.ymin = int(std::max(std::floor(miny-extra), 0.));
+  prim.ymax = int(std::min(std::ceil(maxy+extra), double(height*ss-1)));
+
+  if(qAlpha(prim.col) == 255)
+    opaque.push_back(prim);
+  else
+    trans.push_back(prim);
+}
+
+void ZBuffer::addTriangle(const Vec3& p0, const Vec3& p1, const Vec3& p2,
+                          QRgb col, unsigned id)
+{
+  if(qAlpha(col) == 0)
+    return;
+
+  Prim prim;
+  prim.type = Prim::TRIANGLE;
+  prim.x[0] = p0(0); prim.y[0] = p0(1); prim.z[0] = p0(2);
+  prim.x[1] = p1(0); prim.y[1] = p1(1); prim.z[1] = p1(2);
+  prim.x[2] = p2(0); prim.y[2] = p2(1); prim.z[2] = p2(2);
+  prim.width = 0;
+  prim.col = qPremultiply(col);
+  prim.id = id;
+  addPrim(prim);
+}
+
+void ZBuffer::addLine(const Vec3& p0, const Vec3& p1, double lwidth, QRgb col,
+                      const QVector<qreal>& dashes, unsigned id)
+{
+  if(qAlpha(col) == 0)
+    return;
+
+  Prim prim;
+  prim.type = Prim::LINE;
+  prim.x[0] = p0(0); prim.y[0] = p0(1); prim.z[0] = p0(2);
+  prim.x[1] = p1(0); prim.y[1] = p1(1); prim.z[1] = p1(2);
+  prim.x[2] = prim.y[2] = prim.z[2] = 0;
+  // lines are at least a pixel wide, like cosmetic pens
+  prim.width = std::max(lwidth, 1.)*ss;
+  for(auto d : dashes)
+    prim.dashes.push_back(std::max(double(d), 0.)*prim.width);
+  prim.col = qPremultiply(col);
+  prim.id = id;
+  addPrim(prim);
+}
+
+void ZBuffer::render(unsigned nthreads)
+{
+  idmode = false;
+  img = QImage(width, height, QImage::Format_ARGB32_Premultiplied);
+  img.fill(0);
+  renderBands(nthreads);
+}
+
+void ZBuffer::renderIds(unsigned nthreads)
+{
+  idmode = true;
+  ids.assign(size_t(width)*height, ZBUFFER_NO_ID);
+  renderBands(nthreads);
+}
+
+void ZBuffer::renderBands(unsigned nthreads)
+{
+  // draw furthest transparent primitives first
+  std::stable_sort(trans.begin(), trans.end(),
+                   [](const Prim& a, const Prim& b)
+                   {
+                     return std::max(a.z[0], std::max(a.z[1], a.z[2])) >
+                       std::max(b.z[0], std::max(b.z[1], b.z[2]));
+                   });
+
+  prims.clear();
+  prims.reserve(opaque.size()+trans.size());
+  for(const auto& p : opaque)
+    prims.push_back(&p);
+  for(const auto& p : trans)
+    prims.push_back(&p);
+
+  // assign primitives to the bands they overlap, keeping their order
+  const int bandsamples = ZBUFFER_BAND_ROWS*ss;
+  const unsigned nbands = (height+ZBUFFER_BAND_ROWS-1) / ZBUFFER_BAND_ROWS;
+  std::vector< std::vector<unsigned> > bins(nbands);
+  for(unsigned i=0; i<prims.size(); ++i)
+    {
+      const unsigned b0 = prims[i]->ymin / bandsamples;
+      const unsigned b1 = std::min(unsigned(prims[i]->ymax / bandsamples),
+                                   nbands-1);
+      for(unsigned b=b0; b<=b1; ++b)
+        bins[b].push_back(i);
+    }
+
+  // get pointer before threading, as non-const access may detach
+  uchar* bits = idmode ? 0 : img.bits();
+  const int bpl = idmode ? 0 : img.bytesPerLine();
+
+  parallelFor(nbands, nthreads, [&](unsigned b)
+              {
+                renderBand(b, bins[b], bits, bpl);
+              });
+}
+
+void ZBuffer::renderBand(unsigned band, const std::vector<unsigned>& primidxs,
+                         uchar* bits, int bpl)
+{
+  const int oy0 = band*ZBUFFER_BAND_ROWS;
+  const int oy1 = std::min(oy0+ZBUFFER_BAND_ROWS, height);
+  Band buf(width*ss, oy0*ss, oy1*ss, idmode);
+
+  for(auto idx : primidxs)
+    buf.draw(*prims[idx]);
+
+  // average samples to output pixels (or take the nearest id),
+  // keeping the nearest depth
+  const unsigned nsamp = ss*ss;
+  for(int oy=oy0; oy<oy1; ++oy)
+    {
+      QRgb* outrow = bits==0 ? 0 :
+        reinterpret_cast<QRgb*>(bits + size_t(oy)*bpl);
+      for(int ox=0; ox<width; ++ox)
+        {
+          unsigned r=0, g=0, b=0, a=0;
+          float mindepth = std::numeric_limits<float>::infinity();
+          unsigned nearid = ZBUFFER_NO_ID;
+          for(int sy=0; sy<ss; ++sy)
+            {
+              const size_t rowidx = size_t((oy-oy0)*ss+sy)*buf.width + ox*ss;
+              for(int sx=0; sx<ss; ++sx)
+                {
+                  const float d = buf.depths[rowidx+sx];
+                  if(idmode)
+                    {
+                      if(d < mindepth)
+                        nearid = buf.ids[rowidx+sx];
+                    }
+                  else
+                    {
+                      const QRgb c = buf.cols[rowidx+sx];
+                      r += qRed(c); g += qGreen(c); b += qBlue(c);
+                      a += qAlpha(c);
+                    }
+                  mindepth = std::min(mindepth, d);
+                }
+            }
+          const size_t outidx = size_t(oy)*width+ox;
+          if(idmode)
+            ids[outidx] = nearid;
+          else
+            outrow[ox] = qRgba((r+nsamp/2)/nsamp, (g+nsamp/2)/nsamp,
+                               (b+nsamp/2)/nsamp, (a+nsamp/2)/nsamp);
+          depths[outidx] = mindepth;
+        }
+    }
+}
+
+bool ZBuffer::visible(double x, double y, double z) const
+{
+  if(!(x >= 0 && y >= 0 && x < width && y < height))
+    return true;
+  return z <= depths[size_t(y)*width + size_t(x)];
+}
+
+void ZBuffer::plotId(int x, int y, double z, unsigned id)
+{
+  if(x >= 0 && y >= 0 && x < width && y < height)
+    {
+      const size_t idx = size_t(y)*width + x;
+      if(z < depths[idx])
+        {
+          depths[idx] = float(z);
+          ids[idx] = id;
+        }
+    }
+}
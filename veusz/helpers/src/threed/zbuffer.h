@@ -0,0 +1,118 @@
+// -*-c++-*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef ZBUFFER_H
+#define ZBUFFER_H
+
+#include <limits>
+#include <vector>
+#include <QtGui/QImage>
+#include <QtGui/QRgb>
+#include <QtCore/QVector>
+#include "mmaths.h"
+
+// id of pixels with nothing drawn in renderIds()
+#define ZBUFFER_NO_ID (std::numeric_limits<unsigned>::max())
+
+// This class rasterises triangles and line segments into a depth
+// buffered image, as a fast alternative to drawing each fragment
+// with QPainter. Points are given in pixel coordinates of the output
+// image, with the third coordinate the depth (smaller is nearer).
+// Depths are stored as floats, so should be given relative to an
+// origin near the scene.
+//
+// Opaque primitives are drawn in any order with depth testing.
+// Transparent primitives are then blended from back to front, only
+// where they are in front of the opaque ones. The image is split into
+// bands of rows, which are rasterised in parallel. If supersample > 1,
+// each pixel is the average of supersample*supersample samples.
+//
+// Alternatively, renderIds() records the id of the nearest primitive
+// at each pixel, whether transparent or not, for picking.
+
+class ZBuffer
+{
+public:
+  ZBuffer(int width, int height, int supersample=1);
+
+  // add triangle with a (non-premultiplied) color
+  void addTriangle(const Vec3& p0, const Vec3& p1, const Vec3& p2, QRgb col,
+                   unsigned id=0);
+
+  // add line segment of width given in pixels. If dashes is not
+  // empty, it gives the lengths of the on and off dashes, in units of
+  // the width.
+  void addLine(const Vec3& p0, const Vec3& p1, double width, QRgb col,
+               const QVector<qreal>& dashes=QVector<qreal>(),
+               unsigned id=0);
+
+  // rasterise the added primitives to the image
+  void render(unsigned nthreads=1);
+
+  // rasterise the ids of the added primitives instead
+  void renderIds(unsigned nthreads=1);
+
+  // is the point in front of anything drawn at its pixel?
+  bool visible(double x, double y, double z) const;
+
+  // the output (premultiplied ARGB32)
+  const QImage& image() const { return img; }
+
+  // after renderIds(), the id at a pixel
+  unsigned id(int x, int y) const { return ids[size_t(y)*width+x]; }
+  // set id of pixel to id if z is nearer than the current depth
+  void plotId(int x, int y, double z, unsigned id);
+
+public:
+  struct Prim
+  {
+    enum PrimType {TRIANGLE, LINE};
+
+    // sample coordinates of points
+    double x[3], y[3], z[3];
+    // line width and dashes in samples
+    double width;
+    std::vector<double> dashes;
+    // premultiplied color
+    QRgb col;
+    unsigned id;
+    // range of sample rows covered
+    int ymin, ymax;
+    PrimType type;
+  };
+
+private:
+  void addPrim(Prim& prim);
+  void renderBands(unsigned nthreads);
+  void renderBand(unsigned band, const std::vector<unsigned>& primidxs,
+                  uchar* bits, int bpl);
+
+private:
+  int width, height, ss;
+  bool idmode;
+  QImage img;
+  std::vector<unsigned> ids;
+  std::vector<float> depths;
+  // drawing order of primitives, opaque before transparent
+  std::vector<Prim> opaque, trans;
+  std::vector<Prim const*> prims;
+};
+
+#endif
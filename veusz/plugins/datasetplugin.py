@@ -1653,6 +1653,44 @@ class MovingAveragePlugin(_OneOutputDatasetPlugin):
         data = qtloops.rollingAverage(ds_in.data, weights, width)
         self.dsout.update(data=data)
 
+class MovingStatisticPlugin(_OneOutputDatasetPlugin):
+    """Compute moving median, minimum or maximum for dataset."""
+
+    menu = (_('Filtering'), _('Moving Median/Min/Max'),)
+    name = 'MovingStatistic'
+    description_short = _(
+        'Compute moving median, minimum or maximum for regularly '
+        'spaced data')
+    description_full = _(
+        'Compute moving median, minimum or maximum for regularly '
+        'spaced data.\nThe statistic is computed using the points '
+        'either side of each data point, ignoring invalid values.')
+
+    def __init__(self):
+        """Define fields."""
+        self.fields = [
+            field.FieldDataset('ds_in', _('Input dataset')),
+            field.FieldInt(
+                'width', _('Points either side of point to use'),
+                default=1, minval=0),
+            field.FieldCombo(
+                'statistic', _('Statistic'),
+                items=('median', 'minimum', 'maximum'),
+                editable=False),
+            field.FieldDataset('ds_out', _('Output dataset')),
+        ]
+
+    def updateDatasets(self, fields, helper):
+        """Compute moving statistic of dataset."""
+        ds_in = helper.getDataset(fields['ds_in'])
+        fn = {
+            'median': qtloops.rollingMedian,
+            'minimum': qtloops.rollingMinimum,
+            'maximum': qtloops.rollingMaximum,
+        }[fields['statistic']]
+        data = fn(ds_in.data, fields['width'])
+        self.dsout.update(data=data)
+
 class LinearInterpolatePlugin(_OneOutputDatasetPlugin):
     """Do linear interpolation of data."""
 
@@ -2260,6 +2298,7 @@ datasetpluginregistry += [
     FilterDatasetPlugin,
 
     MovingAveragePlugin,
+    MovingStatisticPlugin,
     LinearInterpolatePlugin,
     ReBinXYPlugin,
 
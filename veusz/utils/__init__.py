@@ -32,8 +32,11 @@ from .formatting import *
 from .colormap import *
 from .extbrushfilling import *
 from .feedback import feedback, FeedbackCheckThread, disableFeedback
+from .contourtiles import traceContourTiles
 
 from ..helpers.qtloops import addNumpyToPolygonF, plotPathsToPainter, \
     plotLinesToPainter, plotClippedPolyline, polygonClip, \
     plotClippedPolygon, plotBoxesToPainter, addNumpyPolygonToPath, \
-    RotatedRectangle, RectangleOverlapTester
+    RotatedRectangle, RectangleOverlapTester, pointDensityImage, \
+    addNumpyLinesToLabeller, addNumpyPolygonsToPath, \
+    plotLineSetsToPainter, plotBoxSetsToPainter
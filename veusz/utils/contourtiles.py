@@ -0,0 +1,245 @@
+#    Copyright (C) 2026 Jeremy S. Sanders
+#    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+###############################################################################
+
+"""Contour large grids tile by tile.
+
+The contour tracer needs copies of the coordinates and values of the
+whole grid, plus its own storage for each point. For large grids
+(which may be numpy memmaps of files), the grid is instead split into
+tiles, which share their edge rows and columns with their neighbours.
+Each tile is traced separately, so the memory used depends on the tile
+size rather than the grid size. Contour lines which cross the seams
+between tiles are joined back together afterwards.
+"""
+
+import collections
+
+import numpy as N
+
+try:
+    from ..helpers._nc_cntr import Cntr
+except ImportError:
+    Cntr = None
+
+class _Chain:
+    """A contour line made of pieces, joined end to end."""
+
+    def __init__(self, piece):
+        self.pieces = collections.deque([piece])
+
+    def start(self):
+        return self.pieces[0][0]
+
+    def end(self):
+        return self.pieces[-1][-1]
+
+    def reverse(self):
+        self.pieces = collections.deque(
+            p[::-1] for p in reversed(self.pieces))
+
+    def append(self, other):
+        """Add other chain to end (its first point is at our end)."""
+        first = True
+        for p in other.pieces:
+            self.pieces.append(p[1:] if first else p)
+            first = False
+
+    def toArray(self):
+        return N.concatenate(list(self.pieces))
+
+class _LineStitcher:
+    """Join contour lines from tiles which meet at their ends.
+
+    Ends of lines are found in a dict keyed by their coordinates,
+    rounded to tol. As a point may be rounded into a neighbouring
+    cell, the neighbouring keys are also checked.
+    """
+
+    def __init__(self, tol):
+        self.tol = tol
+        # chains by key of their ends, with whether the end is the start
+        self.ends = {}
+        self.closed = []
+
+    def key(self, pt):
+        return (int(N.floor(pt[0]/self.tol)), int(N.floor(pt[1]/self.tol)))
+
+    def find(self, pt):
+        """Find (chain, isstart) with an end at pt, or None."""
+        kx, ky = self.key(pt)
+        for dx in (-1, 0, 1):
+            for dy in (-1, 0, 1):
+                for item in self.ends.get((kx+dx, ky+dy), ()):
+                    chain, isstart = item
+                    end = chain.start() if isstart else chain.end()
+                    if ( abs(end[0]-pt[0]) <= self.tol and
+                         abs(end[1]-pt[1]) <= self.tol ):
+                        return item
+        return None
+
+    def removeEnds(self, chain):
+        for pt, isstart in ((chain.start(), True), (chain.end(), False)):
+            items = self.ends[self.key(pt)]
+            items.remove( (chain, isstart) )
+            if not items:
+                del self.ends[self.key(pt)]
+
+    def addEnds(self, chain):
+        for pt, isstart in ((chain.start(), True), (chain.end(), False)):
+            self.ends.setdefault(self.key(pt), []).append( (chain, isstart) )
+
+    def isClosed(self, chain):
+        start, end = chain.start(), chain.end()
+        return ( abs(start[0]-end[0]) <= self.tol and
+                 abs(start[1]-end[1]) <= self.tol )
+
+    def add(self, line):
+        """Add a line from a tile."""
+
+        if len(line) < 2:
+            return
+        chain = _Chain(line)
+        if ( not N.all(N.isfinite(chain.start())) or
+             not N.all(N.isfinite(chain.end())) or self.isClosed(chain) ):
+            # cannot be joined to anything
+            self.closed.append(chain)
+            return
+
+        # join any line ending at our end onto our end
+        item = self.find(chain.end())
+        if item is not None:
+            other, isstart = item
+            self.removeEnds(other)
+            if not isstart:
+                other.reverse()
+            chain.append(other)
+            if self.isClosed(chain):
+                self.closed.append(chain)
+                return
+
+        # join our line onto any line ending at our start
+        item = self.find(chain.start())
+        if item is not None:
+            other, isstart = item
+            self.removeEnds(other)
+            if isstart:
+                other.reverse()
+            other.append(chain)
+            chain = other
+            if self.isClosed(chain):
+                self.closed.append(chain)
+                return
+
+        self.addEnds(chain)
+
+    def lines(self):
+        """Return list of joined lines."""
+        chains = list(self.closed)
+        seen = set()
+        for items in self.ends.values():
+            for chain, isstart in items:
+                if id(chain) not in seen:
+                    seen.add(id(chain))
+                    chains.append(chain)
+        return [c.toArray() for c in chains]
+
+def _spacing(c):
+    """Smallest spacing of coordinates."""
+    if len(c) < 2:
+        return 1.
+    d = N.abs(N.diff(c))
+    d = d[N.isfinite(d) & (d > 0)]
+    return d.min() if len(d) > 0 else 1.
+
+def _tileRanges(size, tilesize):
+    """Ranges of tiles along an axis of size points.
+    Neighbouring tiles share their end points."""
+    step = max(tilesize-1, 1)
+    starts = range(0, max(size-1, 1), step)
+    return [(s, min(s+step+1, size)) for s in starts]
+
+def flattenLines(lines):
+    """Convert list of (N,2) arrays to the tuple (xy, offsets) given
+    by Cntr.trace with flat set."""
+    offsets = N.zeros(len(lines)+1, dtype=N.intp)
+    offsets[1:] = N.cumsum([len(l) for l in lines])
+    if len(lines) == 0:
+        return N.zeros((0, 2)), offsets
+    return N.concatenate(lines), offsets
+
+def traceContourTiles(xc, yc, data, levels, filled=False, flat=False,
+                      tilesize=1024, nthreads=0):
+    """Trace contours of a large grid, tile by tile.
+
+    xc and yc are the coordinates of the columns and rows of the
+    grid, and data is the 2D array of values (rows, columns), which
+    can be a numpy memmap. Only one tile of tilesize by tilesize
+    points is copied at a time. Non-finite values are masked.
+
+    Returns the traced lines (or polygons if filled) of each level,
+    as in Cntr.trace_levels (with flat set if flat). Filled polygons
+    are split at the seams between tiles, which does not change how
+    they look.
+    """
+
+    if Cntr is None:
+        raise RuntimeError('Contour tracing module is not available')
+
+    xc = N.asarray(xc, dtype=N.float64)
+    yc = N.asarray(yc, dtype=N.float64)
+    ny, nx = data.shape
+    if len(xc) != nx or len(yc) != ny:
+        raise ValueError('Coordinates do not match size of data')
+
+    levels = N.asarray(levels, dtype=N.float64)
+    nout = len(levels)-1 if filled else len(levels)
+    nout = max(nout, 0)
+
+    # ends of lines on seams should match to much better than this
+    tol = 1e-6*min(_spacing(xc), _spacing(yc))
+    stitchers = [_LineStitcher(tol) for i in range(nout)]
+    polys = [[] for i in range(nout)]
+
+    for y0, y1 in _tileRanges(ny, tilesize):
+        for x0, x1 in _tileRanges(nx, tilesize):
+            tile = N.array(data[y0:y1, x0:x1], dtype=N.float64)
+            if tile.shape[0] < 2 or tile.shape[1] < 2:
+                continue
+            mask = N.logical_not(N.isfinite(tile))
+            if mask.all():
+                continue
+            th, tw = tile.shape
+            xpts = N.tile(xc[x0:x1], (th, 1))
+            ypts = N.tile(yc[y0:y1, N.newaxis], (1, tw))
+
+            c = Cntr(xpts, ypts, tile, mask)
+            traced = c.trace_levels(
+                levels, filled=filled, nthreads=nthreads)
+            del c, xpts, ypts, tile, mask
+
+            for i, lines in enumerate(traced):
+                if filled:
+                    polys[i] += lines
+                else:
+                    for line in lines:
+                        stitchers[i].add(line)
+
+    out = polys if filled else [s.lines() for s in stitchers]
+    if flat:
+        out = [flattenLines(lines) for lines in out]
+    return out
@@ -629,8 +629,13 @@ def plotMarkers(painter, xpos, ypos, markername, markersize, scaling=None,
         colorimg = colormap.applyColorMap(
             cmap, 'linear', color2d, 0., 1., trans)
 
+    # skipping hidden markers is only invisible for pixel output
+    helper = getattr(painter, 'helper', None)
+    decimate = helper is not None and not helper.vectoroutput
+
     plotPathsToPainter(
-        painter, path, xpos, ypos, scaling, clip, colorimg, scaleline)
+        painter, path, xpos, ypos, scaling, clip, colorimg, scaleline,
+        decimate)
 
     painter.restore()
 
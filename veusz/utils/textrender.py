@@ -1501,7 +1501,20 @@ class _MmlRenderer(_Renderer):
         self.error = ''
         self.size = qt.QSize(1, 1)
 
+        # Upscale any drawing by this factor, then scale back when
+        # drawing. We have to do this to get consistent output at
+        # different zoom factors (I hate this code).
+        upscale = 5.
+
+        ptsize = self.font.pointSizeF()
+        if ptsize < 0:
+            ptsize = self.font.pixelSize() / self.painter.pixperpt
+
+        # set the font before the content, so that documents already
+        # laid out with the same text and font are reused
         self.mmldoc = doc = qtmml.QtMmlDocument()
+        doc.setFontName( qtmml.QtMmlWidget.NormalFont, self.font.family() )
+        doc.setBaseFontPointSize(int(ptsize * upscale))
         try:
             self.mmldoc.setContent(text)
         except ValueError as e:
@@ -1525,19 +1538,6 @@ class _MmlRenderer(_Renderer):
         rpaint.pixperpt = screendev.logicalDpiY() / 72.
         rpaint.scaling = 1.0
 
-        # Upscale any drawing by this factor, then scale back when
-        # drawing. We have to do this to get consistent output at
-        # different zoom factors (I hate this code).
-        upscale = 5.
-
-        doc.setFontName( qtmml.QtMmlWidget.NormalFont, self.font.family() )
-
-        ptsize = self.font.pointSizeF()
-        if ptsize < 0:
-            ptsize = self.font.pixelSize() / self.painter.pixperpt
-
-        doc.setBaseFontPointSize(int(ptsize * upscale))
-
         # the output will be painted finally scaled
         self.drawscale = (
             self.painter.dpi / screendev.logicalDpiY()
@@ -0,0 +1,147 @@
+#    Copyright (C) 2026 Jeremy S. Sanders
+#    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+###############################################################################
+
+"""Timings of rendering stages and widgets.
+
+The native helper modules have timers and counters in their hot paths
+if they are built with tracing (using the --enable-tracing option of
+build_ext, or VEUSZ_TRACING=1 in the environment). Each keeps stats
+giving a count and total time for each name (e.g. "threed.splitting"
+or "qtloops.lines.drawn"), which are collected here into one dict.
+
+While recording, each timed stage is also kept as an event, as is
+the painting of each widget (which does not need the native tracing),
+so that the events can be written as a Chrome trace, viewable in
+chrome://tracing or Perfetto.
+"""
+
+import json
+import os
+import threading
+import time
+
+# names of the helper modules with trace functions
+_modulenames = ('threed', 'qtloops', 'recordpaint', '_nc_cntr')
+_modules = None
+
+# is recording on?
+recording = False
+
+# widget stats, by name, as [count, secs], and recorded events as
+# (name, thread id, start, duration) in microseconds
+_widgetstats = {}
+_widgetevents = []
+_lock = threading.Lock()
+
+def _traceModules():
+    """Return list of the helper modules which could be imported."""
+    global _modules
+    if _modules is None:
+        _modules = []
+        for name in _modulenames:
+            try:
+                mod = __import__('veusz.helpers.'+name, fromlist=[name])
+            except ImportError:
+                continue
+            if hasattr(mod, 'traceStats'):
+                _modules.append(mod)
+    return _modules
+
+def nativeEnabled():
+    """Were any of the native modules built with tracing?"""
+    return any(m.traceEnabled() for m in _traceModules())
+
+def stats():
+    """Return dict of stat names to (count, total seconds).
+
+    Widget stats are named "widget:" followed by the path of the
+    widget, and are only kept while recording."""
+
+    out = {}
+    for mod in _traceModules():
+        out.update(mod.traceStats())
+    with _lock:
+        for name, (count, secs) in _widgetstats.items():
+            out['widget:'+name] = (count, secs)
+    return out
+
+def reset():
+    """Zero the stats and remove recorded events."""
+    for mod in _traceModules():
+        mod.traceReset()
+    with _lock:
+        _widgetstats.clear()
+        del _widgetevents[:]
+
+def setRecording(on):
+    """Set whether events are recorded."""
+    global recording
+    for mod in _traceModules():
+        mod.traceSetRecording(on)
+    recording = bool(on)
+
+def clock():
+    """Time in microseconds, for addWidgetTime."""
+    return time.perf_counter()*1e6
+
+def addWidgetTime(widget, start):
+    """Add painting time of the widget since start (from clock())."""
+    end = clock()
+    name = widget.path
+    with _lock:
+        s = _widgetstats.setdefault(name, [0, 0.])
+        s[0] += 1
+        s[1] += (end-start)*1e-6
+        _widgetevents.append(
+            (name, threading.get_ident(), start, end-start))
+
+def chromeTrace():
+    """Return recorded events and stats as a Chrome trace (a dict
+    which can be written as JSON)."""
+
+    pid = os.getpid()
+    events = []
+
+    def addevents(category, evts, offset):
+        for name, tid, start, duration in evts:
+            events.append({
+                'name': name, 'cat': category, 'ph': 'X', 'pid': pid,
+                'tid': tid, 'ts': start-offset, 'dur': duration,
+            })
+
+    for mod in _traceModules():
+        # the modules may use a different clock from ours
+        offset = mod.traceClock() - clock()
+        addevents(mod.__name__.split('.')[-1], mod.traceEvents(), offset)
+    with _lock:
+        addevents('widget', list(_widgetevents), 0.)
+
+    events.sort(key=lambda e: e['ts'])
+    return {
+        'traceEvents': events,
+        'displayTimeUnit': 'ms',
+        'otherData': {
+            name: {'count': count, 'seconds': secs}
+            for name, (count, secs) in sorted(stats().items())
+        },
+    }
+
+def writeChromeTrace(filename):
+    """Write recorded events and stats as a Chrome trace JSON file."""
+    with open(filename, 'w') as f:
+        json.dump(chromeTrace(), f)
@@ -20,6 +20,7 @@
 
 '''Main Veusz executable.'''
 
+import atexit
 import sys
 import signal
 import argparse
@@ -201,6 +202,10 @@ class VeuszApp(qt.QApplication):
         parser.add_argument(
             '--translation', metavar='FILE',
             help='load the translation .qm file given')
+        parser.add_argument(
+            '--trace', metavar='FILE',
+            help='record how long widgets and rendering stages'
+            ' take, writing a Chrome trace JSON file on exit')
         parser.add_argument(
             'docs', metavar='FILE', nargs='*',
             help='document to load')
@@ -297,6 +302,12 @@ class VeuszApp(qt.QApplication):
         setting.transient_settings['unsafe_mode'] = bool(
             args.unsafe_mode)
 
+        # record timings until exit
+        if args.trace:
+            from veusz.utils import tracing
+            tracing.setRecording(True)
+            atexit.register(tracing.writeChromeTrace, args.trace)
+
         # optionally load a translation
         txfile = args.translation or setting.settingdb['translation_file']
         if txfile:
@@ -286,22 +286,19 @@ class BarPlotter(GenericPlotter):
         ebl = self.settings.ErrorBarLine
         painter.setPen( ebl.makeQPenWHide(painter) )
         w = barwidth*0.25*ebl.endsize
+        lines = []
         if ishorz and not ebl.hideHorz:
-            utils.plotLinesToPainter(
-                painter, mincoord, posns, maxcoord, posns)
+            lines += (mincoord, posns, maxcoord, posns)
             if s.errorstyle == 'barends':
-                utils.plotLinesToPainter(
-                    painter, mincoord, posns-w, mincoord, posns+w)
-                utils.plotLinesToPainter(
-                    painter, maxcoord, posns-w, maxcoord, posns+w)
+                lines += (mincoord, posns-w, mincoord, posns+w)
+                lines += (maxcoord, posns-w, maxcoord, posns+w)
         elif not ishorz and not ebl.hideVert:
-            utils.plotLinesToPainter(
-                painter, posns, mincoord, posns, maxcoord)
+            lines += (posns, mincoord, posns, maxcoord)
             if s.errorstyle == 'barends':
-                utils.plotLinesToPainter(
-                    painter, posns-w, mincoord, posns+w, mincoord)
-                utils.plotLinesToPainter(
-                    painter, posns-w, maxcoord, posns+w, maxcoord)
+                lines += (posns-w, mincoord, posns+w, mincoord)
+                lines += (posns-w, maxcoord, posns+w, maxcoord)
+        if lines:
+            utils.plotLineSetsToPainter(painter, None, *lines)
 
     def plotBars(self, painter, s, dsnum, clip, corners):
         """Plot a set of boxes."""
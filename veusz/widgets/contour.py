@@ -41,14 +41,9 @@ def _(text, disambiguation=None, context='Contour'):
     """Translate text."""
     return qt.QCoreApplication.translate(context, text, disambiguation)
 
-def finitePoly(poly):
-    """Remove non-finite coordinates from numpy arrays of coordinates."""
-    out = []
-    for line in poly:
-        finite = N.isfinite(line)
-        validrows = N.logical_and(finite[:,0], finite[:,1])
-        out.append( line[validrows] )
-    return out
+# grids with more points than this are traced in tiles of this size
+tiledcontourpoints = 4096*4096
+contourtilesize = 1024
 
 class ContourLineLabeller(LineLabeller):
     def __init__(self, clip, rot, painter, font, doc):
@@ -480,40 +475,45 @@ class Contour(plotters.GenericPlotter):
         rangex, rangey = data.getDataRanges()
         yw, xw = data.data.shape
         xc, yc = data.getPixelCentres()
-        xpts = N.reshape( N.tile(xc, yw), (yw, xw) )
-        ypts = N.tile(yc[:, N.newaxis], xw)
-
-        # only keep finite data points
-        mask = N.logical_not(N.isfinite(data.data))
 
         # iterate over the levels and trace the contours
         self._cachedcontours = None
         self._cachedpolygons = None
         self._cachedsubcontours = None
 
-        if Cntr is not None:
+        if Cntr is None:
+            return
+
+        if data.data.size > tiledcontourpoints:
+            # large grids are traced in tiles, to save memory
+            def trace(lev, filled=False):
+                return utils.traceContourTiles(
+                    xc, yc, data.data, lev, filled=filled, flat=True,
+                    tilesize=contourtilesize)
+        else:
+            xpts = N.reshape( N.tile(xc, yw), (yw, xw) )
+            ypts = N.tile(yc[:, N.newaxis], xw)
+
+            # only keep finite data points
+            mask = N.logical_not(N.isfinite(data.data))
+
             c = Cntr(xpts, ypts, data.data, mask)
+            def trace(lev, filled=False):
+                return c.trace_levels(lev, filled=filled, flat=True)
 
-            # trace the contour levels
-            if len(s.Lines.lines) != 0:
-                self._cachedcontours = []
-                for level in levels:
-                    linelist = c.trace(level)
-                    self._cachedcontours.append( finitePoly(linelist) )
-
-            # trace the polygons between the contours
-            if len(s.Fills.fills) != 0 and len(levels) > 1 and not s.Fills.hide:
-                self._cachedpolygons = []
-                for level1, level2 in zip(levels[:-1], levels[1:]):
-                    linelist = c.trace(level1, level2)
-                    self._cachedpolygons.append( finitePoly(linelist) )
-
-            # trace sub-levels
-            if len(sublevels) > 0:
-                self._cachedsubcontours = []
-                for level in sublevels:
-                    linelist = c.trace(level)
-                    self._cachedsubcontours.append( finitePoly(linelist) )
+        # trace the contour levels (all levels at once, in threads)
+        # each level is a tuple of the points of all its lines, and
+        # the offsets of each line in the points
+        if len(s.Lines.lines) != 0:
+            self._cachedcontours = trace(levels)
+
+        # trace the polygons between the contours
+        if len(s.Fills.fills) != 0 and len(levels) > 1 and not s.Fills.hide:
+            self._cachedpolygons = trace(levels, filled=True)
+
+        # trace sub-levels
+        if len(sublevels) > 0:
+            self._cachedsubcontours = trace(sublevels)
 
     def _plotContours(self, painter, posn, axes, linestyles,
                       contours, showlabels, hidelines, clip):
@@ -536,8 +536,8 @@ class Contour(plotters.GenericPlotter):
             clip, cl.rotate, painter, font, self.document)
         levels = []
 
-        # iterate over each level, and list of lines
-        for num, linelist in enumerate(contours):
+        # iterate over each level, and its lines
+        for num, (xy, offsets) in enumerate(contours):
 
             if showlabels and num<len(s.levelsOut):
                 number = s.levelsOut[num]
@@ -552,21 +552,16 @@ class Contour(plotters.GenericPlotter):
             else:
                 textdims = qt.QSizeF(0, 0)
 
-            # iterate over each complete line of the contour
-            for curve in linelist:
-                # convert coordinates from graph to plotter
-                xplt = axes[0].dataToPlotterCoords(posn, curve[:,0])
-                yplt = axes[1].dataToPlotterCoords(posn, curve[:,1])
-
-                pts = qt.QPolygonF()
-                utils.addNumpyToPolygonF(pts, xplt, yplt)
-                linelabeller.addLine(pts, textdims)
+            # convert coordinates from graph to plotter, and add all
+            # the lines of the level
+            xplt = axes[0].dataToPlotterCoords(posn, xy[:,0])
+            yplt = axes[1].dataToPlotterCoords(posn, xy[:,1])
+            utils.addNumpyLinesToLabeller(
+                linelabeller, xplt, yplt, offsets, textdims)
 
-                if showlabels:
-                    linelabeller.labels.append(text)
-                else:
-                    linelabeller.labels.append(None)
-                levels.append(num)
+            nlines = len(offsets)-1
+            linelabeller.labels += [text if showlabels else None]*nlines
+            levels += [num]*nlines
 
         painter.save()
         painter.setPen(labelpen)
@@ -608,22 +603,15 @@ class Contour(plotters.GenericPlotter):
         if self._cachedpolygons is None or s.Fills.hide:
             return
 
-        # iterate over each level, and list of lines
-        for num, polylist in enumerate(self._cachedpolygons):
+        # iterate over each level, and its polygons
+        for num, (xy, offsets) in enumerate(self._cachedpolygons):
 
-            # iterate over each complete line of the contour
+            # convert coordinates from graph to plotter, and add the
+            # clipped polygons to the path
+            xplt = axes[0].dataToPlotterCoords(posn, xy[:,0])
+            yplt = axes[1].dataToPlotterCoords(posn, xy[:,1])
             path = qt.QPainterPath()
-            for poly in polylist:
-                # convert coordinates from graph to plotter
-                xplt = axes[0].dataToPlotterCoords(posn, poly[:,0])
-                yplt = axes[1].dataToPlotterCoords(posn, poly[:,1])
-
-                pts = qt.QPolygonF()
-                utils.addNumpyToPolygonF(pts, xplt, yplt)
-
-                clippedpoly = qt.QPolygonF()
-                utils.polygonClip(pts, clip, clippedpoly)
-                path.addPolygon(clippedpoly)
+            utils.addNumpyPolygonsToPath(path, xplt, yplt, offsets, clip)
 
             # fill polygons
             brush = s.Fills.get('fills').returnBrushExtended(num)
@@ -87,6 +87,34 @@ def cropLinearImageToBox(image, pltx, plty, posn):
     # return new image coordinates and image
     return pltx, plty, newimage
 
+def cropLinearDataToBox(shape, pltx, plty, posn):
+    """Given data of shape (rows, columns) covering the plotting
+    range pltx[0]->pltx[1], plty[0]->plty[1], work out the part of
+    the data which is visible within the plotting bounds posn.
+
+    Returns:
+     - range of columns (i1, i2)
+     - range of rows (j1, j2)
+     - updated pltx range
+     - updated plty range
+    """
+
+    def cropaxis(num, p1, p2, b1, b2):
+        """Crop num pixels from p1->p2 to b1->b2."""
+        f1 = (b1-p1) / (p2-p1)
+        f2 = (b2-p1) / (p2-p1)
+        f1, f2 = min(f1, f2), max(f1, f2)
+        i1 = min(max(int(N.floor(f1*num)), 0), num-1)
+        i2 = max(min(int(N.ceil(f2*num)), num), i1+1)
+        return (
+            (i1, i2),
+            [p1 + (p2-p1)*i1/num, p1 + (p2-p1)*i2/num],
+        )
+
+    irange, pltx = cropaxis(shape[1], pltx[0], pltx[1], posn[0], posn[2])
+    jrange, plty = cropaxis(shape[0], plty[0], plty[1], posn[1], posn[3])
+    return irange, jrange, pltx, plty
+
 def cropGridImageToBox(image, gridx, gridy, posn):
     """Given an image, pixel coordinates and box, crop image to box."""
 
@@ -141,6 +169,18 @@ class Image(plotters.GenericPlotter):
     allowusercreation=True
     description=_('Plot a 2d dataset as an image')
 
+    # images with at least this many pixels are drawn from a pyramid
+    # of reduced resolution copies
+    pyramidminpixels = 1024*1024
+
+    def __init__(self, parent, name=None):
+        """Initialise plotter with axes."""
+
+        plotters.GenericPlotter.__init__(self, parent, name=name)
+
+        # cached (data, reduction, pyramid)
+        self._cachedpyramid = None
+
     @classmethod
     def addSettings(klass, s):
         """Construct list of settings."""
@@ -206,6 +246,15 @@ class Image(plotters.GenericPlotter):
             usertext=_('Draw Mode'),
             formatting=True ) )
 
+        s.add( setting.Choice(
+            'downsampling',
+            ['mean', 'min', 'max'],
+            'mean',
+            descr=_('How to combine pixels when drawing an image at a '
+                    'lower resolution than the data'),
+            usertext=_('Downsampling'),
+            formatting=True ) )
+
         # translate smooth to drawMode
         s.add( setting.SettingBackwardCompat(
             'smooth',
@@ -289,15 +338,43 @@ class Image(plotters.GenericPlotter):
             s.colorInvert,
         )
 
-    def drawNonlinearImage(self, painter, axes, posn, data, image):
+    def getPyramid(self, data):
+        """Get cached pyramid of reduced resolution copies of the
+        data, or None if the image is too small to need one."""
+
+        arr = data.data
+        if arr.size < self.pyramidminpixels:
+            return None
+
+        reduction = {
+            'mean': qtloops.ImagePyramid.MEAN,
+            'min': qtloops.ImagePyramid.MINIMUM,
+            'max': qtloops.ImagePyramid.MAXIMUM,
+        }[self.settings.downsampling]
+
+        c = self._cachedpyramid
+        if c is None or c[0] is not arr or c[1] != reduction:
+            c = self._cachedpyramid = (
+                arr, reduction, qtloops.ImagePyramid(arr, reduction))
+        return c[2]
+
+    def drawNonlinearImage(self, painter, axes, posn, data, image, step=1):
         """Draw an image where the image data are non-linear, or the
-        axes are non-linear."""
+        axes are non-linear.
+
+        step is the number of data pixels in each image pixel, if the
+        image is a reduced resolution copy of the data.
+        """
 
         drawmode = self.settings.drawMode
         # get pixel edges, converted to plotter coordinates
         xedgep, yedgep = data.getPixelEdges(
             scalefnx=lambda v: axes[0].dataToPlotterCoords(posn, v),
             scalefny=lambda v: axes[1].dataToPlotterCoords(posn, v))
+        if step != 1:
+            # keep edges of the combined pixels
+            xedgep = xedgep[:image.width()*step+1:step]
+            yedgep = yedgep[:image.height()*step+1:step]
 
         if drawmode == 'default' or drawmode == 'rectangles':
             # simply draw everything as boxes
@@ -314,23 +391,15 @@ class Image(plotters.GenericPlotter):
             y0 = int(min(yedgep[0], yedgep[-1]))
             y1 = int(max(yedgep[0], yedgep[-1]))
 
-            print(painter.device().logicalDpiY())
             if drawmode == 'resample-pixels':
                 # resample image to a flat bitmap
                 image = qtloops.resampleNonlinearImage(
                     image, x0, y0, x1, y1, xedgep, yedgep)
 
             elif drawmode == 'resample-smooth':
-                # render smaller and scale up to smooth
-                s = 4
-                image = qtloops.resampleNonlinearImage(
-                    image, x0//s, y0//s, x1//s, y1//s,
-                    xedgep/s, yedgep/s)
-                image = image.scaled(
-                    x1-x0, y1-y0,
-                    qt.Qt.IgnoreAspectRatio,
-                    qt.Qt.SmoothTransformation
-                )
+                # interpolate between pixel centres
+                image = qtloops.resampleNonlinearImageBilinear(
+                    image, x0, y0, x1, y1, xedgep, yedgep)
             else:
                 raise RuntimeError('Invalid draw mode')
 
@@ -372,32 +441,78 @@ class Image(plotters.GenericPlotter):
         # make QImage from data
         cmap = d.evaluate.getColormap(s.colorMap, s.colorInvert)
         datavaluerange = self.getDataValueRange(data)
-        image = utils.applyColorMap(
-            cmap,
-            s.colorScaling,
-            data.data,
-            datavaluerange[0], datavaluerange[1],
-            s.transparency, transimg=transimg,
-        )
+        def colorImage(vals, transvals):
+            return utils.applyColorMap(
+                cmap,
+                s.colorScaling,
+                vals,
+                datavaluerange[0], datavaluerange[1],
+                s.transparency, transimg=transvals,
+            )
 
         drawmode = s.drawMode
 
+        # for large images drawn to pixels, use the pyramid level
+        # with about one pixel per output pixel
+        pyramid = None
+        level = 0
+        if ( transimg is None and drawmode != 'rectangles' and
+             not painter.helper.vectoroutput ):
+            pyramid = self.getPyramid(data)
+        if pyramid is not None:
+            rows, cols = data.data.shape
+            scale = painter.scaling * max(
+                abs(pltrangex[1]-pltrangex[0])/cols,
+                abs(pltrangey[1]-pltrangey[0])/rows)
+            level = pyramid.levelForScale(scale)
+
         # if data are non linear, or axes are non linear in pixel
         # mode, switch to non linear drawing
         if not data.isLinearImage() or ((
                 not axes[0].isLinear() or not axes[1].isLinear()) and
                 s.mapping == 'pixels'):
-            self.drawNonlinearImage(painter, axes, posn, data, image)
+            if level == 0:
+                image = colorImage(data.data, transimg)
+            else:
+                image = colorImage(pyramid.levelData(
+                    level, 0, 0,
+                    pyramid.levelWidth(level),
+                    pyramid.levelHeight(level)), None)
+            self.drawNonlinearImage(
+                painter, axes, posn, data, image, step=2**level)
             return
 
         # linearly spaced grid
 
-        # avoid drawing pixels outside of axis range
-        if ( pltrangex[0]<posn[0] or pltrangex[1]>posn[2] or
-             pltrangey[0]<posn[1] or pltrangey[1]>posn[3] ):
-            # need to crop image
-            pltrangex, pltrangey, image = cropLinearImageToBox(
-                image, pltrangex, pltrangey, posn)
+        if pyramid is not None:
+            # only colour map the visible part of the level, which
+            # covers the data apart from any odd rows or columns
+            # dropped when reducing
+            rows, cols = data.data.shape
+            lw = pyramid.levelWidth(level)
+            lh = pyramid.levelHeight(level)
+            fx = lw * 2**level / cols
+            fy = lh * 2**level / rows
+            (i1, i2), (j1, j2), pltrangex, pltrangey = cropLinearDataToBox(
+                (lh, lw),
+                [pltrangex[0], pltrangex[0]+(pltrangex[1]-pltrangex[0])*fx],
+                [pltrangey[0], pltrangey[0]+(pltrangey[1]-pltrangey[0])*fy],
+                posn)
+            if level == 0:
+                vals = data.data[j1:j2, i1:i2]
+            else:
+                vals = pyramid.levelData(level, i1, j1, i2, j2)
+            image = colorImage(vals, None)
+
+        else:
+            image = colorImage(data.data, transimg)
+
+            # avoid drawing pixels outside of axis range
+            if ( pltrangex[0]<posn[0] or pltrangex[1]>posn[2] or
+                 pltrangey[0]<posn[1] or pltrangey[1]>posn[3] ):
+                # need to crop image
+                pltrangex, pltrangey, image = cropLinearImageToBox(
+                    image, pltrangex, pltrangey, posn)
 
         # invert output drawing if axes go from positive->negative
         # we only translate the coordinate system if this is the case
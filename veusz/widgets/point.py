@@ -50,68 +50,73 @@ class ErrorBarDraw:
         pen.setCapStyle(qt.Qt.FlatCap)
 
         painter.setPen(pen)
+
+        # lines from consecutive bar functions are collected in
+        # self.lines and drawn together, before anything else is drawn
+        self.lines = []
         for function in self.error_functions[self.style]:
+            if function not in self.line_functions:
+                self.drawLines(painter, clip)
             function(self, painter, xmin, xmax, ymin, ymax, xplt, yplt, clip)
+        self.drawLines(painter, clip)
+
+    def drawLines(self, painter, clip):
+        """Draw any lines collected in self.lines in a single call."""
+        if self.lines:
+            qtloops.plotLineSetsToPainter(painter, clip, *self.lines)
+            self.lines = []
 
     def errorsBar(self, painter, xmin, xmax, ymin, ymax, xplt, yplt, clip):
         """Draw bar style error lines."""
         # vertical error bars
         if ymin is not None and ymax is not None and not self.linestyle.hideVert:
-            qtloops.plotLinesToPainter(painter, xplt, ymin, xplt, ymax, clip)
+            self.lines += (xplt, ymin, xplt, ymax)
 
         # horizontal error bars
         if xmin is not None and xmax is not None and not self.linestyle.hideHorz:
-            qtloops.plotLinesToPainter(painter, xmin, yplt, xmax, yplt, clip)
+            self.lines += (xmin, yplt, xmax, yplt)
 
     def errorsBarHi(self, painter, xmin, xmax, ymin, ymax, xplt, yplt, clip):
         """Draw bar style error lines (top half only)."""
         if ymin is not None and ymax is not None and not self.linestyle.hideVert:
-            qtloops.plotLinesToPainter(painter, xplt, yplt, xplt, ymax, clip)
+            self.lines += (xplt, yplt, xplt, ymax)
         if xmin is not None and xmax is not None and not self.linestyle.hideHorz:
-            qtloops.plotLinesToPainter(painter, xplt, yplt, xmax, yplt, clip)
+            self.lines += (xplt, yplt, xmax, yplt)
 
     def errorsBarLo(self, painter, xmin, xmax, ymin, ymax, xplt, yplt, clip):
         """Draw bar style error lines (bottom half only)."""
         if ymin is not None and ymax is not None and not self.linestyle.hideVert:
-            qtloops.plotLinesToPainter(painter, xplt, yplt, xplt, ymin, clip)
+            self.lines += (xplt, yplt, xplt, ymin)
         if xmin is not None and xmax is not None and not self.linestyle.hideHorz:
-            qtloops.plotLinesToPainter(painter, xplt, yplt, xmin, yplt, clip)
+            self.lines += (xplt, yplt, xmin, yplt)
 
     def errorsEnds(self, painter, xmin, xmax, ymin, ymax, xplt, yplt, clip):
         """Draw perpendiclar ends on error bars."""
         size = self.markersize * self.linestyle.endsize
 
         if ymin is not None and ymax is not None and not self.linestyle.hideVert:
-            qtloops.plotLinesToPainter(
-                painter, xplt-size, ymin, xplt+size, ymin, clip)
-            qtloops.plotLinesToPainter(
-                painter, xplt-size, ymax, xplt+size, ymax, clip)
+            self.lines += (xplt-size, ymin, xplt+size, ymin)
+            self.lines += (xplt-size, ymax, xplt+size, ymax)
 
         if xmin is not None and xmax is not None and not self.linestyle.hideHorz:
-            qtloops.plotLinesToPainter(
-                painter, xmin, yplt-size, xmin, yplt+size, clip)
-            qtloops.plotLinesToPainter(
-                painter, xmax, yplt-size, xmax, yplt+size, clip)
+            self.lines += (xmin, yplt-size, xmin, yplt+size)
+            self.lines += (xmax, yplt-size, xmax, yplt+size)
 
     def errorsEndsHi(self, painter, xmin, xmax, ymin, ymax, xplt, yplt, clip):
         """Draw perpendiclar ends on error bars (top half only)."""
         size = self.markersize * self.linestyle.endsize
         if ymin is not None and ymax is not None and not self.linestyle.hideVert:
-            qtloops.plotLinesToPainter(
-                painter, xplt-size, ymax, xplt+size, ymax, clip)
+            self.lines += (xplt-size, ymax, xplt+size, ymax)
         if xmin is not None and xmax is not None and not self.linestyle.hideHorz:
-            qtloops.plotLinesToPainter(
-                painter, xmax, yplt-size, xmax, yplt+size, clip)
+            self.lines += (xmax, yplt-size, xmax, yplt+size)
 
     def errorsEndsLo(self, painter, xmin, xmax, ymin, ymax, xplt, yplt, clip):
         """Draw perpendiclar ends on error bars (bottom half only)."""
         size = self.markersize * self.linestyle.endsize
         if ymin is not None and ymax is not None and not self.linestyle.hideVert:
-            qtloops.plotLinesToPainter(
-                painter, xplt-size, ymin, xplt+size, ymin, clip)
+            self.lines += (xplt-size, ymin, xplt+size, ymin)
         if xmin is not None and xmax is not None and not self.linestyle.hideHorz:
-            qtloops.plotLinesToPainter(
-                painter, xmin, yplt-size, xmin, yplt+size, clip)
+            self.lines += (xmin, yplt-size, xmin, yplt+size)
 
     def errorsBox(self, painter, xmin, xmax, ymin, ymax, xplt, yplt, clip):
         """Draw box around error region."""
@@ -268,6 +273,12 @@ class ErrorBarDraw:
         if ptsbelow:
             qtloops.plotClippedPolyline(painter, clip, ptsbelow)
 
+    # functions which only add to self.lines
+    line_functions = frozenset((
+        errorsBar, errorsBarHi, errorsBarLo,
+        errorsEnds, errorsEndsHi, errorsEndsLo,
+    ))
+
     # map error bar names to lists of functions (above)
     error_functions = {
         'none': (),
@@ -651,7 +662,7 @@ class PointPlotter(GenericPlotter):
         path = qt.QPainterPath()
         for lpoly in polys:
             if len(lpoly) >= 2:
-                npts = qtloops.bezier_fit_cubic_multi(lpoly, 0.1, len(lpoly)+1)
+                npts = qtloops.bezier_fit_cubic_cached(lpoly, 0.1)
                 qtloops.addCubicsToPainterPath(path, npts);
         return path
 
@@ -692,15 +703,24 @@ class PointPlotter(GenericPlotter):
             return
         s = self.settings
 
+        # for pixel output, keep only the points which change how the
+        # line is rasterised in each column of pixels
+        rpts = pts
+        if not painter.helper.vectoroutput:
+            rpts = qtloops.reducePolyline(pts, 1./painter.scaling)
+
         # do filling
         for fillstyle in s.FillBelow, s.FillAbove:
             if not fillstyle.hide:
-                fillPtsToEdge(painter, pts, posn, cliprect, fillstyle)
+                fillPtsToEdge(painter, rpts, posn, cliprect, fillstyle)
 
         # draw line between points
         if not s.PlotLine.hide:
             painter.setPen( s.PlotLine.makeQPen(painter) )
-            utils.plotClippedPolyline(painter, cliprect, pts)
+            # dashes depend on the length of the line, so need all points
+            utils.plotClippedPolyline(
+                painter, cliprect,
+                rpts if s.PlotLine.style == 'solid' else pts)
 
     def drawKeySymbol(self, number, painter, x, y, width, height):
         """Draw the plot symbol and/or line."""
@@ -17,6 +17,8 @@
 ##############################################################################
 
 import math
+import threading
+import time
 
 from .. import qtall as qt
 from .. import document
@@ -29,6 +31,11 @@ def _(text, disambiguation=None, context='Scene3D'):
     """Translate text."""
     return qt.QCoreApplication.translate(context, text, disambiguation)
 
+# interactive renders of scenes which took longer than this (in
+# seconds) to render last time are done in a background thread, with
+# a quick preview drawn meanwhile
+asyncrendertime = 0.1
+
 # define 2nd and 3rd lighting classes
 class Lighting3D_2(setting.Lighting3D):
     def __init__(self, name, **args):
@@ -91,13 +98,22 @@ class Scene3D(widget.Widget):
 
         s.add( setting.Choice(
             'rendermode',
-            ('painters', 'bsp'),
+            ('painters', 'bsp', 'zbuffer'),
             'painters',
             uilist=("Fast (Painter's)",
-                    "Accurate (BSP)"),
+                    "Accurate (BSP)",
+                    "Fast raster (Z-buffer)"),
             usertext=_('Render method'),
             descr=_('Method used to draw 3D plot') ))
 
+        s.add( setting.Float(
+            'minCellSize', 1.,
+            minval=0.,
+            descr=_('Grid cells of surfaces smaller than this number of '
+                    'pixels are merged when drawing interactively '
+                    '(0 to draw every cell)'),
+            usertext=_('Min cell size') ))
+
         s.add( setting.Distance(
             'leftMargin',
             '1cm',
@@ -139,6 +155,25 @@ class Scene3D(widget.Widget):
             usertext=_('Lighting (3)')),
             pixmap='settings_lighting' )
 
+    def __init__(self, parent, name=None):
+        """Initialise scene."""
+        widget.Widget.__init__(self, parent, name=name)
+
+        # scene kept between interactive renders, so that its
+        # buffers (and BSP tree if only the view changes) can be
+        # reused. It can only be used by one thread at once.
+        self.retainedscene = None
+        self.retainedscenemode = None
+        self.retainedlock = threading.Lock()
+
+        # background job rendering the retained scene and objects,
+        # which cannot be used by anything else until it is finished,
+        # with its key from _renderJobKey
+        self.renderjob = None
+        self.renderjobkey = None
+        # time taken by the last render of the retained scene
+        self.lastrendertime = 0.
+
     @classmethod
     def allowedParentTypes(self):
         from . import page, grid
@@ -175,10 +210,61 @@ class Scene3D(widget.Widget):
            if obj:
                root.addObject(obj)
 
+        # generate fragments of children using all cores
+        root.setNumThreads(0)
+
+        return root
+
+    def _objectsKey(self, painthelper):
+        """The objects are the same if this is unchanged."""
+        return (
+            self.document.changeset, painthelper.dpi, painthelper.scaling,
+            painthelper.pagesize)
+
+    def getObjects(self, painter, bounds, painthelper):
+        """Get root of objects, with the level of detail set for the
+        bounds.
+
+        The objects are made on every draw, as the children update
+        other state when drawing to objects (e.g. axis ranges and
+        automatic colours).
+        """
+
+        root = self.makeObjects(painter, bounds, painthelper)
+        if root is None:
+            return None
+
+        # level of detail for surface grids, given the size in
+        # pixels, only when drawing interactively so that exported
+        # output is unchanged
+        cellsize = self.settings.minCellSize
+        if not painthelper.asyncrender:
+            cellsize = 0
+        pixels = max(bounds[2]-bounds[0], bounds[3]-bounds[1]) * \
+            painthelper.scaling
+        root.setResolution(pixels/cellsize if cellsize > 0 else 0)
+
         return root
 
-    def makeScene(self, painter):
-        """Make Scene and Camera objects."""
+    def _renderMode(self, painter):
+        """Get the Scene render mode to use."""
+        mode = {
+            'painters': threed.Scene.RENDER_PAINTERS,
+            'bsp': threed.Scene.RENDER_BSP,
+            'zbuffer': threed.Scene.RENDER_ZBUFFER,
+        }[self.settings.rendermode]
+        # rasterising would spoil vector output
+        if mode == threed.Scene.RENDER_ZBUFFER and painter.helper.vectoroutput:
+            mode = threed.Scene.RENDER_BSP
+        return mode
+
+    def makeScene(self, painter, retained=False, mode=None):
+        """Make Scene and Camera objects.
+
+        If retained is set, the caller holds retainedlock and the
+        retained scene is used. The render mode is taken from the
+        settings unless mode is given.
+        """
 
         s = self.settings
 
@@ -192,11 +278,21 @@ class Scene3D(widget.Widget):
             threed.Vec3(0, -1,  0))
         camera.setPerspective(90, 1, 100)
 
-        mode = {
-            'painters': threed.Scene.RENDER_PAINTERS,
-            'bsp': threed.Scene.RENDER_BSP,
-        }[s.rendermode]
-        scene = threed.Scene(mode)
+        if mode is None:
+            mode = self._renderMode(painter)
+        if retained:
+            if self.retainedscene is None or self.retainedscenemode != mode:
+                self.retainedscene = threed.Scene(mode)
+                self.retainedscene.setRetained(
+                    mode == threed.Scene.RENDER_BSP)
+                self.retainedscenemode = mode
+            scene = self.retainedscene
+            scene.clearLights()
+        else:
+            scene = threed.Scene(mode)
+        # markers drawn as images are not exact, so are only used
+        # when drawing interactively
+        scene.setPathSprites(painter.helper.asyncrender)
 
         # add lighting if enabled
         for light in s.Lighting1, s.Lighting2, s.Lighting3:
@@ -220,12 +316,6 @@ class Scene3D(widget.Widget):
             controlgraph.ControlMarginBox(
                 self, bounds, outerbounds, painthelper)])
 
-        root = self.makeObjects(painter, bounds, painthelper)
-        if root is None:
-            return bounds
-
-        scene, camera = self.makeScene(painter)
-
         # def ptToScreen(pt):
         #     pt_v = (camera.viewM*root.objM)*threed.Vec4(pt[0],pt[1],pt[2],1)
         #     pt_proj = threed.calcProjVec(camera.perspM, pt_v)
@@ -236,11 +326,33 @@ class Scene3D(widget.Widget):
         scale = self.settings.size
         if scale == 'Auto':
             scale = -1
-        with painter:
-            scene.render(
-                root,
-                painter, camera,
-                bounds[0], bounds[1], bounds[2], bounds[3], scale)
+        retained = self.retainedlock.acquire(False)
+        try:
+            if retained and self._drawAsync(
+                    painter, bounds, painthelper, scale):
+                return bounds
+
+            # the retained scene may be in use by a background job,
+            # and is only for interactive redraws (exports are drawn
+            # from scratch)
+            useretained = ( retained and painthelper.asyncrender and
+                            self._renderJobIdle() )
+            root = self.getObjects(painter, bounds, painthelper)
+            if root is None:
+                return bounds
+
+            scene, camera = self.makeScene(painter, useretained)
+            with painter:
+                start = time.perf_counter()
+                scene.render(
+                    root,
+                    painter, camera,
+                    bounds[0], bounds[1], bounds[2], bounds[3], scale)
+                if useretained:
+                    self.lastrendertime = time.perf_counter() - start
+        finally:
+            if retained:
+                self.retainedlock.release()
 
         #     painter.setPen(qt.QPen(qt.Qt.red))
         #     origin = ptToScreen((0,0,0))[1]
@@ -250,33 +362,143 @@ class Scene3D(widget.Widget):
         # axx = threed.Vec4(0,0.5,0,1)
         # threed.solveInverseRotation(camera.viewM, camera.perspM, scene.screenM, axx, ptToScreen((0,0.5,0))[0])
 
-    def identifyWidgetAtPoint(self, painthelper, bounds, scaling, x, y):
+    def _renderJobKey(self, painthelper, bounds):
+        """A background render can be drawn if this is unchanged."""
+        return (self._objectsKey(painthelper), tuple(bounds))
+
+    def _stopRenderJob(self):
+        """Cancel any background render, waiting for it to stop.
+        The caller holds retainedlock."""
+        if self.renderjob is not None:
+            self.renderjob.cancel()
+            self.renderjob.wait()
+            self.renderjob = None
+            self.renderjobkey = None
+
+    def _renderJobIdle(self):
+        """Can the retained scene and objects be used? This drops any
+        finished background render, as its result would be
+        overwritten. The caller holds retainedlock."""
+        if self.renderjob is None:
+            return True
+        if self.renderjob.isFinished():
+            self._stopRenderJob()
+            return True
+        return False
+
+    def _drawAsync(self, painter, bounds, painthelper, scale):
+        """Draw a scene which is slow to render using a background job.
+
+        The first time, a quick preview is drawn using the painter's
+        algorithm, and the exact render is started in another thread.
+        The job is added to the pendingrenders of painthelper, so that
+        the page is drawn again when it is finished, when its result
+        is drawn. Jobs for old views are cancelled.
+
+        Returns False if the scene should be drawn normally instead.
+        The caller holds retainedlock.
+        """
+
+        if ( not painthelper.asyncrender or
+             not hasattr(threed, 'SceneRenderJob') or
+             self._renderMode(painter) != threed.Scene.RENDER_BSP or
+             self.lastrendertime < asyncrendertime ):
+            return False
+
+        key = self._renderJobKey(painthelper, bounds)
+        job = self.renderjob
+        if ( job is not None and self.renderjobkey == key and
+             not job.isCancelled() ):
+            if job.isReady():
+                # the objects are not needed, but making them updates
+                # the state the children keep when drawing
+                self.makeObjects(painter, bounds, painthelper)
+                with painter:
+                    job.draw(painter)
+                self.lastrendertime = job.prepareTime()
+                return True
+            if not job.isFinished():
+                # draw another preview, without the objects in use
+                root = self.getObjects(painter, bounds, painthelper)
+                if root is not None:
+                    self._drawPreview(painter, bounds, root, scale)
+                painthelper.pendingrenders.append(job)
+                return True
+            # the job failed, so render normally
+            self._stopRenderJob()
+            self.lastrendertime = 0.
+            return False
+
+        # the view has changed (or the job was cancelled), so start again
+        self._stopRenderJob()
+        root = self.getObjects(painter, bounds, painthelper)
+        if root is None:
+            return True
+        self._drawPreview(painter, bounds, root, scale)
+
+        scene, camera = self.makeScene(painter, True)
+        self.renderjob = threed.SceneRenderJob(
+            scene, root, camera,
+            bounds[0], bounds[1], bounds[2], bounds[3], scale)
+        self.renderjobkey = key
+        painthelper.pendingrenders.append(self.renderjob)
+        return True
+
+    def _drawPreview(self, painter, bounds, root, scale):
+        """Quickly draw root using the painter's algorithm."""
+        scene, camera = self.makeScene(
+            painter, mode=threed.Scene.RENDER_PAINTERS)
+        with painter:
+            scene.render(
+                root,
+                painter, camera,
+                bounds[0], bounds[1], bounds[2], bounds[3], scale)
+
+    def _pickIds(self, painthelper, bounds, scaling, pickfn):
+        """Call pickfn(scene, root, painter, camera, sizescale) to get
+        widget ids, returning None if there is nothing to draw."""
+
         painter = document.PainterRoot()
         painter.updateMetaData(painthelper)
 
-        root = self.makeObjects(painter, bounds, painthelper)
-        if root is None:
-            return self
-        scene, camera = self.makeScene(painter)
-
         sizescale = self.settings.size
         if sizescale == 'Auto':
             sizescale = -1
-        widgetid = scene.idPixel(
-            root, painter, camera,
-            bounds[0], bounds[1], bounds[2], bounds[3], sizescale,
-            scaling, x, y)
-
-        # recursive check id of children against returned value
-        widget = [self]
-        def checkwidget(r):
-            for c in r.children:
-                if id(c) == widgetid:
-                    widget[0] = c
-                checkwidget(c)
-
-        checkwidget(self)
-        return widget[0]
+
+        retained = self.retainedlock.acquire(False)
+        try:
+            useretained = retained and self._renderJobIdle()
+            root = self.getObjects(painter, bounds, painthelper)
+            if root is None:
+                return None
+
+            scene, camera = self.makeScene(painter, useretained)
+            return pickfn(scene, root, painter, camera, sizescale)
+        finally:
+            if retained:
+                self.retainedlock.release()
+
+    def _widgetIdMap(self):
+        """Return dict mapping ids of self and children to widgets."""
+        idmap = {}
+        def addwidget(w):
+            idmap[id(w)] = w
+            for c in w.children:
+                addwidget(c)
+        addwidget(self)
+        return idmap
+
+    def identifyWidgetAtPoint(self, painthelper, bounds, scaling, x, y):
+        """Return widget drawn at pixel (x, y), or self if none."""
+
+        def pick(scene, root, painter, camera, sizescale):
+            return scene.idPixel(
+                root, painter, camera,
+                bounds[0], bounds[1], bounds[2], bounds[3], sizescale,
+                scaling, x, y)
+
+        widgetid = self._pickIds(painthelper, bounds, scaling, pick)
+        return self._widgetIdMap().get(widgetid, self)
 
     def updateControlItem(self, cgi):
         """Area moved or resized - call helper routine to move self."""
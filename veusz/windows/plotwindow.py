@@ -313,6 +313,12 @@ class PlotWindow( qt.QGraphicsView ):
         self.timer = qt.QTimer(self)
         self.timer.timeout.connect(self.checkPlotUpdate)
 
+        # for redrawing when renders widgets started in the background
+        # are finished
+        self.pendingtimer = qt.QTimer(self)
+        self.pendingtimer.setInterval(50)
+        self.pendingtimer.timeout.connect(self.slotCheckPendingRenders)
+
         # for drag scrolling
         self.grabpos = None
         self.scrolltimer = qt.QTimer(self)
@@ -1084,7 +1090,8 @@ class PlotWindow( qt.QGraphicsView ):
                     self.document, size,
                     scaling=scaling,
                     dpi=self.dpi,
-                    devicepixelratio=devicepixelratio)
+                    devicepixelratio=devicepixelratio,
+                    asyncrender=True)
                 self.document.paintTo(phelper, self.pagenumber)
 
             except Exception:
@@ -1096,6 +1103,8 @@ class PlotWindow( qt.QGraphicsView ):
 
             self.painthelper = phelper
             self.rendercontrol.addJob(phelper)
+            if phelper.pendingrenders:
+                self.pendingtimer.start()
         else:
             self.painthelper = None
             self.pagenumber = 0
@@ -1112,6 +1121,16 @@ class PlotWindow( qt.QGraphicsView ):
         self.oldzoom = self.zoomfactor
         self.docchangeset = self.document.changeset
 
+    def slotCheckPendingRenders(self):
+        """Draw the page again if any renders widgets started in the
+        background have finished."""
+        helper = self.painthelper
+        if helper is None or not helper.pendingrenders:
+            self.pendingtimer.stop()
+        elif any(r.isFinished() for r in helper.pendingrenders):
+            self.pendingtimer.stop()
+            self.actionForceUpdate()
+
     def slotRenderFinished(self, jobid, img, helper):
         """Update image on display if rendering (usually in other
         thread) finished."""